@@ -109,6 +109,13 @@ def _set_mcts_option(
     sample_before_step_idx: int = 0,
     randomized_rollouts: bool = False,
     sampling_mcts: bool = False,
+    reuse_tree: bool = False,
+    transposition_table_size: int = 0,
+    num_parallel_rollouts: int = 1,
+    num_pipeline_cohorts: int = 1,
+    use_gumbel: bool = False,
+    gumbel_num_sampled: int = 16,
+    ponder: bool = False,
 ) -> mcts.MctsOption:
     # TODO: put hardcoded value in conf file
     mcts_option = mcts.MctsOption()
@@ -121,6 +128,13 @@ def _set_mcts_option(
     mcts_option.time_ratio = time_ratio
     mcts_option.randomized_rollouts = randomized_rollouts
     mcts_option.sampling_mcts = sampling_mcts
+    mcts_option.reuse_tree = reuse_tree
+    mcts_option.transposition_table_size = transposition_table_size
+    mcts_option.num_parallel_rollouts = num_parallel_rollouts
+    mcts_option.num_pipeline_cohorts = num_pipeline_cohorts
+    mcts_option.use_gumbel = use_gumbel
+    mcts_option.gumbel_num_sampled = gumbel_num_sampled
+    mcts_option.ponder = ponder
     return mcts_option
 
 
@@ -205,6 +219,13 @@ def create_player(
     sample_before_step_idx: int = 0,
     randomized_rollouts: bool = False,
     sampling_mcts: bool = False,
+    reuse_tree: bool = False,
+    transposition_table_size: int = 0,
+    num_parallel_rollouts: int = 1,
+    num_pipeline_cohorts: int = 1,
+    use_gumbel: bool = False,
+    gumbel_num_sampled: int = 16,
+    ponder: bool = False,
     rnn_state_shape: List[int] = [],
     rnn_seqlen: int = 0,
     logit_value: bool = False,
@@ -219,6 +240,13 @@ def create_player(
           sample_before_step_idx=sample_before_step_idx,
           randomized_rollouts=randomized_rollouts,
           sampling_mcts=sampling_mcts,
+          reuse_tree=reuse_tree,
+          transposition_table_size=transposition_table_size,
+          num_parallel_rollouts=num_parallel_rollouts,
+          num_pipeline_cohorts=num_pipeline_cohorts,
+          use_gumbel=use_gumbel,
+          gumbel_num_sampled=gumbel_num_sampled,
+          ponder=ponder,
       )
       if pure_mcts:
           return _create_pure_mcts_player(
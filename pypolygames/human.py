@@ -72,6 +72,13 @@ def create_human_environment(
         human_mode=True,
         total_time=total_time,
         time_ratio=time_ratio,
+        reuse_tree=simulation_params.reuse_tree,
+        transposition_table_size=simulation_params.transposition_table_size,
+        num_parallel_rollouts=simulation_params.num_parallel_rollouts,
+        num_pipeline_cohorts=simulation_params.num_pipeline_cohorts,
+        use_gumbel=simulation_params.use_gumbel,
+        gumbel_num_sampled=simulation_params.gumbel_num_sampled,
+        ponder=simulation_params.ponder,
         sample_before_step_idx=80,
         randomized_rollouts=False,
         sampling_mcts=False,
@@ -131,6 +138,13 @@ def create_tp_environment(
         human_mode=True,
         total_time=total_time,
         time_ratio=time_ratio,
+        reuse_tree=simulation_params.reuse_tree,
+        transposition_table_size=simulation_params.transposition_table_size,
+        num_parallel_rollouts=simulation_params.num_parallel_rollouts,
+        num_pipeline_cohorts=simulation_params.num_pipeline_cohorts,
+        use_gumbel=simulation_params.use_gumbel,
+        gumbel_num_sampled=simulation_params.gumbel_num_sampled,
+        ponder=simulation_params.ponder,
     )
     tp_player = polygames.TPPlayer()
     if game.is_one_player_game():
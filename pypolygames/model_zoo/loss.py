@@ -8,7 +8,7 @@ def mcts_loss(
    self,
    model,
    batch,
-) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor]:
+) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor, torch.Tensor, torch.Tensor]:
 
     predicts = getattr(self, "predicts", 0)
 
@@ -35,7 +35,12 @@ def mcts_loss(
     pi_err = -(pred_log_pi * pi).sum(1)
 
     err = v_err * 1.5 + pi_err + (predict_pi_err * 0.1 if predicts > 0 else 0)
+    # Prioritized replay corrects its sampling bias with importance weights.
+    if "replay_weight" in batch:
+        loss = (err * batch["replay_weight"]).mean()
+    else:
+        loss = err.mean()
 
-    return err.mean(), v_err.detach().mean(), pi_err.detach().mean(), (predict_pi_err.detach().mean() if predicts > 0 else None)
+    return loss, v_err.detach().mean(), pi_err.detach().mean(), (predict_pi_err.detach().mean() if predicts > 0 else None), err.detach()
 
 
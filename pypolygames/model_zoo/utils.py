@@ -28,6 +28,7 @@ def get_game_info(game_params: params) -> Dict[str, list]:
     )
     info = {"feature_size": game.get_feat_size(), "action_size": game.get_action_size()}
     info["raw_feature_size"] = game.get_raw_feat_size()
+    info["binary_features"] = game.has_binary_features()
     return info
 
 
@@ -382,14 +382,38 @@ class SimulationParams:
     num_rollouts: int = 1600
     replay_capacity: int = 1_000_000
     replay_warmup: int = 10_000
+    replay_sampling: str = "uniform"
+    replay_priority_alpha: float = 0.6
+    replay_priority_beta: float = 0.4
+    replay_recency_window: int = 0
+    replay_num_phases: int = 4
+    replay_phase_steps: int = 10
+    replay_prefetch_threads: int = 8
+    replay_prefetch_depth: int = 8
+    replay_dictionary_samples: int = 4096
+    replay_dictionary_size: int = 16384
+    sparse_policy_size: int = 0
+    packed_features: bool = False
     sync_period: int = 100
     act_batchsize: int = 1
     per_thread_batchsize: int = 0
     bsfinder_max_bs: int = 10240
     bsfinder_max_ms: float = 100
+    inference_batch_size: int = 0
+    inference_max_wait_ms: float = 1
+    eval_cache_size: int = 0
+    inference_precision: str = "fp32"
+    inference_max_error: float = 0
     rewind: int = 0
     randomized_rollouts: bool = False
     sampling_mcts: bool = False
+    reuse_tree: bool = False
+    transposition_table_size: int = 0
+    num_parallel_rollouts: int = 1
+    num_pipeline_cohorts: int = 1
+    use_gumbel: bool = False
+    gumbel_num_sampled: int = 16
+    ponder: bool = False
     sample_before_step_idx: int = 30
     train_channel_timeout_ms: int = 1000
     train_channel_num_slots: int = 10000
@@ -435,6 +459,94 @@ class SimulationParams:
                     "before the training can start",
                 )
             ),
+            replay_sampling=ArgFields(
+                opts=dict(
+                    type=str,
+                    choices=["uniform", "prioritized", "recent", "phase"],
+                    help="How training samples are drawn from the replay "
+                    "buffer: uniformly, in proportion to their loss, from the "
+                    "newest ones or evenly over game phases",
+                )
+            ),
+            replay_priority_alpha=ArgFields(
+                opts=dict(
+                    type=float,
+                    help="With '--replay_sampling prioritized', exponent "
+                    "applied to the loss of a sample to get its priority",
+                )
+            ),
+            replay_priority_beta=ArgFields(
+                opts=dict(
+                    type=float,
+                    help="With '--replay_sampling prioritized', exponent of "
+                    "the importance weights correcting the sampling bias",
+                )
+            ),
+            replay_recency_window=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="With '--replay_sampling recent', number of newest "
+                    "samples drawn from (0 for the whole buffer)",
+                )
+            ),
+            replay_num_phases=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="With '--replay_sampling phase', number of game "
+                    "phases sampled equally",
+                )
+            ),
+            replay_phase_steps=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="With '--replay_sampling phase', number of moves "
+                    "in each game phase but the last",
+                )
+            ),
+            replay_prefetch_threads=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="Number of threads preparing training batches ahead "
+                    "of time (0 to sample on the training thread)",
+                )
+            ),
+            replay_prefetch_depth=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="Number of training batches kept ready by the "
+                    "prefetch threads",
+                )
+            ),
+            replay_dictionary_samples=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="Number of first samples the replay buffer trains "
+                    "its compression dictionaries on (0 for none)",
+                )
+            ),
+            replay_dictionary_size=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="Maximum size in bytes of the compression dictionary "
+                    "of each replay buffer key",
+                )
+            ),
+            sparse_policy_size=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="If positive, MCTS training data holds the policy "
+                    "as this many (action, probability) pairs and the legal "
+                    "moves as bits, densified only when training; beyond "
+                    "that many actions, the most probable are kept",
+                )
+            ),
+            packed_features=ArgFields(
+                opts=dict(
+                    type=boolarg,
+                    help="Store and send the features of games with binary "
+                    "features as bits, unpacked only when training",
+                )
+            ),
             sync_period=ArgFields(
                 opts=dict(
                     type=int,
@@ -472,6 +584,43 @@ class SimulationParams:
                     "found by the automatic batch size finder to use",
                 )
             ),
+            inference_batch_size=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="If positive, batches of all game threads are "
+                    "merged by a shared inference thread into batches of up "
+                    "to this many rows",
+                )
+            ),
+            inference_max_wait_ms=ArgFields(
+                opts=dict(
+                    type=float,
+                    help="The maximum time in milliseconds the inference "
+                    "thread waits for a batch to fill",
+                )
+            ),
+            eval_cache_size=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="If positive, network evaluations of up to this "
+                    "many positions are cached and shared by all game threads",
+                )
+            ),
+            inference_precision=ArgFields(
+                opts=dict(
+                    type=str,
+                    choices=["fp32", "bf16", "fp16"],
+                    help="Precision the game threads run the model in",
+                )
+            ),
+            inference_max_error=ArgFields(
+                opts=dict(
+                    type=float,
+                    help="If positive, the largest difference in value or "
+                    "policy logits against fp32 that reduced precision "
+                    "inference may show on its check batch",
+                )
+            ),
             rewind=ArgFields(
                 opts=dict(
                     type=int,
@@ -490,6 +639,55 @@ class SimulationParams:
                     help="Use sampling MCTS",
                 )
             ),
+            reuse_tree=ArgFields(
+                opts=dict(
+                    type=boolarg,
+                    help="Keep the MCTS tree between moves and continue "
+                    "searching from the subtree of the moves played",
+                )
+            ),
+            transposition_table_size=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="Number of entries in the MCTS transposition table "
+                    "(0 to disable)",
+                )
+            ),
+            num_parallel_rollouts=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="Number of MCTS rollouts descending the same tree "
+                    "concurrently, each on its own thread and batch slot",
+                )
+            ),
+            num_pipeline_cohorts=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="Number of cohorts the MCTS batch is split into, so "
+                    "that tree search on some overlaps inference on another",
+                )
+            ),
+            use_gumbel=ArgFields(
+                opts=dict(
+                    type=boolarg,
+                    help="Search the MCTS root by Gumbel-top-k sampling and "
+                    "sequential halving, and train on its improved policy",
+                )
+            ),
+            gumbel_num_sampled=ArgFields(
+                opts=dict(
+                    type=int,
+                    help="Number of root actions sampled for sequential "
+                    "halving with use_gumbel",
+                )
+            ),
+            ponder=ArgFields(
+                opts=dict(
+                    type=boolarg,
+                    help="Keep searching while a human or text protocol "
+                    "opponent thinks, and reuse the tree for the next move",
+                )
+            ),
             sample_before_step_idx=ArgFields(
                 opts=dict(
                     type=int,
@@ -528,6 +726,7 @@ class ExecutionParams:
     save_dir: str = None  # keep for deprecation warning
     save_uncompressed: bool = True
     do_not_save_replay_buffer: bool = False
+    persistent_replay_buffer: bool = False
     saving_period: int = 100
     max_time: Optional[int] = None
     human_first: bool = False
@@ -588,6 +787,16 @@ class ExecutionParams:
                     "in the checkpoint",
                 )
             ),
+            persistent_replay_buffer=ArgFields(
+                opts=dict(
+                    action="store_false"
+                    if cls.persistent_replay_buffer
+                    else "store_true",
+                    help="If set, the replay buffer is kept on disk in "
+                    "checkpoint_dir/replay_buffer, checkpointed along with "
+                    "the model and restored on restart",
+                )
+            ),
             saving_period=ArgFields(
                 opts=dict(
                     type=int,
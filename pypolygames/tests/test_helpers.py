@@ -0,0 +1,57 @@
+# Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+import numpy as np
+import torch
+from .. import utils
+
+
+def pack_bits(dense):
+    """Packs the trailing dimensions of a 0/1 array as the C++ training data
+    does: bit j of byte i is flat element 8 * i + j"""
+    flat = dense.reshape(dense.shape[0], -1).astype(np.uint8)
+    return torch.from_numpy(np.packbits(flat, axis=-1, bitorder="little"))
+
+
+def test_densify_policy() -> None:
+    # 49 actions, so that the mask ends with a partial byte
+    policy_shape = [1, 7, 7]
+    batchsize, capacity = 6, 20
+    rng = np.random.RandomState(0)
+    size = int(np.prod(policy_shape))
+    mask = (rng.rand(batchsize, size) < 0.7).astype(np.float32)
+    pi = np.zeros((batchsize, size), dtype=np.float32)
+    index = np.full((batchsize, capacity), -1, dtype=np.int32)
+    value = np.zeros((batchsize, capacity), dtype=np.float32)
+    for b in range(batchsize):
+        legal = np.flatnonzero(mask[b])
+        # from no action with a non-zero policy to a full sparse policy
+        count = min(len(legal), b * capacity // (batchsize - 1))
+        chosen = rng.permutation(legal)[:count]
+        pi[b, chosen] = rng.rand(count).astype(np.float32)
+        index[b, :count] = chosen
+        value[b, :count] = pi[b, chosen]
+    batch = {
+        "pi_index": torch.from_numpy(index),
+        "pi_value": torch.from_numpy(value),
+        "pi_mask_bits": pack_bits(mask),
+    }
+    utils.densify_policy(batch, policy_shape)
+    assert set(batch) == {"pi", "pi_mask"}
+    assert torch.equal(batch["pi"], torch.from_numpy(pi).view(-1, *policy_shape))
+    assert torch.equal(
+        batch["pi_mask"], torch.from_numpy(mask).view(-1, *policy_shape)
+    )
+
+
+def test_unpack_features() -> None:
+    # 98 features, so that the bits end with a partial byte
+    feature_shape = [2, 7, 7]
+    rng = np.random.RandomState(0)
+    s = (rng.rand(5, *feature_shape) < 0.3).astype(np.float32)
+    batch = {"s_bits": pack_bits(s), "v": torch.zeros(5, 1)}
+    utils.unpack_features(batch, feature_shape)
+    assert set(batch) == {"s", "v"}
+    assert torch.equal(batch["s"], torch.from_numpy(s))
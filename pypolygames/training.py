@@ -88,6 +88,37 @@ def create_training_environment(
     )
     model_manager.set_find_batch_size_max_bs(simulation_params.bsfinder_max_bs)
     model_manager.set_find_batch_size_max_ms(simulation_params.bsfinder_max_ms)
+    model_manager.set_inference_batching(
+        simulation_params.inference_batch_size,
+        simulation_params.inference_max_wait_ms,
+    )
+    model_manager.set_eval_cache_size(simulation_params.eval_cache_size)
+    model_manager.set_inference_precision(
+        simulation_params.inference_precision,
+        simulation_params.inference_max_error,
+    )
+    model_manager.set_replay_sampling(
+        simulation_params.replay_sampling,
+        simulation_params.replay_priority_alpha,
+        simulation_params.replay_priority_beta,
+        simulation_params.replay_recency_window,
+        simulation_params.replay_num_phases,
+        simulation_params.replay_phase_steps,
+    )
+    model_manager.set_replay_prefetch(
+        simulation_params.replay_prefetch_threads,
+        simulation_params.replay_prefetch_depth,
+    )
+    model_manager.set_replay_dictionaries(
+        simulation_params.replay_dictionary_samples,
+        simulation_params.replay_dictionary_size,
+    )
+    if execution_params.persistent_replay_buffer and not is_client:
+        if execution_params.checkpoint_dir is None:
+            raise RuntimeError("persistent_replay_buffer requires checkpoint_dir")
+        replay_buffer_dir = execution_params.checkpoint_dir / "replay_buffer"
+        replay_buffer_dir.mkdir(parents=True, exist_ok=True)
+        model_manager.attach_replay_buffer(str(replay_buffer_dir))
     if is_server:
         model_manager.start_server(listen_ep)
     if is_client:
@@ -141,6 +172,17 @@ def create_training_environment(
       )
       model_manager_opponent.set_find_batch_size_max_bs(simulation_params.bsfinder_max_bs)
       model_manager_opponent.set_find_batch_size_max_ms(simulation_params.bsfinder_max_ms)
+      model_manager_opponent.set_inference_batching(
+          simulation_params.inference_batch_size,
+          simulation_params.inference_max_wait_ms,
+      )
+      model_manager_opponent.set_eval_cache_size(
+          simulation_params.eval_cache_size
+      )
+      model_manager_opponent.set_inference_precision(
+          simulation_params.inference_precision,
+          simulation_params.inference_max_error,
+      )
       print("tournament_mode is " + str(execution_params.tournament_mode))
       if execution_params.tournament_mode:
         model_manager_opponent.set_is_tournament_opponent(True)
@@ -167,6 +209,8 @@ def create_training_environment(
               predict_end_state=game_params.predict_end_state,
               predict_n_states=game_params.predict_n_states,
           )
+          game.set_sparse_policy(simulation_params.sparse_policy_size)
+          game.set_packed_features(simulation_params.packed_features)
           player_1 = create_player(
               seed_generator=seed_generator,
               game=game,
@@ -180,6 +224,13 @@ def create_training_environment(
               sample_before_step_idx=simulation_params.sample_before_step_idx,
               randomized_rollouts=simulation_params.randomized_rollouts,
               sampling_mcts=simulation_params.sampling_mcts,
+              reuse_tree=simulation_params.reuse_tree,
+              transposition_table_size=simulation_params.transposition_table_size,
+              num_parallel_rollouts=simulation_params.num_parallel_rollouts,
+              num_pipeline_cohorts=simulation_params.num_pipeline_cohorts,
+              use_gumbel=simulation_params.use_gumbel,
+              gumbel_num_sampled=simulation_params.gumbel_num_sampled,
+              ponder=simulation_params.ponder,
               rnn_state_shape=rnn_state_shape,
               rnn_seqlen=execution_params.rnn_seqlen,
               logit_value=logit_value
@@ -201,6 +252,13 @@ def create_training_environment(
                 sample_before_step_idx=simulation_params.sample_before_step_idx,
                 randomized_rollouts=simulation_params.randomized_rollouts,
                 sampling_mcts=simulation_params.sampling_mcts,
+                reuse_tree=simulation_params.reuse_tree,
+                transposition_table_size=simulation_params.transposition_table_size,
+                num_parallel_rollouts=simulation_params.num_parallel_rollouts,
+                num_pipeline_cohorts=simulation_params.num_pipeline_cohorts,
+                use_gumbel=simulation_params.use_gumbel,
+                gumbel_num_sampled=simulation_params.gumbel_num_sampled,
+                ponder=simulation_params.ponder,
                 rnn_state_shape=op_rnn_state_shape if op_rnn_state_shape is not None else rnn_state_shape,
                 rnn_seqlen=op_rnn_seqlen if op_rnn_seqlen is not None else execution_params.rnn_seqlen,
                 logit_value=op_logit_value if op_logit_value is not None else logit_value
@@ -308,6 +366,9 @@ def _train_epoch(
     device: torch.device,
     ddpmodel: ModelWrapperForDDP,
     batchsizes,
+    batchdtypes,
+    policy_shape,
+    feature_shape,
     optim: torch.optim.Optimizer,
     model_manager: polygames.ModelManager,
     stat: utils.MultiCounter,
@@ -365,7 +426,7 @@ def _train_epoch(
     for k, v in batchsizes.items():
       sizes = v.copy()
       sizes.insert(0, batchsize)
-      cpubatch[k] = torch.empty(sizes)
+      cpubatch[k] = torch.empty(sizes, dtype=batchdtypes.get(k, torch.float32))
       if k == "predict_pi":
         has_predict = True
 
@@ -403,12 +464,36 @@ def _train_epoch(
             torch.distributed.scatter(v, batchlist[k] if rank == 0 else None)
           batch = utils.to_device(cpubatch, device)
         else:
-          batch = model_manager.sample(batchsize)
-          batch = utils.to_device(batch, device)
+          # The sampled tensors are pinned and reused once released, so
+          # they are kept until the next batch, after the copy completed.
+          host_batch = model_manager.sample(batchsize)
+          batch = utils.to_device(host_batch, device, non_blocking=True)
         for k, v in batch.items():
           batch[k] = v.detach()
-        loss, v_err, pi_err, predict_err = model_loss.mcts_loss(model, lossmodel, batch)
+        if policy_shape is not None:
+          utils.densify_policy(batch, policy_shape)
+        if feature_shape is not None:
+          utils.unpack_features(batch, feature_shape)
+        loss, v_err, pi_err, predict_err, err = model_loss.mcts_loss(model, lossmodel, batch)
         loss.backward()
+        if "replay_index" in batch:
+          replay_index = batch["replay_index"].cpu()
+          err = err.cpu()
+          if world_size > 0:
+            # The batches of all ranks were drawn from the replay buffer of
+            # rank 0, which gets back every loss.
+            indices = None
+            errs = None
+            if rank == 0:
+              indices = [torch.empty_like(replay_index) for _ in range(world_size)]
+              errs = [torch.empty_like(err) for _ in range(world_size)]
+            torch.distributed.gather(replay_index, indices)
+            torch.distributed.gather(err, errs)
+            if rank == 0:
+              replay_index = torch.cat(indices)
+              err = torch.cat(errs)
+          if rank == 0:
+            model_manager.update_replay_priorities(replay_index, err)
 
         grad_norm = nn.utils.clip_grad_norm_(lossmodel.parameters(), optim_params.grad_clip)
         optim.step()
@@ -446,6 +531,7 @@ def _train_epoch(
     print("running sample rate: %.2f / s" % (_running_sample_rate))
     print("current add rate: %.2f / s" % (delta_add / time_elapsed))
     print("current sample rate: %.2f / s" % (delta_sample / time_elapsed))
+    print("replay buffer compression ratio: %.2f" % model_manager.buffer_compression_ratio())
     print(f"syncing duration: {sync_s:2f}s for {num_sync} syncs ({int(100 * sync_s / total_time_elapsed)}% of train time)")
 
     _pre_num_add = pre_num_add
@@ -486,12 +572,34 @@ def train_model(
       "v": [3 if getattr(model, "logit_value", False) else 1],
       "pred_v": [1],
       "pi": [c_prime, h_prime, w_prime],
-      "pi_mask": [c_prime, h_prime, w_prime]
+      "pi_mask": [c_prime, h_prime, w_prime],
+      "step": [1],
     }
 
     if game_params.player == "forward":
       batchsizes["action_pi"] = [c_prime, h_prime, w_prime]
 
+    # Sparse policies are densified on the training device.
+    batchdtypes = {}
+    policy_shape = None
+    if simulation_params.sparse_policy_size > 0 and game_params.player != "forward":
+      k = simulation_params.sparse_policy_size
+      del batchsizes["pi"]
+      del batchsizes["pi_mask"]
+      batchsizes["pi_index"] = [k]
+      batchsizes["pi_value"] = [k]
+      batchsizes["pi_mask_bits"] = [(c_prime * h_prime * w_prime + 7) // 8]
+      batchdtypes = {"pi_index": torch.int32, "pi_mask_bits": torch.uint8}
+      policy_shape = [c_prime, h_prime, w_prime]
+
+    # So are packed features.
+    feature_shape = None
+    if simulation_params.packed_features and info["binary_features"]:
+      del batchsizes["s"]
+      batchsizes["s_bits"] = [(c * h * w + 7) // 8]
+      batchdtypes["s_bits"] = torch.uint8
+      feature_shape = [c, h, w]
+
     if predicts > 0:
       batchsizes["predict_pi"] = [rc * predicts, rh, rw]
       batchsizes["predict_pi_mask"] = [rc * predicts, rh, rw]
@@ -506,6 +614,13 @@ def train_model(
     if getattr(model, "rnn_state_shape", None) is not None:
       batchsizes["rnn_initial_state"] = model.rnn_state_shape
 
+    # Prioritized batches also carry the sample numbers to update and the
+    # importance weights of the loss, so that distributed ranks get them too.
+    if simulation_params.replay_sampling == "prioritized":
+      batchsizes["replay_index"] = []
+      batchsizes["replay_weight"] = []
+      batchdtypes["replay_index"] = torch.int64
+
     rank = 0
     if ddpmodel:
         rank = torch.distributed.get_rank()
@@ -537,12 +652,16 @@ def train_model(
                 execution_params=execution_params,
                 executor=executor
             )
+            model_manager.checkpoint_replay_buffer()
             print("checkpoint saved in %gs" % (time.time() - savestart))
         _train_epoch(
             model=model,
             device=device,
             ddpmodel=ddpmodel,
             batchsizes=batchsizes,
+            batchdtypes=batchdtypes,
+            policy_shape=policy_shape,
+            feature_shape=feature_shape,
             optim=optim,
             model_manager=model_manager,
             stat=stat,
@@ -574,6 +693,7 @@ def train_model(
         simulation_params=simulation_params,
         execution_params=execution_params,
     )
+    model_manager.checkpoint_replay_buffer()
 
 def client_loop(
     model_manager: polygames.ModelManager,
@@ -22,10 +22,45 @@ def generate_random_seeds(seed: int) -> Iterator[int]:
         yield generator.randint(0, 2 ** 31 - 1)
 
 
-def to_device(batch, device):
+def to_device(batch, device, non_blocking=False):
     if isinstance(batch, torch.Tensor):
-        return batch.to(device).detach()
+        return batch.to(device, non_blocking=non_blocking).detach()
     elif isinstance(batch, dict):
-        return {key: to_device(batch[key], device) for key in batch}
+        return {
+            key: to_device(batch[key], device, non_blocking=non_blocking)
+            for key in batch
+        }
     else:
         assert False, "unsupported type: %s" % type(batch)
+
+
+def unpack_bits(bits, size):
+    """Unpacks the last dimension of uint8 tensor bits, bit j of byte i being
+    element 8 * i + j, into its first size 0/1 floats"""
+    shifts = torch.arange(8, dtype=torch.uint8, device=bits.device)
+    return ((bits.unsqueeze(-1) >> shifts) & 1).flatten(-2)[..., :size].float()
+
+
+def unpack_features(batch, feature_shape):
+    """Replaces the packed features of a training batch, "s_bits", with float
+    "s" of shape feature_shape"""
+    bits = batch.pop("s_bits")
+    lead = bits.shape[:-1]
+    size = int(np.prod(feature_shape))
+    batch["s"] = unpack_bits(bits, size).reshape(*lead, *feature_shape)
+
+
+def densify_policy(batch, policy_shape):
+    """Replaces the sparse policy of a training batch, "pi_index", "pi_value"
+    and "pi_mask_bits", with dense "pi" and "pi_mask" of shape policy_shape"""
+    index = batch.pop("pi_index").long()
+    value = batch.pop("pi_value")
+    bits = batch.pop("pi_mask_bits")
+    lead = index.shape[:-1]
+    size = int(np.prod(policy_shape))
+    # Padding has index -1; it goes to an extra slot that is dropped.
+    index = index.masked_fill(index < 0, size)
+    pi = torch.zeros(*lead, size + 1, dtype=value.dtype, device=value.device)
+    pi.scatter_add_(-1, index, value)
+    batch["pi"] = pi[..., :size].reshape(*lead, *policy_shape)
+    batch["pi_mask"] = unpack_bits(bits, size).reshape(*lead, *policy_shape)
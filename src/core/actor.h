@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "eval_cache.h"
 #include "model_manager.h"
 #include "tube/src_cpp/data_block.h"
 #include "tube/src_cpp/dispatcher.h"
@@ -84,61 +85,14 @@ class Actor {
   }
 
   PiVal& evaluate(const core::State& s, PiVal& pival) {
-    const auto state = dynamic_cast<const State*>(&s);
-    assert(state != nullptr);
-
-    // termination should be handled by mcts
-    assert(!state->terminated());
-
-    bool resultsAreValid = false;
-    if (useValue_ || usePolicy_) {
-      getFeatureInTensor(*state, feat_->data);
-      int errcode = dispatcher_.dispatch();
-      switch (errcode) {
-      case tube::Dispatcher::DISPATCH_ERR_DC_TERM:
-#ifdef DEBUG_ACTOR
-        std::cout << "actor " << this << ": attempt to dispatch through"
-                  << " a terminated data channel " << std::endl;
-#endif
-        break;
-      case tube::Dispatcher::DISPATCH_ERR_NO_SLOT:
-#ifdef DEBUG_ACTOR
-        std::cout << "actor " << this << ": no slots available to dispatch"
-                  << std::endl;
-#endif
-        break;
-      case tube::Dispatcher::DISPATCH_NOERR:
-        resultsAreValid = true;
-      }
-    }
-
-    float val;
-    torch::Tensor policy;
-    if (useValue_ && resultsAreValid) {
-      if (logitValue_) {
-        float* begin = value_->data.data_ptr<float>();
-        float* end = begin + 3;
-        softmax_(begin, end);
-      }
-      val = logitValue_
-                ? value_->data[0].item<float>() - value_->data[1].item<float>()
-                : value_->data.item<float>();
-    } else {
-      val = state->getRandomRolloutReward(state->getCurrentPlayer());
-    }
-    if (usePolicy_ && resultsAreValid) {
-      policy = pi_->data;
-    } else {
-      policy = torch::zeros(policySize_, torch::kFloat32);
-      policy.fill_(uniformPolicy_);
-    }
+    pival.logitPolicy = evaluatePolicy(s, pival).clone();
+    return pival;
+  }
 
-    pival.logitPolicy = policy.clone();
-    pival.playerId = state->getCurrentPlayer();
-    pival.value = val;
-    if (rnnStateOut_) {
-      pival.rnnState = rnnStateOut_->data.clone();
-    }
+  // Same as evaluate, but writes the policy logits of the legal actions of s
+  // to legalPolicy instead of copying all of them into pival.
+  PiVal& evaluate(const core::State& s, PiVal& pival, float* legalPolicy) {
+    getLegalPi(s, evaluatePolicy(s, pival).accessor<float, 3>(), legalPolicy);
     return pival;
   }
 
@@ -172,7 +126,9 @@ class Actor {
     }
     if (rnnState_) {
       rnnStateStack_.resize(n);
+      rnnStateOutStack_.resize(n);
     }
+    cacheSlots_.resize(n);
   }
   void batchPrepare(size_t index,
                     const core::State& s,
@@ -183,6 +139,19 @@ class Actor {
       }
       return;
     }
+    CacheSlot& slot = cacheSlots_[index];
+    slot.prepared = true;
+    slot.hit = false;
+    slot.version = 0;
+    if (EvalCache* cache = evalCacheFor(s)) {
+      slot.version = cache->version();
+      slot.hit = cache->lookup(s, slot.version, slot.value, slot.legalPolicy);
+      evalCacheLookups_.fetch_add(1, std::memory_order_relaxed);
+      if (slot.hit) {
+        evalCacheHits_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
     getFeatureInTensor(*dynamic_cast<const State*>(&s), featAcc_[index].data());
     if (!useValue_) {
       batchValue_[index][0] = s.getRandomRolloutReward(s.getCurrentPlayer());
@@ -195,20 +164,18 @@ class Actor {
     }
   }
   void batchEvaluate(size_t n) {
+    batchEvaluate(0, n);
+  }
+  // Evaluates entries [begin, begin + n) of the batch; only those prepared
+  // since the last evaluation go to the model, so callers may leave some
+  // out. Other entries may be prepared or have their results read by other
+  // threads meanwhile.
+  void batchEvaluate(size_t begin, size_t n) {
     if (!modelManager_) {
       return;
     }
     if (useValue_ || usePolicy_) {
-      if (rnnState_) {
-        modelManager_->batchAct(
-            batchFeat_.narrow(0, 0, n), batchValue_.narrow(0, 0, n),
-            batchPi_.narrow(0, 0, n), torch::stack(rnnStateStack_),
-            &batchRnnStateOut_);
-      } else {
-        modelManager_->batchAct(batchFeat_.narrow(0, 0, n),
-                                batchValue_.narrow(0, 0, n),
-                                batchPi_.narrow(0, 0, n));
-      }
+      evaluatePrepared(begin, n);
     }
   }
   void batchResult(size_t index, const core::State& s, PiVal& pival) {
@@ -216,21 +183,54 @@ class Actor {
       evaluate(s, pival);
       return;
     }
-    if (logitValue_) {
-      float* begin = &valueAcc_[index][0];
-      float* end = begin + 3;
-      softmax_(begin, end);
+    const CacheSlot& slot = cacheSlots_[index];
+    if (slot.hit) {
+      pival.playerId = s.getCurrentPlayer();
+      pival.value = slot.value;
+      pival.logitPolicy = scatterLegalPi(s, slot.legalPolicy);
+      return;
     }
-    float val = logitValue_ ? valueAcc_[index][0] - valueAcc_[index][1]
-                            : valueAcc_[index][0];
+    batchResultValue(index, s, pival);
     pival.logitPolicy = batchPi_[index].clone();
-    pival.playerId = s.getCurrentPlayer();
-    pival.value = val;
-    if (rnnState_) {
-      pival.rnnState = batchRnnStateOut_[index];
+  }
+
+  // Same as batchResult, but gathers the policy logits of the legal actions
+  // of s straight from the batch into legalPolicy, which must have room for
+  // them. This neither allocates nor copies the full policy.
+  void batchResult(size_t index,
+                   const core::State& s,
+                   PiVal& pival,
+                   float* legalPolicy) {
+    if (!modelManager_) {
+      evaluate(s, pival, legalPolicy);
+      return;
+    }
+    const CacheSlot& slot = cacheSlots_[index];
+    if (slot.hit) {
+      pival.playerId = s.getCurrentPlayer();
+      pival.value = slot.value;
+      std::copy(slot.legalPolicy.begin(), slot.legalPolicy.end(), legalPolicy);
+      return;
+    }
+    batchResultValue(index, s, pival);
+    getLegalPi(s, piAcc_[index], legalPolicy);
+    if (slot.version) {
+      modelManager_->evalCache()->insert(
+          s, slot.version, pival.value, legalPolicy);
     }
   }
 
+  // See ModelManager::modelVersion; constant without a model.
+  uint64_t modelVersion() const {
+    return modelManager_ ? modelManager_->modelVersion() : 0;
+  }
+
+  // Lookups in the evaluation cache, and hits among them, since the last
+  // call.
+  std::pair<int64_t, int64_t> takeEvalCacheStats() {
+    return {evalCacheLookups_.exchange(0), evalCacheHits_.exchange(0)};
+  }
+
   void recordMove(const core::State* state) {
     auto id = modelManager_->getTournamentModelId();
     ++modelTrackers_[state][id];
@@ -311,6 +311,170 @@ class Actor {
   }
 
  private:
+  // Runs the network on s, fills in pival but for its logits and returns the
+  // policy logits, in a tensor that is only valid until the next call.
+  torch::Tensor evaluatePolicy(const core::State& s, PiVal& pival) {
+    const auto state = dynamic_cast<const State*>(&s);
+    assert(state != nullptr);
+
+    // termination should be handled by mcts
+    assert(!state->terminated());
+
+    bool resultsAreValid = false;
+    if (useValue_ || usePolicy_) {
+      getFeatureInTensor(*state, feat_->data);
+      int errcode = dispatcher_.dispatch();
+      switch (errcode) {
+      case tube::Dispatcher::DISPATCH_ERR_DC_TERM:
+#ifdef DEBUG_ACTOR
+        std::cout << "actor " << this << ": attempt to dispatch through"
+                  << " a terminated data channel " << std::endl;
+#endif
+        break;
+      case tube::Dispatcher::DISPATCH_ERR_NO_SLOT:
+#ifdef DEBUG_ACTOR
+        std::cout << "actor " << this << ": no slots available to dispatch"
+                  << std::endl;
+#endif
+        break;
+      case tube::Dispatcher::DISPATCH_NOERR:
+        resultsAreValid = true;
+      }
+    }
+
+    float val;
+    torch::Tensor policy;
+    if (useValue_ && resultsAreValid) {
+      if (logitValue_) {
+        float* begin = value_->data.data_ptr<float>();
+        float* end = begin + 3;
+        softmax_(begin, end);
+      }
+      val = logitValue_
+                ? value_->data[0].item<float>() - value_->data[1].item<float>()
+                : value_->data.item<float>();
+    } else {
+      val = state->getRandomRolloutReward(state->getCurrentPlayer());
+    }
+    if (usePolicy_ && resultsAreValid) {
+      policy = pi_->data;
+    } else {
+      // Several threads may be evaluating at once; each fills its own.
+      thread_local torch::Tensor uniform;
+      if (!uniform.defined() || uniform.sizes() != policySize_) {
+        uniform = torch::empty(policySize_, torch::kFloat32);
+      }
+      uniform.fill_(uniformPolicy_);
+      policy = uniform;
+    }
+
+    pival.playerId = state->getCurrentPlayer();
+    pival.value = val;
+    if (rnnStateOut_) {
+      pival.rnnState = rnnStateOut_->data.clone();
+    }
+    return policy;
+  }
+
+  // The cache of the model manager, if batch entries for s may use it.
+  // Outputs of recurrent models depend on more than the position, and
+  // without a value head the value is a random rollout.
+  EvalCache* evalCacheFor(const core::State& s) const {
+    if (!useValue_ || !usePolicy_ || rnnState_) {
+      return nullptr;
+    }
+    EvalCache* cache = modelManager_->evalCache();
+    return cache && EvalCache::supports(s) ? cache : nullptr;
+  }
+
+  // Runs the model on the entries of [begin, begin + n) prepared since the
+  // last evaluation that missed the cache, gathering them into a smaller
+  // batch when some hit or were not prepared, like MCTS rollouts that sat
+  // out the batch.
+  void evaluatePrepared(size_t begin, size_t n) {
+    thread_local std::vector<int64_t> pending;
+    pending.clear();
+    for (size_t i = begin; i != begin + n; ++i) {
+      CacheSlot& slot = cacheSlots_[i];
+      if (slot.prepared && !slot.hit) {
+        pending.push_back(i);
+      }
+      slot.prepared = false;
+    }
+    if (pending.empty()) {
+      return;
+    }
+    if (pending.size() == n) {
+      if (rnnState_) {
+        torch::Tensor rnnStateOut;
+        modelManager_->batchAct(
+            batchFeat_.narrow(0, begin, n), batchValue_.narrow(0, begin, n),
+            batchPi_.narrow(0, begin, n),
+            torch::stack(torch::TensorList(&rnnStateStack_[begin], n)),
+            &rnnStateOut);
+        for (size_t i = 0; i != n; ++i) {
+          rnnStateOutStack_[begin + i] = rnnStateOut[i];
+        }
+      } else {
+        modelManager_->batchAct(batchFeat_.narrow(0, begin, n),
+                                batchValue_.narrow(0, begin, n),
+                                batchPi_.narrow(0, begin, n));
+      }
+      return;
+    }
+    torch::Tensor index = torch::from_blob(
+        pending.data(), {(int64_t)pending.size()}, torch::kInt64);
+    torch::Tensor value = batchValue_.index_select(0, index);
+    torch::Tensor pi = batchPi_.index_select(0, index);
+    if (rnnState_) {
+      thread_local std::vector<torch::Tensor> rnnStates;
+      rnnStates.clear();
+      for (int64_t i : pending) {
+        rnnStates.push_back(rnnStateStack_[i]);
+      }
+      torch::Tensor rnnStateOut;
+      modelManager_->batchAct(batchFeat_.index_select(0, index), value, pi,
+                              torch::stack(rnnStates), &rnnStateOut);
+      for (size_t k = 0; k != pending.size(); ++k) {
+        rnnStateOutStack_[pending[k]] = rnnStateOut[k];
+      }
+    } else {
+      modelManager_->batchAct(batchFeat_.index_select(0, index), value, pi);
+    }
+    batchValue_.index_copy_(0, index, value);
+    batchPi_.index_copy_(0, index, pi);
+  }
+
+  // The inverse of getLegalPi: the full policy with the legal logits in
+  // place and -400 elsewhere.
+  torch::Tensor scatterLegalPi(const core::State& s,
+                               const std::vector<float>& legalPolicy) const {
+    torch::Tensor pi = torch::full(policySize_, -400.0f, torch::kFloat32);
+    auto accessor = pi.accessor<float, 3>();
+    const auto& legalActions = s.GetLegalActions();
+    for (size_t i = 0; i != legalActions.size(); ++i) {
+      const auto& action = legalActions[i];
+      float& v = accessor[action.GetX()][action.GetY()][action.GetZ()];
+      v = std::max(v, legalPolicy[i]);
+    }
+    return pi;
+  }
+
+  void batchResultValue(size_t index, const core::State& s, PiVal& pival) {
+    if (logitValue_) {
+      float* begin = &valueAcc_[index][0];
+      float* end = begin + 3;
+      softmax_(begin, end);
+    }
+    float val = logitValue_ ? valueAcc_[index][0] - valueAcc_[index][1]
+                            : valueAcc_[index][0];
+    pival.playerId = s.getCurrentPlayer();
+    pival.value = val;
+    if (rnnState_) {
+      pival.rnnState = rnnStateOutStack_[index];
+    }
+  }
+
   tube::Dispatcher dispatcher_;
 
   std::shared_ptr<tube::DataBlock> feat_;
@@ -328,15 +492,29 @@ class Actor {
   torch::Tensor batchPi_;
   torch::Tensor batchValue_;
 
-  torch::Tensor batchRnnStateOut_;
-
   torch::TensorAccessor<float, 2> valueAcc_{nullptr, nullptr, nullptr};
   torch::TensorAccessor<float, 4> piAcc_{nullptr, nullptr, nullptr};
   torch::TensorAccessor<float, 4> featAcc_{nullptr, nullptr, nullptr};
 
   std::vector<torch::Tensor> rnnStateStack_;
+  std::vector<torch::Tensor> rnnStateOutStack_;
   torch::Tensor rnnStateStackResult_;
 
+  // What the evaluation cache knows of a batch entry.
+  struct CacheSlot {
+    // Set by batchPrepare, cleared once the entry is evaluated.
+    bool prepared = false;
+    bool hit = false;
+    // The model version a missed entry goes into the cache under, or 0 if
+    // it does not.
+    uint64_t version = 0;
+    float value = 0.0f;
+    std::vector<float> legalPolicy;
+  };
+  std::vector<CacheSlot> cacheSlots_;
+  std::atomic<int64_t> evalCacheLookups_{0};
+  std::atomic<int64_t> evalCacheHits_{0};
+
   std::unordered_map<const core::State*,
                      std::unordered_map<std::string_view, float>>
       modelTrackers_;
@@ -19,11 +19,11 @@ class ActorPlayer : public Player {
     actor_->recordMove(state);
   }
 
-  void result(const core::State* state, float reward) {
+  virtual void result(const core::State* state, float reward) {
     actor_->result(state, reward);
   }
 
-  void forget(const core::State* state) {
+  virtual void forget(const core::State* state) {
     actor_->forget(state);
   }
 
@@ -74,6 +74,10 @@ class ActorPlayer : public Player {
     return actor_->vOutputs();
   }
 
+  std::pair<int64_t, int64_t> takeEvalCacheStats() {
+    return actor_->takeEvalCacheStats();
+  }
+
   int findBatchSize(const core::State& state) const {
     return actor_->findBatchSize(state);
   }
@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Times the chess move generator with perft on the usual test positions.
+// Leaves are counted from the move lists of their parents, so nodes per
+// second counts the leaves but only plays the moves above them.
+
+#include "games/chess.h"
+
+#include <chrono>
+#include <cstdio>
+
+namespace {
+
+double seconds(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       begin)
+      .count();
+}
+
+}  // namespace
+
+int main() {
+  struct Position {
+    const char* name;
+    const char* fen;
+    int depth;
+    uint64_t nodes;
+  };
+  Position positions[] = {
+      {"initial", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+       6, 119060324},
+      {"kiwipete",
+       "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+       5, 193690690},
+      {"position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6, 11030083},
+      {"position4",
+       "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 5,
+       15833292},
+      {"position5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+       5, 89941194},
+      {"position6",
+       "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 "
+       "10",
+       5, 164075551},
+  };
+
+  int failures = 0;
+  std::printf("%-10s %5s %12s %8s %10s\n", "position", "depth", "nodes",
+              "seconds", "Mnodes/s");
+  for (const Position& position : positions) {
+    chess::ChessBoard board;
+    board.setFen(position.fen);
+    board.findMoves();
+    auto begin = std::chrono::steady_clock::now();
+    uint64_t nodes = board.perft(position.depth);
+    double s = seconds(begin);
+    std::printf("%-10s %5d %12llu %8.2f %10.1f%s\n", position.name,
+                position.depth, (unsigned long long)nodes, s, nodes / s / 1e6,
+                nodes == position.nodes ? "" : "  WRONG");
+    failures += nodes != position.nodes;
+  }
+  return failures != 0;
+}
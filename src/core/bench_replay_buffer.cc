@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Times adding to and sampling from a full replay buffer with each sampling
+// mode and with compression dictionaries, for samples shaped like those of a
+// 9x9 board game.
+
+#include "core/replay_buffer.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace core;
+
+namespace {
+
+constexpr int capacity = 100000;
+constexpr int addBatchSize = 1024;
+constexpr int sampleBatchSize = 1024;
+constexpr int numSampleBatches = 50;
+
+std::unordered_map<std::string, torch::Tensor> makeBatch(int64_t firstStep) {
+  int n = addBatchSize;
+  std::unordered_map<std::string, torch::Tensor> batch;
+  batch["s"] = (torch::rand({n, 6, 9, 9}) < 0.3).to(torch::kFloat32);
+  batch["pi"] = torch::rand({n, 1, 9, 9});
+  batch["pi_mask"] = torch::ones({n, 1, 9, 9});
+  batch["v"] = torch::rand({n, 1}) * 2 - 1;
+  batch["step"] = (torch::arange(n) + firstStep).remainder(81).to(
+      torch::kFloat32).view({n, 1});
+  return batch;
+}
+
+double seconds(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       begin)
+      .count();
+}
+
+}  // namespace
+
+int main() {
+  struct Config {
+    const char* mode;
+    int dictionarySamples;
+  };
+  Config configs[] = {{"uniform", 0},
+                      {"uniform", 4096},
+                      {"prioritized", 0},
+                      {"recent", 0},
+                      {"phase", 0}};
+
+  std::printf("%-12s %6s %8s %10s %10s %10s\n", "mode", "dict", "ratio",
+              "add ns", "sample ns", "update ns");
+  for (const Config& config : configs) {
+    ReplayBuffer buffer(capacity, 42);
+    ReplayBuffer::SamplingOptions options;
+    options.mode = config.mode;
+    options.recencyWindow = capacity / 4;
+    options.phaseSteps = 20;
+    buffer.setSampling(options);
+    buffer.setDictionaries(config.dictionarySamples, 16 << 10);
+
+    // Fill the buffer once to train dictionaries, then time a second pass.
+    for (int64_t i = 0; i < capacity; i += addBatchSize) {
+      buffer.add(makeBatch(i));
+    }
+    int64_t numAdd = buffer.numAdd();
+    auto begin = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < capacity; i += addBatchSize) {
+      buffer.add(makeBatch(i));
+    }
+    double addNs = seconds(begin) * 1e9 / (buffer.numAdd() - numAdd);
+
+    double updateSeconds = 0.0;
+    begin = std::chrono::steady_clock::now();
+    for (int i = 0; i != numSampleBatches; ++i) {
+      auto batch = buffer.sampleImpl(sampleBatchSize);
+      if (batch.count("replay_index")) {
+        auto updateBegin = std::chrono::steady_clock::now();
+        buffer.updatePriorities(
+            batch["replay_index"], torch::rand({sampleBatchSize}));
+        updateSeconds += seconds(updateBegin);
+      }
+    }
+    double total = (double)numSampleBatches * sampleBatchSize;
+    double sampleNs = (seconds(begin) - updateSeconds) * 1e9 / total;
+
+    std::printf("%-12s %6d %8.2f %10.0f %10.0f ", config.mode,
+                config.dictionarySamples, buffer.compressionRatio(), addNs,
+                sampleNs);
+    if (updateSeconds > 0.0) {
+      std::printf("%10.0f\n", updateSeconds * 1e9 / total);
+    } else {
+      std::printf("%10s\n", "-");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Times State::copy, as done at the start of every MCTS rollout, and
+// State::clone, from a midgame position of several games, with and without
+// history feature planes, and counts the heap allocations of copies.
+
+#include "games/breakthrough_state.h"
+#include "games/chess.h"
+#include "games/connectfour.h"
+#include "games/havannah_state.h"
+#include "games/hex_state.h"
+#include "games/mnkgame.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+using namespace core;
+
+namespace {
+std::atomic_int64_t numAllocs{0};
+}  // namespace
+
+void* operator new(size_t size) {
+  ++numAllocs;
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+namespace {
+
+constexpr int numMoves = 20;
+constexpr int numCopies = 1000000;
+constexpr int numClones = 100000;
+
+double seconds(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       begin)
+      .count();
+}
+
+template <typename T> void bench(const char* name, int history) {
+  FeatureOptions opts;
+  opts.history = history;
+
+  auto src = std::make_unique<T>(1);
+  src->template initializeAs<T>();
+  src->setFeatures(&opts);
+  src->Initialize();
+  for (int i = 0; i != numMoves && !src->terminated(); ++i) {
+    src->DoRandomAction();
+  }
+
+  // Like rollouts, copy into a state that has held another position.
+  auto dst = src->clone();
+  dst->copy(*src);
+  dst->DoRandomAction();
+  int64_t allocs = numAllocs;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i != numCopies; ++i) {
+    dst->copy(*src);
+  }
+  double copyNs = seconds(begin) * 1e9 / numCopies;
+  double copyAllocs = double(numAllocs - allocs) / numCopies;
+
+  begin = std::chrono::steady_clock::now();
+  for (int i = 0; i != numCopies / 10; ++i) {
+    dst->copy(*src);
+    dst->DoRandomAction();
+  }
+  double copyForwardNs = seconds(begin) * 1e9 / (numCopies / 10);
+
+  begin = std::chrono::steady_clock::now();
+  for (int i = 0; i != numClones; ++i) {
+    dst = src->clone();
+  }
+  double cloneNs = seconds(begin) * 1e9 / numClones;
+
+  std::printf("%-14s %7d %12.0f %10.0f %12.2f %14.0f %10.0f\n", name,
+              history, 1e9 / copyNs, copyNs, copyAllocs, copyForwardNs,
+              cloneNs);
+}
+
+}  // namespace
+
+int main() {
+  std::printf("%-14s %7s %12s %10s %12s %14s %10s\n", "game", "history",
+              "copies/s", "copy ns", "copy allocs", "copy+move ns",
+              "clone ns");
+  for (int history : {0, 2}) {
+    bench<StateForConnectFour>("Connect4", history);
+    bench<MNKGame::State<15, 15, 5>>("Gomoku", history);
+    bench<Hex::State<11, true>>("Hex11pie", history);
+    bench<Hex::State<19, true>>("Hex19pie", history);
+    bench<Havannah::State<8, true, true>>("Havannah8pie", history);
+    bench<StateForBreakthrough<true>>("Breakthrough", history);
+    bench<chess::State>("Chess", history);
+  }
+  return 0;
+}
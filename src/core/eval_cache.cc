@@ -0,0 +1,40 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eval_cache.h"
+
+namespace core {
+
+bool EvalCache::lookup(const State& state,
+                       uint64_t version,
+                       float& value,
+                       std::vector<float>& legalPolicy) {
+  return cache_.lookup(state.getHash(), version, [&](const Eval& e) {
+    // Guard against hash collisions as far as cheaply possible.
+    if (e.playerId != state.getCurrentPlayer() ||
+        e.legalPolicy.size() != state.GetLegalActions().size()) {
+      return false;
+    }
+    value = e.value;
+    legalPolicy = e.legalPolicy;
+    return true;
+  });
+}
+
+void EvalCache::insert(const State& state,
+                       uint64_t version,
+                       float value,
+                       const float* legalPolicy) {
+  cache_.insert(state.getHash(), version, [&](Eval& e) {
+    e.playerId = state.getCurrentPlayer();
+    e.value = value;
+    e.legalPolicy.assign(
+        legalPolicy, legalPolicy + state.GetLegalActions().size());
+  });
+}
+
+}  // namespace core
@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "sharded_cache.h"
+#include "state.h"
+
+#include <atomic>
+#include <vector>
+
+namespace core {
+
+// Bounded cache of network outputs keyed by State::getHash(), shared by all
+// the actors of a ModelManager, so that a position evaluated by one game
+// thread, an earlier search or a common opening does not go through the
+// model again. Entries are tagged with the model version and go stale when
+// the model is updated.
+class EvalCache {
+ public:
+  EvalCache(size_t size)
+      : cache_(size) {
+  }
+
+  // Only deterministic games that maintain a hash can use the cache, and
+  // only with features that the hash determines.
+  static bool supports(const State& state) {
+    return state.hasHash() && !state.isStochastic() &&
+           state.hasPositionalFeatures();
+  }
+
+  uint64_t version() const {
+    return version_.load(std::memory_order_relaxed);
+  }
+
+  // Makes all current entries stale.
+  void invalidate() {
+    ++version_;
+  }
+
+  // On a hit, fills in the value and the policy logits of the legal actions
+  // of state and returns true.
+  bool lookup(const State& state,
+              uint64_t version,
+              float& value,
+              std::vector<float>& legalPolicy);
+
+  // version is that of the model at lookup time, so that an evaluation
+  // racing with a model update is never stored as current.
+  void insert(const State& state,
+              uint64_t version,
+              float value,
+              const float* legalPolicy);
+
+  size_t size() const {
+    return cache_.size();
+  }
+
+ private:
+  struct Eval {
+    int playerId = 0;
+    float value = 0.0f;
+    std::vector<float> legalPolicy;
+  };
+
+  ShardedCache<Eval> cache_;
+  std::atomic_uint64_t version_{1};
+};
+
+}  // namespace core
@@ -29,9 +29,11 @@ struct BatchExecutor {
     std::vector<torch::Tensor> feat;
     std::vector<torch::Tensor> v;
     std::vector<torch::Tensor> pi;
+    std::vector<torch::Tensor> piIndex;
     std::vector<torch::Tensor> piMask;
     std::vector<torch::Tensor> actionPi;
     std::vector<torch::Tensor> predV;
+    std::vector<torch::Tensor> step;
     torch::Tensor rnnInitialState;
     std::vector<torch::Tensor> rnnStateMask;
     std::vector<torch::Tensor> predictPi;
@@ -45,10 +47,12 @@ struct BatchExecutor {
     std::vector<size_t> playersReverseMap;
     std::vector<std::vector<torch::Tensor>> feat;
     std::vector<std::vector<torch::Tensor>> pi;
+    std::vector<std::vector<torch::Tensor>> piIndex;
     std::vector<std::vector<torch::Tensor>> piMask;
     std::vector<std::vector<torch::Tensor>> rnnStates;
     std::vector<std::vector<torch::Tensor>> actionPi;
     std::vector<std::vector<torch::Tensor>> predV;
+    std::vector<std::vector<torch::Tensor>> step;
     std::vector<std::vector<float>> reward;
     size_t stepindex;
     std::chrono::steady_clock::time_point start;
@@ -169,6 +173,7 @@ struct BatchExecutor {
     }
     gst.feat.resize(players_.size());
     gst.pi.resize(players_.size());
+    gst.piIndex.resize(players_.size());
     gst.piMask.resize(players_.size());
     gst.reward.resize(players_.size());
     gst.rnnState.resize(players_.size());
@@ -176,6 +181,7 @@ struct BatchExecutor {
     gst.rnnStates.resize(players_.size());
     gst.actionPi.resize(players_.size());
     gst.predV.resize(players_.size());
+    gst.step.resize(players_.size());
     gst.stepindex = 0;
     gst.start = std::chrono::steady_clock::now();
     gst.resignCounter.resize(players_.size());
@@ -266,6 +272,9 @@ struct BatchExecutor {
     for (auto& v : gst.pi) {
       v.clear();
     }
+    for (auto& v : gst.piIndex) {
+      v.clear();
+    }
     for (auto& v : gst.piMask) {
       v.clear();
     }
@@ -278,6 +287,9 @@ struct BatchExecutor {
     for (auto& v : gst.predV) {
       v.clear();
     }
+    for (auto& v : gst.step) {
+      v.clear();
+    }
     for (auto& v : gst.resignCounter) {
       v = 0;
     }
@@ -416,7 +428,9 @@ struct BatchExecutor {
       saveForTraining = false;
     }
     if (saveForTraining) {
-      torch::Tensor feat = getFeatureInTensor(*state);
+      torch::Tensor feat = game->packedFeatures_
+                               ? getPackedFeatureInTensor(*state)
+                               : getFeatureInTensor(*state);
       gameState->feat.at(slot).push_back(feat);
       if (forwardPlayer) {
         auto actionPolicy = torch::zeros_like(pival.logitPolicy);
@@ -425,6 +439,12 @@ struct BatchExecutor {
         gameState->actionPi.at(slot).push_back(actionPolicy);
         gameState->pi.at(slot).push_back(pival.logitPolicy);
         gameState->piMask.at(slot).push_back(getPolicyMaskInTensor(*state));
+      } else if (game->sparsePolicySize_ > 0) {
+        auto [policyIndex, policy, policyMask] = getSparsePolicyInTensor(
+            *state, mctsResult.at(index).mctsPolicy, game->sparsePolicySize_);
+        gameState->piIndex.at(slot).push_back(policyIndex);
+        gameState->pi.at(slot).push_back(policy);
+        gameState->piMask.at(slot).push_back(policyMask);
       } else {
         auto [policy, policyMask] =
             getPolicyInTensor(*state, mctsResult.at(index).mctsPolicy);
@@ -434,6 +454,9 @@ struct BatchExecutor {
       torch::Tensor predV = torch::zeros({1}, torch::kFloat32);
       predV[0] = value;
       gameState->predV.at(slot).push_back(predV);
+      torch::Tensor step = torch::zeros({1}, torch::kFloat32);
+      step[0] = (float)state->getStepIdx();
+      gameState->step.at(slot).push_back(step);
 
       gameState->reward[slot].push_back(state->getReward(slot));
     }
@@ -707,6 +730,15 @@ struct BatchExecutor {
         std::get<0>(stats_s) += 1;
         std::get<1>(stats_s) += rps;
         std::get<2>(stats_s) += rps * rps;
+        auto [lookups, hits] =
+            mctsPlayers.at(playerIndex)->takeEvalCacheStats();
+        if (lookups) {
+          double rate = (double)hits / lookups;
+          auto& stats_c = game->stats_["NN cache hit rate"];
+          std::get<0>(stats_c) += 1;
+          std::get<1>(stats_c) += rate;
+          std::get<2>(stats_c) += rate * rate;
+        }
       }
 
       pushStateCallback(&BatchExecutor::actResult);
@@ -876,9 +908,13 @@ struct BatchExecutor {
               result_[dstp] = i->history.back().value;
 
               i->pi[slot].pop_back();
+              if (!i->piIndex[slot].empty()) {
+                i->piIndex[slot].pop_back();
+              }
               i->piMask[slot].pop_back();
               i->actionPi[slot].pop_back();
               i->predV[slot].pop_back();
+              i->step[slot].pop_back();
               i->feat[slot].pop_back();
               i->rnnStates[slot].pop_back();
               i->reward[slot].pop_back();
@@ -964,12 +1000,16 @@ struct BatchExecutor {
                 }
                 addseq(i->feat[slot], seq.feat, game->feature_[dstp]);
                 addseq(i->pi[slot], seq.pi, game->pi_[dstp]);
+                if (!i->piIndex[slot].empty()) {
+                  addseq(i->piIndex[slot], seq.piIndex, game->piIndex_[dstp]);
+                }
                 addseq(i->piMask[slot], seq.piMask, game->piMask_[dstp]);
                 if (isForward) {
                   addseq(
                       i->actionPi[slot], seq.actionPi, game->actionPi_[dstp]);
                 }
                 addseq(i->predV[slot], seq.predV, game->predV_[dstp]);
+                addseq(i->step[slot], seq.step, game->step_[dstp]);
                 std::vector<torch::Tensor> rnnStateMask;
                 rnnStateMask.resize(i->feat[slot].size());
                 for (auto& v : rnnStateMask) {
@@ -985,6 +1025,9 @@ struct BatchExecutor {
                 for (auto& v : i->pi[slot]) {
                   game->pi_[dstp].pushBack(v);
                 }
+                for (auto& v : i->piIndex[slot]) {
+                  game->piIndex_[dstp].pushBack(v);
+                }
                 for (auto& v : i->piMask[slot]) {
                   game->piMask_[dstp].pushBack(v);
                 }
@@ -994,6 +1037,9 @@ struct BatchExecutor {
                 for (auto& v : i->predV[slot]) {
                   game->predV_[dstp].pushBack(v);
                 }
+                for (auto& v : i->step[slot]) {
+                  game->step_[dstp].pushBack(v);
+                }
               }
 
               if (game->predictEndState || game->predictNStates) {
@@ -1056,9 +1102,11 @@ struct BatchExecutor {
             }
 
             i->pi[slot].clear();
+            i->piIndex[slot].clear();
             i->piMask[slot].clear();
             i->actionPi[slot].clear();
             i->predV[slot].clear();
+            i->step[slot].clear();
             i->feat[slot].clear();
             i->rnnStates[slot].clear();
             i->reward[slot].clear();
@@ -1396,7 +1444,9 @@ void Game::step() {
   if (player->isTP()) {
     // auto TPplayer = std::dynamic_pointer_cast<TPPlayer>(player);
     assert(!state_->isStochastic());
+    startPondering();
     auto index = state_->TPInputAction();
+    stopPondering();
     auto action = state_->GetLegalActions().at(index);
     lastAction_ = state_->actionDescription(action);
     state_->forward(index);
@@ -1414,8 +1464,10 @@ void Game::step() {
 
     std::cout << "History: " << state_->history() << "\n";
 
+    startPondering();
     int index = state_->humanInputAction(
         std::bind(&Game::parseSpecialAction, this, std::placeholders::_1));
+    stopPondering();
     if (index == -1) {
       return step();
     }
@@ -1454,11 +1506,24 @@ void Game::step() {
 
     // store feature for training
     if (!evalMode) {
-      torch::Tensor feat = getFeatureInTensor(*state_);
-      auto [policy, policyMask] = getPolicyInTensor(*state_, result.mctsPolicy);
+      torch::Tensor feat = packedFeatures_ ? getPackedFeatureInTensor(*state_)
+                                           : getFeatureInTensor(*state_);
+      torch::Tensor step = torch::zeros({1}, torch::kFloat32);
+      step[0] = (float)state_->getStepIdx();
       feature_[playerIdx].pushBack(std::move(feat));
-      pi_[playerIdx].pushBack(std::move(policy));
-      piMask_[playerIdx].pushBack(std::move(policyMask));
+      if (sparsePolicySize_ > 0) {
+        auto [policyIndex, policy, policyMask] = getSparsePolicyInTensor(
+            *state_, result.mctsPolicy, sparsePolicySize_);
+        piIndex_[playerIdx].pushBack(std::move(policyIndex));
+        pi_[playerIdx].pushBack(std::move(policy));
+        piMask_[playerIdx].pushBack(std::move(policyMask));
+      } else {
+        auto [policy, policyMask] =
+            getPolicyInTensor(*state_, result.mctsPolicy);
+        pi_[playerIdx].pushBack(std::move(policy));
+        piMask_[playerIdx].pushBack(std::move(policyMask));
+      }
+      step_[playerIdx].pushBack(std::move(step));
     }
 
     // std::cout << ">>>>actual act" << std::endl;
@@ -1489,31 +1554,39 @@ void Game::step() {
   }
 }
 
+void Game::startPondering() {
+  for (auto& v : players_) {
+    auto mctsPlayer = std::dynamic_pointer_cast<mcts::MctsPlayer>(v);
+    if (mctsPlayer && mctsPlayer->option().ponder) {
+      mctsPlayer->ponder(*state_);
+    }
+  }
+}
+
+void Game::stopPondering() {
+  for (auto& v : players_) {
+    auto mctsPlayer = std::dynamic_pointer_cast<mcts::MctsPlayer>(v);
+    if (mctsPlayer) {
+      mctsPlayer->stopPondering();
+    }
+  }
+}
+
 void Game::sendTrajectory() {
   for (int i = 0; i < (int)players_.size(); ++i) {
     assert(v_[i].len() == pi_[i].len() && pi_[i].len() == feature_[i].len());
     assert(pi_[i].len() == piMask_[i].len());
-    int errcode;
-    while (prepareForSend(i)) {
-      // ignore error codes from the dispatcher
-      errcode = dispatchers_[i].dispatchNoReply();
-      switch (errcode) {
-      case tube::Dispatcher::DISPATCH_ERR_DC_TERM:
-#ifdef DEBUG_GAME
-        std::cout << "game " << this << ", sendTrajectory: "
-                  << "attempt to dispatch through"
-                  << " a terminated data channel " << std::endl;
-#endif
-        break;
-      case tube::Dispatcher::DISPATCH_ERR_NO_SLOT:
+    if (feature_[i].len() == 0) {
+      continue;
+    }
+    // ignore error codes from the dispatcher
+    int errcode = dispatchers_[i].dispatchBlockNoReply(takeTrajectory(i));
+    if (errcode == tube::Dispatcher::DISPATCH_ERR_DC_TERM) {
 #ifdef DEBUG_GAME
-        std::cout << "game " << this << ": sendTrajectory: "
-                  << "no slots available to dispatch" << std::endl;
+      std::cout << "game " << this << ", sendTrajectory: "
+                << "attempt to dispatch through"
+                << " a terminated data channel " << std::endl;
 #endif
-        break;
-      case tube::Dispatcher::DISPATCH_NOERR:
-        break;
-      }
     }
     assert(v_[i].len() == 0);
     assert(pi_[i].len() == 0);
@@ -1522,59 +1595,51 @@ void Game::sendTrajectory() {
   }
 }
 
-bool Game::prepareForSend(int playerId) {
+std::unordered_map<std::string, torch::Tensor> Game::takeTrajectory(
+    int playerId) {
   int len = feature_[playerId].len();
 #define check(n)                                                               \
   if (!n.empty() && n[playerId].len() != len)                                  \
   throw std::runtime_error("len mismatch in " #n)
   check(pi_);
+  check(piIndex_);
   check(piMask_);
   check(actionPi_);
   check(v_);
   check(predV_);
+  check(step_);
   check(rnnInitialState_);
   check(rnnStateMask_);
 #undef check
-  if (feature_[playerId].prepareForSend()) {
-    bool b = pi_[playerId].prepareForSend();
-    b &= piMask_[playerId].prepareForSend();
-    if (!actionPi_.empty()) {
-      b &= actionPi_[playerId].prepareForSend();
-    }
-    b &= v_[playerId].prepareForSend();
-    b &= predV_[playerId].prepareForSend();
-    if (predictEndState + predictNStates) {
-      b &= predictPi_[playerId].prepareForSend();
-      b &= predictPiMask_[playerId].prepareForSend();
-    }
-    if (!rnnInitialState_.empty()) {
-      b &= rnnInitialState_[playerId].prepareForSend();
-      b &= rnnStateMask_[playerId].prepareForSend();
-    }
-    if (!b) {
-      throw std::runtime_error("prepareForSend mismatch 1");
-    }
-    return true;
+  std::unordered_map<std::string, torch::Tensor> block;
+  auto take = [&](tube::EpisodicTrajectory& trajectory) {
+    block[trajectory.name] = trajectory.takeAll();
+  };
+  take(feature_[playerId]);
+  take(pi_[playerId]);
+  take(piMask_[playerId]);
+  if (!piIndex_.empty()) {
+    take(piIndex_[playerId]);
   }
-  bool b = pi_[playerId].prepareForSend();
-  b |= piMask_[playerId].prepareForSend();
-  b |= v_[playerId].prepareForSend();
-  b |= predV_[playerId].prepareForSend();
   if (!actionPi_.empty()) {
-    b |= actionPi_[playerId].prepareForSend();
+    take(actionPi_[playerId]);
   }
+  take(v_[playerId]);
+  take(predV_[playerId]);
+  take(step_[playerId]);
   if (predictEndState + predictNStates) {
-    b |= predictPi_[playerId].prepareForSend();
-    b |= predictPiMask_[playerId].prepareForSend();
+    if (predictPi_[playerId].len() != len ||
+        predictPiMask_[playerId].len() != len) {
+      throw std::runtime_error("len mismatch in predictPi_");
+    }
+    take(predictPi_[playerId]);
+    take(predictPiMask_[playerId]);
   }
   if (!rnnInitialState_.empty()) {
-    b |= rnnInitialState_[playerId].prepareForSend();
-    b |= rnnStateMask_[playerId].prepareForSend();
-  }
-  if (b) {
-    throw std::runtime_error("prepareForSend mismatch 2");
+    take(rnnInitialState_[playerId]);
+    take(rnnStateMask_[playerId]);
   }
-  return false;
+  return block;
 }
 
 }  // namespace core
@@ -359,6 +359,26 @@ to look into this) if the strategy is identical to knuth’s.
     state_->setFeatures(&opt);
   }
 
+  // With size > 0, the training data of MCTS players holds their policy as
+  // up to size (flat action index, probability) pairs, "pi_index" and
+  // "pi_value", and the legal action mask as bits, "pi_mask_bits", instead of
+  // dense "pi" and "pi_mask" tensors of the action shape; see
+  // getSparsePolicyInTensor. Call before adding players.
+  void setSparsePolicy(int size) {
+    sparsePolicySize_ = size;
+  }
+
+  // With packed set and binary features, the training data holds the
+  // features as bits, "s_bits", instead of a float "s" tensor; see
+  // getPackedFeatureInTensor. Call before adding players.
+  void setPackedFeatures(bool packed) {
+    packedFeatures_ = packed && state_->hasBinaryFeatures();
+  }
+
+  bool hasBinaryFeatures() const {
+    return state_->hasBinaryFeatures();
+  }
+
   void addHumanPlayer(std::shared_ptr<HumanPlayer> player) {
     players_.push_back(std::move(player));
   }
@@ -393,22 +413,42 @@ to look into this) if the strategy is identical to knuth’s.
       return a;
     };
 
-    auto feat = tube::EpisodicTrajectory(
-        "s", addseq(state_->GetFeatureSize()), torch::kFloat32);
+    auto feat = packedFeatures_
+                    ? tube::EpisodicTrajectory(
+                          "s_bits", addseq({getPackedFeatureBytes(*state_)}),
+                          torch::kUInt8)
+                    : tube::EpisodicTrajectory(
+                          "s", addseq(state_->GetFeatureSize()),
+                          torch::kFloat32);
     auto rnnInitialState = tube::EpisodicTrajectory(
         "rnn_initial_state", player->rnnStateSize(), torch::kFloat32);
     auto rnnStateMask = tube::EpisodicTrajectory(
         "rnn_state_mask", addseq({1}), torch::kFloat32);
-    auto pi = tube::EpisodicTrajectory(
-        "pi", addseq(state_->GetActionSize()), torch::kFloat32);
-    auto piMask = tube::EpisodicTrajectory(
-        "pi_mask", addseq(state_->GetActionSize()), torch::kFloat32);
+    bool forward = dynamic_cast<ForwardPlayer*>(&*player) != nullptr;
+    bool sparse = sparsePolicySize_ > 0 && !forward;
+    auto pi = sparse ? tube::EpisodicTrajectory(
+                           "pi_value", addseq({sparsePolicySize_}),
+                           torch::kFloat32)
+                     : tube::EpisodicTrajectory(
+                           "pi", addseq(state_->GetActionSize()),
+                           torch::kFloat32);
+    auto piIndex = tube::EpisodicTrajectory(
+        "pi_index", addseq({sparsePolicySize_}), torch::kInt32);
+    auto piMask = sparse ? tube::EpisodicTrajectory(
+                               "pi_mask_bits",
+                               addseq({getSparsePolicyMaskBytes(*state_)}),
+                               torch::kUInt8)
+                         : tube::EpisodicTrajectory(
+                               "pi_mask", addseq(state_->GetActionSize()),
+                               torch::kFloat32);
     auto actionPi = tube::EpisodicTrajectory(
         "action_pi", addseq(state_->GetActionSize()), torch::kFloat32);
     auto v = tube::EpisodicTrajectory(
         "v", addseq({player->vOutputs()}), torch::kFloat32);
     auto predV = tube::EpisodicTrajectory(
         "pred_v", addseq({player->vOutputs()}), torch::kFloat32);
+    // The move number of each position, for phase-stratified replay.
+    auto step = tube::EpisodicTrajectory("step", addseq({1}), torch::kFloat32);
     int predicts = (predictEndState ? 2 : 0) + predictNStates;
     auto predictSize = state_->GetRawFeatureSize();
     predictSize[0] *= predicts;
@@ -419,7 +459,8 @@ to look into this) if the strategy is identical to knuth’s.
 
     tube::Dispatcher dispatcher(std::move(dc));
     std::vector<std::shared_ptr<tube::DataBlock>> send;
-    send = {feat.buffer, pi.buffer, piMask.buffer, v.buffer, predV.buffer};
+    send = {feat.buffer, pi.buffer, piMask.buffer,
+            v.buffer, predV.buffer, step.buffer};
     if (predictEndState + predictNStates) {
       send.push_back(predictPi.buffer);
       send.push_back(predictPiMask.buffer);
@@ -432,10 +473,14 @@ to look into this) if the strategy is identical to knuth’s.
       send.push_back(rnnStateMask.buffer);
       rnnStateMask_.push_back(rnnStateMask);
     }
-    if (dynamic_cast<ForwardPlayer*>(&*player) != nullptr) {
+    if (forward) {
       send.push_back(actionPi.buffer);
       actionPi_.push_back(actionPi);
     }
+    if (sparse) {
+      send.push_back(piIndex.buffer);
+      piIndex_.push_back(piIndex);
+    }
     dispatcher.addDataBlocks(send, {});
 
     feature_.push_back(feat);
@@ -443,6 +488,7 @@ to look into this) if the strategy is identical to knuth’s.
     piMask_.push_back(piMask);
     v_.push_back(v);
     predV_.push_back(predV);
+    step_.push_back(step);
     dispatchers_.push_back(dispatcher);
   }
 
@@ -518,9 +564,18 @@ to look into this) if the strategy is identical to knuth’s.
 
   void step();
 
+  // Lets the MCTS players with the ponder option search the current position
+  // while another player thinks.
+  void startPondering();
+  void stopPondering();
+
+  // Sends the stored training data of each player through its dispatcher,
+  // a whole game at a time.
   void sendTrajectory();
 
-  bool prepareForSend(int playerId);
+  // Removes the training data of playerId, one tensor per key with a row
+  // per stored move.
+  std::unordered_map<std::string, torch::Tensor> takeTrajectory(int playerId);
 
   std::unique_ptr<State> state_;
   std::vector<std::shared_ptr<Player>> players_;
@@ -530,15 +585,20 @@ to look into this) if the strategy is identical to knuth’s.
   std::vector<tube::EpisodicTrajectory> rnnStateMask_;
   std::vector<tube::EpisodicTrajectory> rnnInitialState_;
   std::vector<tube::EpisodicTrajectory> pi_;
+  std::vector<tube::EpisodicTrajectory> piIndex_;
   std::vector<tube::EpisodicTrajectory> piMask_;
   std::vector<tube::EpisodicTrajectory> actionPi_;
   std::vector<tube::EpisodicTrajectory> v_;
   std::vector<tube::EpisodicTrajectory> predV_;
+  std::vector<tube::EpisodicTrajectory> step_;
   std::vector<tube::EpisodicTrajectory> predictPi_;
   std::vector<tube::EpisodicTrajectory> predictPiMask_;
 
   std::vector<tube::Dispatcher> dispatchers_;
 
+  int sparsePolicySize_ = 0;
+  bool packedFeatures_ = false;
+
   std::list<FeatureOptions> featopts;
 
   std::vector<float> result_;
@@ -5,6 +5,7 @@
 #include "common/thread_id.h"
 #include "distributed/distributed.h"
 #include "distributed/rpc.h"
+#include "eval_cache.h"
 #include "replay_buffer.h"
 #include "tube/src_cpp/data_channel.h"
 
@@ -199,7 +200,7 @@ class ModelManagerImpl {
 
     dtype_ = at::ScalarType::Float;
 
-    model_->to(dtype_);
+    model_->to(at::ScalarType::Float);
 
     modelMutex_ = getDeviceMutex(device);
   }
@@ -208,6 +209,13 @@ class ModelManagerImpl {
     terminate_ = true;
     actChannel_->terminate();
     trainChannel_->terminate();
+    {
+      std::lock_guard l(inferenceMutex_);
+      inferenceCv_.notify_all();
+    }
+    if (inferenceThread_.joinable()) {
+      inferenceThread_.join();
+    }
     for (auto& v : threads_) {
       v.join();
     }
@@ -318,7 +326,7 @@ class ModelManagerImpl {
     std::unordered_map<std::string, torch::Tensor> r;
     for (auto& [name, tensor] : stateDict) {
       r[name] = tensor.detach().to(
-          torch::TensorOptions().device(torch::kCPU).dtype(dtype_), false,
+          torch::TensorOptions().device(torch::kCPU).dtype(at::kFloat), false,
           true);
     }
     return r;
@@ -434,6 +442,14 @@ class ModelManagerImpl {
     PriorityMutex::setThreadPriority(-9);
     std::lock_guard<PriorityMutex> lk(*modelMutex_);
     loadModelStateDict(*model_, stateDict);
+    if (referenceModel_) {
+      loadModelStateDict(*referenceModel_, stateDict);
+      precisionCheckPending_ = true;
+    }
+    ++modelVersion_;
+    if (evalCache_) {
+      evalCache_->invalidate();
+    }
   }
 
   int bufferSize() const {
@@ -448,6 +464,43 @@ class ModelManagerImpl {
     return replayBuffer_.sample(sampleSize);
   }
 
+  void attachReplayBuffer(const std::string& directory) {
+    replayBuffer_.attach(directory);
+  }
+
+  void checkpointReplayBuffer() {
+    replayBuffer_.checkpoint();
+  }
+
+  void setReplaySampling(const std::string& mode,
+                         float priorityAlpha,
+                         float priorityBeta,
+                         int recencyWindow,
+                         int numPhases,
+                         int phaseSteps) {
+    ReplayBuffer::SamplingOptions options;
+    options.mode = mode;
+    options.priorityAlpha = priorityAlpha;
+    options.priorityBeta = priorityBeta;
+    options.recencyWindow = recencyWindow;
+    options.numPhases = numPhases;
+    options.phaseSteps = phaseSteps;
+    replayBuffer_.setSampling(std::move(options));
+  }
+
+  void updateReplayPriorities(torch::Tensor indices,
+                              torch::Tensor priorities) {
+    replayBuffer_.updatePriorities(indices, priorities);
+  }
+
+  void setReplayPrefetch(int numThreads, int depth) {
+    replayBuffer_.setPrefetch(numThreads, depth, device_.is_cuda());
+  }
+
+  void setReplayDictionaries(int trainingSamples, int dictionarySize) {
+    replayBuffer_.setDictionaries(trainingSamples, dictionarySize);
+  }
+
   void start() {
     threads_.emplace_back(&ModelManagerImpl::trainThread, this);
 
@@ -522,12 +575,24 @@ class ModelManagerImpl {
         break;
       }
       // TODO[hengyuan]: temp hard code
-      auto s = batch["s"].to(device_);
+      auto s = batch["s"].to(device_, dtype_.load());
       std::vector<torch::jit::IValue> input;
       input.push_back(s);
       PriorityMutex::setThreadPriority(-1);
       std::unique_lock<PriorityMutex> lk(*modelMutex_);
       auto output = model_->forward(input);
+      try {
+        checkPrecision(input, output);
+      } catch (const std::runtime_error& e) {
+        // No caller waits on this thread to see the exception, so fall back
+        // to fp32 and redo the batch.
+        lk.unlock();
+        fmt::printf("Error: %s, falling back to fp32\n", e.what());
+        setInferencePrecision("fp32", 0.0f);
+        input = {s.to(at::kFloat)};
+        lk.lock();
+        output = model_->forward(input);
+      }
       lk.unlock();
       auto reply = convertIValueToMap(output);
       actChannel_->setReply(reply);
@@ -552,6 +617,19 @@ class ModelManagerImpl {
                 torch::Tensor pi,
                 torch::Tensor rnnState = {},
                 torch::Tensor* rnnStateOut = nullptr) {
+    if (inferenceBatchSize_ > 0 && !rnnState.defined()) {
+      InferenceRequest req;
+      req.input = std::move(input);
+      req.v = std::move(v);
+      req.pi = std::move(pi);
+      req.submitted = std::chrono::steady_clock::now();
+      submitInference(&req);
+      req.done.wait();
+      if (req.error) {
+        std::rethrow_exception(req.error);
+      }
+      return;
+    }
     torch::NoGradGuard ng;
     bool isCuda = device_.is_cuda();
     PriorityMutex::setThreadPriority(common::getThreadId());
@@ -560,12 +638,14 @@ class ModelManagerImpl {
       g.emplace(c10::cuda::getStreamFromPool(false, device_.index()));
     }
     std::vector<torch::jit::IValue> inp;
-    inp.push_back(input.to(device_, dtype_, true));
+    at::ScalarType dtype = dtype_;
+    inp.push_back(input.to(device_, dtype, true));
     if (rnnState.defined()) {
-      inp.push_back(rnnState.to(device_, dtype_, true));
+      inp.push_back(rnnState.to(device_, dtype, true));
     }
     std::unique_lock<PriorityMutex> lk(*modelMutex_);
     auto output = model_->forward(inp);
+    checkPrecision(inp, output);
     if (isCuda) {
       g->current_stream().synchronize();
     }
@@ -581,6 +661,42 @@ class ModelManagerImpl {
     }
   }
 
+  std::shared_ptr<TorchJitModel> cloneModel(const TorchJitModel& model) {
+    std::shared_ptr<TorchJitModel> r =
+        std::make_shared<TorchJitModel>(model.clone());
+    r->eval();
+    return r;
+  }
+
+  // With reduced precision, the first batch after a precision switch or a
+  // model update also goes through the fp32 model, and the largest
+  // difference in value and policy logits is reported. Must be called with
+  // modelMutex_ held.
+  void checkPrecision(const std::vector<torch::jit::IValue>& inp,
+                      const torch::jit::IValue& output) {
+    if (!referenceModel_ || !precisionCheckPending_.exchange(false)) {
+      return;
+    }
+    std::vector<torch::jit::IValue> referenceInp;
+    for (auto& v : inp) {
+      referenceInp.push_back(v.toTensor().to(at::kFloat));
+    }
+    auto expected = convertIValueToMap(referenceModel_->forward(referenceInp));
+    auto actual = convertIValueToMap(output);
+    float error = 0.0f;
+    for (const char* key : {"v", "pi_logit"}) {
+      torch::Tensor diff = actual[key].to(at::kFloat) - expected[key];
+      error = std::max(error, diff.abs().max().item<float>());
+    }
+    fmt::printf("Inference precision %s: max abs error %g against fp32\n",
+                precision_, error);
+    if (precisionMaxError_ > 0 && error > precisionMaxError_) {
+      throw std::runtime_error(fmt::sprintf(
+          "inference precision %s: error %g against fp32 exceeds %g",
+          precision_, error, precisionMaxError_));
+    }
+  }
+
   struct Timer {
     std::chrono::steady_clock::time_point start;
     Timer() {
@@ -619,10 +735,11 @@ class ModelManagerImpl {
       return 1;
     }
     std::vector<torch::jit::IValue> inp;
-    torch::Tensor gpuinput = input.to(device_, dtype_, true);
+    at::ScalarType dtype = dtype_;
+    torch::Tensor gpuinput = input.to(device_, dtype, true);
     torch::Tensor gpurnnState;
     if (rnnState.defined()) {
-      gpurnnState = rnnState.to(device_, dtype_, true);
+      gpurnnState = rnnState.to(device_, dtype, true);
     }
     auto prep = [&](int bs) {
       inp.clear();
@@ -630,13 +747,13 @@ class ModelManagerImpl {
       for (int i = 0; i != bs; ++i) {
         batch.push_back(gpuinput);
       }
-      inp.push_back(torch::stack(batch).to(device_, dtype_, true));
+      inp.push_back(torch::stack(batch).to(device_, dtype, true));
       if (rnnState.defined()) {
         batch.clear();
         for (int i = 0; i != bs; ++i) {
           batch.push_back(gpurnnState);
         }
-        inp.push_back(torch::stack(batch).to(device_, dtype_, true));
+        inp.push_back(torch::stack(batch).to(device_, dtype, true));
       }
       g->current_stream().synchronize();
     };
@@ -838,6 +955,10 @@ class ModelManagerImpl {
     return replayBuffer_.numAdd();
   }
 
+  double bufferCompressionRatio() const {
+    return replayBuffer_.compressionRatio();
+  }
+
   void setIsTournamentOpponent(bool mode) {
     isTournamentOpponent_ = mode;
   }
@@ -867,6 +988,66 @@ class ModelManagerImpl {
     }
   }
 
+  void setInferenceBatching(int maxBatchSize, float maxWaitMs) {
+    inferenceMaxWaitMs_ = maxWaitMs;
+    inferenceBatchSize_ = maxBatchSize;
+    if (maxBatchSize > 0 && !inferenceThread_.joinable()) {
+      inferenceThread_ =
+          std::thread(&ModelManagerImpl::inferenceThread, this);
+    }
+  }
+
+  void setInferencePrecision(const std::string& precision, float maxError) {
+    torch::ScalarType dtype;
+    if (precision == "fp32") {
+      dtype = at::kFloat;
+    } else if (precision == "bf16") {
+      dtype = at::kBFloat16;
+    } else if (precision == "fp16") {
+      dtype = at::kHalf;
+    } else {
+      throw std::runtime_error(fmt::sprintf(
+          "unknown inference precision '%s' (expected fp32, bf16 or fp16)",
+          precision));
+    }
+    torch::NoGradGuard ng;
+    std::lock_guard<PriorityMutex> lk(*modelMutex_);
+    // Weights are converted from the fp32 copy, never between reduced
+    // precisions.
+    if (!referenceModel_) {
+      referenceModel_ = cloneModel(*model_);
+    }
+    model_ = cloneModel(*referenceModel_);
+    model_->to(dtype);
+    dtype_ = dtype;
+    precision_ = precision;
+    precisionMaxError_ = maxError;
+    if (dtype == at::kFloat) {
+      referenceModel_.reset();
+    }
+    precisionCheckPending_ = referenceModel_ != nullptr;
+    ++modelVersion_;
+    if (evalCache_) {
+      evalCache_->invalidate();
+    }
+  }
+
+  void setEvalCacheSize(int size) {
+    if (size > 0) {
+      evalCache_ = std::make_unique<EvalCache>(size);
+    } else {
+      evalCache_.reset();
+    }
+  }
+
+  EvalCache* evalCache() const {
+    return evalCache_.get();
+  }
+
+  uint64_t modelVersion() const {
+    return modelVersion_.load(std::memory_order_relaxed);
+  }
+
   void setFindBatchSizeMaxMs(float ms) {
     findBatchSizeMaxMs_ = ms;
   }
@@ -875,12 +1056,139 @@ class ModelManagerImpl {
   }
 
  private:
+  // A batchAct call waiting for the inference thread.
+  struct InferenceRequest {
+    torch::Tensor input;
+    torch::Tensor v;
+    torch::Tensor pi;
+    std::chrono::steady_clock::time_point submitted;
+    std::exception_ptr error;
+    async::Semaphore done;
+    InferenceRequest* next = nullptr;
+  };
+
+  void submitInference(InferenceRequest* req) {
+    InferenceRequest* head = inferenceQueue_.load();
+    do {
+      req->next = head;
+    } while (!inferenceQueue_.compare_exchange_weak(head, req));
+    // The inference thread empties the queue whenever it wakes up, so only
+    // a request into an empty queue needs to wake it.
+    if (!head) {
+      std::lock_guard l(inferenceMutex_);
+      inferenceCv_.notify_one();
+    }
+  }
+
+  // Coalesces the batchAct calls of all game threads into batches of up to
+  // inferenceBatchSize_ rows, waiting at most inferenceMaxWaitMs_ after the
+  // oldest request for more to arrive.
+  void inferenceThread() {
+    torch::NoGradGuard ng;
+    std::deque<InferenceRequest*> pending;
+    int64_t pendingRows = 0;
+    auto takeQueue = [&]() {
+      // The queue is a stack; reverse it to serve requests in order.
+      InferenceRequest* list = inferenceQueue_.exchange(nullptr);
+      InferenceRequest* reversed = nullptr;
+      while (list) {
+        InferenceRequest* next = list->next;
+        list->next = reversed;
+        reversed = list;
+        list = next;
+      }
+      while (reversed) {
+        InferenceRequest* next = reversed->next;
+        pending.push_back(reversed);
+        pendingRows += reversed->input.size(0);
+        reversed = next;
+      }
+    };
+    auto wakeUp = [&]() { return inferenceQueue_.load() || terminate_; };
+    while (true) {
+      if (pending.empty()) {
+        std::unique_lock l(inferenceMutex_);
+        inferenceCv_.wait(l, wakeUp);
+      }
+      if (terminate_) {
+        break;
+      }
+      takeQueue();
+      auto deadline =
+          pending.front()->submitted +
+          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<float, std::milli>(inferenceMaxWaitMs_));
+      while (pendingRows < inferenceBatchSize_ && !terminate_ &&
+             std::chrono::steady_clock::now() < deadline) {
+        std::unique_lock l(inferenceMutex_);
+        inferenceCv_.wait_until(l, deadline, wakeUp);
+        l.unlock();
+        takeQueue();
+      }
+
+      std::vector<InferenceRequest*> batch;
+      std::vector<torch::Tensor> inputs;
+      int64_t rows = 0;
+      while (!pending.empty()) {
+        InferenceRequest* req = pending.front();
+        int64_t n = req->input.size(0);
+        if (!batch.empty() && rows + n > inferenceBatchSize_) {
+          break;
+        }
+        pending.pop_front();
+        pendingRows -= n;
+        rows += n;
+        batch.push_back(req);
+        inputs.push_back(req->input);
+      }
+      try {
+        std::vector<torch::jit::IValue> inp;
+        inp.push_back(torch::cat(inputs).to(device_, dtype_.load()));
+        PriorityMutex::setThreadPriority(-1);
+        std::unique_lock<PriorityMutex> lk(*modelMutex_);
+        auto output = model_->forward(inp);
+        checkPrecision(inp, output);
+        lk.unlock();
+        auto reply = convertIValueToMap(output);
+        torch::Tensor v = reply["v"].to(torch::kCPU);
+        torch::Tensor pi = reply["pi_logit"].to(torch::kCPU);
+        int64_t offset = 0;
+        for (InferenceRequest* req : batch) {
+          int64_t n = req->input.size(0);
+          req->v.copy_(v.narrow(0, offset, n));
+          req->pi.copy_(pi.narrow(0, offset, n));
+          offset += n;
+        }
+      } catch (...) {
+        for (InferenceRequest* req : batch) {
+          req->error = std::current_exception();
+        }
+      }
+      for (InferenceRequest* req : batch) {
+        req->done.post();
+      }
+    }
+    takeQueue();
+    for (InferenceRequest* req : pending) {
+      req->error = std::make_exception_ptr(
+          std::runtime_error("ModelManager destroyed during batchAct"));
+      req->done.post();
+    }
+  }
+
   const std::string jitModel_;
   torch::Device device_;
-  torch::ScalarType dtype_;
+  // Set under modelMutex_, but read without it to convert inputs before
+  // taking the lock.
+  std::atomic<torch::ScalarType> dtype_;
 
   PriorityMutex* modelMutex_;
   std::shared_ptr<TorchJitModel> model_;
+  // The fp32 model, kept alongside model_ when it runs in reduced precision.
+  std::shared_ptr<TorchJitModel> referenceModel_;
+  std::string precision_ = "fp32";
+  float precisionMaxError_ = 0.0f;
+  std::atomic_bool precisionCheckPending_{false};
   std::shared_ptr<tube::DataChannel> actChannel_;
   std::shared_ptr<tube::DataChannel> trainChannel_;
   std::vector<std::thread> threads_;
@@ -900,6 +1208,16 @@ class ModelManagerImpl {
 
   std::atomic<float> findBatchSizeMaxMs_ = 100.0f;
   std::atomic<int> findBatchSizeMaxBs_ = 10240;
+
+  std::atomic<InferenceRequest*> inferenceQueue_{nullptr};
+  std::mutex inferenceMutex_;
+  std::condition_variable inferenceCv_;
+  std::thread inferenceThread_;
+  std::atomic_int inferenceBatchSize_{0};
+  std::atomic<float> inferenceMaxWaitMs_{1.0f};
+
+  std::unique_ptr<EvalCache> evalCache_;
+  std::atomic_uint64_t modelVersion_{1};
 };
 
 ModelManager::ModelManager() {
@@ -946,6 +1264,38 @@ std::unordered_map<std::string, at::Tensor> ModelManager::sample(
   return impl->sample(sampleSize);
 }
 
+void ModelManager::attachReplayBuffer(const std::string& directory) {
+  impl->attachReplayBuffer(directory);
+}
+
+void ModelManager::checkpointReplayBuffer() {
+  impl->checkpointReplayBuffer();
+}
+
+void ModelManager::setReplaySampling(const std::string& mode,
+                                     float priorityAlpha,
+                                     float priorityBeta,
+                                     int recencyWindow,
+                                     int numPhases,
+                                     int phaseSteps) {
+  impl->setReplaySampling(
+      mode, priorityAlpha, priorityBeta, recencyWindow, numPhases, phaseSteps);
+}
+
+void ModelManager::updateReplayPriorities(torch::Tensor indices,
+                                          torch::Tensor priorities) {
+  impl->updateReplayPriorities(indices, priorities);
+}
+
+void ModelManager::setReplayPrefetch(int numThreads, int depth) {
+  impl->setReplayPrefetch(numThreads, depth);
+}
+
+void ModelManager::setReplayDictionaries(int trainingSamples,
+                                         int dictionarySize) {
+  impl->setReplayDictionaries(trainingSamples, dictionarySize);
+}
+
 void ModelManager::start() {
   return impl->start();
 }
@@ -1026,6 +1376,10 @@ int64_t ModelManager::bufferNumAdd() const {
   return impl->bufferNumAdd();
 }
 
+double ModelManager::bufferCompressionRatio() const {
+  return impl->bufferCompressionRatio();
+}
+
 bool ModelManager::isTournamentOpponent() const {
   return impl->isTournamentOpponent();
 }
@@ -1034,6 +1388,27 @@ bool ModelManager::wantsTournamentResult() {
   return impl->wantsTournamentResult();
 }
 
+void ModelManager::setInferenceBatching(int maxBatchSize, float maxWaitMs) {
+  impl->setInferenceBatching(maxBatchSize, maxWaitMs);
+}
+
+void ModelManager::setInferencePrecision(const std::string& precision,
+                                         float maxError) {
+  impl->setInferencePrecision(precision, maxError);
+}
+
+void ModelManager::setEvalCacheSize(int size) {
+  impl->setEvalCacheSize(size);
+}
+
+EvalCache* ModelManager::evalCache() const {
+  return impl->evalCache();
+}
+
+uint64_t ModelManager::modelVersion() const {
+  return impl->modelVersion();
+}
+
 void ModelManager::setFindBatchSizeMaxMs(float ms) {
   impl->setFindBatchSizeMaxMs(ms);
 }
@@ -25,6 +25,7 @@ struct SampleResult {
   }
 };
 
+class EvalCache;
 class ModelManagerImpl;
 class ModelManager {
   std::unique_ptr<ModelManagerImpl> impl;
@@ -47,6 +48,28 @@ class ModelManager {
   int bufferSize() const;
   bool bufferFull() const;
   std::unordered_map<std::string, torch::Tensor> sample(int sampleSize);
+  // Keeps the replay buffer on disk under directory, restoring it from its
+  // last checkpoint there; see ReplayBuffer::attach. Call before start.
+  void attachReplayBuffer(const std::string& directory);
+  void checkpointReplayBuffer();
+  // Selects how training samples are drawn from the replay buffer; see
+  // ReplayBuffer::SamplingOptions. Call before attachReplayBuffer and start.
+  void setReplaySampling(const std::string& mode,
+                         float priorityAlpha,
+                         float priorityBeta,
+                         int recencyWindow,
+                         int numPhases,
+                         int phaseSteps);
+  // Sets the priorities of samples drawn in "prioritized" mode, indexed by
+  // the "replay_index" of their batch.
+  void updateReplayPriorities(torch::Tensor indices, torch::Tensor priorities);
+  // Number of threads prefetching training batches and how many batches
+  // they keep ready; batches go to pinned memory on a CUDA device. Call
+  // before the first sample.
+  void setReplayPrefetch(int numThreads, int depth);
+  // Trains zstd dictionaries for the replay buffer on its first
+  // trainingSamples samples; see ReplayBuffer::setDictionaries.
+  void setReplayDictionaries(int trainingSamples, int dictionarySize);
   void start();
   void testAct();
   void setIsTournamentOpponent(bool mode);
@@ -72,9 +95,33 @@ class ModelManager {
   int findBatchSize(torch::Tensor input, torch::Tensor rnnState = {});
   int64_t bufferNumSample() const;
   int64_t bufferNumAdd() const;
+  double bufferCompressionRatio() const;
   bool isTournamentOpponent() const;
   bool wantsTournamentResult();
 
+  // With maxBatchSize > 0, batchAct calls without rnn state from all threads
+  // are queued to one inference thread, which runs them together in batches
+  // of up to maxBatchSize rows, waiting up to maxWaitMs for them to fill.
+  void setInferenceBatching(int maxBatchSize, float maxWaitMs);
+
+  // Runs the model in precision "fp32", "bf16" or "fp16". Updates still
+  // arrive in fp32 and are converted on load. With reduced precision, the
+  // first batch after the switch and after each update is checked against
+  // the fp32 model; the error is printed, and batchAct throws if it exceeds
+  // maxError > 0. Call before the actors start.
+  void setInferencePrecision(const std::string& precision, float maxError);
+
+  // Caches up to size network outputs for the actors of this manager; 0
+  // disables it. Call before the actors start.
+  void setEvalCacheSize(int size);
+  // nullptr when disabled.
+  EvalCache* evalCache() const;
+
+  // Changes whenever the outputs of the model may change: on each update
+  // and precision switch. Evaluations cached under an older version are
+  // stale.
+  uint64_t modelVersion() const;
+
   void setFindBatchSizeMaxMs(float ms);
   void setFindBatchSizeMaxBs(int n);
 };
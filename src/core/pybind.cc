@@ -32,6 +32,9 @@ PYBIND11_MODULE(polygames, m) {
       .def("get_feat_size", &Game::getFeatSize)
       .def("is_one_player_game", &Game::isOnePlayerGame)
       .def("set_features", &Game::setFeatures)
+      .def("set_sparse_policy", &Game::setSparsePolicy)
+      .def("set_packed_features", &Game::setPackedFeatures)
+      .def("has_binary_features", &Game::hasBinaryFeatures)
       .def("get_action_size", &Game::getActionSize)
       .def("get_result", &Game::getResult);
 
@@ -71,7 +74,14 @@ PYBIND11_MODULE(polygames, m) {
       .def("buffer_full", &ModelManager::bufferFull)
       .def("buffer_num_sample", &ModelManager::bufferNumSample)
       .def("buffer_num_add", &ModelManager::bufferNumAdd)
+      .def("buffer_compression_ratio", &ModelManager::bufferCompressionRatio)
       .def("sample", &ModelManager::sample)
+      .def("attach_replay_buffer", &ModelManager::attachReplayBuffer)
+      .def("checkpoint_replay_buffer", &ModelManager::checkpointReplayBuffer)
+      .def("set_replay_sampling", &ModelManager::setReplaySampling)
+      .def("update_replay_priorities", &ModelManager::updateReplayPriorities)
+      .def("set_replay_prefetch", &ModelManager::setReplayPrefetch)
+      .def("set_replay_dictionaries", &ModelManager::setReplayDictionaries)
       .def("start", &ModelManager::start)
       .def("test_act", &ModelManager::testAct)
       .def("set_is_tournament_opponent", &ModelManager::setIsTournamentOpponent)
@@ -83,6 +93,9 @@ PYBIND11_MODULE(polygames, m) {
       .def("start_replay_buffer_server", &ModelManager::startReplayBufferServer)
       .def("start_replay_buffer_client", &ModelManager::startReplayBufferClient)
       .def("remote_sample", &ModelManager::remoteSample)
+      .def("set_inference_batching", &ModelManager::setInferenceBatching)
+      .def("set_inference_precision", &ModelManager::setInferencePrecision)
+      .def("set_eval_cache_size", &ModelManager::setEvalCacheSize)
       .def("set_find_batch_size_max_ms", &ModelManager::setFindBatchSizeMaxMs)
       .def("set_find_batch_size_max_bs", &ModelManager::setFindBatchSizeMaxBs);
 
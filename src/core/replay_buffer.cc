@@ -7,10 +7,23 @@
 
 #include <sstream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
 #include "replay_buffer.h"
 
 #define ZSTD_STATIC_LINKING_ONLY
 #include "zstd/lib/zstd.h"
+#include "zstd/lib/dictBuilder/zdict.h"
 
 namespace {
 struct cctx {
@@ -38,10 +51,95 @@ struct dctx {
     ZSTD_freeDCtx(ctx);
   }
 };
+
+constexpr uint64_t fileMagic = 0x3166627265706c79;  // "ylperbf1"
+// Segments are sparse files of this size, filled in order.
+constexpr size_t segmentBytes = 64 << 20;
+
+// The checkpoint file is this header followed by a copy of the index.
+struct CheckpointHeader {
+  uint64_t magic;
+  uint64_t capacity;
+  uint64_t nextSegment;
+};
+
+[[noreturn]] void throwErrno(const std::string& what,
+                             const std::string& path) {
+  throw std::runtime_error(
+      "replay buffer: " + what + " " + path + ": " + std::strerror(errno));
+}
+
+// Replaces path with data such that a crash leaves either the old or the
+// new contents.
+void writeFileAtomic(const std::string& directory,
+                     const std::string& name,
+                     const void* data,
+                     size_t size) {
+  std::string path = directory + "/" + name;
+  std::string tmpPath = path + ".tmp";
+  int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throwErrno("failed to create", tmpPath);
+  }
+  if (write(fd, data, size) != (ssize_t)size || fsync(fd)) {
+    close(fd);
+    throwErrno("failed to write", tmpPath);
+  }
+  close(fd);
+  if (rename(tmpPath.c_str(), path.c_str())) {
+    throwErrno("failed to rename", tmpPath);
+  }
+  fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0 || fsync(fd)) {
+    throwErrno("failed to sync", directory);
+  }
+  close(fd);
+}
+
 }  // namespace
 
 namespace core {
 
+struct ReplayBuffer::Segment {
+  ReplayBuffer* owner = nullptr;
+  uint64_t id = 0;
+  std::string path;
+  char* data = nullptr;
+  size_t size = 0;
+
+  ~Segment() {
+    if (data) {
+      munmap(data, size);
+    }
+    if (!owner->closing_) {
+      owner->releaseSegment(*this);
+    }
+  }
+};
+
+struct ReplayBuffer::Dictionary {
+  std::vector<char> data;
+  unsigned id = 0;
+  ZSTD_CDict* cdict = nullptr;
+  ZSTD_DDict* ddict = nullptr;
+
+  Dictionary(std::vector<char> d)
+      : data(std::move(d)) {
+    id = ZDICT_getDictID(data.data(), data.size());
+    cdict = ZSTD_createCDict(data.data(), data.size(), 0);
+    ddict = ZSTD_createDDict(data.data(), data.size());
+    if (!cdict || !ddict) {
+      ZSTD_freeCDict(cdict);
+      ZSTD_freeDDict(ddict);
+      throw std::runtime_error("Failed to allocate zstd dictionary");
+    }
+  }
+  ~Dictionary() {
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+  }
+};
+
 ReplayBuffer::ReplayBuffer(int capacity, int seed)
     : capacity(capacity)
     , buffer(capacity) {
@@ -58,6 +156,372 @@ ReplayBuffer::~ReplayBuffer() {
       v.join();
     }
   }
+  closing_ = true;
+  for (auto& v : buffer) {
+    delete[] v.exchange(nullptr);
+  }
+  activeSegment_ = nullptr;
+  if (index_) {
+    munmap(indexMap_, indexMapSize_);
+  }
+}
+
+void ReplayBuffer::attach(const std::string& directory) {
+  if (index_) {
+    throw std::runtime_error("replay buffer is already attached");
+  }
+  if (numAdd_ != 0) {
+    throw std::runtime_error("replay buffer must be attached before adding");
+  }
+  if (mkdir(directory.c_str(), 0755) && errno != EEXIST) {
+    throwErrno("failed to create", directory);
+  }
+  directory_ = directory;
+
+  std::vector<char> checkpoint;
+  {
+    std::ifstream f(directory + "/checkpoint", std::ios::binary);
+    checkpoint.assign(std::istreambuf_iterator<char>(f), {});
+  }
+
+  // The index is rebuilt from the checkpoint, if any.
+  std::string indexPath = directory + "/index";
+  indexMapSize_ = sizeof(IndexEntry) * capacity;
+  int fd = open(indexPath.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    throwErrno("failed to open", indexPath);
+  }
+  if (ftruncate(fd, 0) || ftruncate(fd, indexMapSize_)) {
+    close(fd);
+    throwErrno("failed to resize", indexPath);
+  }
+  void* map = mmap(
+      nullptr, indexMapSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throwErrno("failed to map", indexPath);
+  }
+  indexMap_ = (char*)map;
+  index_ = (IndexEntry*)indexMap_;
+
+  if (!checkpoint.empty()) {
+    readKeys();
+    readDictionaries();
+    restore(checkpoint);
+  }
+}
+
+std::string ReplayBuffer::segmentPath(uint64_t id) const {
+  return directory_ + "/segment-" + std::to_string(id);
+}
+
+std::shared_ptr<ReplayBuffer::Segment> ReplayBuffer::openSegment(
+    uint64_t id, bool create) {
+  std::string path = segmentPath(id);
+  int fd = open(
+      path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+  if (fd < 0) {
+    if (!create && errno == ENOENT) {
+      return nullptr;
+    }
+    throwErrno("failed to open", path);
+  }
+  struct stat st;
+  if (create ? ftruncate(fd, segmentBytes) : fstat(fd, &st)) {
+    close(fd);
+    throwErrno("failed to open", path);
+  }
+  size_t size = create ? segmentBytes : (size_t)st.st_size;
+  void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throwErrno("failed to map", path);
+  }
+  auto segment = std::make_shared<Segment>();
+  segment->owner = this;
+  segment->id = id;
+  segment->path = path;
+  segment->data = (char*)map;
+  segment->size = size;
+  segments_[id] = segment;
+  return segment;
+}
+
+void ReplayBuffer::releaseSegment(const Segment& segment) {
+  std::lock_guard l(releaseMutex_);
+  if (checkpointSegments_.count(segment.id)) {
+    releasedSegments_.push_back(segment.id);
+  } else {
+    unlink(segment.path.c_str());
+  }
+}
+
+int64_t ReplayBuffer::persist(BufferEntry* entries) {
+  size_t size = 0;
+  for (size_t i = 0; i != keys.size(); ++i) {
+    size += 2 * sizeof(uint64_t) + entries[i].data.size();
+  }
+  if (size > segmentBytes) {
+    throw std::runtime_error("replay buffer sample exceeds segment size");
+  }
+  std::lock_guard l(fileMutex_);
+  if (!activeSegment_ || activeOffset_ + size > activeSegment_->size) {
+    activeSegment_ = openSegment(nextSegment_++, true);
+    activeOffset_ = 0;
+  }
+  char* dst = activeSegment_->data + activeOffset_;
+  for (size_t i = 0; i != keys.size(); ++i) {
+    auto& e = entries[i];
+    uint64_t header[2] = {e.datasize, e.data.size()};
+    std::memcpy(dst, header, sizeof(header));
+    dst += sizeof(header);
+    std::memcpy(dst, e.data.data(), e.data.size());
+    e.segment = activeSegment_;
+    e.mapped = dst;
+    e.mappedSize = e.data.size();
+    dst += e.data.size();
+    std::vector<char>().swap(e.data);
+  }
+  int64_t seq = numAdd_;
+  index_[seq % capacity] = {
+      (uint64_t)seq + 1, activeSegment_->id, activeOffset_, size};
+  activeOffset_ += size;
+  ++numAdd_;
+  return seq;
+}
+
+void ReplayBuffer::restore(const std::vector<char>& checkpoint) {
+  CheckpointHeader header{};
+  size_t expectedSize = sizeof(header) + sizeof(IndexEntry) * capacity;
+  if (checkpoint.size() == expectedSize) {
+    std::memcpy(&header, checkpoint.data(), sizeof(header));
+  }
+  if (header.magic != fileMagic || header.capacity != (uint64_t)capacity) {
+    throw std::runtime_error("replay buffer checkpoint in " + directory_ +
+                             " does not match capacity " +
+                             std::to_string(capacity));
+  }
+  std::vector<IndexEntry> slots(capacity);
+  std::memcpy(slots.data(), checkpoint.data() + sizeof(header),
+              sizeof(IndexEntry) * capacity);
+  std::sort(slots.begin(), slots.end(),
+            [](const IndexEntry& a, const IndexEntry& b) {
+              return a.seq < b.seq;
+            });
+
+  auto read = [&](const Segment& segment, const IndexEntry& ie) {
+    if (ie.offset + ie.size > segment.size) {
+      return false;
+    }
+    const char* src = segment.data + ie.offset;
+    const char* end = src + ie.size;
+    for (size_t i = 0; i != keys.size(); ++i) {
+      size_t datasize = keys[i].dtype.itemsize();
+      for (int64_t v : keys[i].shape) {
+        datasize *= v;
+      }
+      uint64_t header[2];
+      if (end - src < (ptrdiff_t)sizeof(header)) {
+        return false;
+      }
+      std::memcpy(header, src, sizeof(header));
+      src += sizeof(header);
+      if (header[0] != datasize || header[1] > (uint64_t)(end - src) ||
+          !hasDictionary(i, ZSTD_getDictID_fromFrame(src, header[1]))) {
+        return false;
+      }
+      src += header[1];
+    }
+    return true;
+  };
+
+  // Samples keep their order but are renumbered from 0, leaving out any
+  // whose record is missing or damaged.
+  std::map<uint64_t, std::shared_ptr<Segment>> opened;
+  std::set<uint64_t> referenced;
+  int64_t n = 0;
+  size_t stepKey = keys.size();
+  for (size_t i = 0; i != keys.size(); ++i) {
+    if (sampling_.mode == "phase" && keys[i].name == "step") {
+      stepKey = i;
+    }
+  }
+  std::vector<float> step;
+  for (const IndexEntry& ie : slots) {
+    if (ie.seq == 0 || ie.segment >= header.nextSegment) {
+      continue;
+    }
+    auto it = opened.find(ie.segment);
+    if (it == opened.end()) {
+      it = opened.emplace(ie.segment, openSegment(ie.segment, false)).first;
+    }
+    const std::shared_ptr<Segment>& segment = it->second;
+    if (!segment || !read(*segment, ie)) {
+      continue;
+    }
+    auto* entries = new BufferEntry[keys.size()];
+    const char* src = segment->data + ie.offset;
+    for (size_t i = 0; i != keys.size(); ++i) {
+      uint64_t header[2];
+      std::memcpy(header, src, sizeof(header));
+      src += sizeof(header);
+      auto& e = entries[i];
+      e.datasize = header[0];
+      e.segment = segment;
+      e.mapped = src;
+      e.mappedSize = header[1];
+      src += header[1];
+    }
+    entries[0].seq = n;
+    buffer[n] = entries;
+    index_[n] = {(uint64_t)n + 1, ie.segment, ie.offset, ie.size};
+    if (stepKey != keys.size()) {
+      const auto& e = entries[stepKey];
+      step.resize(e.datasize / sizeof(float));
+      decompress(stepKey, e, step.data());
+      onAdd(n, step.at(0));
+    } else if (sampling_.mode != "uniform") {
+      onAdd(n, 0.0f);
+    }
+    referenced.insert(ie.segment);
+    ++n;
+  }
+  {
+    std::lock_guard l(releaseMutex_);
+    checkpointSegments_ = std::move(referenced);
+  }
+  opened.clear();
+  // Remove the segments of samples added after the checkpoint, and any
+  // left behind by a crash.
+  for (uint64_t id = 0;; ++id) {
+    auto it = segments_.find(id);
+    if (it != segments_.end() && !it->second.expired()) {
+      continue;
+    }
+    segments_.erase(id);
+    if (unlink(segmentPath(id).c_str()) && errno == ENOENT &&
+        id >= header.nextSegment) {
+      break;
+    }
+  }
+  nextSegment_ = header.nextSegment;
+  numAdd_ = n;
+  prevSampleNumAdd_ = n;
+  printf("replay buffer: restored %d samples from %s\n", (int)n,
+         directory_.c_str());
+}
+
+void ReplayBuffer::checkpoint() {
+  if (!index_) {
+    return;
+  }
+  std::lock_guard l(fileMutex_);
+  for (auto i = segments_.begin(); i != segments_.end();) {
+    auto segment = i->second.lock();
+    if (!segment) {
+      i = segments_.erase(i);
+      continue;
+    }
+    if (msync(segment->data, segment->size, MS_SYNC)) {
+      throwErrno("failed to sync", segment->path);
+    }
+    ++i;
+  }
+  CheckpointHeader header{fileMagic, (uint64_t)capacity, nextSegment_};
+  std::vector<char> data(sizeof(header) + indexMapSize_);
+  std::memcpy(data.data(), &header, sizeof(header));
+  std::memcpy(data.data() + sizeof(header), indexMap_, indexMapSize_);
+  writeFileAtomic(directory_, "checkpoint", data.data(), data.size());
+
+  std::set<uint64_t> referenced;
+  for (int slot = 0; slot != capacity; ++slot) {
+    if (index_[slot].seq) {
+      referenced.insert(index_[slot].segment);
+    }
+  }
+  std::lock_guard l2(releaseMutex_);
+  checkpointSegments_ = std::move(referenced);
+  auto i = std::remove_if(
+      releasedSegments_.begin(), releasedSegments_.end(), [&](uint64_t id) {
+        if (checkpointSegments_.count(id)) {
+          return false;
+        }
+        unlink(segmentPath(id).c_str());
+        return true;
+      });
+  releasedSegments_.erase(i, releasedSegments_.end());
+}
+
+void ReplayBuffer::writeKeys() {
+  std::ostringstream ss;
+  for (const auto& [name, shape, dtype] : keys) {
+    ss << name << " " << (int)c10::typeMetaToScalarType(dtype) << " "
+       << shape.size();
+    for (int64_t v : shape) {
+      ss << " " << v;
+    }
+    ss << "\n";
+  }
+  std::string str = ss.str();
+  writeFileAtomic(directory_, "keys", str.data(), str.size());
+}
+
+void ReplayBuffer::readKeys() {
+  std::ifstream f(directory_ + "/keys");
+  std::string name;
+  int dtype;
+  size_t ndim;
+  while (f >> name >> dtype >> ndim) {
+    std::vector<int64_t> shape(ndim);
+    for (auto& v : shape) {
+      f >> v;
+    }
+    keys.push_back(
+        {name, shape, c10::scalarTypeToTypeMeta((c10::ScalarType)dtype)});
+  }
+  if (keys.empty()) {
+    throw std::runtime_error(
+        "replay buffer: no keys in " + directory_ + "/keys");
+  }
+  hasKeys = true;
+}
+
+void ReplayBuffer::writeDictionaries() {
+  // For each key, the size of its dictionary, 0 if none, and its data.
+  std::vector<char> data;
+  for (size_t i = 0; i != keys.size(); ++i) {
+    uint64_t size = dictionaries_[i] ? dictionaries_[i]->data.size() : 0;
+    data.insert(data.end(), (const char*)&size, (const char*)(&size + 1));
+    if (size) {
+      const auto& d = dictionaries_[i]->data;
+      data.insert(data.end(), d.begin(), d.end());
+    }
+  }
+  writeFileAtomic(directory_, "dictionaries", data.data(), data.size());
+}
+
+void ReplayBuffer::readDictionaries() {
+  std::ifstream f(directory_ + "/dictionaries", std::ios::binary);
+  if (!f) {
+    return;
+  }
+  dictionaries_.resize(keys.size());
+  for (size_t i = 0; i != keys.size(); ++i) {
+    uint64_t size = 0;
+    if (!f.read((char*)&size, sizeof(size))) {
+      throw std::runtime_error(
+          "replay buffer: truncated " + directory_ + "/dictionaries");
+    }
+    if (size) {
+      std::vector<char> d(size);
+      if (!f.read(d.data(), size)) {
+        throw std::runtime_error(
+            "replay buffer: truncated " + directory_ + "/dictionaries");
+      }
+      dictionaries_[i] = std::make_unique<Dictionary>(std::move(d));
+    }
+  }
+  hasDictionaries_ = true;
 }
 
 void ReplayBuffer::add(std::unordered_map<std::string, at::Tensor> input) {
@@ -73,6 +537,9 @@ void ReplayBuffer::add(std::unordered_map<std::string, at::Tensor> input) {
         keys.push_back({v.first, std::vector<int64_t>(x.begin(), x.end()),
                         v.second.dtype()});
       }
+      if (index_) {
+        writeKeys();
+      }
       hasKeys = true;
 
       for (auto& vx : input) {
@@ -86,7 +553,13 @@ void ReplayBuffer::add(std::unordered_map<std::string, at::Tensor> input) {
 
   auto n = input.begin()->second.size(0);
 
-  cctx ctx;
+  bool collect = dictionarySamples_ > 0 && !hasDictionaries_;
+  std::vector<torch::Tensor> sample;
+
+  bool phases = sampling_.mode == "phase";
+  if (phases && !input.count("step")) {
+    throw std::runtime_error("phase sampling needs a \"step\" key");
+  }
 
   for (int i = 0; i != n; ++i) {
     if (input.size() != keys.size()) {
@@ -95,6 +568,8 @@ void ReplayBuffer::add(std::unordered_map<std::string, at::Tensor> input) {
     BufferEntry* newEntry = new BufferEntry[input.size()];
 
     size_t index = 0;
+    float step = 0.0f;
+    sample.clear();
     for (const auto& [key, shape, dtype] : keys) {
       auto t = input.at(key)[i];
 
@@ -105,23 +580,288 @@ void ReplayBuffer::add(std::unordered_map<std::string, at::Tensor> input) {
       void* data = t.data_ptr();
       size_t datasize = dtype.itemsize() * t.numel();
 
-      tmpbuf.resize(sizeof(size_t) + ZSTD_compressBound(datasize));
-      auto n = ZSTD_compressCCtx(
-          ctx.ctx, tmpbuf.data(), tmpbuf.size(), data, datasize, 0);
-      if (ZSTD_isError(n)) {
-        throw std::runtime_error("replay buffer compress failed");
+      if (phases && key == "step") {
+        step = t.flatten()[0].item<float>();
+      }
+
+      if (collect) {
+        sample.push_back(t);
       }
 
+      tmpbuf.resize(ZSTD_compressBound(datasize));
+      auto n = compress(index, data, datasize, tmpbuf.data());
+      rawBytes_ += datasize;
+      compressedBytes_ += n;
+
       auto& e = newEntry[index++];
       e.datasize = datasize;
       e.data.assign(tmpbuf.begin(), tmpbuf.begin() + n);
     }
+    if (collect) {
+      collectTrainingSample(sample);
+    }
 
-    auto slot = numAdd_++ % capacity;
-    auto* prev = buffer[slot].exchange(newEntry);
+    int64_t seq = index_ ? persist(newEntry) : numAdd_++;
+    newEntry[0].seq = seq;
+    auto* prev = buffer[seq % capacity].exchange(newEntry);
     if (prev) {
       delete[] prev;
     }
+    if (sampling_.mode != "uniform") {
+      onAdd(seq, step);
+    }
+  }
+}
+
+void ReplayBuffer::setDictionaries(int trainingSamples, int dictionarySize) {
+  if (numAdd_ != 0 || index_) {
+    throw std::runtime_error(
+        "replay buffer dictionaries must be set before attaching or adding");
+  }
+  if (trainingSamples < 0 || (trainingSamples && dictionarySize <= 0)) {
+    throw std::runtime_error("invalid replay buffer dictionary size");
+  }
+  dictionarySamples_ = trainingSamples;
+  dictionarySize_ = dictionarySize;
+}
+
+void ReplayBuffer::collectTrainingSample(
+    const std::vector<torch::Tensor>& data) {
+  std::unique_lock l(dictionaryMutex_);
+  if (numTrainingSamples_ == dictionarySamples_) {
+    return;
+  }
+  trainingData_.resize(data.size());
+  trainingSizes_.resize(data.size());
+  for (size_t i = 0; i != data.size(); ++i) {
+    const char* src = (const char*)data[i].data_ptr();
+    size_t size = data[i].dtype().itemsize() * data[i].numel();
+    trainingData_[i].insert(trainingData_[i].end(), src, src + size);
+    trainingSizes_[i].push_back(size);
+  }
+  if (++numTrainingSamples_ == dictionarySamples_) {
+    // Other threads go on without dictionaries in the meantime.
+    auto trainingData = std::move(trainingData_);
+    auto trainingSizes = std::move(trainingSizes_);
+    l.unlock();
+    trainDictionaries(std::move(trainingData), std::move(trainingSizes));
+  }
+}
+
+void ReplayBuffer::trainDictionaries(std::vector<std::vector<char>> data,
+                                     std::vector<std::vector<size_t>> sizes) {
+  auto begin = std::chrono::steady_clock::now();
+  dictionaries_.resize(keys.size());
+  for (size_t i = 0; i != keys.size(); ++i) {
+    std::vector<char> dictionary(dictionarySize_);
+    size_t n = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(),
+                                     data[i].data(), sizes[i].data(),
+                                     (unsigned)sizes[i].size());
+    // Keys too small or too random to train on keep plain compression.
+    if (ZDICT_isError(n)) {
+      printf("replay buffer: no dictionary for key '%s': %s\n",
+             keys[i].name.c_str(), ZDICT_getErrorName(n));
+      continue;
+    }
+    dictionary.resize(n);
+    dictionaries_[i] = std::make_unique<Dictionary>(std::move(dictionary));
+  }
+  if (index_) {
+    writeDictionaries();
+  }
+  hasDictionaries_ = true;
+  printf("replay buffer: trained dictionaries on %d samples in %gs\n",
+         dictionarySamples_,
+         std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       begin)
+             .count());
+}
+
+size_t ReplayBuffer::compress(size_t key,
+                              const void* src,
+                              size_t size,
+                              char* dst) {
+  // Each adding thread keeps its compression context.
+  thread_local cctx ctx;
+  const Dictionary* dictionary =
+      hasDictionaries_ ? dictionaries_[key].get() : nullptr;
+  size_t bound = ZSTD_compressBound(size);
+  size_t n = dictionary ? ZSTD_compress_usingCDict(ctx.ctx, dst, bound, src,
+                                                   size, dictionary->cdict)
+                        : ZSTD_compressCCtx(ctx.ctx, dst, bound, src, size, 0);
+  if (ZSTD_isError(n)) {
+    throw std::runtime_error("replay buffer compress failed");
+  }
+  return n;
+}
+
+void ReplayBuffer::decompress(size_t key, const BufferEntry& e, void* dst) {
+  // Each sampling thread keeps its decompression context.
+  thread_local dctx ctx;
+  const char* src = e.compressedData();
+  size_t size = e.compressedSize();
+  unsigned id = ZSTD_getDictID_fromFrame(src, size);
+  size_t n;
+  if (id) {
+    if (!hasDictionary(key, id)) {
+      throw std::runtime_error("replay buffer sample needs a missing "
+                               "dictionary");
+    }
+    n = ZSTD_decompress_usingDDict(
+        ctx.ctx, dst, e.datasize, src, size, dictionaries_[key]->ddict);
+  } else {
+    n = ZSTD_decompressDCtx(ctx.ctx, dst, e.datasize, src, size);
+  }
+  if (ZSTD_isError(n)) {
+    throw std::runtime_error("replay buffer decompress failed");
+  }
+}
+
+bool ReplayBuffer::hasDictionary(size_t key, unsigned id) const {
+  if (id == 0) {
+    return true;
+  }
+  return hasDictionaries_ && key < dictionaries_.size() &&
+         dictionaries_[key] && dictionaries_[key]->id == id;
+}
+
+void ReplayBuffer::setSampling(SamplingOptions options) {
+  if (numAdd_ != 0 || index_) {
+    throw std::runtime_error(
+        "replay buffer sampling must be set before attaching or adding");
+  }
+  const auto& mode = options.mode;
+  if (mode != "uniform" && mode != "prioritized" && mode != "recent" &&
+      mode != "phase") {
+    throw std::runtime_error("unknown replay buffer sampling '" + mode + "'");
+  }
+  if (mode == "phase" && (options.numPhases < 1 || options.phaseSteps < 1)) {
+    throw std::runtime_error("phase sampling needs positive phase sizes");
+  }
+  std::lock_guard l(sampleMutex);
+  sampling_ = std::move(options);
+  if (sampling_.mode == "prioritized") {
+    priorities_.resize(capacity);
+    slotSeq_.assign(capacity, -1);
+  } else if (sampling_.mode == "phase") {
+    strata_.assign(sampling_.numPhases, {});
+    slotStratum_.assign(capacity, -1);
+    slotStratumPos_.assign(capacity, 0);
+  }
+}
+
+void ReplayBuffer::onAdd(int64_t seq, float step) {
+  std::lock_guard l(sampleMutex);
+  size_t slot = seq % capacity;
+  if (sampling_.mode == "prioritized") {
+    slotSeq_[slot] = seq;
+    priorities_.set(slot, maxPriority_);
+  } else if (sampling_.mode == "phase") {
+    int stratum = std::clamp(
+        (int)(step / sampling_.phaseSteps), 0, sampling_.numPhases - 1);
+    int& current = slotStratum_[slot];
+    if (current == stratum) {
+      return;
+    }
+    if (current >= 0) {
+      auto& slots = strata_[current];
+      size_t pos = slotStratumPos_[slot];
+      slots[pos] = slots.back();
+      slotStratumPos_[slots[pos]] = pos;
+      slots.pop_back();
+    }
+    slotStratumPos_[slot] = strata_[stratum].size();
+    strata_[stratum].push_back(slot);
+    current = stratum;
+  }
+}
+
+void ReplayBuffer::updatePriorities(torch::Tensor indices,
+                                    torch::Tensor priorities) {
+  indices = indices.to(torch::kInt64).contiguous();
+  priorities = priorities.to(torch::kFloat32).contiguous();
+  if (indices.numel() != priorities.numel()) {
+    throw std::runtime_error("replay buffer priorities size mismatch");
+  }
+  const int64_t* seqs = indices.data_ptr<int64_t>();
+  const float* values = priorities.data_ptr<float>();
+  std::lock_guard l(sampleMutex);
+  if (sampling_.mode != "prioritized") {
+    return;
+  }
+  for (int64_t i = 0; i != indices.numel(); ++i) {
+    if (seqs[i] < 0 || slotSeq_[seqs[i] % capacity] != seqs[i]) {
+      continue;
+    }
+    double p = std::pow(std::abs(values[i]) + 1e-6, sampling_.priorityAlpha);
+    priorities_.set(seqs[i] % capacity, p);
+    maxPriority_ = std::max(maxPriority_, p);
+  }
+}
+
+void ReplayBuffer::drawSlots(size_t n,
+                             int size,
+                             std::vector<size_t>& slots,
+                             std::vector<double>& probs) {
+  const auto& mode = sampling_.mode;
+  if (mode == "prioritized" && priorities_.total() > 0.0) {
+    // One draw from each of n equal ranges of the priority mass.
+    double total = priorities_.total();
+    double range = total / n;
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    for (size_t i = 0; i != n; ++i) {
+      size_t slot = priorities_.find((i + u(rng_)) * range);
+      slots.push_back(slot);
+      probs.push_back(priorities_.get(slot) / total);
+    }
+    return;
+  }
+  if (mode == "recent") {
+    int64_t window = sampling_.recencyWindow > 0
+                         ? std::min(sampling_.recencyWindow, size)
+                         : size;
+    int64_t newest = numAdd_ - 1;
+    std::uniform_int_distribution<int64_t> age(0, window - 1);
+    for (size_t i = 0; i != n; ++i) {
+      slots.push_back((newest - age(rng_)) % capacity);
+      probs.push_back(1.0 / window);
+    }
+    return;
+  }
+  if (mode == "phase") {
+    std::vector<const std::vector<size_t>*> strata;
+    for (const auto& v : strata_) {
+      if (!v.empty()) {
+        strata.push_back(&v);
+      }
+    }
+    if (!strata.empty()) {
+      // The strata take turns, from a random one.
+      size_t first = std::uniform_int_distribution<size_t>(
+          0, strata.size() - 1)(rng_);
+      for (size_t i = 0; i != n; ++i) {
+        const auto& stratum = *strata[(first + i) % strata.size()];
+        slots.push_back(stratum[std::uniform_int_distribution<size_t>(
+            0, stratum.size() - 1)(rng_)]);
+        probs.push_back(1.0 / (strata.size() * stratum.size()));
+      }
+      return;
+    }
+  }
+  for (size_t i = 0; i != n; ++i) {
+    if (sampleOrderIndex >= sampleOrder.size()) {
+      size_t p = sampleOrder.size();
+      if (p != (size_t)capacity) {
+        sampleOrder.resize(size);
+        for (size_t i = p; i != sampleOrder.size(); ++i) {
+          sampleOrder[i] = i;
+        }
+      }
+      std::shuffle(sampleOrder.begin(), sampleOrder.end(), rng_);
+      sampleOrderIndex = 0;
+    }
+    slots.push_back(sampleOrder.at(sampleOrderIndex++));
+    probs.push_back(1.0 / size);
   }
 }
 
@@ -131,19 +871,15 @@ std::unordered_map<std::string, at::Tensor> ReplayBuffer::sampleImpl(
     return {};
   }
   int siz = size();
-  std::unordered_map<std::string, torch::Tensor> r;
+  std::unordered_map<std::string, torch::Tensor> r = allocateBatch(sampleSize);
   std::vector<char*> pointers;
   for (auto& [k, shape, dtype] : keys) {
-    std::vector<int64_t> sizes;
-    sizes.assign(shape.begin(), shape.end());
-    sizes.insert(sizes.begin(), sampleSize);
-    auto tensor = torch::empty(sizes, dtype);
-    pointers.push_back((char*)tensor.data_ptr());
-    r[k] = tensor;
+    pointers.push_back((char*)r.at(k).data_ptr());
   }
-  dctx ctx;
   size_t nCopies = 0;
-  auto copy = [&](size_t srcIndex) {
+  std::vector<int64_t> seqs;
+  std::vector<double> probs;
+  auto copy = [&](size_t srcIndex, double prob) {
     auto src = buffer[srcIndex].exchange(nullptr);
     if (!src) {
       return 0;
@@ -153,14 +889,11 @@ std::unordered_map<std::string, at::Tensor> ReplayBuffer::sampleImpl(
           "replay buffer internal error: copied too many samples");
     }
     ++nCopies;
+    seqs.push_back(src[0].seq);
+    probs.push_back(prob);
     for (size_t i = 0; i != keys.size(); ++i) {
-      size_t datasize = src[i].datasize;
-      auto n = ZSTD_decompressDCtx(ctx.ctx, pointers[i], datasize,
-                                   src[i].data.data(), src[i].data.size());
-      if (ZSTD_isError(n)) {
-        throw std::runtime_error("replay buffer decompress failed");
-      }
-      pointers[i] += datasize;
+      decompress(i, src[i], pointers[i]);
+      pointers[i] += src[i].datasize;
     }
     BufferEntry* nullref = nullptr;
     if (!buffer[srcIndex].compare_exchange_strong(nullref, src)) {
@@ -175,63 +908,124 @@ std::unordered_map<std::string, at::Tensor> ReplayBuffer::sampleImpl(
   //    }
   prevSampleNumAdd_ += seq;
   std::vector<size_t> indices;
+  std::vector<double> indexProbs;
   while (i != sampleSize) {
     indices.clear();
+    indexProbs.clear();
     std::unique_lock l(sampleMutex);
-    for (size_t ii = i; ii != (size_t)sampleSize;) {
-      if (sampleOrderIndex >= sampleOrder.size()) {
-        size_t p = sampleOrder.size();
-        if (p != (size_t)capacity) {
-          sampleOrder.resize(siz);
-          for (size_t i = p; i != sampleOrder.size(); ++i) {
-            sampleOrder[i] = i;
-          }
-        }
-        std::shuffle(sampleOrder.begin(), sampleOrder.end(), rng_);
-        sampleOrderIndex = 0;
-      }
-      indices.push_back(sampleOrder.at(sampleOrderIndex++));
-      ++ii;
-    }
+    drawSlots(sampleSize - i, siz, indices, indexProbs);
     l.unlock();
-    for (size_t index : indices) {
-      i += copy(index);
+    for (size_t k = 0; k != indices.size(); ++k) {
+      i += copy(indices[k], indexProbs[k]);
     }
   }
+  if (sampling_.mode == "prioritized") {
+    auto index = torch::empty({sampleSize}, torch::kInt64);
+    auto weight = torch::empty({sampleSize}, torch::kFloat32);
+    int64_t* indexData = index.data_ptr<int64_t>();
+    float* weightData = weight.data_ptr<float>();
+    double maxWeight = 0.0;
+    for (int k = 0; k != sampleSize; ++k) {
+      indexData[k] = seqs[k];
+      weightData[k] = std::pow(siz * probs[k], -sampling_.priorityBeta);
+      maxWeight = std::max(maxWeight, (double)weightData[k]);
+    }
+    for (int k = 0; k != sampleSize; ++k) {
+      weightData[k] /= maxWeight;
+    }
+    r["replay_index"] = index;
+    r["replay_weight"] = weight;
+  }
   numSample_ += sampleSize;
   return r;
 }
 
-std::unordered_map<std::string, at::Tensor> ReplayBuffer::sample(
+std::unordered_map<std::string, torch::Tensor> ReplayBuffer::allocateBatch(
     int sampleSize) {
-  // return sampleImpl(sampleSize);
+  std::lock_guard l(poolMutex_);
+  for (auto& batch : pool_) {
+    bool isFree = true;
+    for (auto& [k, tensor] : batch) {
+      // Copies of the returned tensors share their TensorImpl with the pool,
+      // and views share the storage: the batch is free when the pool holds
+      // the only reference to both.
+      if (tensor.size(0) != sampleSize || tensor.use_count() != 1 ||
+          tensor.storage().use_count() != 1) {
+        isFree = false;
+        break;
+      }
+    }
+    if (isFree) {
+      return batch;
+    }
+  }
+  std::unordered_map<std::string, torch::Tensor> batch;
+  for (auto& [k, shape, dtype] : keys) {
+    std::vector<int64_t> sizes;
+    sizes.assign(shape.begin(), shape.end());
+    sizes.insert(sizes.begin(), sampleSize);
+    batch[k] = torch::empty(
+        sizes, torch::TensorOptions().dtype(dtype).pinned_memory(pinMemory_));
+  }
+  // Enough for the queued batches, those being filled and those held by the
+  // consumer; beyond that, batches are left to the allocator.
+  if ((int)pool_.size() < prefetchDepth_ + prefetchThreads_ + 2) {
+    pool_.push_back(batch);
+  }
+  return batch;
+}
+
+void ReplayBuffer::setPrefetch(int numThreads, int depth, bool pinMemory) {
+  std::unique_lock l(mut);
+  if (!sampleThreads.empty()) {
+    throw std::runtime_error(
+        "replay buffer prefetch must be set before sampling");
+  }
+  if (numThreads < 0 || depth < 1) {
+    throw std::runtime_error("invalid replay buffer prefetch configuration");
+  }
+  prefetchThreads_ = numThreads;
+  prefetchDepth_ = depth;
+  pinMemory_ = pinMemory;
+}
 
-  // TODO
-  // This code currently prefetches 8 samples for efficent sampling when
-  // training on 8 gpus. This should be made configurable or training
-  // should be made efficient without requiring prefetch
+std::unordered_map<std::string, at::Tensor> ReplayBuffer::sample(
+    int sampleSize) {
   std::unique_lock l(mut);
+  if (prefetchThreads_ == 0) {
+    l.unlock();
+    return sampleImpl(sampleSize);
+  }
   if (sampleThreads.empty()) {
-    for (int i = 0; i != 8; ++i) {
+    for (int i = 0; i != prefetchThreads_; ++i) {
       sampleThreads.emplace_back([this]() {
         std::unique_lock l(mut);
         while (true) {
-          while (results.size() >= 8 || resultsSampleSize == 0) {
+          while (!sampleThreadDie &&
+                 ((int)results.size() >= prefetchDepth_ ||
+                  resultsSampleSize == 0)) {
             cv.wait(l);
-            if (sampleThreadDie) {
-              return;
-            }
           }
+          if (sampleThreadDie) {
+            return;
+          }
+          int sampleSize = resultsSampleSize;
           l.unlock();
-          auto tmp = sampleImpl(resultsSampleSize);
+          auto tmp = sampleImpl(sampleSize);
           l.lock();
-          results.push_back(std::move(tmp));
-          cv2.notify_all();
+          // Batches of a previous size are dropped.
+          if (sampleSize == resultsSampleSize) {
+            results.push_back(std::move(tmp));
+            cv2.notify_all();
+          }
         }
       });
     }
   }
-  resultsSampleSize = sampleSize;
+  if (sampleSize != resultsSampleSize) {
+    results.clear();
+    resultsSampleSize = sampleSize;
+  }
   while (results.empty()) {
     cv.notify_all();
     cv2.wait(l);
@@ -7,8 +7,11 @@
 
 #pragma once
 
+#include <map>
+#include <memory>
 #include <mutex>
 #include <random>
+#include <set>
 #include <string>
 #include <torch/torch.h>
 #include <unordered_map>
@@ -16,8 +19,72 @@
 
 namespace core {
 
+// Partial sums over a fixed number of non-negative leaf values, to draw
+// leaves in proportion to their values in O(log n).
+class SumTree {
+ public:
+  void resize(size_t n) {
+    size_ = 1;
+    while (size_ < n) {
+      size_ *= 2;
+    }
+    nodes_.assign(2 * size_, 0.0);
+  }
+
+  void set(size_t i, double value) {
+    i += size_;
+    nodes_[i] = value;
+    for (i /= 2; i; i /= 2) {
+      nodes_[i] = nodes_[2 * i] + nodes_[2 * i + 1];
+    }
+  }
+
+  double get(size_t i) const {
+    return nodes_[size_ + i];
+  }
+
+  double total() const {
+    return nodes_[1];
+  }
+
+  // The leaf whose range of prefix sums holds u, for 0 <= u < total().
+  size_t find(double u) const {
+    size_t i = 1;
+    while (i < size_) {
+      // Rounding may leave u past the last non-zero leaf; stay left then.
+      if (u < nodes_[2 * i] || nodes_[2 * i + 1] <= 0.0) {
+        i = 2 * i;
+      } else {
+        u -= nodes_[2 * i];
+        i = 2 * i + 1;
+      }
+    }
+    return i - size_;
+  }
+
+ private:
+  size_t size_ = 0;
+  std::vector<double> nodes_;
+};
+
 class ReplayBuffer {
  public:
+  struct SamplingOptions {
+    // "uniform" draws without replacement from a shuffled order of the
+    // slots, "prioritized" in proportion to priority^priorityAlpha,
+    // "recent" uniformly from the newest recencyWindow samples and "phase"
+    // equally from numPhases strata of phaseSteps moves, the last one
+    // open-ended.
+    std::string mode = "uniform";
+    float priorityAlpha = 0.6f;
+    // Prioritized samples come with importance weights
+    // (size * P(i))^-priorityBeta, divided by their maximum in the batch.
+    float priorityBeta = 0.4f;
+    int recencyWindow = 0;
+    int numPhases = 4;
+    int phaseSteps = 10;
+  };
+
   ReplayBuffer(int capacity, int seed);
   ~ReplayBuffer();
 
@@ -28,6 +95,35 @@ class ReplayBuffer {
    */
   void add(std::unordered_map<std::string, torch::Tensor> input);
 
+  /*
+   * keeps the samples in an append-only log of segment files under
+   * directory, indexed by a memory-mapped file, instead of in RAM
+   * restores the samples of the last checkpoint if directory holds one
+   * must be called before the first add
+   */
+  void attach(const std::string& directory);
+
+  /*
+   * makes the samples added so far durable: after a crash or restart,
+   * attach restores them
+   * does nothing unless attached
+   */
+  void checkpoint();
+
+  /*
+   * selects how samples are drawn; must be called before attach and add
+   * prioritized batches have two more keys: "replay_index", the sample
+   * numbers to pass to updatePriorities, and "replay_weight"
+   * phase sampling reads the move number from the "step" key
+   */
+  void setSampling(SamplingOptions options);
+
+  /*
+   * sets the priorities of prioritized samples, by their replay_index
+   * samples overwritten since they were drawn are skipped
+   */
+  void updatePriorities(torch::Tensor indices, torch::Tensor priorities);
+
   template <typename T> static std::string ss(T&& sizes) {
     std::string r = "[";
     for (int64_t v : sizes) {
@@ -38,8 +134,36 @@ class ReplayBuffer {
     return r + "]";
   }
 
+  /*
+   * once trainingSamples samples have been added, trains a zstd dictionary
+   * of up to dictionarySize bytes for each key on them, and compresses the
+   * samples added after with it; 0 trainingSamples disables dictionaries
+   * must be called before attach and add
+   */
+  void setDictionaries(int trainingSamples, int dictionarySize);
+
+  /*
+   * raw over compressed size of the samples added so far
+   */
+  double compressionRatio() const {
+    uint64_t compressed = compressedBytes_;
+    return compressed ? (double)rawBytes_ / compressed : 0.0;
+  }
+
+  /*
+   * configures the prefetching of sample: numThreads threads keep up to
+   * depth batches ready; numThreads 0 samples on the calling thread
+   * with pinMemory, batches are collated into page-locked memory, ready for
+   * non_blocking copies to the GPU
+   * must be called before the first sample
+   */
+  void setPrefetch(int numThreads, int depth, bool pinMemory);
+
   /*
    * sample sampleSize elements from the replayBuffer
+   * the returned tensors come from a pool and are reused once all
+   * references to them are dropped; a caller copying them asynchronously
+   * must hold on to them until the copy is complete
    */
   std::unordered_map<std::string, torch::Tensor> sampleImpl(int sampleSize);
 
@@ -79,16 +203,130 @@ class ReplayBuffer {
     caffe2::TypeMeta dtype;
   };
 
+  struct Segment;
+  struct Dictionary;
+
   struct BufferEntry {
     size_t datasize;
     std::vector<char> data;
+    // Entries of an attached buffer point into a mapped segment instead.
+    std::shared_ptr<Segment> segment;
+    const char* mapped = nullptr;
+    size_t mappedSize = 0;
+    // Sequence number of the sample, in the first entry.
+    int64_t seq = 0;
+
+    const char* compressedData() const {
+      return segment ? mapped : data.data();
+    }
+    size_t compressedSize() const {
+      return segment ? mappedSize : data.size();
+    }
   };
 
+  // Slot of the index of an attached buffer: where the record of sample
+  // seq - 1 (0 when empty) is.
+  struct IndexEntry {
+    uint64_t seq;
+    uint64_t segment;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  std::string segmentPath(uint64_t id) const;
+  std::shared_ptr<Segment> openSegment(uint64_t id, bool create);
+  // Called as the last entry of a segment goes away.
+  void releaseSegment(const Segment& segment);
+  // Appends the compressed data of a sample to the active segment, points
+  // the entries at it and indexes it; returns its sequence number.
+  int64_t persist(BufferEntry* entries);
+  void restore(const std::vector<char>& checkpoint);
+  void writeKeys();
+  void readKeys();
+  void writeDictionaries();
+  void readDictionaries();
+
+  // Keeps the data of the first samples until there are enough to train
+  // the dictionaries.
+  void collectTrainingSample(const std::vector<torch::Tensor>& data);
+  void trainDictionaries(std::vector<std::vector<char>> data,
+                         std::vector<std::vector<size_t>> sizes);
+  // Compresses size bytes of key to dst, of ZSTD_compressBound(size) bytes,
+  // with its dictionary if trained; returns the compressed size.
+  size_t compress(size_t key, const void* src, size_t size, char* dst);
+  // Decompresses entry e of key to dst, with the dictionary named in its
+  // frame if any.
+  void decompress(size_t key, const BufferEntry& e, void* dst);
+  // Whether the frames of key compressed with dictionary id can be read.
+  bool hasDictionary(size_t key, unsigned id) const;
+
+  // Output tensors of sampleImpl for sampleSize samples, from the pool if a
+  // batch of that size is no longer referenced, neither by a tensor returned
+  // from sample() nor by a view of one.
+  std::unordered_map<std::string, torch::Tensor> allocateBatch(
+      int sampleSize);
+
+  // Records a new sample with the sampling structures.
+  void onAdd(int64_t seq, float step);
+  // Draws n slots to copy; probs gets their probability of being drawn.
+  void drawSlots(size_t n,
+                 int size,
+                 std::vector<size_t>& slots,
+                 std::vector<double>& probs);
+
+  // Set on destruction, so that dropping the last entries of a segment
+  // does not delete its file.
+  std::atomic_bool closing_ = false;
+
   std::vector<std::atomic<BufferEntry*>> buffer;
 
+  std::string directory_;
+  std::mutex fileMutex_;
+  char* indexMap_ = nullptr;
+  size_t indexMapSize_ = 0;
+  IndexEntry* index_ = nullptr;
+  std::shared_ptr<Segment> activeSegment_;
+  size_t activeOffset_ = 0;
+  uint64_t nextSegment_ = 0;
+  // Segments with live entries, to sync on checkpoint.
+  std::map<uint64_t, std::weak_ptr<Segment>> segments_;
+  // Segments the last checkpoint refers to; their files outlive their
+  // entries until the next checkpoint.
+  std::mutex releaseMutex_;
+  std::set<uint64_t> checkpointSegments_;
+  std::vector<uint64_t> releasedSegments_;
+
   size_t sampleOrderIndex = 0;
   std::vector<size_t> sampleOrder;
 
+  // Sampling structures, guarded by sampleMutex.
+  SamplingOptions sampling_;
+  SumTree priorities_;
+  std::vector<int64_t> slotSeq_;
+  double maxPriority_ = 1.0;
+  std::vector<std::vector<size_t>> strata_;
+  std::vector<int> slotStratum_;
+  std::vector<size_t> slotStratumPos_;
+
+  int prefetchThreads_ = 8;
+  int prefetchDepth_ = 8;
+  bool pinMemory_ = false;
+  std::mutex poolMutex_;
+  std::vector<std::unordered_map<std::string, torch::Tensor>> pool_;
+
+  int dictionarySamples_ = 0;
+  int dictionarySize_ = 0;
+  std::mutex dictionaryMutex_;
+  // Raw data of the first samples, concatenated per key, and their sizes.
+  std::vector<std::vector<char>> trainingData_;
+  std::vector<std::vector<size_t>> trainingSizes_;
+  int numTrainingSamples_ = 0;
+  // Per key, null where training failed; set once, before hasDictionaries_.
+  std::vector<std::unique_ptr<Dictionary>> dictionaries_;
+  std::atomic<bool> hasDictionaries_ = false;
+  std::atomic_uint64_t rawBytes_ = 0;
+  std::atomic_uint64_t compressedBytes_ = 0;
+
   std::vector<Key> keys;
   std::mutex keyMutex;
   std::atomic<bool> hasKeys = false;
@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace core {
+
+// Bounded table of T keyed by position hashes, shared by concurrent threads.
+// Entries are spread over independently locked shards, and a new entry
+// always replaces whatever occupied its slot. Each entry is also tagged with
+// a version chosen by the caller, typically that of the model which computed
+// it, and only lookups for that same version see it.
+template <typename T> class ShardedCache {
+ public:
+  ShardedCache(size_t size)
+      : size_(size)
+      , shards_(numShards) {
+    size_t perShard = std::max((size + numShards - 1) / numShards, size_t(1));
+    for (auto& v : shards_) {
+      v.entries.resize(perShard);
+    }
+  }
+  ShardedCache(const ShardedCache&) = delete;
+  ShardedCache& operator=(const ShardedCache&) = delete;
+
+  // If an entry is stored for hash and version, calls read(const T&) on it
+  // with its shard locked and returns the result, which tells whether the
+  // entry was used. read can so reject hash collisions.
+  template <typename Read>
+  bool lookup(uint64_t hash, uint64_t version, Read&& read) {
+    Shard& shard = shards_[hash % numShards];
+    std::lock_guard l(shard.mutex);
+    Entry& e = slot(shard, hash);
+    if (!e.used || e.hash != hash || e.version != version) {
+      return false;
+    }
+    return read(static_cast<const T&>(e.value));
+  }
+
+  // Stores an entry for hash and version, filled in by write(T&) with its
+  // shard locked.
+  template <typename Write>
+  void insert(uint64_t hash, uint64_t version, Write&& write) {
+    Shard& shard = shards_[hash % numShards];
+    std::lock_guard l(shard.mutex);
+    Entry& e = slot(shard, hash);
+    e.used = true;
+    e.hash = hash;
+    e.version = version;
+    write(e.value);
+  }
+
+  void clear() {
+    for (auto& v : shards_) {
+      std::lock_guard l(v.mutex);
+      for (auto& e : v.entries) {
+        e = Entry();
+      }
+    }
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  struct Entry {
+    // Every hash, including 0, is a valid key.
+    bool used = false;
+    uint64_t hash = 0;
+    uint64_t version = 0;
+    T value;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::vector<Entry> entries;
+  };
+
+  static constexpr size_t numShards = 64;
+
+  Entry& slot(Shard& shard, uint64_t hash) {
+    return shard.entries[(hash / numShards) % shard.entries.size()];
+  }
+
+  size_t size_;
+  std::vector<Shard> shards_;
+};
+
+}  // namespace core
@@ -115,36 +115,22 @@ void State::fillFullFeatures() {
       }
     }
 
-    _previousFeatures.resize(_features.size() * (_featopts->history + 1));
+    // The history starts as copies of the initial features.
     for (int i = 0; i != _featopts->history + 1; ++i) {
-      std::memcpy(_previousFeatures.data() + _features.size() * i,
+      std::memcpy(_fullFeatures.data() + _features.size() * i,
                   _features.data(), sizeof(float) * _features.size());
     }
   }
   if (_featopts->history > 0) {
     offset = 0;
-    // we check the expected size of features.
-    unsigned int expected_size =
-        (_featopts->history + 1) * _featSize[0] * _featSize[1] * _featSize[2];
-    if (_previousFeatures.size() != expected_size) {
-      throw std::runtime_error(
-          "internal error: previousFeatures is of incorrect size!");
-    }
-    std::memcpy(_previousFeatures.data() + _previousFeaturesOffset,
-                _features.data(), sizeof(float) * _features.size());
-
-    _previousFeaturesOffset += _features.size();
-    if (_previousFeaturesOffset == expected_size) {
-      _previousFeaturesOffset = 0;
-    }
-
-    // we add the previous features in the full features.
-    auto* dst = expand(expected_size);
-    std::memcpy(dst, _previousFeatures.data() + _previousFeaturesOffset,
-                sizeof(float) * (expected_size - _previousFeaturesOffset));
-    std::memcpy(dst + expected_size - _previousFeaturesOffset,
-                _previousFeatures.data(),
-                sizeof(float) * _previousFeaturesOffset);
+    // The first planes hold the features of the last history + 1 positions,
+    // oldest first: drop the oldest and append the current ones. They are
+    // kept nowhere else, so that copying a state copies them only once.
+    size_t historySize = _features.size() * _featopts->history;
+    auto* dst = expand(historySize + _features.size());
+    std::memmove(dst, dst + _features.size(), sizeof(float) * historySize);
+    std::memcpy(dst + historySize, _features.data(),
+                sizeof(float) * _features.size());
   } else {
     offset = 0;
     std::memcpy(expand(_features.size()), _features.data(),
@@ -22,6 +22,10 @@
 #include <string>
 #include <thread>
 
+// Check after every forward() that the incrementally maintained _hash matches
+// computeHash().
+//#define DEBUG_HASH
+
 namespace core {
 
 /*****
@@ -265,6 +269,13 @@ class State {
     ApplyAction(GetLegalActions().at(action));
     _moves.push_back(action);
     _moveRngs.emplace_back(_rng, forcedDice);
+#ifdef DEBUG_HASH
+    if (_hash != computeHash()) {
+      throw std::runtime_error("incremental hash " + std::to_string(_hash) +
+                               " does not match computeHash() " +
+                               std::to_string(computeHash()));
+    }
+#endif
   }
 
   // -----interface for games to implement-----
@@ -275,6 +286,12 @@ class State {
 
   virtual void ApplyAction(const _Action& action) = 0;
 
+  // Zobrist hash of the current position recomputed from scratch. ApplyAction
+  // updates _hash incrementally; this is the reference it is checked against.
+  virtual uint64_t computeHash() const {
+    return _hash;
+  }
+
   virtual void DoGoodAction() {
     DoRandomAction();
   }
@@ -570,6 +587,30 @@ class State {
     return _outFeatSize.empty() ? _featSize : _outFeatSize;
   }
 
+  // Whether every value of GetFeatures() is 0 or 1, so that the features
+  // can be stored and sent as bits; see getPackedFeatureInTensor. Geometric
+  // and random feature planes are not binary, nor is the single turn plane
+  // with more than two colors.
+  bool hasBinaryFeatures() const {
+    if (!_binaryFeatures) {
+      return false;
+    }
+    if (!_featopts) {
+      return true;
+    }
+    return !_featopts->geometricFeatures && _featopts->randomFeatures == 0 &&
+           (!_featopts->turnFeaturesSingleChannel || getNumPlayerColors() <= 2);
+  }
+
+  // Whether GetFeatures() depends on the current position alone, so that
+  // network outputs can be cached by getHash(). History planes also depend
+  // on the moves leading to the position, and random planes are left out
+  // as well. Games that add such planes of their own override this.
+  virtual bool hasPositionalFeatures() const {
+    return !_featopts ||
+           (_featopts->history == 0 && _featopts->randomFeatures == 0);
+  }
+
   int GetFeatureLength() const {
     auto featureSize = GetFeatureSize();
     return featureSize[0] * featureSize[1] * featureSize[2];
@@ -582,8 +623,6 @@ class State {
   void reset() {
     _moves.clear();
     _moveRngs.clear();
-    _previousFeatures.clear();
-    _previousFeaturesOffset = 0;
     _turnFeaturesSingleChannelOffset = 0;
     _turnFeaturesMultiChannelOffset = 0;
     _outFeatSize.clear();
@@ -617,6 +656,13 @@ class State {
     return false;
   }
 
+  // Whether ApplyAction maintains _hash, so that getHash() identifies the
+  // position. Any value is a valid hash, including 0 for the empty board of
+  // many games.
+  virtual bool hasHash() const {
+    return true;
+  }
+
   int forcedDice;
 
  protected:
@@ -627,6 +673,37 @@ class State {
   void addAction(int x, int y, int z) {
     _legalActions.emplace_back(_legalActions.size(), x, y, z);
   }
+  // Incremental updates of the legal actions, for games whose moves only
+  // change a few of them.  Both keep the order of the other actions, so the
+  // list stays identical to a full regeneration, and renumber the actions
+  // that moved.
+  void insertAction(size_t i, int x, int y, int z) {
+    _legalActions.emplace(_legalActions.begin() + i, i, x, y, z);
+    for (++i; i < _legalActions.size(); ++i) {
+      _legalActions[i].SetIndex(i);
+    }
+  }
+  void eraseAction(size_t i) {
+    _legalActions.erase(_legalActions.begin() + i);
+    for (; i < _legalActions.size(); ++i) {
+      _legalActions[i].SetIndex(i);
+    }
+  }
+  // Position of the first legal action not ordered before the one searched,
+  // according to less(action), for lists kept sorted by the game.
+  template <typename Less> size_t lowerBoundAction(Less less) const {
+    size_t lo = 0;
+    size_t hi = _legalActions.size();
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (less(_legalActions[mid])) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
 
   bool _stochastic;
   bool _stochasticReset;
@@ -640,6 +717,7 @@ class State {
   uint64_t _hash;
 
   std::vector<float> _features;  // neural network input
+  bool _binaryFeatures = false;  // whether _features only holds 0 and 1
   std::vector<_Action> _legalActions;
   std::vector<int64_t> _featSize;    // size of the neural network input
   std::vector<int64_t> _actionSize;  // size of the neural network output
@@ -652,9 +730,8 @@ class State {
   // Below the std::vector involved in the generic added features.
   // size of the neural network input if using _outFeature or _history > 0:
   std::vector<int64_t> _outFeatSize;
-  std::vector<float> _fullFeatures;      // neural network input, completed
-  std::vector<float> _previousFeatures;  // history of features
-  size_t _previousFeaturesOffset = 0;
+  // neural network input, completed, including the history of features
+  std::vector<float> _fullFeatures;
   size_t _turnFeaturesSingleChannelOffset = 0;
   size_t _turnFeaturesMultiChannelOffset = 0;
 };
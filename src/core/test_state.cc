@@ -49,11 +49,42 @@ float randEval(core::State& s) {
   return true;
 }
 
+void hashEval(core::State& s) {
+  // The incremental hash must match a full recomputation along random games.
+  for (int gameCount = 0; gameCount < 20; ++gameCount) {
+    s.reset();
+    while (!s.terminated()) {
+      if (s.getHash() != s.computeHash()) {
+        std::cout << s.stateDescription() << std::endl;
+        throw std::runtime_error("incremental hash differs from computeHash");
+      }
+      s.DoRandomAction();
+    }
+  }
+}
+
+// Same check after every move, terminal ones included, over more games: for
+// games where only rare move sequences reach the incremental update's corner
+// cases.
+void hashEvalEveryMove(core::State& s, int numGames) {
+  for (int gameCount = 0; gameCount < numGames; ++gameCount) {
+    s.reset();
+    while (!s.terminated()) {
+      s.DoRandomAction();
+      if (s.getHash() != s.computeHash()) {
+        std::cout << s.stateDescription() << std::endl;
+        throw std::runtime_error("incremental hash differs from computeHash");
+      }
+    }
+  }
+}
+
 int doSimpleTest(core::State& s) {
   // goodEval(s);
   // Test that everything is fine.
   // win_frequency = 0 or 1 in purely random play is weird.
   randEval(s);
+  hashEval(s);
 
   // Now testing if the game looks stochastic.
   bool isStochastic = false;
@@ -142,6 +173,8 @@ int main() {
   {
     std::cout << "testing: BlockGo" << std::endl;
     auto state = StateForBlockGo(seed);
+    // Opening pieces may be dropped over stones already on the board.
+    hashEvalEveryMove(state, 2000);
     doTest(state);
     std::cout << "test pass: BlockGo" << std::endl;
   }
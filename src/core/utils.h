@@ -7,6 +7,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <tuple>
+
 #include <torch/torch.h>
 
 #include "state.h"
@@ -52,6 +56,47 @@ inline torch::Tensor getRawFeatureInTensor(const State& state) {
   return t;
 }
 
+// Number of bytes of the features of getPackedFeatureInTensor.
+inline int64_t getPackedFeatureBytes(const State& state) {
+  return (state.GetFeatureLength() + 7) / 8;
+}
+
+// Packed form of getFeatureInTensor for states with binary features, for
+// training data: bit i % 8 of byte i / 8 is flat feature i, as in the mask of
+// getSparsePolicyInTensor.
+inline void getPackedFeatureInTensor(const State& state, torch::Tensor& dest) {
+  assert(dest.dtype() == torch::kUInt8);
+  const auto& feat = state.GetFeatures();
+  if (dest.numel() != (int64_t)(feat.size() + 7) / 8) {
+    throw std::runtime_error("getPackedFeatureInTensor size mismatch");
+  }
+  const float* src = feat.data();
+  uint8_t* bits = dest.data_ptr<uint8_t>();
+  size_t n = feat.size() / 8;
+  // Branch-free so that the compiler vectorizes it.
+  for (size_t i = 0; i != n; ++i, src += 8) {
+    uint8_t b = 0;
+    for (int j = 0; j != 8; ++j) {
+      b |= uint8_t(src[j] != 0.0f) << j;
+    }
+    bits[i] = b;
+  }
+  if (feat.size() % 8) {
+    uint8_t b = 0;
+    for (size_t j = 0; j != feat.size() % 8; ++j) {
+      b |= uint8_t(src[j] != 0.0f) << j;
+    }
+    bits[n] = b;
+  }
+}
+
+inline torch::Tensor getPackedFeatureInTensor(const State& state) {
+  torch::Tensor t =
+      torch::empty({getPackedFeatureBytes(state)}, torch::kUInt8);
+  getPackedFeatureInTensor(state, t);
+  return t;
+}
+
 inline void getPolicyMaskInTensor(
     const State& state, torch::TensorAccessor<float, 3> maskaccessor) {
   for (const auto& action : state.GetLegalActions()) {
@@ -107,6 +152,80 @@ inline std::pair<torch::Tensor, torch::Tensor> getPolicyInTensor(
   return std::make_pair(t, mask);
 }
 
+// Sparse form of getPolicyInTensor, for training data: the flat indices into
+// the action tensor and the probabilities of up to index.size(0) actions
+// with a non-zero policy, padded with -1 and 0, and the legal action mask
+// with one bit per flat index. Beyond that many actions, the most probable
+// are kept and rescaled to the same total.
+inline void getSparsePolicyInTensor(const State& state,
+                                    const std::vector<float>& pi,
+                                    torch::Tensor& index,
+                                    torch::Tensor& value,
+                                    torch::Tensor& maskBits) {
+  const auto& size = state.GetActionSize();
+  assert(size.size() == 3);
+  const auto& legalAction = state.GetLegalActions();
+  if (pi.size() > legalAction.size()) {
+    throw std::runtime_error("getSparsePolicyInTensor: wrong policy size");
+  }
+  auto flat = [&](const _Action& action) {
+    return (action.GetX() * size[1] + action.GetY()) * size[2] +
+           action.GetZ();
+  };
+
+  std::vector<std::pair<float, int32_t>> nonzero;
+  float total = 0.0f;
+  for (size_t i = 0; i != pi.size(); ++i) {
+    if (pi[i] != 0.0f) {
+      nonzero.emplace_back(pi[i], (int32_t)flat(legalAction[i]));
+      total += pi[i];
+    }
+  }
+  size_t capacity = index.size(0);
+  float scale = 1.0f;
+  if (nonzero.size() > capacity) {
+    std::nth_element(nonzero.begin(), nonzero.begin() + capacity,
+                     nonzero.end(), std::greater<>());
+    nonzero.resize(capacity);
+    float kept = 0.0f;
+    for (const auto& v : nonzero) {
+      kept += v.first;
+    }
+    scale = total / kept;
+  }
+  int32_t* indexData = index.data_ptr<int32_t>();
+  float* valueData = value.data_ptr<float>();
+  for (size_t i = 0; i != capacity; ++i) {
+    indexData[i] = i < nonzero.size() ? nonzero[i].second : -1;
+    valueData[i] = i < nonzero.size() ? nonzero[i].first * scale : 0.0f;
+  }
+
+  uint8_t* bits = maskBits.data_ptr<uint8_t>();
+  std::fill(bits, bits + maskBits.numel(), 0);
+  for (const auto& action : legalAction) {
+    int64_t i = flat(action);
+    bits[i / 8] |= 1 << (i % 8);
+  }
+}
+
+// Number of bytes of the mask of getSparsePolicyInTensor.
+inline int64_t getSparsePolicyMaskBytes(const State& state) {
+  const auto& size = state.GetActionSize();
+  return (size[0] * size[1] * size[2] + 7) / 8;
+}
+
+inline std::tuple<torch::Tensor, torch::Tensor, torch::Tensor>
+getSparsePolicyInTensor(const State& state,
+                        const std::vector<float>& pi,
+                        int64_t capacity) {
+  torch::Tensor index = torch::empty({capacity}, torch::kInt32);
+  torch::Tensor value = torch::empty({capacity}, torch::kFloat32);
+  torch::Tensor maskBits =
+      torch::empty({getSparsePolicyMaskBytes(state)}, torch::kUInt8);
+  getSparsePolicyInTensor(state, pi, index, value, maskBits);
+  return std::make_tuple(index, value, maskBits);
+}
+
 inline void normalize(std::vector<float>& a2pi) {
   float sumProb = 0.0f;
   for (auto& p : a2pi) {
@@ -124,11 +243,12 @@ inline void normalize(std::vector<float>& a2pi) {
   }
 }
 
+// Writes the policy logit of each legal action of state to out, which must
+// have room for them.
 inline void getLegalPi(const State& state,
                        torch::TensorAccessor<float, 3> accessor,
-                       std::vector<float>& out) {
+                       float* out) {
   const auto& legalActions = state.GetLegalActions();
-  out.resize(legalActions.size());
   for (size_t i = 0; i != legalActions.size(); ++i) {
     const auto& action = legalActions[i];
     float& pi = accessor[action.GetX()][action.GetY()][action.GetZ()];
@@ -155,6 +275,13 @@ inline void getLegalPi(const State& state,
   }
 }
 
+inline void getLegalPi(const State& state,
+                       torch::TensorAccessor<float, 3> accessor,
+                       std::vector<float>& out) {
+  out.resize(state.GetLegalActions().size());
+  getLegalPi(state, accessor, out.data());
+}
+
 inline void getLegalPi(const State& state,
                        const torch::Tensor& pi,
                        std::vector<float>& out) {
@@ -61,6 +61,13 @@ void State::DoGoodAction() {
   DoRandomAction();
 }
 
+uint64_t State::computeHash() const {
+  // Every move shoots exactly one arrow and toggles the turn key.
+  auto counts = board.countChesses();
+  int arrows = counts[ChessKind::whiteArrow] + counts[ChessKind::blackArrow];
+  return board.computeHash(arrows % 2 == 1);
+}
+
 void State::printCurrentBoard() const {
   std::cout << board.sprint("  ");
 }
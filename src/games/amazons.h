@@ -57,6 +57,7 @@ class State : public core::State {
   std::unique_ptr<core::State> clone_() const override;
   void ApplyAction(const ::_Action& action) override;
   void DoGoodAction() override;
+  uint64_t computeHash() const override;
   void printCurrentBoard() const override;
   std::string stateDescription() const override;
   std::string actionDescription(const ::_Action& action) const override;
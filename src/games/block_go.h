@@ -8,6 +8,7 @@
 #pragma once
 
 #include "../core/state.h"
+#include "commons/hash.h"
 #include <algorithm>
 
 class StateForBlockGo : public core::State {
@@ -81,8 +82,10 @@ class StateForBlockGo : public core::State {
   int board[13][13];
   int territory[13][13];
   int round;
-  unsigned long long HashArray[20][13][13];  // 20 different types
-  unsigned long long HashTurn;
+  // Zobrist keys: (player, cell), (player, piece placed) and side to move.
+  static const int hashPieceOffset = 2 * 13 * 13;
+  static const int hashTurn = hashPieceOffset + 2 * 9;
+  using _Zobrist = Zobrist<hashTurn + 1>;
   std::vector<Piece> player0;
   std::vector<Piece> player1;
   std::vector<Move> moves;
@@ -106,7 +109,6 @@ class StateForBlockGo : public core::State {
     _features.resize(_featSize[0] * _featSize[1] * _featSize[2]);
 
     gameInit();
-    initHash();
     // printCurrentBoard();
 
     findFeature();
@@ -114,21 +116,6 @@ class StateForBlockGo : public core::State {
     fillFullFeatures();
   }
 
-  void initHash() {
-    for (int x = 0; x < 20; ++x)
-      for (int y = 0; y < boardHeight; ++y)
-        for (int z = 0; z < boardWidth; ++z) {
-          HashArray[x][y][z] = 0;
-          for (int k = 0; k < 64; ++k)
-            if ((rand() / (RAND_MAX + 1.0)) > 0.5)
-              HashArray[x][y][z] |= (1ULL << k);
-        }
-    HashTurn = 0;
-    for (int k = 0; k < 64; k++)
-      if ((rand() / (RAND_MAX + 1.0)) > 0.5)
-        HashTurn |= (1ULL << k);
-  }
-
   void gameInit() {
     round = 1;
     std::fill(&board[0][0], &board[0][0] + 169, 2);
@@ -509,56 +496,41 @@ class StateForBlockGo : public core::State {
       return GameStatus::player1Win;
   }
 
-  int findType(int piece, int dir) {
-    switch (piece) {
-    case 0:
-    case 1:
-      return 0;
-    case 2:
-      return 1;
-    case 3:
-      return 2 + dir;
-    case 4:
-      return 4 + dir;
-    case 5:
-      return 6 + dir;
-    case 6:
-      return 8 + dir;
-    case 7:
-      return 12 + dir;
-    case 8:
-      return 16 + dir;
-
-    default:
-      fprintf(stderr, "piece error!!!!!\n");
-      return -1;
-    }
-  }
-
   virtual void ApplyAction(const _Action& action) override {
-    _hash ^= HashTurn;
+    _hash ^= _Zobrist::key(hashTurn);
     // fprintf(stderr, "ApplyAction round %d\n", round);
     int x = action.GetY();
     int y = action.GetZ();
     int piece = action.GetX() >> 2;
     int dir = action.GetX() & 3;
-    _hash ^= HashArray[findType(piece, dir)][x][y];
     // fprintf(stderr, "(%d, %d) %d %d\n", x, y, piece, dir);
     // fprintf(stderr, "hash: %llu\n", _hash);
     if (_status == GameStatus::player0Turn) {
       for (int i = 0; i < dir; ++i)
         player0[piece].turn90();
-      for (int i = 0; i < player0[piece].count; ++i)
-        board[y + player0[piece].tail[i].y][x + player0[piece].tail[i].x] = 0;
+      for (int i = 0; i < player0[piece].count; ++i) {
+        int cx = x + player0[piece].tail[i].x;
+        int cy = y + player0[piece].tail[i].y;
+        hashCell(cx, cy);
+        board[cy][cx] = 0;
+        hashCell(cx, cy);
+      }
       player0[piece].onboard = true;
+      _hash ^= _Zobrist::key(hashPieceOffset + piece);
       _status = GameStatus::player1Turn;
 
     } else {
       for (int i = 0; i < dir; ++i)
         player1[piece].turn90();
-      for (int i = 0; i < player1[piece].count; ++i)
-        board[y + player1[piece].tail[i].y][x + player1[piece].tail[i].x] = 1;
+      for (int i = 0; i < player1[piece].count; ++i) {
+        int cx = x + player1[piece].tail[i].x;
+        int cy = y + player1[piece].tail[i].y;
+        hashCell(cx, cy);
+        board[cy][cx] = 1;
+        hashCell(cx, cy);
+      }
       player1[piece].onboard = true;
+      _hash ^= _Zobrist::key(hashPieceOffset + 9 + piece);
       _status = GameStatus::player0Turn;
     }
 
@@ -576,6 +548,31 @@ class StateForBlockGo : public core::State {
     fillFullFeatures();
   }
 
+  // Toggles the key of the stone on (x, y), if any. Pieces may be dropped
+  // over stones already on the board, so the old one has to be removed.
+  void hashCell(int x, int y) {
+    if (board[y][x] == 0 || board[y][x] == 1)
+      _hash ^= _Zobrist::key((board[y][x] * boardHeight + y) * boardWidth + x);
+  }
+
+  virtual uint64_t computeHash() const override {
+    uint64_t hash = 0;
+    for (int y = 0; y < boardHeight; ++y)
+      for (int x = 0; x < boardWidth; ++x)
+        if (board[y][x] == 0 || board[y][x] == 1)
+          hash ^=
+              _Zobrist::key((board[y][x] * boardHeight + y) * boardWidth + x);
+    for (int piece = 0; piece < 9; ++piece) {
+      if (player0[piece].onboard)
+        hash ^= _Zobrist::key(hashPieceOffset + piece);
+      if (player1[piece].onboard)
+        hash ^= _Zobrist::key(hashPieceOffset + 9 + piece);
+    }
+    if (_status == GameStatus::player1Turn)
+      hash ^= _Zobrist::key(hashTurn);
+    return hash;
+  }
+
   virtual std::string stateDescription() const override {
     std::stringstream ss;
     ss << "    0  1  2  3  4  5  6  7  8  9  10 11 12\n";
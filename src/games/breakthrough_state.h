@@ -14,6 +14,7 @@
 #include <vector>
 
 #include "breakthrough.h"
+#include "commons/bitboard.h"
 //#include "game.h"
 #include "../core/state.h"
 
@@ -23,7 +24,6 @@ const int StateForBreakthroughNumActions = 64 * 3;
 const int StateForBreakthroughX = 2;
 const int StateForBreakthroughY = 8;
 const int StateForBreakthroughZ = 8;
-const int BTMaxLegalMoves = 48;
 
 template <bool fixedPolicy = true>
 class StateForBreakthrough : public core::State, BTBoard {
@@ -62,6 +62,7 @@ class StateForBreakthrough : public core::State, BTBoard {
     // between 0 and 1. trivial case in dimension 1.
     _features.resize(StateForBreakthroughX * StateForBreakthroughY *
                      StateForBreakthroughZ);
+    _binaryFeatures = true;
     /*
         // _features[:_hash] = 1
         for (int i = 0; i < DISTANCE; i++) {
@@ -69,6 +70,7 @@ class StateForBreakthrough : public core::State, BTBoard {
         }
     */
     init();
+    _hash = hash;
     findFeatures();
     findActions(White);
     fillFullFeatures();
@@ -93,41 +95,29 @@ class StateForBreakthrough : public core::State, BTBoard {
   }
 
   void findActions(int color) {
-    BTMove moves[BTMaxLegalMoves];
-    int nb = legalBTMoves(color, moves);
-
-    _legalActions.clear();
-    for (int i = 0; i < nb; i++) {
-      int x = moves[i].x;
-      int y = moves[i].y;
-      int dir = 2;
-      if (moves[i].x1 == x - 1)
-        dir = 0;
-      else if (moves[i].x1 == x)
-        dir = 1;
-      _legalActions.emplace_back(i, dir, x, y);
-    }
+    clearActions();
+    _legalActions.reserve(countMoves(color));
+    for (int dir = 0; dir < 3; dir++)
+      for (uint64_t b = movers(color, dir); b; b &= b - 1) {
+        int sq = __builtin_ctzll(b);
+        addAction(dir, sq / BTDy, sq % BTDy);
+      }
   }
 
+  // Black pieces in the first plane and White pieces in the second, on the
+  // transposed board unless fixedPolicy.
   void findFeatures() {
     if ((_status == GameStatus::player0Win) ||
         (_status == GameStatus::player1Win))
       return;
-    // init
-    const size_t numFeats =
-        StateForBreakthroughX * StateForBreakthroughY * StateForBreakthroughZ;
-    std::fill(_features.begin(), _features.begin() + numFeats, 0.);
-    for (int i = 0; i < 64; i++) {
-      auto value = fixedPolicy ? board[i / 8][i % 8] : board[i % 8][i / 8];
-      if (value == Black)
-        _features[i] = 1;
-      else if (value == White)
-        _features[64 + i] = 1;
+    for (int color : {Black, White}) {
+      uint64_t b = fixedPolicy ? pieces[color] : flipDiagonal(pieces[color]);
+      expandBits(b, _features.data() + (color == Black ? 0 : 64), 64);
     }
   }
   // The action just decreases the distance and swaps the turn to play.
   virtual void ApplyAction(const _Action& action) override {
-    BTMove m;
+    BTMove m{};
     // print(stdout);
     if (_status == GameStatus::player0Turn) {  // White
       m.color = White;
@@ -176,6 +166,10 @@ class StateForBreakthrough : public core::State, BTBoard {
     fillFullFeatures();
   }
 
+  virtual uint64_t computeHash() const override {
+    return fullHash();
+  }
+
   // For this trivial example we just compare to random play. Ok, this is not
   // really a good action.
   // By the way we need a good default DoGoodAction, e.g. one-ply at least.
@@ -192,9 +186,9 @@ class StateForBreakthrough : public core::State, BTBoard {
     for (int i = 0; i < BTDy; i++) {
       s += std::to_string(BTDy - i);
       for (int j = 0; j < BTDx; j++)
-        if (board[j][i] == Empty)
+        if (get(j, i) == Empty)
           s += " +";
-        else if (board[j][i] == Black)
+        else if (get(j, i) == Black)
           s += " @";
         else
           s += " O";
@@ -7,399 +7,519 @@
 
 #include "chess.h"
 
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__BMI2__)
+#define CHESS_PEXT
+#include <immintrin.h>
+#endif
+
 namespace chess {
 
 struct ZobrishHash {
-  std::array<std::array<uint64_t, 13 * 2>, 12 * 12> hash;
+  std::array<std::array<uint64_t, 64>, 12> pieces;
+  std::array<uint64_t, 64> enPassant;
+  std::array<uint64_t, 4> castling;
+  std::array<uint64_t, 2> turn;
   ZobrishHash() {
     std::mt19937_64 rng(std::random_device{}() + 42);
     rng.discard(1024);
-    for (auto& v : hash) {
+    for (auto& v : pieces) {
       for (auto& v2 : v) {
         v2 = rng();
       }
     }
+    for (auto& v : enPassant) {
+      v = rng();
+    }
+    for (auto& v : castling) {
+      v = rng();
+    }
+    for (auto& v : turn) {
+      v = rng();
+    }
   }
 };
 
 static inline ZobrishHash zhash;
 
-void ChessBoard::init() {
-  board.fill(0);
-  for (int i = 0; i != boardDim; ++i) {
-    board[i] = OOB;
-    board[i + boardDim] = OOB;
-    board[boardDim * i] = OOB;
-    board[boardDim * i + 1] = OOB;
-    board[boardDim * (boardDim - 1) + i] = OOB;
-    board[boardDim * (boardDim - 2) + i] = OOB;
-    board[boardDim * i + boardDim - 1] = OOB;
-    board[boardDim * i + boardDim - 2] = OOB;
-  }
-
-  board[boardDim * 2 + 2] = WHITE | ROOK;
-  board[boardDim * 2 + 3] = WHITE | KNIGHT;
-  board[boardDim * 2 + 4] = WHITE | BISHOP;
-  board[boardDim * 2 + 5] = WHITE | QUEEN;
-  board[boardDim * 2 + 6] = WHITE | KING;
-  board[boardDim * 2 + 7] = WHITE | BISHOP;
-  board[boardDim * 2 + 8] = WHITE | KNIGHT;
-  board[boardDim * 2 + 9] = WHITE | ROOK;
-  board[boardDim * (boardDim - 3) + 2] = BLACK | ROOK;
-  board[boardDim * (boardDim - 3) + 3] = BLACK | KNIGHT;
-  board[boardDim * (boardDim - 3) + 4] = BLACK | BISHOP;
-  board[boardDim * (boardDim - 3) + 5] = BLACK | QUEEN;
-  board[boardDim * (boardDim - 3) + 6] = BLACK | KING;
-  board[boardDim * (boardDim - 3) + 7] = BLACK | BISHOP;
-  board[boardDim * (boardDim - 3) + 8] = BLACK | KNIGHT;
-  board[boardDim * (boardDim - 3) + 9] = BLACK | ROOK;
-  for (int i = 0; i != 8; ++i) {
-    board[boardDim * 3 + 2 + i] = WHITE | PAWN;
-    board[boardDim * (boardDim - 4) + 2 + i] = BLACK | PAWN;
-  }
-
-  moveflags = castleleft | castleright;
-  moveflags |= (castleleft | castleright) << 1;
-  turn = 0;
-  moves.clear();
-  done = false;
-  winner = -1;
-  fiftyMoveCounter = 100;
+static uint64_t bit(int square) {
+  return uint64_t(1) << square;
 }
 
-void ChessBoard::findMoves() {
+static int lsb(uint64_t b) {
+  return __builtin_ctzll(b);
+}
 
-  int color = turn;
-  const int ahead = color == 0 ? boardDim : -boardDim;
+static int popLsb(uint64_t& b) {
+  int square = lsb(b);
+  b &= b - 1;
+  return square;
+}
 
-  char colorbit = 1 << (5 + color);
-  char opponentcolorbit = 1 << (5 + (color ^ 1));
-  char occupied = colorbit | OOB;
+static const int rookDirections[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+static const int bishopDirections[4][2] = {
+    {1, 1}, {-1, 1}, {1, -1}, {-1, -1}};
+
+// Walks the four rays from the square up to the first occupied square.
+static uint64_t slidingAttacks(int square,
+                               uint64_t occupied,
+                               const int (*directions)[2]) {
+  uint64_t attacks = 0;
+  for (int d = 0; d != 4; ++d) {
+    int x = square % 8 + directions[d][0];
+    int y = square / 8 + directions[d][1];
+    while (x >= 0 && x < 8 && y >= 0 && y < 8) {
+      attacks |= bit(y * 8 + x);
+      if (occupied & bit(y * 8 + x)) {
+        break;
+      }
+      x += directions[d][0];
+      y += directions[d][1];
+    }
+  }
+  return attacks;
+}
 
-  moves.clear();
+// Sliding attacks are looked up per square in a table indexed by the
+// occupancy of the squares that can block them: with PEXT where the CPU has
+// BMI2, and by magic multiplication otherwise.
+struct Magic {
+  uint64_t mask = 0;
+  uint64_t magic = 0;
+  int shift = 0;
+  const uint64_t* attacks = nullptr;
+
+  size_t index(uint64_t occupied) const {
+#ifdef CHESS_PEXT
+    return _pext_u64(occupied, mask);
+#else
+    return ((occupied & mask) * magic) >> shift;
+#endif
+  }
+};
 
-  size_t end = boardDim * (boardDim - 2) - 2;
-  size_t king = 0;
-  for (size_t i = 2 + boardDim * 2; i != end; ++i) {
-    if (board[i] == (colorbit | KING)) {
-      king = i;
+struct Tables {
+  std::array<uint64_t, 64> knight;
+  std::array<uint64_t, 64> king;
+  std::array<std::array<uint64_t, 64>, 2> pawn;  // captures, by color
+  // Squares strictly between two aligned squares, and the whole line through
+  // them; empty if they are not aligned.
+  std::array<std::array<uint64_t, 64>, 64> between;
+  std::array<std::array<uint64_t, 64>, 64> line;
+  std::array<Magic, 64> rook;
+  std::array<Magic, 64> bishop;
+  std::array<uint8_t, 64> castlingMask;
+  std::vector<uint64_t> attacks;
+
+  Tables() {
+    auto leaper = [](int square, const int (*steps)[2], int n) {
+      uint64_t r = 0;
+      for (int k = 0; k != n; ++k) {
+        int x = square % 8 + steps[k][0];
+        int y = square / 8 + steps[k][1];
+        if (x >= 0 && x < 8 && y >= 0 && y < 8) {
+          r |= bit(y * 8 + x);
+        }
+      }
+      return r;
+    };
+    static const int knightSteps[8][2] = {{1, 2},  {2, 1},  {2, -1}, {1, -2},
+                                          {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+    static const int kingSteps[8][2] = {{1, 0},  {1, 1},   {0, 1},  {-1, 1},
+                                        {-1, 0}, {-1, -1}, {0, -1}, {1, -1}};
+    static const int whitePawnSteps[2][2] = {{-1, 1}, {1, 1}};
+    static const int blackPawnSteps[2][2] = {{-1, -1}, {1, -1}};
+    for (int i = 0; i != 64; ++i) {
+      knight[i] = leaper(i, knightSteps, 8);
+      king[i] = leaper(i, kingSteps, 8);
+      pawn[ChessBoard::WHITE][i] = leaper(i, whitePawnSteps, 2);
+      pawn[ChessBoard::BLACK][i] = leaper(i, blackPawnSteps, 2);
     }
-  }
-  size_t kingx = king % boardDim;
-  size_t kingy = king / boardDim;
-
-  auto checkcheck = [&]() {
-    uint8_t pawn = opponentcolorbit | PAWN;
-    if ((board[king + ahead + 1] & pawn) == pawn)
-      return true;
-    if ((board[king + ahead - 1] & pawn) == pawn)
-      return true;
-    uint8_t rook = opponentcolorbit | ROOK;
-    for (size_t xx = kingx + 1, ii = king + 1; xx != boardDim - 2; ++xx, ++ii) {
-      if ((board[ii] & rook) == rook)
-        return true;
-      else if (board[ii] != EMPTY)
-        break;
+
+    for (int i = 0; i != 64; ++i) {
+      for (int j = 0; j != 64; ++j) {
+        between[i][j] = 0;
+        line[i][j] = 0;
+        for (auto directions : {rookDirections, bishopDirections}) {
+          if (slidingAttacks(i, 0, directions) & bit(j)) {
+            between[i][j] = slidingAttacks(i, bit(j), directions) &
+                            slidingAttacks(j, bit(i), directions);
+            line[i][j] = (slidingAttacks(i, 0, directions) &
+                          slidingAttacks(j, 0, directions)) |
+                         bit(i) | bit(j);
+          }
+        }
+      }
     }
-    for (size_t xx = kingx - 1, ii = king - 1; xx != 1; --xx, --ii) {
-      if ((board[ii] & rook) == rook)
-        return true;
-      else if (board[ii] != EMPTY)
-        break;
+
+    castlingMask.fill(0xff);
+    for (int color : {ChessBoard::WHITE, ChessBoard::BLACK}) {
+      int home = color == ChessBoard::WHITE ? 0 : 56;
+      castlingMask[home] = ~(ChessBoard::castleleft << color);
+      castlingMask[home + 7] = ~(ChessBoard::castleright << color);
+      castlingMask[home + 4] =
+          ~((ChessBoard::castleleft | ChessBoard::castleright) << color);
     }
-    for (size_t xx = kingy - 1, ii = king - boardDim; xx != 1;
-         --xx, ii -= boardDim) {
-      if ((board[ii] & rook) == rook)
-        return true;
-      else if (board[ii] != EMPTY)
-        break;
+
+    attacks.resize(102400 + 5248);
+    size_t offset = 0;
+    initMagics(rook, rookDirections, offset);
+    initMagics(bishop, bishopDirections, offset);
+  }
+
+  void initMagics(std::array<Magic, 64>& magics,
+                  const int (*directions)[2],
+                  size_t& offset) {
+    std::vector<uint64_t> occupancies;
+    std::vector<uint64_t> reference;
+#ifndef CHESS_PEXT
+    std::vector<int> epoch;
+    int tries = 0;
+#endif
+    for (int i = 0; i != 64; ++i) {
+      Magic& m = magics[i];
+      // Edge squares never block: there is no square behind them.
+      uint64_t edges = ((0xffull | 0xffull << 56) & ~(0xffull << (i / 8 * 8))) |
+                       ((0x0101010101010101ull | 0x8080808080808080ull) &
+                        ~(0x0101010101010101ull << (i % 8)));
+      m.mask = slidingAttacks(i, 0, directions) & ~edges;
+      int bits = __builtin_popcountll(m.mask);
+      m.shift = 64 - bits;
+      m.attacks = &attacks[offset];
+      size_t size = size_t(1) << bits;
+      occupancies.clear();
+      reference.clear();
+      uint64_t subset = 0;
+      do {
+        occupancies.push_back(subset);
+        reference.push_back(slidingAttacks(i, subset, directions));
+        subset = (subset - m.mask) & m.mask;
+      } while (subset);
+
+#ifdef CHESS_PEXT
+      for (size_t k = 0; k != size; ++k) {
+        attacks[offset + m.index(occupancies[k])] = reference[k];
+      }
+#else
+      // Seeds, per rank, with which the search below ends quickly.
+      static const uint64_t seeds[8] = {
+          728, 10316, 55013, 32803, 12281, 15100, 16645, 255};
+      uint64_t seed = seeds[i / 8];
+      auto rng = [&seed]() {
+        seed ^= seed >> 12;
+        seed ^= seed << 25;
+        seed ^= seed >> 27;
+        return seed * 2685821657736338717ull;
+      };
+      epoch.assign(size, 0);
+      for (bool found = false; !found;) {
+        do {
+          m.magic = rng() & rng() & rng();
+        } while (__builtin_popcountll((m.mask * m.magic) >> 56) < 6);
+        ++tries;
+        found = true;
+        for (size_t k = 0; k != size; ++k) {
+          size_t index = m.index(occupancies[k]);
+          if (epoch[index] != tries) {
+            epoch[index] = tries;
+            attacks[offset + index] = reference[k];
+          } else if (attacks[offset + index] != reference[k]) {
+            found = false;
+            break;
+          }
+        }
+      }
+#endif
+      offset += size;
     }
-    for (size_t xx = kingy + 1, ii = king + boardDim; xx != boardDim - 2;
-         ++xx, ii += boardDim) {
-      if ((board[ii] & rook) == rook)
-        return true;
-      else if (board[ii] != EMPTY)
-        break;
+  }
+};
+
+static const Tables tables;
+
+static uint64_t rookAttacks(int square, uint64_t occupied) {
+  const Magic& m = tables.rook[square];
+  return m.attacks[m.index(occupied)];
+}
+
+static uint64_t bishopAttacks(int square, uint64_t occupied) {
+  const Magic& m = tables.bishop[square];
+  return m.attacks[m.index(occupied)];
+}
+
+static const uint8_t promotions[4] = {ChessBoard::QUEEN, ChessBoard::ROOK,
+                                      ChessBoard::BISHOP, ChessBoard::KNIGHT};
+
+void ChessBoard::clear() {
+  squares.fill(EMPTY);
+  pieces.fill(0);
+  colors.fill(0);
+  moves.clear();
+  castling = 0;
+  enPassant = -1;
+  repetitions.clear();
+  hash = 0;
+  turn = 0;
+  done = false;
+  winner = -1;
+  fiftyMoveCounter = 100;
+}
+
+void ChessBoard::addPiece(int square, uint8_t piece) {
+  squares[square] = piece;
+  pieces[pieceKind(piece)] |= bit(square);
+  colors[piece >= 6] |= bit(square);
+  hash ^= zhash.pieces[piece][square];
+}
+
+void ChessBoard::removePiece(int square) {
+  uint8_t piece = squares[square];
+  squares[square] = EMPTY;
+  pieces[pieceKind(piece)] &= ~bit(square);
+  colors[piece >= 6] &= ~bit(square);
+  hash ^= zhash.pieces[piece][square];
+}
+
+void ChessBoard::init() {
+  clear();
+  static const uint8_t backRank[8] = {
+      ROOK, KNIGHT, BISHOP, QUEEN, KING, BISHOP, KNIGHT, ROOK};
+  for (int x = 0; x != 8; ++x) {
+    addPiece(x, backRank[x]);
+    addPiece(8 + x, PAWN);
+    addPiece(48 + x, 6 + PAWN);
+    addPiece(56 + x, 6 + backRank[x]);
+  }
+  castling = (castleleft | castleright) * 3;
+}
+
+void ChessBoard::setFen(const std::string& fen) {
+  clear();
+  std::istringstream in(fen);
+  std::string placement, side, rights, ep;
+  int halfmoves = 0;
+  if (!(in >> placement >> side >> rights >> ep)) {
+    throw std::runtime_error("invalid FEN '" + fen + "'");
+  }
+  in >> halfmoves;
+
+  static const char* names = "PNBRQKpnbrqk";
+  int x = 0;
+  int y = 7;
+  for (char c : placement) {
+    const char* name = std::strchr(names, c);
+    if (c == '/' && x == 8 && y > 0) {
+      x = 0;
+      --y;
+    } else if (c >= '1' && c <= '8' && x + c - '0' <= 8) {
+      x += c - '0';
+    } else if (c && name && x < 8) {
+      addPiece(y * 8 + x, name - names);
+      ++x;
+    } else {
+      throw std::runtime_error("invalid FEN '" + fen + "'");
     }
-    uint8_t bishop = opponentcolorbit | BISHOP;
-    for (size_t xx = std::min(kingx, kingy) - 1, ii = king - 1 - boardDim;
-         xx != 1; --xx, ii += -1 - boardDim) {
-      if ((board[ii] & bishop) == bishop)
-        return true;
-      else if (board[ii] != EMPTY)
-        break;
+  }
+  if (x != 8 || y != 0 ||
+      __builtin_popcountll(pieces[KING] & colors[WHITE]) != 1 ||
+      __builtin_popcountll(pieces[KING] & colors[BLACK]) != 1) {
+    throw std::runtime_error("invalid FEN '" + fen + "'");
+  }
+
+  if (side != "w" && side != "b") {
+    throw std::runtime_error("invalid FEN '" + fen + "'");
+  }
+  turn = side == "w" ? WHITE : BLACK;
+  for (char c : rights) {
+    switch (c) {
+    case 'K':
+      castling |= castleright << WHITE;
+      break;
+    case 'Q':
+      castling |= castleleft << WHITE;
+      break;
+    case 'k':
+      castling |= castleright << BLACK;
+      break;
+    case 'q':
+      castling |= castleleft << BLACK;
+      break;
+    case '-':
+      break;
+    default:
+      throw std::runtime_error("invalid FEN '" + fen + "'");
     }
-    for (size_t xx = std::min(kingx, boardDim - 1 - kingy) - 1,
-                ii = king - 1 + boardDim;
-         xx != 1; --xx, ii += -1 + boardDim) {
-      if ((board[ii] & bishop) == bishop)
-        return true;
-      else if (board[ii] != EMPTY)
-        break;
+  }
+  if (ep != "-") {
+    if (ep.size() != 2 || ep[0] < 'a' || ep[0] > 'h' ||
+        ep[1] != (turn == WHITE ? '6' : '3')) {
+      throw std::runtime_error("invalid FEN '" + fen + "'");
     }
-    for (size_t xx = std::min(boardDim - 1 - kingx, boardDim - 1 - kingy) - 1,
-                ii = king + 1 + boardDim;
-         xx != 1; --xx, ii += 1 + boardDim) {
-      if ((board[ii] & bishop) == bishop)
-        return true;
-      else if (board[ii] != EMPTY)
-        break;
+    // FEN gives the square passed over, we keep the pawn's.
+    enPassant = (ep[1] - '1' + (turn == WHITE ? -1 : 1)) * 8 + ep[0] - 'a';
+  }
+  fiftyMoveCounter = 100 - halfmoves;
+}
+
+uint64_t ChessBoard::piecesHash() const {
+  uint64_t h = 0;
+  for (int i = 0; i != 64; ++i) {
+    if (squares[i] != EMPTY) {
+      h ^= zhash.pieces[squares[i]][i];
     }
-    for (size_t xx = std::min(boardDim - 1 - kingx, kingy) - 1,
-                ii = king + 1 - boardDim;
-         xx != 1; --xx, ii += 1 - boardDim) {
-      if ((board[ii] & bishop) == bishop)
-        return true;
-      else if (board[ii] != EMPTY)
-        break;
+  }
+  return h;
+}
+
+uint64_t ChessBoard::positionHash(uint64_t piecesHash) const {
+  uint64_t h = piecesHash ^ zhash.turn[turn];
+  for (int i = 0; i != 4; ++i) {
+    if (castling & (1 << i)) {
+      h ^= zhash.castling[i];
     }
-    uint8_t knight = opponentcolorbit | KNIGHT;
-    if (board[king + ahead + ahead - 1] == knight)
-      return true;
-    if (board[king + ahead + ahead + 1] == knight)
-      return true;
-    if (board[king - ahead - ahead - 1] == knight)
-      return true;
-    if (board[king - ahead - ahead + 1] == knight)
-      return true;
-    if (board[king - 1 - 1 - ahead] == knight)
-      return true;
-    if (board[king - 1 - 1 + ahead] == knight)
-      return true;
-    if (board[king + 1 + 1 - ahead] == knight)
-      return true;
-    if (board[king + 1 + 1 + ahead] == knight)
-      return true;
-    return false;
-  };
+  }
+  if (enPassant >= 0) {
+    h ^= zhash.enPassant[enPassant];
+  }
+  return h;
+}
 
-  for (size_t i = 2 + boardDim * 2; i != end; ++i) {
-    if ((board[i] & colorbit) == 0)
-      continue;
-    int piece = board[i] & 0xf;
-
-    unsigned char* relative = &board[i];
-
-    auto check = [&](size_t to) {
-      auto dst = board[to];
-      auto src = board[i];
-      board[to] = src;
-      board[i] = EMPTY;
-      bool r;
-      if (piece == KING) {
-        uint8_t knight = opponentcolorbit | KNIGHT;
-        uint8_t pawn = opponentcolorbit | PAWN;
-        if ((board[to + ahead] & 0xf) == KING)
-          r = true;
-        else if ((board[to + ahead + 1] & pawn) == pawn)
-          r = true;
-        else if ((board[to + ahead - 1] & pawn) == pawn)
-          r = true;
-        else if ((board[to + 1] & 0xf) == KING)
-          r = true;
-        else if ((board[to - 1] & 0xf) == KING)
-          r = true;
-        else if ((board[to - ahead] & 0xf) == KING)
-          r = true;
-        else if ((board[to - ahead + 1] & 0xf) == KING)
-          r = true;
-        else if ((board[to - ahead - 1] & 0xf) == KING)
-          r = true;
-        else if (board[to + ahead + ahead - 1] == knight)
-          r = true;
-        else if (board[to + ahead + ahead + 1] == knight)
-          r = true;
-        else if (board[to - ahead - ahead - 1] == knight)
-          r = true;
-        else if (board[to - ahead - ahead + 1] == knight)
-          r = true;
-        else if (board[to - 1 - 1 - ahead] == knight)
-          r = true;
-        else if (board[to - 1 - 1 + ahead] == knight)
-          r = true;
-        else if (board[to + 1 + 1 - ahead] == knight)
-          r = true;
-        else if (board[to + 1 + 1 + ahead] == knight)
-          r = true;
-        else {
-          king = to;
-          kingx = to % boardDim;
-          kingy = to / boardDim;
-          r = checkcheck();
-          king = i;
-          kingx = i % boardDim;
-          kingy = i / boardDim;
-        }
-      } else {
-        r = checkcheck();
-      }
-      board[i] = src;
-      board[to] = dst;
-      return r;
-    };
+uint64_t ChessBoard::attackers(int square, uint64_t occupied) const {
+  return (tables.pawn[WHITE][square] & pieces[PAWN] & colors[BLACK]) |
+         (tables.pawn[BLACK][square] & pieces[PAWN] & colors[WHITE]) |
+         (tables.knight[square] & pieces[KNIGHT]) |
+         (tables.king[square] & pieces[KING]) |
+         (bishopAttacks(square, occupied) & (pieces[BISHOP] | pieces[QUEEN])) |
+         (rookAttacks(square, occupied) & (pieces[ROOK] | pieces[QUEEN]));
+}
 
-    auto addMove = [&](size_t to) {
-      if (!check(to)) {
-        if (piece == PAWN && relative[ahead + ahead] == OOB) {
-          moves.push_back(i | (to << 17));
-          moves.push_back(i | (to << 17) | 0x8000);
-          moves.push_back(i | (to << 17) | 0x10000);
-          moves.push_back(i | (to << 17) | 0x18000);
-        } else {
-          moves.push_back(i | (to << 17));
-        }
-      }
-    };
+void ChessBoard::findMoves() {
+  const int us = turn;
+  const int them = turn ^ 1;
+  const uint64_t own = colors[us];
+  const uint64_t opponent = colors[them];
+  const uint64_t occupied = own | opponent;
+  const int king = lsb(pieces[KING] & own);
+  const uint64_t checkers = attackers(king, occupied) & opponent;
 
-    auto test = [&](size_t to) {
-      board.at(i + to);
-      if ((relative[to] & occupied) == 0) {
-        addMove(i + to);
-        return true;
-      } else {
-        return false;
-      }
-    };
+  moves.clear();
+
+  auto add = [&](int from, uint64_t targets) {
+    while (targets) {
+      moves.push_back(from | popLsb(targets) << 6);
+    }
+  };
+
+  // The king may not stay on a line it is attacked along.
+  const uint64_t withoutKing = occupied ^ bit(king);
+  uint64_t targets = tables.king[king] & ~own;
+  while (targets) {
+    int to = popLsb(targets);
+    if (!(attackers(to, withoutKing) & opponent)) {
+      moves.push_back(king | to << 6);
+    }
+  }
 
-    auto tryMove = [&](size_t to) {
-      board.at(to);
-      int v = board[to];
-      if (v != EMPTY) {
-        if (v & occupied)
-          return false;
-        addMove(to);
-        return false;
+  // Only the king moves out of a double check. Other moves must take or
+  // block a single checker, and pinned pieces must stay on their line.
+  if (!(checkers & (checkers - 1))) {
+    const uint64_t allowed =
+        checkers ? checkers | tables.between[king][lsb(checkers)] : ~0ull;
+    uint64_t pinned = 0;
+    uint64_t snipers =
+        ((rookAttacks(king, opponent) & (pieces[ROOK] | pieces[QUEEN])) |
+         (bishopAttacks(king, opponent) & (pieces[BISHOP] | pieces[QUEEN]))) &
+        opponent;
+    while (snipers) {
+      uint64_t b = tables.between[king][popLsb(snipers)] & occupied;
+      if (!(b & (b - 1)) && (b & own)) {
+        pinned |= b;
       }
-      addMove(to);
-      return true;
+    }
+    auto legal = [&](int from) {
+      return pinned & bit(from) ? allowed & tables.line[king][from] : allowed;
     };
 
-    switch (piece) {
-    case PAWN:
-      if (relative[ahead] == EMPTY) {
-        addMove(i + ahead);
-        if (color == 0 ? i - boardDim * 3 < boardDim
-                       : i - boardDim * (boardDim - 4) < boardDim) {
-          if (relative[ahead + ahead] == EMPTY && !check(i + ahead + ahead)) {
-            moves.push_back(i | 0x8000 | ((i + ahead + ahead) << 17));
-          }
+    const int ahead = us == WHITE ? 8 : -8;
+    const uint64_t startRank = us == WHITE ? 0xff00ull : 0xff000000000000ull;
+    const uint64_t lastRank = us == WHITE ? 0xff00000000000000ull : 0xffull;
+    uint64_t pawns = pieces[PAWN] & own;
+    while (pawns) {
+      int from = popLsb(pawns);
+      uint64_t mask = legal(from);
+      uint64_t steps = tables.pawn[us][from] & opponent;
+      int push = from + ahead;
+      if (!(occupied & bit(push))) {
+        steps |= bit(push);
+        if ((startRank & bit(from)) && !(occupied & bit(push + ahead)) &&
+            (mask & bit(push + ahead))) {
+          moves.push_back(from | (push + ahead) << 6 | DOUBLEPUSH << 12);
         }
       }
-      if ((relative[ahead + 1] & opponentcolorbit) == opponentcolorbit) {
-        addMove(i + ahead + 1);
-      }
-      if ((relative[ahead - 1] & opponentcolorbit) == opponentcolorbit) {
-        addMove(i + ahead - 1);
-      }
-      if (moveflags & 0x8000) {
-        size_t x = moveflags & 0x7fff;
-        if (i + 1 == x) {
-          int tmp = board[i + 1];
-          board[i + 1] = EMPTY;
-          if (!check(i + ahead + 1)) {
-            moves.push_back(i | 0x10000 | ((i + ahead + 1) << 17));
+      steps &= mask;
+      if (steps & lastRank) {
+        while (steps) {
+          int to = popLsb(steps);
+          for (int k = 0; k != 4; ++k) {
+            moves.push_back(from | to << 6 | (PROMOTION + k) << 12);
           }
-          board[i + 1] = tmp;
-        } else if (i - 1 == x) {
-          int tmp = board[i - 1];
-          board[i - 1] = EMPTY;
-          if (!check(i + ahead - 1)) {
-            moves.push_back(i | 0x10000 | ((i + ahead - 1) << 17));
-          }
-          board[i - 1] = tmp;
         }
+      } else {
+        add(from, steps);
       }
-      break;
-    case KNIGHT:
-      test(ahead + ahead + 1);
-      test(ahead + ahead - 1);
-      test(-ahead - ahead - 1);
-      test(-ahead - ahead + 1);
-      test(-1 - 1 - ahead);
-      test(-1 - 1 + ahead);
-      test(+1 + 1 - ahead);
-      test(+1 + 1 + ahead);
-      break;
-    case KING:
-      test(ahead);
-      test(ahead + 1);
-      test(ahead - 1);
-      test(1);
-      test(-1);
-      test(-ahead);
-      test(-ahead + 1);
-      test(-ahead - 1);
-      if ((moveflags & (castleleft << turn)) && !checkcheck()) {
-        size_t x = i % boardDim;
-        for (size_t xx = x - 1, ii = i - 1;; --xx, --ii) {
-          if (xx == 2) {
-            if (!check(i - 1) && !check(i - 2)) {
-              moves.push_back(i | 0x8000 | ((i - 1 - 1) << 17));
-            }
-            break;
-          }
-          if (board[ii] != EMPTY)
-            break;
+    }
+    if (enPassant >= 0) {
+      // Taking en passant removes two pieces from a rank: test it directly.
+      int to = enPassant + ahead;
+      uint64_t candidates = tables.pawn[them][to] & pieces[PAWN] & own;
+      while (candidates) {
+        int from = popLsb(candidates);
+        uint64_t after = (occupied ^ bit(from) ^ bit(enPassant)) | bit(to);
+        if (!(attackers(king, after) & opponent & ~bit(enPassant))) {
+          moves.push_back(from | to << 6 | ENPASSANT << 12);
         }
       }
-      if ((moveflags & (castleright << turn)) && !checkcheck()) {
-        size_t x = i % boardDim;
-        for (size_t xx = x + 1, ii = i + 1;; ++xx, ++ii) {
-          if (xx == boardDim - 3) {
-            if (!check(i + 1) && !check(i + 2)) {
-              moves.push_back(i | 0x8000 | ((i + 1 + 1) << 17));
-            }
-            break;
-          }
-          if (board[ii] != EMPTY)
-            break;
-        }
+    }
+
+    uint64_t knights = pieces[KNIGHT] & own & ~pinned;
+    while (knights) {
+      int from = popLsb(knights);
+      add(from, tables.knight[from] & ~own & allowed);
+    }
+    uint64_t diagonal = (pieces[BISHOP] | pieces[QUEEN]) & own;
+    while (diagonal) {
+      int from = popLsb(diagonal);
+      add(from, bishopAttacks(from, occupied) & ~own & legal(from));
+    }
+    uint64_t straight = (pieces[ROOK] | pieces[QUEEN]) & own;
+    while (straight) {
+      int from = popLsb(straight);
+      add(from, rookAttacks(from, occupied) & ~own & legal(from));
+    }
+
+    if (!checkers) {
+      auto safe = [&](int square) {
+        return !(attackers(square, withoutKing) & opponent);
+      };
+      if ((castling & (castleleft << us)) &&
+          !(occupied & (bit(king - 1) | bit(king - 2) | bit(king - 3))) &&
+          safe(king - 1) && safe(king - 2)) {
+        moves.push_back(king | (king - 2) << 6 | CASTLE << 12);
       }
-      break;
-    default:
-      size_t x = i % boardDim;
-      size_t y = i / boardDim;
-      switch (piece) {
-      case QUEEN:
-      case ROOK:
-        for (size_t xx = x + 1, ii = i + 1; xx != boardDim - 2 && tryMove(ii);
-             ++xx, ++ii)
-          ;
-        for (size_t xx = x - 1, ii = i - 1; xx != 1 && tryMove(ii); --xx, --ii)
-          ;
-        for (size_t xx = y - 1, ii = i - boardDim; xx != 1 && tryMove(ii);
-             --xx, ii -= boardDim)
-          ;
-        for (size_t xx = y + 1, ii = i + boardDim;
-             xx != boardDim - 2 && tryMove(ii); ++xx, ii += boardDim)
-          ;
-        if (piece != QUEEN)
-          break;
-        [[fallthrough]];
-      case BISHOP:
-        for (size_t xx = std::min(x, y) - 1, ii = i - 1 - boardDim;
-             xx != 1 && tryMove(ii); --xx, ii += -1 - boardDim)
-          ;
-        for (size_t xx = std::min(x, boardDim - 1 - y) - 1,
-                    ii = i - 1 + boardDim;
-             xx != 1 && tryMove(ii); --xx, ii += -1 + boardDim)
-          ;
-        for (size_t xx = std::min(boardDim - 1 - x, boardDim - 1 - y) - 1,
-                    ii = i + 1 + boardDim;
-             xx != 1 && tryMove(ii); --xx, ii += 1 + boardDim)
-          ;
-        for (size_t xx = std::min(boardDim - 1 - x, y) - 1,
-                    ii = i + 1 - boardDim;
-             xx != 1 && tryMove(ii); --xx, ii += 1 - boardDim)
-          ;
-        break;
+      if ((castling & (castleright << us)) &&
+          !(occupied & (bit(king + 1) | bit(king + 2))) && safe(king + 1) &&
+          safe(king + 2)) {
+        moves.push_back(king | (king + 2) << 6 | CASTLE << 12);
       }
     }
   }
 
   if (moves.empty()) {
     done = true;
-    if (checkcheck()) {
+    if (checkers) {
       winner = turn ^ 1;
     }
   } else if (fiftyMoveCounter <= 0) {
@@ -409,143 +529,107 @@ void ChessBoard::findMoves() {
 }
 
 void ChessBoard::move(uint_fast32_t move) {
-  size_t to = move >> 17;
-  size_t from = move & 0x7fff;
-
-  int v = board[from];
-  int piece = v & 0xf;
+  int from = moveFrom(move);
+  int to = moveTo(move);
+  int flag = moveFlag(move);
+  uint8_t piece = squares[from];
 
   --fiftyMoveCounter;
+  bool irreversible = pieceKind(piece) == PAWN;
 
-  switch (piece) {
-  case KING:
-    moveflags &= ~((castleleft | castleright) << turn);
-    break;
-  case ROOK: {
-    size_t x = from % boardDim;
-    size_t y = from / boardDim;
-    if (x == 2 || x == boardDim - 3) {
-      if (y == (turn == 0 ? 2 : boardDim - 3)) {
-        if (x == 2)
-          moveflags &= ~(castleleft << turn);
-        else
-          moveflags &= ~(castleright << turn);
-      }
-    }
-    break;
-  }
-  case PAWN:
-    fiftyMoveCounter = 100;
-    for (auto& v : repetitions) {
-      v.clear();
-    }
-    if (board[to + (turn == 0 ? boardDim : -boardDim)] == OOB) {
-      v &= ~PAWN;
-      switch ((move >> 15) & 3) {
-      case 0:
-        v |= QUEEN;
-        break;
-      case 1:
-        v |= ROOK;
-        break;
-      case 2:
-        v |= BISHOP;
-        break;
-      case 3:
-        v |= KNIGHT;
-        break;
-      }
-      move = 0;
-    }
-    break;
+  if (flag == ENPASSANT) {
+    removePiece(to + (turn == WHITE ? -8 : 8));
+  } else if (squares[to] != EMPTY) {
+    removePiece(to);
+    irreversible = true;
   }
+  castling &= tables.castlingMask[from] & tables.castlingMask[to];
 
-  moveflags &= ~0xffff;
-  if ((move & 0x8000) != 0) {
-    if (piece == PAWN) {
-      moveflags |= to | 0x8000;
-    } else if (piece == KING) {
-      size_t y = from / boardDim;
-      if (to < from) {
-        std::swap(board[y * boardDim + 2], board[to + 1]);
-      } else {
-        std::swap(board[y * boardDim + boardDim - 3], board[to - 1]);
-      }
-    }
-  } else {
-    if ((move & 0x10000) != 0) {
-      int dx = to % boardDim - from % boardDim;
-      board.at(from + dx) = EMPTY;
-
-      fiftyMoveCounter = 100;
-      for (auto& v : repetitions) {
-        v.clear();
-      }
-    }
+  removePiece(from);
+  if (flag >= PROMOTION) {
+    piece = turn * 6 + promotions[flag - PROMOTION];
   }
+  addPiece(to, piece);
+  if (flag == CASTLE) {
+    int rookFrom = to < from ? to - 2 : to + 1;
+    int rookTo = to < from ? to + 1 : to - 1;
+    uint8_t rook = squares[rookFrom];
+    removePiece(rookFrom);
+    addPiece(rookTo, rook);
+  }
+  enPassant = flag == DOUBLEPUSH ? to : -1;
+
+  turn ^= 1;
 
-  if (board[to] != EMPTY) {
+  if (irreversible) {
     fiftyMoveCounter = 100;
-    for (auto& v : repetitions) {
-      v.clear();
-    }
+    repetitions.clear();
   }
-  if ((board[to] & 0xf) == ROOK) {
-    size_t x = to % boardDim;
-    size_t y = to / boardDim;
-    if (x == 2 || x == boardDim - 3) {
-      if (y == (turn == 1 ? 2 : boardDim - 3)) {
-        if (x == 2)
-          moveflags &= ~(castleleft << (turn ^ 1));
-        else
-          moveflags &= ~(castleright << (turn ^ 1));
-      }
-    }
+  uint64_t fullhash = positionHash(hash);
+  int count = 1;
+  for (uint64_t h : repetitions) {
+    count += h == fullhash;
   }
+  if (count >= 3) {
+    done = true;
+    winner = -1;
+  }
+  repetitions.push_back(fullhash);
+}
 
-  hash ^= zhash.hash.at(from).at(13 * turn + piece);
-  hash ^= zhash.hash.at(to).at(13 * turn + piece);
-
-  board[from] = EMPTY;
-  board[to] = v;
-
-  turn ^= 1;
+int ChessBoard::changedSquares(uint_fast32_t move,
+                               std::array<int, 4>& out) const {
+  int from = moveFrom(move);
+  int to = moveTo(move);
+  int n = 0;
+  out[n++] = from;
+  out[n++] = to;
+  if (moveFlag(move) == CASTLE) {
+    out[n++] = to < from ? to - 2 : to + 1;
+    out[n++] = to < from ? to + 1 : to - 1;
+  } else if (moveFlag(move) == ENPASSANT) {
+    out[n++] = to + (turn == WHITE ? -8 : 8);
+  }
+  return n;
+}
 
-  uint64_t fullhash = hash ^ moveflags ^ zhash.hash.at(5).at(turn);
-  size_t index = fullhash % repetitions.size();
-  bool found = false;
-  for (auto& v : repetitions[index]) {
-    if (v.first == fullhash) {
-      ++v.second;
-      if (v.second >= 3) {
-        done = true;
-        winner = -1;
-      }
-      found = true;
-      break;
-    }
+static uint64_t perft(const ChessBoard& board, ChessBoard* stack, int depth) {
+  if (depth == 1) {
+    return board.moves.size();
   }
-  if (!found) {
-    repetitions[index].emplace_back(fullhash, 1);
+  uint64_t n = 0;
+  ChessBoard& child = *stack;
+  for (auto move : board.moves) {
+    child = board;
+    child.move(move);
+    child.findMoves();
+    n += perft(child, stack + 1, depth - 1);
+  }
+  return n;
+}
+
+uint64_t ChessBoard::perft(int depth) const {
+  if (depth <= 0) {
+    return 1;
   }
+  // One board per ply, so that copies reuse their buffers.
+  std::vector<ChessBoard> stack(depth);
+  return chess::perft(*this, stack.data(), depth);
 }
 
 std::string ChessBoard::moveString(uint_fast32_t move) const {
-  size_t from = move & 0x7fff;
-  size_t fx = from % boardDim - 2;
-  size_t fy = from / boardDim - 2;
-  size_t to = move >> 17;
-  size_t tx = to % boardDim - 2;
-  size_t ty = to / boardDim - 2;
-  int piece = board[from];
+  int from = moveFrom(move);
+  int fx = from % 8;
+  int fy = from / 8;
+  int to = moveTo(move);
+  int flag = moveFlag(move);
+  uint8_t piece = squares[from];
   bool disx = false;
   bool disy = false;
-  for (auto& v : moves) {
-    size_t vfrom = v & 0x7fff;
-    size_t vto = v >> 17;
-    if (vfrom != from && board[vfrom] == piece && vto == to) {
-      size_t vx = vfrom % boardDim - 2;
-      if (vx == fx) {
+  for (auto v : moves) {
+    int vfrom = moveFrom(v);
+    if (vfrom != from && squares[vfrom] == piece && moveTo(v) == to) {
+      if (vfrom % 8 == fx) {
         disy = true;
       } else {
         disx = true;
@@ -553,42 +637,15 @@ std::string ChessBoard::moveString(uint_fast32_t move) const {
     }
   }
 
-  std::string str;
-  switch (piece & 0xf) {
-  case KNIGHT:
-    str += 'N';
-    break;
-  case BISHOP:
-    str += 'B';
-    break;
-  case ROOK:
-    str += 'R';
-    break;
-  case QUEEN:
-    str += 'Q';
-    break;
-  case KING:
-    str += 'K';
-    break;
-  }
-  bool promotion = false;
-  if ((piece & 0xf) == PAWN) {
-    if (board[to + (turn == 0 ? boardDim : -boardDim)] == OOB) {
-      promotion = true;
-    }
-  } else if ((piece & 0xf) == KING) {
-    if ((move & 0x8000) != 0) {
-      if (to < from) {
-        return "O-O-O";
-      } else {
-        return "O-O";
-      }
-    }
+  if (flag == CASTLE) {
+    return to < from ? "O-O-O" : "O-O";
   }
-  bool capture = board[to] != EMPTY;
-  if (!promotion && (move & 0x10000) != 0) {
-    capture = true;
+  std::string str;
+  int kind = pieceKind(piece);
+  if (kind != PAWN) {
+    str += "PNBRQK"[kind];
   }
+  bool capture = squares[to] != EMPTY || flag == ENPASSANT;
   if (capture && str.empty()) {
     disx = true;
   }
@@ -598,26 +655,14 @@ std::string ChessBoard::moveString(uint_fast32_t move) const {
   if (disy) {
     str += char('1' + fy);
   }
-  if (capture != EMPTY) {
+  if (capture) {
     str += 'x';
   }
-  str += char('a' + tx);
-  str += char('1' + ty);
-  if (promotion) {
-    switch ((move >> 15) & 3) {
-    case 0:
-      str += "=Q";
-      break;
-    case 1:
-      str += "=R";
-      break;
-    case 2:
-      str += "=B";
-      break;
-    case 3:
-      str += "=N";
-      break;
-    }
+  str += char('a' + to % 8);
+  str += char('1' + to / 8);
+  if (flag >= PROMOTION) {
+    str += '=';
+    str += "QRBN"[flag - PROMOTION];
   }
   return str;
 }
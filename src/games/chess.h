@@ -16,46 +16,94 @@
 
 namespace chess {
 
+// Bitboard chess. Squares are numbered rank * 8 + file from a1 = 0, and
+// pieces color * 6 + kind, which is also their feature plane.
 struct ChessBoard {
 
   static const size_t boardSize = 8;
-  static const size_t boardDim = boardSize + 4;
 
-  std::array<uint8_t, boardDim * boardDim> board;
-
-  std::vector<uint32_t> moves;
-  uint_fast32_t moveflags = 0;
-  std::array<std::vector<std::pair<uint64_t, char>>, 16> repetitions;
+  static const uint8_t PAWN = 0;
+  static const uint8_t KNIGHT = 1;
+  static const uint8_t BISHOP = 2;
+  static const uint8_t ROOK = 3;
+  static const uint8_t QUEEN = 4;
+  static const uint8_t KING = 5;
+  static const uint8_t EMPTY = 12;
+
+  static const uint8_t WHITE = 0;
+  static const uint8_t BLACK = 1;
+
+  // Moves are from | to << 6 | flag << 12. Promotions to a queen, rook,
+  // bishop and knight are flagged PROMOTION + 0, 1, 2 and 3.
+  static const uint16_t NORMAL = 0;
+  static const uint16_t DOUBLEPUSH = 1;
+  static const uint16_t CASTLE = 2;
+  static const uint16_t ENPASSANT = 3;
+  static const uint16_t PROMOTION = 4;
+
+  // Castling rights, shifted left by the color.
+  static const uint8_t castleleft = 1;
+  static const uint8_t castleright = 4;
+
+  std::array<uint8_t, 64> squares;
+  std::array<uint64_t, 6> pieces;  // by kind
+  std::array<uint64_t, 2> colors;
+
+  std::vector<uint16_t> moves;
+  uint8_t castling = 0;
+  int enPassant = -1;  // square of a pawn that just moved two squares
+  // Position hashes since the last capture or pawn move.
+  std::vector<uint64_t> repetitions;
   uint64_t hash = 0;
 
-  static const uint32_t castleleft = 1u << 28;
-  static const uint32_t castleright = 1u << 30;
-
   int turn = 0;
 
-  static const uint8_t EMPTY = 0;
-  static const uint8_t PAWN = 1;
-  static const uint8_t KNIGHT = 2;
-  static const uint8_t BISHOP = 4;
-  static const uint8_t ROOK = 8;
-  static const uint8_t QUEEN = 12;
-  static const uint8_t KING = 3;
-  static const uint8_t OOB = 0x80;
-
-  static const uint8_t WHITE = 1 << 5;
-  static const uint8_t BLACK = 2 << 5;
+  static int pieceKind(uint8_t piece) {
+    return piece >= 6 ? piece - 6 : piece;
+  }
+  static int moveFrom(uint_fast32_t move) {
+    return move & 63;
+  }
+  static int moveTo(uint_fast32_t move) {
+    return (move >> 6) & 63;
+  }
+  static int moveFlag(uint_fast32_t move) {
+    return move >> 12;
+  }
 
   void init();
 
+  // Sets up the position from the FEN string, for tests.
+  void setFen(const std::string& fen);
+
   void findMoves();
 
   void move(uint_fast32_t move);
 
   std::string moveString(uint_fast32_t move) const;
 
+  // Squares whose piece changes when the move is played, and their count.
+  int changedSquares(uint_fast32_t move, std::array<int, 4>& out) const;
+
+  // Number of leaf nodes of the legal move tree, of moves found by
+  // findMoves().
+  uint64_t perft(int depth) const;
+
+  // hash covers the pieces only and is updated incrementally by move();
+  // piecesHash() recomputes it from scratch. positionHash() adds the side to
+  // move, the castling rights and the en passant square.
+  uint64_t piecesHash() const;
+  uint64_t positionHash(uint64_t piecesHash) const;
+
   bool done = false;
   int winner = -1;
   int fiftyMoveCounter = 0;
+
+ private:
+  void clear();
+  void addPiece(int square, uint8_t piece);
+  void removePiece(int square);
+  uint64_t attackers(int square, uint64_t occupied) const;
 };
 
 class State : public core::State {
@@ -72,7 +120,6 @@ class State : public core::State {
 
   virtual void Initialize() override {
     _moves.clear();
-    _hash = 2166136261u;
     _status = GameStatus::player0Turn;
     _featSize[0] = 12;
     _featSize[1] = boardSize;
@@ -85,6 +132,7 @@ class State : public core::State {
     std::fill(_features.begin(), _features.end(), 0.0f);
     board.init();
     board.findMoves();
+    _hash = board.positionHash(board.hash);
     featurize();
     findActions();
     fillFullFeatures();
@@ -96,70 +144,15 @@ class State : public core::State {
 
   virtual std::string stateDescription() const override {
     std::string str;
-    const size_t boardDim = 8 + 4;
-    int y = 8;
-    for (size_t iy = 2 + boardDim * 2;;) {
-      str += '0' + y;
-      --y;
+    for (int y = 7; y >= 0; --y) {
+      str += char('1' + y);
       str += ' ';
-      size_t ii = (boardDim - 1 - iy / boardDim) * boardDim + 2;
-      for (size_t i = 0; i != 8; ++i, ++ii) {
-        int v = board.board[ii];
-        if (v & ChessBoard::WHITE) {
-          switch (v & 0xf) {
-          case ChessBoard::PAWN:
-            str += 'P';
-            break;
-          case ChessBoard::KNIGHT:
-            str += 'N';
-            break;
-          case ChessBoard::BISHOP:
-            str += 'B';
-            break;
-          case ChessBoard::ROOK:
-            str += 'R';
-            break;
-          case ChessBoard::QUEEN:
-            str += 'Q';
-            break;
-          case ChessBoard::KING:
-            str += 'K';
-            break;
-          default:
-            str += '.';
-          }
-        } else {
-          switch (v & 0xf) {
-          case ChessBoard::PAWN:
-            str += 'p';
-            break;
-          case ChessBoard::KNIGHT:
-            str += 'n';
-            break;
-          case ChessBoard::BISHOP:
-            str += 'b';
-            break;
-          case ChessBoard::ROOK:
-            str += 'r';
-            break;
-          case ChessBoard::QUEEN:
-            str += 'q';
-            break;
-          case ChessBoard::KING:
-            str += 'k';
-            break;
-          default:
-            str += '.';
-          }
-        }
+      for (int x = 0; x != 8; ++x) {
+        uint8_t v = board.squares[y * 8 + x];
+        str += v == ChessBoard::EMPTY ? '.' : "PNBRQKpnbrqk"[v];
         str += ' ';
       }
       str += '\n';
-      iy += 8 + 2;
-      if (iy == 12 + boardDim * 9) {
-        break;
-      }
-      iy += 2;
     }
     str += "  a b c d e f g h";
     return str;
@@ -171,95 +164,34 @@ class State : public core::State {
   }
 
   void featurize() {
-    const size_t boardDim = 8 + 4;
-    size_t findex = 0;
     std::fill(_features.begin(), _features.begin() + boardSize * boardSize * 12,
               0.0f);
-    for (size_t ii = 2 + boardDim * 2;;) {
-      for (size_t i = 0; i != 8; ++i, ++ii) {
-        int v = board.board[ii];
-        if (v) {
-          size_t offset = 0;
-          switch (v & 0xf) {
-          case ChessBoard::PAWN:
-            offset = 0;
-            break;
-          case ChessBoard::KNIGHT:
-            offset = 1;
-            break;
-          case ChessBoard::BISHOP:
-            offset = 2;
-            break;
-          case ChessBoard::ROOK:
-            offset = 3;
-            break;
-          case ChessBoard::QUEEN:
-            offset = 4;
-            break;
-          case ChessBoard::KING:
-            offset = 5;
-            break;
-          }
-          if (v & ChessBoard::BLACK) {
-            offset += 6;
-          }
-          _features[boardSize * boardSize * offset + findex] = 1.0f;
-        }
-        ++findex;
+    for (int i = 0; i != 64; ++i) {
+      uint8_t v = board.squares[i];
+      if (v != ChessBoard::EMPTY) {
+        _features[boardSize * boardSize * v + i] = 1.0f;
       }
-      ii += 2;
-      if (ii == 12 + boardDim * 9) {
-        break;
-      }
-      ii += 2;
     }
   }
 
   void findActions() {
     clearActions();
-
-    const size_t boardDim = 12;
-
     for (auto move : board.moves) {
-      size_t to = move >> 17;
-      size_t from = move & 0x7fff;
-
-      int v = board.board[from];
-
-      size_t offset = 0;
-      switch (v & 0xf) {
-      case ChessBoard::PAWN:
-        offset = 0;
-        break;
-      case ChessBoard::KNIGHT:
-        offset = 1;
-        break;
-      case ChessBoard::BISHOP:
-        offset = 2;
-        break;
-      case ChessBoard::ROOK:
-        offset = 3;
-        break;
-      case ChessBoard::QUEEN:
-        offset = 4;
-        break;
-      case ChessBoard::KING:
-        offset = 5;
-        break;
-      }
-
-      size_t x = to % boardDim - 2;
-      size_t y = to / boardDim - 2;
-
-      addAction(offset, y, x);
+      int to = ChessBoard::moveTo(move);
+      int offset = ChessBoard::pieceKind(
+          board.squares[ChessBoard::moveFrom(move)]);
+      addAction(offset, to / 8, to % 8);
     }
   }
 
   virtual void ApplyAction(const _Action& action) override {
     auto move = board.moves.at(action.GetIndex());
 
+    std::array<int, 4> changed;
+    int numChanged = board.changedSquares(move, changed);
     board.move(move);
     board.findMoves();
+    _hash = board.positionHash(board.hash);
     findActions();
 
     if (board.done) {
@@ -273,11 +205,25 @@ class State : public core::State {
     } else {
       _status =
           board.turn == 0 ? GameStatus::player0Turn : GameStatus::player1Turn;
-      featurize();
+      // Only the planes of the squares the move changed need updating.
+      for (int k = 0; k != numChanged; ++k) {
+        int i = changed[k];
+        for (int plane = 0; plane != 12; ++plane) {
+          _features[boardSize * boardSize * plane + i] = 0.0f;
+        }
+        uint8_t v = board.squares[i];
+        if (v != ChessBoard::EMPTY) {
+          _features[boardSize * boardSize * v + i] = 1.0f;
+        }
+      }
     }
     fillFullFeatures();
   }
 
+  virtual uint64_t computeHash() const override {
+    return board.positionHash(board.piecesHash());
+  }
+
   virtual void DoGoodAction() override {
     return DoRandomAction();
   }
@@ -396,7 +396,23 @@ void State::ApplyAction(const _Action& action) {
       }
     }
   }
-  _hash = board.getHash();
+  _hash = board.getHash() ^ jumpHash();
+}
+
+uint64_t State::computeHash() const {
+  return board.computeHash(hands % 2 == 1) ^ jumpHash();
+}
+
+// The features are only refreshed when the turn changes, so in the middle of
+// a chain of jumps they still show the position before it.
+bool State::hasPositionalFeatures() const {
+  return false;
+}
+
+// A non-empty way means the current player may keep jumping with the piece
+// that landed on way.back().tx.
+uint64_t State::jumpHash() const {
+  return way.empty() ? 0 : _Zobrist::key(way.back().tx);
 }
 
 Player State::changeTurn(Player player) {
@@ -21,6 +21,7 @@
 #include "../core/state.h"
 #include "chinesecheckers_defines.h"
 #include "commons/chessboard.h"
+#include "commons/hash.h"
 
 using namespace std;
 
@@ -224,6 +225,8 @@ class State : public core::State, public Game {
   unique_ptr<core::State> clone_() const override;
   void ApplyAction(const _Action& action) override;
   void DoGoodAction() override;
+  uint64_t computeHash() const override;
+  bool hasPositionalFeatures() const override;
   void printCurrentBoard() const override;
   string stateDescription() const override;
   string actionsDescription() const override;
@@ -237,8 +240,11 @@ class State : public core::State, public Game {
   bool canChange(Player Player);
   void findActions();
   void findFeatures();
+  uint64_t jumpHash() const;
 
   int seed;
+  // One key per square for the piece in the middle of a jump sequence.
+  using _Zobrist = Zobrist<boardWH * boardWH>;
 
   static constexpr size_t featuresSizeX = chesses;
   static constexpr size_t featuresSizeY = boardWH;
@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Helpers for games that keep their boards as 64-bit bitboards.
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Writes bit i of bits to out[i] as 0 or 1, for i < n <= 64: a feature plane
+// from a bitboard.
+inline void expandBits(uint64_t bits, float* out, int n) {
+  int i = 0;
+#if defined(__AVX2__)
+  const __m256i select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  for (; i + 8 <= n; i += 8) {
+    __m256i b = _mm256_set1_epi32((bits >> i) & 0xff);
+    __m256i set = _mm256_cmpeq_epi32(_mm256_and_si256(b, select), select);
+    _mm256_storeu_ps(out + i, _mm256_and_ps(_mm256_castsi256_ps(set), one));
+  }
+#elif defined(__SSE2__)
+  const __m128i select = _mm_setr_epi32(1, 2, 4, 8);
+  const __m128 one = _mm_set1_ps(1.0f);
+  for (; i + 4 <= n; i += 4) {
+    __m128i b = _mm_set1_epi32((bits >> i) & 0xf);
+    __m128i set = _mm_cmpeq_epi32(_mm_and_si128(b, select), select);
+    _mm_storeu_ps(out + i, _mm_and_ps(_mm_castsi128_ps(set), one));
+  }
+#endif
+  for (; i < n; ++i) {
+    out[i] = (bits >> i) & 1;
+  }
+}
+
+// Mirrors an 8x8 bitboard about its a1-h8 diagonal, swapping the roles of
+// bit i * 8 + j and bit j * 8 + i.
+inline uint64_t flipDiagonal(uint64_t b) {
+  const uint64_t k1 = 0x5500550055005500ull;
+  const uint64_t k2 = 0x3333000033330000ull;
+  const uint64_t k4 = 0x0f0f0f0f00000000ull;
+  uint64_t t = k4 & (b ^ (b << 28));
+  b ^= t ^ (t >> 28);
+  t = k2 & (b ^ (b << 14));
+  b ^= t ^ (t >> 14);
+  t = k1 & (b ^ (b << 7));
+  b ^= t ^ (t >> 7);
+  return b;
+}
@@ -65,6 +65,7 @@ template <int ROW, int COL, bool INVERTY = true> class Chessboard {
       const std::set<std::tuple<int, int>>& markedPos = {}) const;
   const Board& getBoard() const;
   std::uint64_t getHash() const;
+  std::uint64_t computeHash(bool turned) const;
   virtual std::string getPosStr(int xy) const;
   virtual std::string getPosStr(int x, int y) const;
   virtual std::optional<std::tuple<int, int>> parsePosStr(
@@ -261,6 +262,16 @@ std::uint64_t Chessboard<ROW, COL, INVERTY>::getHash() const {
   return hash;
 }
 
+// Recomputes from scratch the hash maintained incrementally by setChess() and
+// turnHash(); turned tells whether the turn key is currently toggled.
+template <int ROW, int COL, bool INVERTY>
+std::uint64_t Chessboard<ROW, COL, INVERTY>::computeHash(bool turned) const {
+  std::uint64_t h = turned ? hashTurn : 0ULL;
+  for (int xy = 0; xy < squares; xy++)
+    h ^= hashList[squares * getChess(xy) + xy];
+  return h;
+}
+
 template <int ROW, int COL, bool INVERTY>
 std::string Chessboard<ROW, COL, INVERTY>::getPosStr(int xy) const {
   auto [x, y] = posTo2D(xy);
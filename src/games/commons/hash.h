@@ -7,6 +7,10 @@
 
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <random>
+
 template <typename T, size_t SIZE> class HashBook {
  public:
   using Storage = std::array<T, SIZE>;
@@ -53,3 +57,29 @@ template <typename T, size_t SIZE> class Hasher {
   const HashBook<T, SIZE>* _hashBook;
   uint64_t _hash;
 };
+
+// Zobrist keys shared by all the states of a game. The keys are drawn once from
+// a fixed seed, so that a position hashes to the same value in every instance
+// and every process. Games XOR Zobrist<SIZE>::key(i) into core::State::_hash
+// in ApplyAction, and recompute it from scratch in computeHash().
+template <size_t SIZE> class Zobrist {
+ public:
+  static constexpr size_t size = SIZE;
+
+  static const HashBook<uint64_t, SIZE>& book() {
+    static const Zobrist zobrist;
+    return zobrist._book;
+  }
+
+  static uint64_t key(size_t i) {
+    return book()[i];
+  }
+
+ private:
+  Zobrist() {
+    std::mt19937_64 rng(0x9e3779b97f4a7c15ull ^ SIZE);
+    _book.setup(rng);
+  }
+
+  HashBook<uint64_t, SIZE> _book;
+};
@@ -16,6 +16,8 @@
 #include <sys/time.h>
 #include <time.h>
 
+#include "commons/hash.h"
+
 using namespace std;
 namespace Connect6 {
 
@@ -53,6 +55,9 @@ class C6Move {
 class C6Board {
 
  public:
+  // One key per (color, cell); whose turn it is follows from the stone count.
+  using C6Zobrist = Zobrist<2 * C6Dx * C6Dy>;
+
   int nb;
   char board[C6Dx][C6Dy];
   unsigned long long hash;
@@ -181,6 +186,16 @@ class C6Board {
   void play(C6Move m) {
 
     board[m.x][m.y] = m.color;
+    hash ^= C6Zobrist::key((m.color * C6Dx + m.x) * C6Dy + m.y);
+  }
+
+  unsigned long long fullHash() const {
+    unsigned long long h = 0;
+    for (int i = 0; i < C6Dx; i++)
+      for (int j = 0; j < C6Dy; j++)
+        if (board[i][j] != C6Empty)
+          h ^= C6Zobrist::key((board[i][j] * C6Dx + i) * C6Dy + j);
+    return h;
   }
 
   int legalMoves(C6Move moves[C6MaxLegalMoves]) {
@@ -196,6 +196,10 @@ class StateForConnect6 : public core::State, C6Board {
     fillFullFeatures();
   }
 
+  virtual uint64_t computeHash() const override {
+    return fullHash();
+  }
+
   virtual void DoGoodAction() override {
     return DoRandomAction();
   }
@@ -7,12 +7,15 @@
 
 #pragma once
 
+#include <array>
 #include <iostream>
 #include <random>
 #include <string>
 #include <vector>
 
 #include "../core/state.h"
+#include "commons/bitboard.h"
+#include "commons/hash.h"
 
 class StateForConnectFour : public core::State {
  public:
@@ -22,7 +25,7 @@ class StateForConnectFour : public core::State {
 
   virtual void Initialize() override {
     _moves.clear();
-    _hash = 2166136261u;
+    _hash = 0;
     _status = GameStatus::player0Turn;
     _featSize[0] = 3;
     _featSize[1] = boardHeight;
@@ -33,10 +36,9 @@ class StateForConnectFour : public core::State {
     _features.clear();
     _features.resize(_featSize[0] * _featSize[1] * _featSize[2]);
     std::fill(_features.begin(), _features.end(), 1.0f);
-    board.clear();
-    board.resize(boardWidth * boardHeight, 0);
-    height.clear();
-    height.resize(boardWidth, 0);
+    _binaryFeatures = true;
+    stones.fill(0);
+    height.fill(0);
     featurize();
     findActions();
     fillFullFeatures();
@@ -51,15 +53,13 @@ class StateForConnectFour : public core::State {
     for (int r = boardHeight - 1; r >= 0; --r) {
       std::cout << "|";
       for (int c = 0; c < boardWidth; ++c) {
-        auto val = board[r * boardWidth + c];
-        if (val == 0) {
-          std::cout << " ";
-        } else if (val == 1) {
+        uint64_t bit = uint64_t(1) << (r * rowBits + c);
+        if (stones[0] & bit) {
           std::cout << "X";
-        } else if (val == 2) {
+        } else if (stones[1] & bit) {
           std::cout << "O";
         } else {
-          assert(false);
+          std::cout << " ";
         }
         std::cout << "|";
       }
@@ -67,14 +67,12 @@ class StateForConnectFour : public core::State {
     }
   }
 
+  // Planes of the stones of the player whose turn it is in _status, and of
+  // the other player.
   void featurize() {
-    int player = 1 + getCurrentPlayer();
-    int otherPlayer = player == 1 ? 2 : 1;
-    for (int i = 0; i != (int)board.size(); ++i) {
-      int v = board[i];
-      _features[i] = v == player;
-      _features[board.size() + i] = v == otherPlayer;
-    }
+    int player = getCurrentPlayer();
+    expandBits(packRows(stones[player]), _features.data(), cells);
+    expandBits(packRows(stones[1 - player]), _features.data() + cells, cells);
   }
 
   void findActions() {
@@ -91,34 +89,23 @@ class StateForConnectFour : public core::State {
     int y = height.at(x);
     ++height[x];
     int player = 1 + getCurrentPlayer();
-    size_t index = x + y * boardWidth;
-    board.at(index) = player;
-    _hash ^= index;
-    _hash *= 16777619u;
-    auto count = [&](int dx, int dy) {
-      int nx = x + dx;
-      int ny = y + dy;
-      int r = 0;
-      int stride = dx + dy * boardWidth;
-      size_t nIndex = index + stride;
-      while (nx >= 0 && nx < boardWidth && ny >= 0 && ny < boardHeight &&
-             board.at(nIndex) == player) {
-        ++r;
-        nIndex += stride;
-        nx += dx;
-        ny += dy;
-      }
-      return r;
-    };
-    bool won = count(-1, 0) + count(1, 0) >= 3;
-    won |= count(0, -1) + count(0, 1) >= 3;
-    won |= count(-1, -1) + count(1, 1) >= 3;
-    won |= count(1, -1) + count(-1, 1) >= 3;
+    uint64_t& own = stones[player - 1];
+    own |= uint64_t(1) << (y * rowBits + x);
+    _hash ^= _Zobrist::key((player - 1) * cells + x + y * boardWidth);
+    // Each row has a spare high bit, so no line wraps around the board.
+    bool won = false;
+    for (int shift : {1, rowBits, rowBits + 1, rowBits - 1}) {
+      uint64_t pairs = own & (own >> shift);
+      won |= (pairs & (pairs >> (2 * shift))) != 0;
+    }
     if (won) {
       _status = player == 1 ? GameStatus::player0Win : GameStatus::player1Win;
     } else {
       featurize();
-      findActions();
+      if (height[x] == boardHeight) {
+        eraseAction(lowerBoundAction(
+            [x](const _Action& a) { return a.GetX() < x; }));
+      }
       if (_legalActions.empty()) {
         _status = GameStatus::tie;
       } else {
@@ -129,12 +116,45 @@ class StateForConnectFour : public core::State {
     fillFullFeatures();
   }
 
+  virtual uint64_t computeHash() const override {
+    uint64_t hash = 0;
+    for (int player = 0; player != 2; ++player) {
+      for (int i = 0; i != cells; ++i) {
+        int x = i % boardWidth;
+        int y = i / boardWidth;
+        if (stones[player] & (uint64_t(1) << (y * rowBits + x))) {
+          hash ^= _Zobrist::key(player * cells + i);
+        }
+      }
+    }
+    return hash;
+  }
+
   virtual void DoGoodAction() override {
     return DoRandomAction();
   }
 
-  int boardWidth = 7;
-  int boardHeight = 6;
-  std::vector<char> board;
-  std::vector<char> height;
+  static constexpr int boardWidth = 7;
+  static constexpr int boardHeight = 6;
+  static constexpr int cells = boardWidth * boardHeight;
+
+  // One key per (player, cell); the side to move follows from the stone count.
+  using _Zobrist = Zobrist<2 * cells>;
+
+  // Bitboards of the stones of each player: bit y * rowBits + x for column x
+  // and row y from the bottom.
+  static constexpr int rowBits = 8;
+  std::array<uint64_t, 2> stones;
+  std::array<char, boardWidth> height;
+
+ private:
+  // Drops the spare bit of each row: bit y * boardWidth + x for the stone at
+  // column x and row y.
+  static uint64_t packRows(uint64_t b) {
+    uint64_t packed = 0;
+    for (int y = 0; y != boardHeight; ++y) {
+      packed |= ((b >> (y * rowBits)) & 0x7f) << (y * boardWidth);
+    }
+    return packed;
+  }
 };
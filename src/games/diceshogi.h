@@ -14,6 +14,7 @@
 
 #pragma once
 #include "../core/state.h"
+#include "commons/hash.h"
 #include "shogi.h"
 #include <queue>
 #include <sstream>
@@ -21,9 +22,13 @@
 
 class StateForDiceshogi : public core::State, public Shogi {
  public:
-  unsigned long long HashArray[2][10][Dx][Dy];
-  unsigned long long HashArrayJail[20];
-  unsigned long long HashTurn;
+  // Zobrist keys: (color, piece kind, cell), (color, piece type in hand), side
+  // to move and dice. hash covers everything but the dice.
+  static constexpr int hashPieceKinds = 11;
+  static constexpr int hashJailOffset = 2 * hashPieceKinds * Dx * Dy;
+  static constexpr int hashTurn = hashJailOffset + 2 * hashPieceKinds;
+  static constexpr int hashDiceOffset = hashTurn + 1;
+  using _Zobrist = Zobrist<hashDiceOffset + 6>;
   unsigned long long hash;
   int length;
   short dice;  // 0-5
@@ -52,7 +57,6 @@ class StateForDiceshogi : public core::State, public Shogi {
     // setFeatures(false, false, false, 0, 0, false);
 
     gameInit();
-    initHash();
     // printCurrentBoard();
 
     findFeature();
@@ -92,35 +96,14 @@ class StateForDiceshogi : public core::State, public Shogi {
       dice = _rng() % 6;
     }
 
-    _hash = dice + 1;
-    hash = 0;
+    hash = piecesHash();
+    _hash = hash ^ _Zobrist::key(hashDiceOffset + dice);
     length = 0;
     repeat = 0;
+    situation = std::queue<unsigned long long>();
     situation.push(hash);
   }
 
-  void initHash() {
-    for (int a = 0; a < 2; ++a)
-      for (int b = 0; b < 10; ++b)
-        for (int c = 0; c < 5; ++c)
-          for (int d = 0; d < 5; ++d) {
-            HashArray[a][b][c][d] = 0;
-            for (int k = 0; k < 64; ++k)
-              if ((_rng() / (RAND_MAX + 1.0)) > 0.5)
-                HashArray[a][b][c][d] |= (1ULL << k);
-          }
-    for (int a = 0; a < 20; ++a) {
-      for (int k = 0; k < 64; ++k)
-        if ((_rng() / (RAND_MAX + 1.0)) > 0.5)
-          HashArrayJail[a] |= (1ULL << k);
-    }
-
-    HashTurn = 0;
-    for (int k = 0; k < 64; k++)
-      if ((_rng() / (RAND_MAX + 1.0)) > 0.5)
-        HashTurn |= (1ULL << k);
-  }
-
   void findFeature() {
     std::vector<float> old(_features);
     for (int i = 0; i < 5425; ++i)
@@ -436,7 +419,7 @@ class StateForDiceshogi : public core::State, public Shogi {
     return std::make_unique<StateForDiceshogi>(*this);
   }
 
-  int getHashNum(Piece p) {
+  int getHashNum(Piece p) const {
     int num = (int)p.type;
     if (num >= 7)
       num -= 5;
@@ -448,9 +431,37 @@ class StateForDiceshogi : public core::State, public Shogi {
     return num;
   }
 
-  int getHashNumjail(Piece p) {
-    // 0~19
-    return (int)p.type - 2 + 10 * p.color;
+  int getHashNumjail(Piece p) const {
+    return (int)p.type - 1 + hashPieceKinds * p.color;
+  }
+
+  unsigned long long pieceHash(const Piece& p, int x, int y) const {
+    return _Zobrist::key(
+        ((p.color * hashPieceKinds + getHashNum(p)) * Dx + x) * Dy + y);
+  }
+
+  unsigned long long jailHash(const Piece& p) const {
+    return _Zobrist::key(hashJailOffset + getHashNumjail(p));
+  }
+
+  // Recomputes from scratch the hash maintained incrementally by play().
+  unsigned long long piecesHash() const {
+    unsigned long long h = 0;
+    for (int color = 0; color < 2; ++color) {
+      for (const Piece& p : chess[color]) {
+        if (p.pos.on_board())
+          h ^= pieceHash(p, p.pos.x, p.pos.y);
+        else
+          h ^= jailHash(p);
+      }
+    }
+    if (_status == GameStatus::player1Turn)
+      h ^= _Zobrist::key(hashTurn);
+    return h;
+  }
+
+  virtual uint64_t computeHash() const override {
+    return piecesHash() ^ _Zobrist::key(hashDiceOffset + dice);
   }
 
   void play(Move m) {
@@ -460,17 +471,16 @@ class StateForDiceshogi : public core::State, public Shogi {
     m.piece.promoted |= m.promote;
 
     if (m.piece.pos.on_board()) {
-      hash ^= HashArray[m.piece.color][getHashNum(m.piece)][m.piece.pos.x]
-                       [m.piece.pos.y];
+      hash ^= pieceHash(
+          board[m.piece.pos.x][m.piece.pos.y], m.piece.pos.x, m.piece.pos.y);
       // eat
       if (board[m.next.x][m.next.y].color != Empty) {
         int opp = opponent(m.piece.color);
-        hash ^= HashArray[opp][getHashNum(board[m.next.x][m.next.y])][m.next.x]
-                         [m.next.y];
-        hash ^= HashArrayJail[getHashNumjail(m.piece)];
+        hash ^= pieceHash(board[m.next.x][m.next.y], m.next.x, m.next.y);
 
         Piece tmp(
             m.piece.color, new_type(board[m.next.x][m.next.y].type), false);
+        hash ^= jailHash(tmp);
         chess[m.piece.color].push_back(tmp);
 
         std::vector<Piece>::iterator it;
@@ -500,7 +510,7 @@ class StateForDiceshogi : public core::State, public Shogi {
         }
       }
     } else {  // Drop move
-      hash ^= HashArrayJail[getHashNumjail(m.piece)];
+      hash ^= jailHash(m.piece);
       std::vector<Piece>::iterator it;
       for (it = chess[m.piece.color].begin(); it != chess[m.piece.color].end();
            ++it) {
@@ -511,9 +521,8 @@ class StateForDiceshogi : public core::State, public Shogi {
         }
       }
     }
-    hash ^= HashArray[m.piece.color][getHashNum(board[m.next.x][m.next.y])]
-                     [m.next.x][m.next.y];
-    hash ^= HashTurn;
+    hash ^= pieceHash(board[m.next.x][m.next.y], m.next.x, m.next.y);
+    hash ^= _Zobrist::key(hashTurn);
 
     if (length < MaxPlayoutLength) {
       // rollout[length] = m;
@@ -612,7 +621,7 @@ class StateForDiceshogi : public core::State, public Shogi {
       } else {
         dice = _rng() % 6;
       }
-      _hash = dice + 1;
+      _hash = hash ^ _Zobrist::key(hashDiceOffset + dice);
       findFeature();
       findActions();
       fillFullFeatures();
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "../core/state.h"
+#include "commons/hash.h"
 
 class StateForEinstein : public core::State {
  public:
@@ -67,8 +68,12 @@ class StateForEinstein : public core::State {
   int dice;
   int round;
   std::vector<Move> moves;
-  //  unsigned long long HashArray[2][6][5][5];
-  unsigned long long HashTurn;
+  // Zobrist keys: (color, piece, cell), side to move, placement phase (the
+  // first 12 rounds) and dice.
+  static const int hashTurn = 2 * 6 * 25;
+  static const int hashSetup = hashTurn + 1;
+  static const int hashDiceOffset = hashSetup + 1;
+  using _Zobrist = Zobrist<hashDiceOffset + 6>;
 
   StateForEinstein(int seed)
       : State(seed) {
@@ -99,22 +104,6 @@ class StateForEinstein : public core::State {
     findActions();
   }
 
-  void initHash() {
-    /*    for (int i = 0; i < 2; ++i)
-          for (int j = 0; j < 6; ++j)
-            for (int x = 0; x < boardWidth; ++x)
-              for (int y = 0; y < boardHeight; ++y) {
-                HashArray[i][j][x][y] = 0;
-                for (int k = 0; k < 64; ++k)
-                  if ((_rng() / (RAND_MAX + 1.0)) > 0.5)
-                    HashArray[i][j][x][y] |= (1ULL << k);
-              }
-        HashTurn = 0;
-        for (int k = 0; k < 64; ++k)
-          if ((_rng() / (RAND_MAX + 1.0)) > 0.5)
-            HashTurn |= (1ULL << k);*/
-  }
-
   void gameInit() {
     for (int j = 0; j < boardHeight; ++j)
       for (int i = 0; i < boardWidth; ++i)
@@ -129,8 +118,25 @@ class StateForEinstein : public core::State {
     } else {
       dice = _rng() % 6;
     }
-    _hash = dice;
     round = 1;
+    _hash = computeHash();
+  }
+
+  static uint64_t pieceHash(int color, int t, int x, int y) {
+    return _Zobrist::key((color * 6 + t) * 25 + y * 5 + x);
+  }
+
+  virtual uint64_t computeHash() const override {
+    uint64_t hash = _Zobrist::key(hashDiceOffset + dice);
+    for (int y = 0; y < boardHeight; ++y)
+      for (int x = 0; x < boardWidth; ++x)
+        if (board[y][x].type != 0)
+          hash ^= pieceHash(board[y][x].color, board[y][x].type - 1, x, y);
+    if (_status == GameStatus::player1Turn)
+      hash ^= _Zobrist::key(hashTurn);
+    if (round <= 12)
+      hash ^= _Zobrist::key(hashSetup);
+    return hash;
   }
 
   virtual void setStateFromStr(const std::string& str) override {
@@ -170,8 +176,8 @@ class StateForEinstein : public core::State {
     } else {
       dice = _rng() % 6;
     }
-    _hash = dice;
     round = 13;
+    _hash = computeHash();
     findActions();
   }
 
@@ -381,6 +387,7 @@ class StateForEinstein : public core::State {
       color = 1;
       _status = GameStatus::player0Turn;
     }
+    _hash ^= _Zobrist::key(hashTurn);
 
     int t = action.GetX();
     assert(t < 6);
@@ -396,18 +403,18 @@ class StateForEinstein : public core::State {
       player[color][t].onboard = true;
     } else {
       board[player[color][t].y][player[color][t].x] = Piece();
+      _hash ^= pieceHash(color, t, player[color][t].x, player[color][t].y);
     }
 
     if (board[y][x].type != 0) {  // eat
       player[board[y][x].color][board[y][x].type - 1].onboard = false;
       player[board[y][x].color][board[y][x].type - 1].setPosition(-1, -1);
-      //      _hash ^= HashArray[board[y][x].color][board[y][x].type - 1][x][y];
+      _hash ^= pieceHash(board[y][x].color, board[y][x].type - 1, x, y);
     }
     player[color][t].onboard = true;
     player[color][t].setPosition(x, y);
     board[y][x] = player[color][t];
-    //    _hash ^= HashArray[color][t][x][y];
-    //    _hash ^= HashTurn;
+    _hash ^= pieceHash(color, t, x, y);
     // fprintf(stderr, "(%d %d) t:%d c:%d\n", x, y, board[y][x].type,
     // board[y][x].color);
 
@@ -417,6 +424,9 @@ class StateForEinstein : public core::State {
       _status = GameStatus::player1Win;
     else {
       round += 1;
+      if (round == 13)
+        _hash ^= _Zobrist::key(hashSetup);
+      _hash ^= _Zobrist::key(hashDiceOffset + dice);
       if (forcedDice > 0) {
         assert(forcedDice > 0);
         assert(forcedDice < 7);
@@ -425,7 +435,7 @@ class StateForEinstein : public core::State {
       } else {
         dice = _rng() % 6;
       }
-      _hash = dice;
+      _hash ^= _Zobrist::key(hashDiceOffset + dice);
       findActions();
     }
     findFeature();
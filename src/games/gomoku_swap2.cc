@@ -12,6 +12,7 @@ namespace GomokuSwap2 {
 void Game::initGame() {
   board.initialize();
   hands = 0;
+  isTurned = false;
   winner = -1;
 }
 
@@ -172,7 +173,12 @@ void State::ApplyAction(const _Action& action) {
       findFeatures();
     }
   }
-  _hash = board.getHash();
+  _hash = board.getHash() ^ (isTurned ? _Zobrist::key(0) : 0);
+}
+
+uint64_t State::computeHash() const {
+  return board.computeHash(hands % 2 == 1) ^
+         (isTurned ? _Zobrist::key(0) : 0);
 }
 
 bool State::canGoNext(Move& m) {
@@ -14,6 +14,7 @@
 
 #include "../core/state.h"
 #include "commons/chessboard.h"
+#include "commons/hash.h"
 
 using namespace std;
 
@@ -75,6 +76,7 @@ class State : public core::State, public Game {
   unique_ptr<core::State> clone_() const override;
   void ApplyAction(const ::_Action& action) override;
   void DoGoodAction() override;
+  uint64_t computeHash() const override;
   // void printCurrentBoard() const override;
   // string stateDescription() const override;
   // std::string actionDescription(const ::_Action& action) const override;
@@ -92,6 +94,8 @@ class State : public core::State, public Game {
   static constexpr size_t featuresSizeZ = boardRadix;
   static constexpr size_t featuresSize =
       featuresSizeX * featuresSizeY * featuresSizeZ;
+  // The board hash covers stones and side to move; this key covers the swap.
+  using _Zobrist = Zobrist<1>;
 };
 
 }  // namespace GomokuSwap2
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "commons/hash.h"
 #include "game_player.h"
 
 #include <array>
@@ -29,17 +30,18 @@ constexpr int fullsize(int size) {
   return 2 * size - 1;
 }
 
+// Zobrist hash of a board: one key per (color, cell), plus the side to move
+// and the pie rule. The keys are shared, the value belongs to each board.
 template <int SIZE> class Hash {
  protected:
-  unsigned long long _array[2][fullsize(SIZE)][fullsize(SIZE)];
-  unsigned long long _turn;
+  using Keys = Zobrist<2 * fullsize(SIZE) * fullsize(SIZE) + 2>;
   unsigned long long _value;
 
  public:
-  Hash();
   void init();
   void updateArray(int color, int j, int i);
   void updateTurn();
+  void updatePie();
   unsigned long long getValue() const;
 };
 
@@ -64,6 +66,94 @@ struct PathInfo {
   }
 };
 
+// Board topology: constant, so it is computed at compile time and shared by
+// all the boards of a size.
+template <int SIZE> struct Topology {
+  static constexpr int F = fullsize(SIZE);
+
+  static constexpr bool isValidCell(int i, int j) {
+    return i >= 0 and i < F and j >= 0 and j < F and i + j >= SIZE - 1 and
+           i + j <= 3 * SIZE - 3;
+  }
+
+  // Neighbours of each cell (indices), in the order (i - 1, j),
+  // (i - 1, j + 1), (i, j - 1), (i, j + 1), (i + 1, j - 1), (i + 1, j);
+  // end value: -1.
+  static constexpr std::array<std::array<int, 7>, F * F> neighbours() {
+    std::array<std::array<int, 7>, F * F> neighboursBoard{};
+    constexpr int di[6] = {-1, -1, 0, 0, 1, 1};
+    constexpr int dj[6] = {0, 1, -1, 1, -1, 0};
+    for (int i = 0; i < F; i++) {
+      for (int j = 0; j < F; j++) {
+        auto& neighbours = neighboursBoard[i * F + j];
+        int k = 0;
+        for (int d = 0; d < 6; d++) {
+          if (isValidCell(i + di[d], j + dj[d])) {
+            neighbours[k++] = (i + di[d]) * F + j + dj[d];
+          }
+        }
+        neighbours[k] = -1;
+      }
+    }
+    return neighboursBoard;
+  }
+
+  // Bit b of the borders of a cell is set if the cell is on border b, not
+  // counting the corners.
+  static constexpr std::array<unsigned, F * F> borders() {
+    std::array<unsigned, F * F> bordersBoard{};
+    constexpr int e1 = SIZE - 1;
+    constexpr int s1 = F - 1;
+    for (int i = 0; i < F; i++) {
+      for (int j = 0; j < F; j++) {
+        if (!isValidCell(i, j))
+          continue;
+        unsigned& borders = bordersBoard[i * F + j];
+        if (i == 0 and e1 < j and j < s1)
+          borders += 1;
+        if (0 < i and i < e1 and j == s1)
+          borders += 2;
+        if (i + j == 3 * e1 and i < s1 and j < s1)
+          borders += 4;
+        if (i == s1 and 0 < j and j < e1)
+          borders += 8;
+        if (e1 < i and i < s1 and j == 0)
+          borders += 16;
+        if (i + j == e1 and i > 0 and j > 0)
+          borders += 32;
+      }
+    }
+    return bordersBoard;
+  }
+
+  // Bit b of the corners of a cell is set if the cell is corner b.
+  static constexpr std::array<unsigned, F * F> corners() {
+    std::array<unsigned, F * F> cornersBoard{};
+    constexpr int e1 = SIZE - 1;
+    constexpr int s1 = F - 1;
+    for (int i = 0; i < F; i++) {
+      for (int j = 0; j < F; j++) {
+        if (!isValidCell(i, j))
+          continue;
+        unsigned& corners = cornersBoard[i * F + j];
+        if (i == 0 and j == e1)
+          corners += 1;
+        if (i == 0 and j == s1)
+          corners += 2;
+        if (i == e1 and j == s1)
+          corners += 4;
+        if (i == s1 and j == e1)
+          corners += 8;
+        if (i == s1 and j == 0)
+          corners += 16;
+        if (i == e1 and j == 0)
+          corners += 32;
+      }
+    }
+    return cornersBoard;
+  }
+};
+
 template <int SIZE, bool PIE> class Board {
 
  protected:
@@ -77,12 +167,15 @@ template <int SIZE, bool PIE> class Board {
   std::optional<int> _lastIndex;
   int _nbEmptyIndices;
 
-  // neighbours of each cell (indices)
-  // end value: -1
-  std::array<std::array<int, 7>, fullsize(SIZE) * fullsize(SIZE)>
-      _neighboursBoard;
+  // topology, shared by all boards so that copying a board only copies what
+  // changes: the neighbours of each cell (indices, end value: -1), and the
+  // borders and corners of each cell as computeBorders and computeCorners
+  // return them
+  static constexpr auto _neighboursBoard = Topology<SIZE>::neighbours();
+  static constexpr auto _bordersBoard = Topology<SIZE>::borders();
+  static constexpr auto _cornersBoard = Topology<SIZE>::corners();
 
-  static inline Hash<SIZE> _hash;
+  Hash<SIZE> _hash;
 
  public:  // TODO getter ?
   // PathInfo of the paths indexed from _pathBoard
@@ -108,6 +201,7 @@ template <int SIZE, bool PIE> class Board {
   static int convertCellToIndex(const Cell& refCell);
 
   unsigned long long getHashValue() const;
+  unsigned long long computeHashValue() const;
 
   Color getColorAtIndex(int index) const;
 
@@ -152,32 +246,21 @@ template <int SIZE, bool PIE> class Board {
 // Havannah::Hash
 ///////////////////////////////////////////////////////////////////////////////
 
-template <int SIZE> Havannah::Hash<SIZE>::Hash() {
-  for (int color = 0; color < 2; color++)
-    for (int j = 0; j < fullsize(SIZE); j++)
-      for (int i = 0; i < fullsize(SIZE); i++) {
-        _array[color][j][i] = 0;
-        for (int k = 0; k < 64; k++)
-          if ((rand() / (RAND_MAX + 1.0)) > 0.5)
-            _array[color][j][i] |= (1ULL << k);
-      }
-  _turn = 0;
-  for (int k = 0; k < 64; k++)
-    if ((rand() / (RAND_MAX + 1.0)) > 0.5)
-      _turn |= (1ULL << k);
-}
-
 template <int SIZE> void Havannah::Hash<SIZE>::init() {
   _value = 0;
 }
 
 template <int SIZE>
 void Havannah::Hash<SIZE>::updateArray(int color, int j, int i) {
-  _value ^= _array[color][j][i];
+  _value ^= Keys::key((color * fullsize(SIZE) + j) * fullsize(SIZE) + i);
 }
 
 template <int SIZE> void Havannah::Hash<SIZE>::updateTurn() {
-  _value ^= _turn;
+  _value ^= Keys::key(2 * fullsize(SIZE) * fullsize(SIZE));
+}
+
+template <int SIZE> void Havannah::Hash<SIZE>::updatePie() {
+  _value ^= Keys::key(2 * fullsize(SIZE) * fullsize(SIZE) + 1);
 }
 
 template <int SIZE> unsigned long long Havannah::Hash<SIZE>::getValue() const {
@@ -253,6 +336,27 @@ unsigned long long Havannah::Board<SIZE, PIE>::getHashValue() const {
   return _hash.getValue();
 }
 
+// Recomputes from scratch the value maintained incrementally by play().
+template <int SIZE, bool PIE>
+unsigned long long Havannah::Board<SIZE, PIE>::computeHashValue() const {
+  Hash<SIZE> hash;
+  hash.init();
+  for (int index = 0; index < _nbFullIndices; index++) {
+    if (isValidIndex(index)) {
+      Color color = getColorAtIndex(index);
+      if (color != COLOR_NONE) {
+        Cell cell = convertIndexToCell(index);
+        hash.updateArray(color, cell.second, cell.first);
+      }
+    }
+  }
+  if (_currentColor == COLOR_WHITE)
+    hash.updateTurn();
+  if (_hasPie)
+    hash.updatePie();
+  return hash.getValue();
+}
+
 template <int SIZE, bool PIE>
 void Havannah::Board<SIZE, PIE>::getPathIndexAndColorAtIndex(
     int index, int& pathIndex, Color& color) const {
@@ -296,25 +400,7 @@ template <int SIZE, bool PIE> void Havannah::Board<SIZE, PIE>::reset() {
   _hasPie = false;
 
   _lastIndex.reset();
-
-  // _neighboursBoard
-  // precompute all valid neighbours of each cell
-  for (int i = 0; i < fullsize(SIZE); i++) {
-    for (int j = 0; j < fullsize(SIZE); j++) {
-      int index = convertCellToIndex(Cell(i, j));
-      int k = 0;
-      std::array<Cell, 6> neighbours = {{Cell(i - 1, j), Cell(i - 1, j + 1),
-                                         Cell(i, j - 1), Cell(i, j + 1),
-                                         Cell(i + 1, j - 1), Cell(i + 1, j)}};
-      for (const Cell& refCell : neighbours) {
-        if (isValidCell(refCell)) {
-          _neighboursBoard[index][k] = convertCellToIndex(refCell);
-          k++;
-        }
-      }
-      _neighboursBoard[index][k] = -1;
-    }
-  }
+  _hash.init();
 
   // _paths
   // no initial path
@@ -335,13 +421,7 @@ template <int SIZE, bool PIE> void Havannah::Board<SIZE, PIE>::play(int index) {
   if (_lastIndex and index == *_lastIndex) {
     assert(canPie());
     _hasPie = true;
-
-    /*
-    // TODO player or color in hash ?
-    Cell cell = convertIndexToCell(index);
-    _hash.updateArray(_currentPlayer, cell.second, cell.first);
-    _hash.updateTurn();
-     */
+    _hash.updatePie();
 
   } else {
     assert(_pathBoard[index] == 0);
@@ -429,10 +509,7 @@ template <int SIZE, bool PIE> void Havannah::Board<SIZE, PIE>::play(int index) {
 
 template <int SIZE, bool PIE>
 bool Havannah::Board<SIZE, PIE>::isValidCell(const Cell& refCell) const {
-  int i = refCell.first;
-  int j = refCell.second;
-  return i >= 0 and i < fullsize(SIZE) and j >= 0 and j < fullsize(SIZE) and
-         i + j >= SIZE - 1 and i + j <= 3 * SIZE - 3;
+  return Topology<SIZE>::isValidCell(refCell.first, refCell.second);
 }
 
 template <int SIZE, bool PIE>
@@ -531,52 +608,12 @@ bool Havannah::Board<SIZE, PIE>::isCycle(int pathIndex, int cellIndex) const {
 
 template <int SIZE, bool PIE>
 unsigned Havannah::Board<SIZE, PIE>::computeBorders(int index) const {
-  unsigned borders = 0;
-  Cell c = convertIndexToCell(index);
-  if (isValidCell(c)) {
-    int i = c.first;
-    int j = c.second;
-    int e1 = SIZE - 1;
-    int s1 = fullsize(SIZE) - 1;
-    if (i == 0 and e1 < j and j < s1)
-      borders += 1;
-    if (0 < i and i < e1 and j == s1)
-      borders += 2;
-    if (i + j == 3 * e1 and i < s1 and j < s1)
-      borders += 4;
-    if (i == s1 and 0 < j and j < e1)
-      borders += 8;
-    if (e1 < i and i < s1 and j == 0)
-      borders += 16;
-    if (i + j == e1 and i > 0 and j > 0)
-      borders += 32;
-  }
-  return borders;
+  return _bordersBoard[index];
 }
 
 template <int SIZE, bool PIE>
 unsigned Havannah::Board<SIZE, PIE>::computeCorners(int index) const {
-  unsigned corners = 0;
-  Cell c = convertIndexToCell(index);
-  if (isValidCell(c)) {
-    int i = c.first;
-    int j = c.second;
-    int e1 = SIZE - 1;
-    int s1 = fullsize(SIZE) - 1;
-    if (i == 0 and j == e1)
-      corners += 1;
-    if (i == 0 and j == s1)
-      corners += 2;
-    if (i == e1 and j == s1)
-      corners += 4;
-    if (i == s1 and j == e1)
-      corners += 8;
-    if (i == s1 and j == 0)
-      corners += 16;
-    if (i == e1 and j == 0)
-      corners += 32;
-  }
-  return corners;
+  return _cornersBoard[index];
 }
 
 template <int SIZE, bool PIE>
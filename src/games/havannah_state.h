@@ -28,8 +28,12 @@ template <int SIZE, bool PIE, bool EXTENDED> class State : public core::State {
   State(int seed);
   // State(int seed, int history, bool turnFeatures);
   void findActions();
+  void updateActions(int index, bool hadPie);
   void Initialize() override;
   void ApplyAction(const _Action& action) override;
+  uint64_t computeHash() const override {
+    return _board.computeHashValue();
+  }
   void DoGoodAction() override;
   std::unique_ptr<core::State> clone_() const override;
   std::string stateDescription() const override;
@@ -72,6 +76,30 @@ void Havannah::State<SIZE, PIE, EXTENDED>::findActions() {
   }
 }
 
+template <int SIZE, bool PIE, bool EXTENDED>
+void Havannah::State<SIZE, PIE, EXTENDED>::updateActions(int index,
+                                                         bool hadPie) {
+  // findActions lists the empty cells by index, then the pie move if any
+  auto indexOf = [this](const _Action& a) {
+    return _board.convertCellToIndex(Cell(a.GetY(), a.GetZ()));
+  };
+  bool isPie = false;
+  if (hadPie) {
+    isPie = indexOf(_legalActions.back()) == index;
+    eraseAction(_legalActions.size() - 1);
+  }
+  if (not isPie) {
+    size_t k = lowerBoundAction(
+        [&](const _Action& a) { return indexOf(a) < index; });
+    assert(k < _legalActions.size() and indexOf(_legalActions[k]) == index);
+    eraseAction(k);
+  }
+  if (_board.canPie()) {
+    auto c = _board.convertIndexToCell(*_board.getLastIndex());
+    addAction(0, c.first, c.second);
+  }
+}
+
 template <int SIZE, bool PIE, bool EXTENDED>
 void Havannah::State<SIZE, PIE, EXTENDED>::Initialize() {
   _board.reset();
@@ -83,6 +111,7 @@ void Havannah::State<SIZE, PIE, EXTENDED>::Initialize() {
   _featSize = {EXTENDED ? 27 : 3, fullsize(SIZE), fullsize(SIZE)};
   _features =
       std::vector<float>(_featSize[0] * _featSize[1] * _featSize[2], 0.f);
+  _binaryFeatures = true;
 
   for (int k = 0; k < fullsize(SIZE) * fullsize(SIZE); k++)
     _features[2 * fullsize(SIZE) * fullsize(SIZE) + k] = _board.isValidIndex(k);
@@ -141,6 +170,7 @@ void Havannah::State<SIZE, PIE, EXTENDED>::ApplyAction(const _Action& action) {
   }
 
   // play move
+  bool hadPie = _board.canPie();
   _board.play(index);
 
   // update game status
@@ -159,7 +189,7 @@ void Havannah::State<SIZE, PIE, EXTENDED>::ApplyAction(const _Action& action) {
 
   fillFullFeatures();
   // update actions
-  findActions();
+  updateActions(index, hadPie);
 
   // update hash
   _hash = _board.getHashValue();
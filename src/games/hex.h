@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "commons/hash.h"
 #include "game_player.h"
 
 #include <array>
@@ -21,17 +22,18 @@ enum Color { COLOR_BLACK, COLOR_WHITE, COLOR_NONE };
 
 using Cell = std::pair<int, int>;  // (i, j) in [0, SIZE) x [0, SIZE)
 
+// Zobrist hash of a board: one key per (color, cell), plus the side to move
+// and the pie rule. The keys are shared, the value belongs to each board.
 template <int SIZE> class Hash {
  protected:
-  unsigned long long _array[2][SIZE][SIZE];
-  unsigned long long _turn;
+  using Keys = Zobrist<2 * SIZE * SIZE + 2>;
   unsigned long long _value;
 
  public:
-  Hash();
   void init();
-  void updateArray(int Color, int j, int i);
+  void updateArray(int color, int j, int i);
   void updateTurn();
+  void updatePie();
   unsigned long long getValue() const;
 };
 
@@ -56,6 +58,30 @@ struct PathInfo {
   }
 };
 
+// Neighbours of each cell (indices), in the order (i - 1, j), (i - 1, j + 1),
+// (i, j - 1), (i, j + 1), (i + 1, j - 1), (i + 1, j); end value: -1.
+template <int SIZE>
+constexpr std::array<std::array<int, 7>, SIZE * SIZE> makeNeighboursBoard() {
+  std::array<std::array<int, 7>, SIZE * SIZE> neighboursBoard{};
+  constexpr int di[6] = {-1, -1, 0, 0, 1, 1};
+  constexpr int dj[6] = {0, 1, -1, 1, -1, 0};
+  for (int i = 0; i < SIZE; i++) {
+    for (int j = 0; j < SIZE; j++) {
+      auto& neighbours = neighboursBoard[i * SIZE + j];
+      int k = 0;
+      for (int d = 0; d < 6; d++) {
+        int ni = i + di[d];
+        int nj = j + dj[d];
+        if (ni >= 0 and ni < SIZE and nj >= 0 and nj < SIZE) {
+          neighbours[k++] = ni * SIZE + nj;
+        }
+      }
+      neighbours[k] = -1;
+    }
+  }
+  return neighboursBoard;
+}
+
 template <int SIZE, bool PIE> class Board {
 
  protected:
@@ -69,9 +95,11 @@ template <int SIZE, bool PIE> class Board {
   std::optional<int> _lastIndex;
   int _nbEmptyIndices;
 
-  // neighbours of each cell (indices)
+  // neighbours of each cell (indices), computed at compile time and shared
+  // by all boards, so that copying a board only copies what changes
   // end value: -1
-  std::array<std::array<int, 7>, SIZE * SIZE> _neighboursBoard;
+  static constexpr std::array<std::array<int, 7>, SIZE * SIZE>
+      _neighboursBoard = makeNeighboursBoard<SIZE>();
 
   // PathInfo of the paths indexed from _pathBoard
   int _pathsEnd;
@@ -80,7 +108,7 @@ template <int SIZE, bool PIE> class Board {
   // path of each cell (index in _paths)
   std::array<int, SIZE * SIZE> _pathBoard;
 
-  // static inline Hash<SIZE> _hash;
+  Hash<SIZE> _hash;
 
  public:
   Board();
@@ -98,6 +126,7 @@ template <int SIZE, bool PIE> class Board {
   static int convertCellToIndex(const Cell& refCell);
 
   unsigned long long getHashValue() const;
+  unsigned long long computeHashValue() const;
 
  protected:
   void getPathIndexAndColorAtIndex(int index,
@@ -131,31 +160,20 @@ template <int SIZE, bool PIE> class Board {
 // Hex::Hash
 ///////////////////////////////////////////////////////////////////////////////
 
-template <int SIZE> Hex::Hash<SIZE>::Hash() {
-  for (int color = 0; color < 2; color++)
-    for (int j = 0; j < SIZE; j++)
-      for (int i = 0; i < SIZE; i++) {
-        _array[color][j][i] = 0;
-        for (int k = 0; k < 64; k++)
-          if ((rand() / (RAND_MAX + 1.0)) > 0.5)
-            _array[color][j][i] |= (1ULL << k);
-      }
-  _turn = 0;
-  for (int k = 0; k < 64; k++)
-    if ((rand() / (RAND_MAX + 1.0)) > 0.5)
-      _turn |= (1ULL << k);
-}
-
 template <int SIZE> void Hex::Hash<SIZE>::init() {
   _value = 0;
 }
 
 template <int SIZE> void Hex::Hash<SIZE>::updateArray(int color, int j, int i) {
-  _value ^= _array[color][j][i];
+  _value ^= Keys::key((color * SIZE + j) * SIZE + i);
 }
 
 template <int SIZE> void Hex::Hash<SIZE>::updateTurn() {
-  _value ^= _turn;
+  _value ^= Keys::key(2 * SIZE * SIZE);
+}
+
+template <int SIZE> void Hex::Hash<SIZE>::updatePie() {
+  _value ^= Keys::key(2 * SIZE * SIZE + 1);
 }
 
 template <int SIZE> unsigned long long Hex::Hash<SIZE>::getValue() const {
@@ -167,7 +185,7 @@ template <int SIZE> unsigned long long Hex::Hash<SIZE>::getValue() const {
 ///////////////////////////////////////////////////////////////////////////////
 
 template <int SIZE, bool PIE> Hex::Board<SIZE, PIE>::Board() {
-  //_hash.init();
+  _hash.init();
 }
 
 template <int SIZE, bool PIE>
@@ -228,8 +246,30 @@ int Hex::Board<SIZE, PIE>::convertCellToIndex(const Cell& refCell) {
 
 template <int SIZE, bool PIE>
 unsigned long long Hex::Board<SIZE, PIE>::getHashValue() const {
-  return 0;
-  // return _hash.getValue();
+  return _hash.getValue();
+}
+
+// Recomputes from scratch the value maintained incrementally by play().
+template <int SIZE, bool PIE>
+unsigned long long Hex::Board<SIZE, PIE>::computeHashValue() const {
+  Hash<SIZE> hash;
+  hash.init();
+  for (int index = 0; index < _nbFullIndices; index++) {
+    if (isValidIndex(index)) {
+      int pathIndex;
+      Color color;
+      getPathIndexAndColorAtIndex(index, pathIndex, color);
+      if (color != COLOR_NONE) {
+        Cell cell = convertIndexToCell(index);
+        hash.updateArray(color, cell.second, cell.first);
+      }
+    }
+  }
+  if (_currentColor == COLOR_WHITE)
+    hash.updateTurn();
+  if (_hasPie)
+    hash.updatePie();
+  return hash.getValue();
 }
 
 template <int SIZE, bool PIE>
@@ -264,25 +304,7 @@ template <int SIZE, bool PIE> void Hex::Board<SIZE, PIE>::reset() {
   _hasPie = false;
 
   _lastIndex.reset();
-
-  // _neighboursBoard
-  // precompute all valid neighbours of each cell
-  for (int i = 0; i < SIZE; i++) {
-    for (int j = 0; j < SIZE; j++) {
-      int index = convertCellToIndex(Cell(i, j));
-      int k = 0;
-      std::array<Cell, 6> neighbours = {{Cell(i - 1, j), Cell(i - 1, j + 1),
-                                         Cell(i, j - 1), Cell(i, j + 1),
-                                         Cell(i + 1, j - 1), Cell(i + 1, j)}};
-      for (const Cell& refCell : neighbours) {
-        if (isValidCell(refCell)) {
-          _neighboursBoard[index][k] = convertCellToIndex(refCell);
-          k++;
-        }
-      }
-      _neighboursBoard[index][k] = -1;
-    }
-  }
+  _hash.init();
 
   // _paths
   // no initial path
@@ -302,13 +324,7 @@ template <int SIZE, bool PIE> void Hex::Board<SIZE, PIE>::play(int index) {
   if (_lastIndex and index == *_lastIndex) {
     assert(canPie());
     _hasPie = true;
-
-    /*
-    // TODO player or color in hash ?
-    Cell cell = convertIndexToCell(index);
-    _hash.updateArray(_currentPlayer, cell.second, cell.first);
-    _hash.updateTurn();
-     */
+    _hash.updatePie();
 
   } else {
     assert(_pathBoard[index] == 0);
@@ -322,10 +338,10 @@ template <int SIZE, bool PIE> void Hex::Board<SIZE, PIE>::play(int index) {
     if (boardColor == COLOR_NONE) {
 
       // update hash
-      // int color = getCurrentColor() == COLOR_BLACK ? 0 : 1;
-      // Cell cell = convertIndexToCell(index);
-      //_hash.updateArray(color, cell.second, cell.first);
-      //_hash.updateTurn();
+      int color = getCurrentColor() == COLOR_BLACK ? 0 : 1;
+      Cell cell = convertIndexToCell(index);
+      _hash.updateArray(color, cell.second, cell.first);
+      _hash.updateTurn();
 
       // cell data
       int mainPathIndex = _pathsEnd;
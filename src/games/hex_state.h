@@ -23,8 +23,12 @@ template <int SIZE, bool PIE> class State : public core::State {
   State(int seed);
   // State(int seed, int history, bool turnFeatures);
   void findActions();
+  void updateActions(int index, bool hadPie);
   void Initialize() override;
   void ApplyAction(const _Action& action) override;
+  uint64_t computeHash() const override {
+    return _board.computeHashValue();
+  }
   void DoGoodAction() override;
   std::unique_ptr<core::State> clone_() const override;
   std::string stateDescription() const override;
@@ -54,6 +58,29 @@ template <int SIZE, bool PIE> void Hex::State<SIZE, PIE>::findActions() {
   }
 }
 
+template <int SIZE, bool PIE>
+void Hex::State<SIZE, PIE>::updateActions(int index, bool hadPie) {
+  // findActions lists the empty cells by index, then the pie move if any
+  auto indexOf = [this](const _Action& a) {
+    return _board.convertCellToIndex(Cell(a.GetY(), a.GetZ()));
+  };
+  bool isPie = false;
+  if (hadPie) {
+    isPie = indexOf(_legalActions.back()) == index;
+    eraseAction(_legalActions.size() - 1);
+  }
+  if (not isPie) {
+    size_t k = lowerBoundAction(
+        [&](const _Action& a) { return indexOf(a) < index; });
+    assert(k < _legalActions.size() and indexOf(_legalActions[k]) == index);
+    eraseAction(k);
+  }
+  if (_board.canPie()) {
+    auto c = _board.convertIndexToCell(*_board.getLastIndex());
+    addAction(0, c.first, c.second);
+  }
+}
+
 template <int SIZE, bool PIE> void Hex::State<SIZE, PIE>::Initialize() {
   _board.reset();
   _moves.clear();
@@ -64,6 +91,7 @@ template <int SIZE, bool PIE> void Hex::State<SIZE, PIE>::Initialize() {
   _featSize = {2, SIZE, SIZE};
   _features =
       std::vector<float>(_featSize[0] * _featSize[1] * _featSize[2], 0.f);
+  _binaryFeatures = true;
   fillFullFeatures();
 
   // actions
@@ -90,6 +118,7 @@ void Hex::State<SIZE, PIE>::ApplyAction(const _Action& action) {
   }
 
   // play move
+  bool hadPie = _board.canPie();
   _board.play(index);
 
   // update game status
@@ -107,7 +136,7 @@ void Hex::State<SIZE, PIE>::ApplyAction(const _Action& action) {
 
   fillFullFeatures();
   // update actions
-  findActions();
+  updateActions(index, hadPie);
 
   // update hash
   _hash = _board.getHashValue();
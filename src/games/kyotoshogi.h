@@ -266,7 +266,7 @@ class KSPosition {
     y = Y;
   }
 
-  bool on_board() {
+  bool on_board() const {
     return (x >= 0 && y >= 0 && x < KSDx && y < KSDy);
   }
 
@@ -61,10 +61,10 @@ class StateForKyotoshogi : public core::State {
     }
 
     turn = KyotoBlack;  // black first
-    hash = 0;
+    hash = piecesHash();
     length = 0;
     Repetition = 0;
-    repet.push(_hash);
+    repet.push(hash);
   }
 
   bool fourfold() {
@@ -460,18 +460,16 @@ class StateForKyotoshogi : public core::State {
   void play(KSMove m) {
     turn = opponent(turn);
     if (m.piece.pos.on_board()) {
-      hash ^= KSHashArray[m.piece.color][getHashNum(m.piece)][m.piece.pos.x]
-                         [m.piece.pos.y];
+      hash ^= boardHash(board[m.piece.pos.x][m.piece.pos.y]);
 
       if (board[m.pos1.x][m.pos1.y].color != KyotoEmpty) {
         assert(m.pos1.on_board());
-        hash ^= KSHashArray[turn][getHashNum(board[m.pos1.x][m.pos1.y])]
-                           [m.pos1.x][m.pos1.y];
-        hash ^= KSHashArrayE[getHashNumE(m.piece)];
+        hash ^= boardHash(board[m.pos1.x][m.pos1.y]);
 
         KSPiece tmp(
             m.piece.color, new_type(board[m.pos1.x][m.pos1.y].type), false);
         chess[m.piece.color].push_back(tmp);
+        hash ^= handHash(tmp);
 
         std::vector<KSPiece>::iterator it;
         for (it = chess[turn].begin(); it != chess[turn].end(); ++it)
@@ -491,7 +489,7 @@ class StateForKyotoshogi : public core::State {
 
       board[m.piece.pos.x][m.piece.pos.y] = KSPiece(KyotoEmpty, KSNone, false);
     } else {
-      hash ^= KSHashArrayE[getHashNumE(m.piece)];
+      hash ^= handHash(m.piece);
       board[m.pos1.x][m.pos1.y] =
           KSPiece(m.piece.color, m.piece.type, m.piece.promoted);
       board[m.pos1.x][m.pos1.y].pos = KSPosition(m.pos1.x, m.pos1.y);
@@ -512,8 +510,7 @@ class StateForKyotoshogi : public core::State {
       }
     }
 
-    hash ^= KSHashArray[m.piece.color][getHashNum(board[m.pos1.x][m.pos1.y])]
-                       [m.pos1.x][m.pos1.y];
+    hash ^= boardHash(board[m.pos1.x][m.pos1.y]);
     hash ^= KSHashTurn;
 
     if (length < KSMaxPlayoutLength) {
@@ -530,7 +527,7 @@ class StateForKyotoshogi : public core::State {
     }
   }
 
-  int getHashNum(KSPiece p) {
+  int getHashNum(KSPiece p) const {
     int num = p.type;
     if (num == 3) {
       num = 1;
@@ -545,7 +542,7 @@ class StateForKyotoshogi : public core::State {
     return num;
   }
 
-  int getHashNumE(KSPiece p) {
+  int getHashNumE(KSPiece p) const {
     int num = p.type;
     if (num == 3) {
       num = 1;
@@ -556,6 +553,38 @@ class StateForKyotoshogi : public core::State {
     return num - 2 + 10 * p.color;
   }
 
+  unsigned long long boardHash(const KSPiece& p) const {
+    return KSHashArray[p.color][getHashNum(p)][p.pos.x][p.pos.y];
+  }
+
+  // A captured king only ends the game, it has no hand key.
+  unsigned long long handHash(const KSPiece& p) const {
+    return p.type == KSKing ? 0 : KSHashArrayE[getHashNumE(p)];
+  }
+
+  // Recomputes from scratch the value maintained incrementally by play().
+  unsigned long long piecesHash() const {
+    unsigned long long h = turn == KyotoWhite ? KSHashTurn : 0;
+    for (int i = 0; i < KSDx; ++i)
+      for (int j = 0; j < KSDy; ++j)
+        if (board[i][j].color != KyotoEmpty)
+          h ^= boardHash(board[i][j]);
+    for (const auto& pieces : chess)
+      for (const auto& p : pieces)
+        if (!p.pos.on_board())
+          h ^= handHash(p);
+    return h;
+  }
+
+  uint64_t computeHash() const override {
+    return piecesHash();
+  }
+
+  // The features hold the previous positions and the repetition count.
+  bool hasPositionalFeatures() const override {
+    return false;
+  }
+
   virtual void Initialize() override {
     _moves.clear();
 
@@ -579,6 +608,7 @@ class StateForKyotoshogi : public core::State {
     std::fill(_features.begin(), _features.end(), 0);
 
     init();
+    _hash = hash;
     _status = (GameStatus)opponent(turn);
     findFeatures();
     findActions(turn);
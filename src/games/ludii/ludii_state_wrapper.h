@@ -109,6 +109,13 @@ class LudiiStateWrapper : public core::State {
 
   virtual bool isOnePlayerGame() const override;
 
+  /**
+   * @return False: the state lives in the JVM and is not hashed.
+   */
+  virtual bool hasHash() const override {
+    return false;
+  }
+
   virtual float getRandomRolloutReward(int player) const override;
 
   LudiiStateWrapper& operator=(LudiiStateWrapper const& other);
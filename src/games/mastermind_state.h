@@ -13,6 +13,7 @@
 #include <random>
 
 #include "../core/state.h"
+#include "commons/hash.h"
 // #include <boost/stacktrace.hpp>
 
 /*****************************
@@ -43,6 +44,16 @@ template <int SIZE, int HORIZON, int ARITY> class State : public core::State {
   int real[SIZE];
   int _timeStep;
 
+  // Zobrist keys: one per (row, slot, color) and one per (row, score).
+  static constexpr size_t hashResultOffset = HORIZON * SIZE * ARITY;
+  using _Zobrist = Zobrist<hashResultOffset + HORIZON * (SIZE + 1)>;
+  static uint64_t pegHash(int time, int slot, int color) {
+    return _Zobrist::key((time * SIZE + slot) * ARITY + color);
+  }
+  static uint64_t resultHash(int time, int result) {
+    return _Zobrist::key(hashResultOffset + time * (SIZE + 1) + result);
+  }
+
   // helper functions
   int mmhamming(int real[], int action[]);
   void rejection(int real[], int board[][SIZE], int results[], int time);
@@ -87,6 +98,7 @@ template <int SIZE, int HORIZON, int ARITY> class State : public core::State {
   void findActions();
   void Initialize() override;
   void ApplyAction(const _Action& action) override;
+  uint64_t computeHash() const override;
   void DoGoodAction() override;
   std::unique_ptr<core::State> clone_() const override;
 };
@@ -312,6 +324,7 @@ void Mastermind::State<SIZE, HORIZON, ARITY>::ApplyAction(
   assert(time < HORIZON);
   assert(slot < SIZE);
   _board[time][slot] = action.GetX();
+  _hash ^= pegHash(time, slot, action.GetX());
   assert(action.GetX() * HORIZON * SIZE + time * SIZE + slot <
          (int)_features.size());
   _features[action.GetX() * HORIZON * SIZE + time * SIZE + slot] = 1;
@@ -341,7 +354,7 @@ void Mastermind::State<SIZE, HORIZON, ARITY>::ApplyAction(
             float(distance) / float(ARITY);
       }
     }
-    _hash = distance;
+    _hash ^= resultHash(time, distance);
     if (distance == SIZE) {
       if (mmverbose) {
         std::cout << " won by found at time " << time << std::endl;
@@ -390,6 +403,19 @@ void Mastermind::State<SIZE, HORIZON, ARITY>::ApplyAction(
   }
 }
 
+template <int SIZE, int HORIZON, int ARITY>
+uint64_t Mastermind::State<SIZE, HORIZON, ARITY>::computeHash() const {
+  uint64_t hash = 0;
+  for (int step = 0; step < _timeStep; step++) {
+    int time = step / SIZE;
+    int slot = step % SIZE;
+    hash ^= pegHash(time, slot, _board[time][slot]);
+    if (slot == SIZE - 1)
+      hash ^= resultHash(time, _results[time]);
+  }
+  return hash;
+}
+
 template <int SIZE, int HORIZON, int ARITY>
 void Mastermind::State<SIZE, HORIZON, ARITY>::DoGoodAction() {
   if (mmverbose) {
@@ -30,8 +30,7 @@ class State : public core::State {
 
   static constexpr size_t HASHBOOK_SIZE = WIDTH * HEIGHT * 11;
   using _Mask = Mask<WIDTH, HEIGHT, MINES>;
-  using _HashBook = HashBook<uint64_t, HASHBOOK_SIZE>;
-  using _Hasher = Hasher<uint64_t, HASHBOOK_SIZE>;
+  using _Zobrist = Zobrist<HASHBOOK_SIZE>;
 
  public:
   using Act = ::_Action;
@@ -42,12 +41,10 @@ class State : public core::State {
   using Neighbors = typename _GameDefs::Neighbors;
 
   State(int seed)
-      : core::State(seed)
-      , _hasher(hashBook) {
+      : core::State(seed) {
     _board.fill(UNKNOWN);
     _boardSample.fill(UNKNOWN);
     _minesSample.fill(-1);
-    std::call_once(hashBookConfigured, [this]() { hashBook.setup(_rng); });
   }  // State::State
 
   virtual void Initialize() override {
@@ -64,7 +61,7 @@ class State : public core::State {
     fillLegalActions(_legalActions, _board, std::vector<int>());
     MINESWEEPER_DEBUG(debug(std::cout) << "Num legal actions: "
                                        << _legalActions.size() << std::endl);
-    _hash = boardHash();
+    _hash = computeHash();
   }  // State::Initialize
 
   virtual std::unique_ptr<core::State> clone_() const override {
@@ -81,7 +78,6 @@ class State : public core::State {
     sampleMines(_minesSample, _board, _rng, row, col);
     minesToBoard(_minesSample, _boardSample);
     applyActionToSampledBoard(row, col);
-    _hash = boardHash();
   }  // State::ApplyAction
 
   virtual void DoGoodAction() override {
@@ -189,6 +185,17 @@ class State : public core::State {
     return boardStr;
   }  // State::stateDescription
 
+  virtual uint64_t computeHash() const override {
+    uint64_t hash = 0;
+    int v;
+    for (unsigned i = 0; i < _board.size(); ++i) {
+      v = _board[i] + 2;
+      assert(v >= 0);
+      hash ^= _Zobrist::key(static_cast<size_t>(v) * WIDTH * HEIGHT + i);
+    }
+    return hash;
+  }  // State::computeHash
+
  private:
   void applyActionToSampledBoard(int row, int col) {
     MINESWEEPER_DEBUG(displayBoard("Current board:", _board));
@@ -207,11 +214,11 @@ class State : public core::State {
       fillFullFeatures();
       return;
     }
-    arrGet<Board, WIDTH>(_board, row, col) = value;
+    revealCell(row, col, value);
     MINESWEEPER_DEBUG(std::cout << "value=" << value << std::endl);
 #ifdef EXPAND_ZEROS
     if (!value) {
-      expandZeros(_board, _boardSample, row, col);
+      expandZeros(_boardSample, row, col);
       MINESWEEPER_DEBUG(debug(std::cout) << "Expanded zeros" << std::endl);
       MINESWEEPER_DEBUG(displayBoard("Current board:", _board));
     }
@@ -237,8 +244,8 @@ class State : public core::State {
     fillFullFeatures();
   }
 
-  void expandZeros(Board& board, const Board& boardSample, int row, int col) {
-    int value = arrGet<Board, WIDTH>(board, row, col);
+  void expandZeros(const Board& boardSample, int row, int col) {
+    int value = arrGet<Board, WIDTH>(_board, row, col);
     assert(!value);
     _expandZerosProcessedMask.zero();
     auto select_unprocessed = [this](int UNUSED(v), int row, int col) {
@@ -253,10 +260,10 @@ class State : public core::State {
       queue.pop_front();
       idxToRowCol<WIDTH>(idx, row, col);
       auto neighborPositions =
-          _GameDefs::getNeighbors(board, row, col, select_unprocessed);
+          _GameDefs::getNeighbors(_board, row, col, select_unprocessed);
       for (const auto& pos : neighborPositions) {
         value = arrGet<Board, WIDTH>(boardSample, pos.row(), pos.col());
-        arrGet<Board, WIDTH>(board, pos.row(), pos.col()) = value;
+        revealCell(pos.row(), pos.col(), value);
         if (!value) {
           idx = rowColToIdx<WIDTH>(pos.row(), pos.col());
           queue.push_back(idx);
@@ -266,6 +273,14 @@ class State : public core::State {
     }
   }  // expandZeros
 
+  void revealCell(int row, int col, int value) {
+    int& cell = arrGet<Board, WIDTH>(_board, row, col);
+    size_t idx = rowColToIdx<WIDTH>(row, col);
+    _hash ^= _Zobrist::key((cell + 2) * WIDTH * HEIGHT + idx);
+    cell = value;
+    _hash ^= _Zobrist::key((cell + 2) * WIDTH * HEIGHT + idx);
+  }  // revealCell
+
   template <typename RngEngine>
   void sampleMines(Mines& minesSample,
                    const Board& board,
@@ -437,17 +452,6 @@ class State : public core::State {
     return (nUnknown == MINES);
   }  // done
 
-  uint64_t boardHash() {
-    _hasher.reset();
-    int v;
-    for (unsigned i = 0; i < _board.size(); ++i) {
-      v = _board[i] + 2;
-      assert(v >= 0);
-      _hasher.trigger(static_cast<size_t>(v) * WIDTH * HEIGHT + i);
-    }
-    return _hasher.hash();
-  }  // boardHash
-
   Board _board;
   Board _boardSample;
   Mines _minesSample;
@@ -459,17 +463,6 @@ class State : public core::State {
   static constexpr Neighbors _minesToBoardDeltaCol =
       NeighborOffsets<int, WIDTH, NUM_NEIGHBORS>::dcol;
 
-  static std::once_flag hashBookConfigured;
-  static _HashBook hashBook;
-  _Hasher _hasher;
-
 };  // class State
 
-template <size_t WIDTH, size_t HEIGHT, size_t MINES>
-std::once_flag State<WIDTH, HEIGHT, MINES>::hashBookConfigured;
-
-template <size_t WIDTH, size_t HEIGHT, size_t MINES>
-typename State<WIDTH, HEIGHT, MINES>::_HashBook
-    State<WIDTH, HEIGHT, MINES>::hashBook;
-
 }  // namespace Minesweeper
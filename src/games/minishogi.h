@@ -17,8 +17,8 @@
 
 #pragma once
 #include "../core/state.h"
+#include "commons/hash.h"
 #include "shogi.h"
-#include <mutex>
 #include <queue>
 #include <sstream>
 #include <vector>
@@ -26,9 +26,12 @@
 template <int version = 2>
 class StateForMinishogi : public core::State, public Shogi {
  public:
-  static inline uint64_t HashArray[2][10][Dx][Dy];
-  static inline uint64_t HashArrayJail[20];
-  static inline uint64_t HashTurn;
+  // Zobrist keys: pieces on the board, pieces in hand (indexed by how many
+  // of that kind the player holds, at most 2) and the side to move.
+  static constexpr int hashPieceKinds = 11;
+  static constexpr int hashJailOffset = 2 * hashPieceKinds * Dx * Dy;
+  static constexpr int hashTurn = hashJailOffset + 20 * 2;
+  using _Zobrist = Zobrist<hashTurn + 1>;
   int length;
 
   std::array<int, 2> checkCount;
@@ -69,8 +72,6 @@ class StateForMinishogi : public core::State, public Shogi {
     _features.resize(_featSize[0] * _featSize[1] * _featSize[2]);
 
     gameInit();
-    static std::once_flag initFlag;
-    std::call_once(initFlag, initHash);
 
     findFeature();
     findActions();
@@ -100,7 +101,7 @@ class StateForMinishogi : public core::State, public Shogi {
     chess[Black].push_back(board[4][3]);
 
     length = 0;
-    _hash = 0;
+    _hash = computeHash();
     checkCount = {0, 0};
     for (auto& v : repetitions) {
       v.clear();
@@ -109,24 +110,6 @@ class StateForMinishogi : public core::State, public Shogi {
     repeatCount = 0;
   }
 
-  static void initHash() {
-    std::mt19937_64 rng(
-        std::random_device{}() ^
-        std::chrono::steady_clock::now().time_since_epoch().count());
-    rng.discard(1024);
-    for (int a = 0; a < 2; ++a)
-      for (int b = 0; b < 10; ++b)
-        for (int c = 0; c < 5; ++c)
-          for (int d = 0; d < 5; ++d) {
-            HashArray[a][b][c][d] = rng();
-          }
-    for (int a = 0; a < 20; ++a) {
-      HashArrayJail[a] = rng();
-    }
-
-    HashTurn = rng();
-  }
-
   void findFeature() {
     if (version == 2) {
       std::fill(_features.begin(), _features.end(), 0);
@@ -494,7 +477,7 @@ class StateForMinishogi : public core::State, public Shogi {
     return std::make_unique<StateForMinishogi>(*this);
   }
 
-  int getHashNum(Piece p) {
+  int getHashNum(Piece p) const {
     int num = (int)p.type;
     if (num >= 7)
       num -= 5;
@@ -506,22 +489,63 @@ class StateForMinishogi : public core::State, public Shogi {
     return num;
   }
 
-  int getHashNumjail(Piece p) {
+  int getHashNumjail(Piece p) const {
     // 0~19
     return (int)p.type - 2 + 10 * p.color;
   }
 
+  uint64_t pieceHash(const Piece& p) const {
+    return _Zobrist::key(
+        ((p.color * hashPieceKinds + getHashNum(p)) * Dx + p.pos.x) * Dy +
+        p.pos.y);
+  }
+
+  // Key for holding the n-th piece of this kind in hand. A captured king
+  // only ends the game, it has no key.
+  uint64_t jailHash(const Piece& p, int n) const {
+    if (p.type == PieceType::King)
+      return 0;
+    return _Zobrist::key(hashJailOffset + getHashNumjail(p) * 2 + n - 1);
+  }
+
+  int jailCount(int color, PieceType type) const {
+    int n = 0;
+    for (const Piece& p : chess[color])
+      if (p.type == type && !p.pos.on_board())
+        ++n;
+    return n;
+  }
+
+  // The features also hold the previous positions.
+  bool hasPositionalFeatures() const override {
+    return false;
+  }
+
+  uint64_t computeHash() const override {
+    uint64_t h = _status == GameStatus::player1Turn ? _Zobrist::key(hashTurn)
+                                                    : 0;
+    for (int i = 0; i < Dx; ++i)
+      for (int j = 0; j < Dy; ++j)
+        if (board[i][j].color != Empty)
+          h ^= pieceHash(board[i][j]);
+    for (int color = 0; color < 2; ++color) {
+      int count[12] = {};
+      for (const Piece& p : chess[color])
+        if (!p.pos.on_board())
+          h ^= jailHash(p, ++count[(int)p.type]);
+    }
+    return h;
+  }
+
   void play(Move m) {
 
     if (m.piece.pos.on_board()) {
-      _hash ^= HashArray[m.piece.color][getHashNum(m.piece)][m.piece.pos.x]
-                        [m.piece.pos.y];
+      _hash ^= pieceHash(board[m.piece.pos.x][m.piece.pos.y]);
       m.piece.promoted |= m.promote;
       // eat
       if (board[m.next.x][m.next.y].color != Empty) {
         int opp = opponent(m.piece.color);
-        _hash ^= HashArray[opp][getHashNum(board[m.next.x][m.next.y])][m.next.x]
-                          [m.next.y];
+        _hash ^= pieceHash(board[m.next.x][m.next.y]);
 
         auto type = board[m.next.x][m.next.y].type;
         if (version == 1) {
@@ -530,7 +554,7 @@ class StateForMinishogi : public core::State, public Shogi {
         Piece tmp(m.piece.color, type, false);
         chess[m.piece.color].push_back(tmp);
 
-        _hash ^= HashArrayJail[getHashNumjail(tmp)];
+        _hash ^= jailHash(tmp, jailCount(m.piece.color, type));
 
         bool found = false;
         std::vector<Piece>::iterator it;
@@ -566,7 +590,7 @@ class StateForMinishogi : public core::State, public Shogi {
         throw std::runtime_error("could not find piece to move");
       }
     } else {  // Drop move
-      _hash ^= HashArrayJail[getHashNumjail(m.piece)];
+      _hash ^= jailHash(m.piece, jailCount(m.piece.color, m.piece.type));
       std::vector<Piece>::iterator it;
       for (it = chess[m.piece.color].begin(); it != chess[m.piece.color].end();
            ++it) {
@@ -577,9 +601,8 @@ class StateForMinishogi : public core::State, public Shogi {
         }
       }
     }
-    _hash ^= HashArray[m.piece.color][getHashNum(board[m.next.x][m.next.y])]
-                      [m.next.x][m.next.y];
-    _hash ^= HashTurn;
+    _hash ^= pieceHash(board[m.next.x][m.next.y]);
+    _hash ^= _Zobrist::key(hashTurn);
 
     if (length < MaxPlayoutLength) {
       // rollout[length] = m;
@@ -12,6 +12,7 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <bitset>
 #include <cassert>
 #include <functional>
@@ -54,6 +55,7 @@ template <int M, int N, int K> class State : public core::State {
   std::unique_ptr<core::State> clone_() const override;
   void ApplyAction(const ::_Action& action) override;
   void DoGoodAction() override;
+  uint64_t computeHash() const override;
   void printCurrentBoard() const override;
   std::string stateDescription() const override;
   std::string actionDescription(const ::_Action& action) const override;
@@ -79,12 +81,17 @@ template <int M, int N, int K> class State : public core::State {
   static constexpr int chessKinds = 2;
   static constexpr int connections = K;
   static constexpr int maxLegalActionsCnt = Board::squares;
-  static constexpr std::tuple<int, int> directions[4] = {
-      {0, 1}, {1, -1}, {1, 0}, {1, 1}};
+  // The stones of each kind are also kept in bitboards with a spare empty
+  // column: bit (M + 1) * y + x. Shifting by one of these steps moves every
+  // stone one square along a line, and never wraps around the board.
+  static constexpr int rowBits = M + 1;
+  static constexpr int steps[4] = {1, rowBits - 1, rowBits, rowBits + 1};
   static inline std::once_flag setupCalled;
+  using Stones = std::bitset<rowBits * N>;
 
   Board board;
   std::bitset<Board::squares> areEmpty;
+  std::array<Stones, chessKinds> stones;
 };
 
 template <int M, int N, int K>
@@ -97,12 +104,15 @@ template <int M, int N, int K> void State<M, N, K>::Initialize() {
   _moves.clear();
   _featSize = {chessKinds, Board::rows, Board::columns};
   _features.resize(chessKinds * Board::squares);
+  _binaryFeatures = true;
   _actionSize = {1, Board::rows, Board::columns};
   _legalActions.reserve(maxLegalActionsCnt);
   _status = GameStatus::player0Turn;
 
   board.initialize();
   areEmpty.set();
+  for (auto& s : stones)
+    s.reset();
   _hash = board.getHash();
   findLegalActions();
   fillFeatures();
@@ -124,8 +134,12 @@ void State<M, N, K>::ApplyAction(const ::_Action& action) {
   _hash = board.getHash();
   if (auto hasWinner = findWinner(move); !hasWinner) {
     turnPlayer();
-    findLegalActions();
-    fillFeatures();
+    int xy = Board::posTo1D(move.x, move.y);
+    eraseAction(lowerBoundAction([xy](const ::_Action& a) {
+      return Board::posTo1D(a.GetY(), a.GetZ()) < xy;
+    }));
+    _features[(move.chess - 1) * Board::squares + xy] = 1.0;
+    fillFullFeatures();
   } else {
     setTerminatedStatus(hasWinner.value());
   }
@@ -135,6 +149,11 @@ template <int M, int N, int K> void State<M, N, K>::DoGoodAction() {
   DoRandomAction();
 }
 
+template <int M, int N, int K> uint64_t State<M, N, K>::computeHash() const {
+  // The turn key is toggled once per stone.
+  return board.computeHash((Board::squares - areEmpty.count()) % 2 == 1);
+}
+
 template <int M, int N, int K> void State<M, N, K>::printCurrentBoard() const {
   std::cout << board.sprint("  ");
 }
@@ -227,6 +246,7 @@ constexpr Chess State<M, N, K>::playerToChess(Player player) {
 template <int M, int N, int K> void State<M, N, K>::play(const Move& move) {
   board.setChess(move.x, move.y, move.chess);
   areEmpty.reset(Board::posTo1D(move.x, move.y));
+  stones[move.chess - 1].set(rowBits * move.y + move.x);
 }
 
 template <int M, int N, int K>
@@ -240,24 +260,17 @@ std::optional<Player> State<M, N, K>::findWinner(const Move& move) {
 
 template <int M, int N, int K>
 bool State<M, N, K>::isConnected(const Move& move) {
-  if (connections == 1)
-    return true;
-  auto areChessesEnough = [&](int& count, int dx, int dy) {
-    int x = move.x + dx, y = move.y + dy;
-    while (Board::isPosInBoard(x, y)) {
-      if (board.getChess(x, y) == move.chess) {
-        if (++count == connections)
-          return true;
-      } else {
-        return false;
-      }
-      x += dx, y += dy;
+  const Stones& own = stones[move.chess - 1];
+  for (int step : steps) {
+    // Keep the stones that start a run of `length` stones along the line,
+    // doubling the length while it is below K.
+    Stones runs = own;
+    for (int length = 1; length < connections && runs.any();) {
+      int more = std::min(length, connections - length);
+      runs &= runs >> (more * step);
+      length += more;
     }
-    return false;
-  };
-  for (auto [dx, dy] : directions) {
-    int count = 1;
-    if (areChessesEnough(count, dx, dy) || areChessesEnough(count, -dx, -dy))
+    if (runs.any())
       return true;
   }
   return false;
@@ -57,6 +57,7 @@ template <int BR> class State : public core::State {
   std::unique_ptr<core::State> clone_() const override;
   void ApplyAction(const ::_Action& action) override;
   void DoGoodAction() override;
+  uint64_t computeHash() const override;
   void printCurrentBoard() const override;
   std::string stateDescription() const override;
   std::string actionDescription(const ::_Action& action) const override;
@@ -114,6 +115,7 @@ template <int BR> void State<BR>::Initialize() {
   _moves.clear();
   _featSize = {chessKinds, Board::rows, Board::columns};
   _features.resize(chessKinds * Board::squares);
+  _binaryFeatures = true;
   _actionSize = {2, Board::rows, Board::columns};
   _legalActions.reserve(maxLegalActionsCnt);
   _status = GameStatus::player0Turn;
@@ -160,6 +162,11 @@ template <int BR> void State<BR>::DoGoodAction() {
   DoRandomAction();
 }
 
+template <int BR> uint64_t State<BR>::computeHash() const {
+  // Passes toggle the turn key too, so it follows the side to move.
+  return board.computeHash(_status == GameStatus::player1Turn);
+}
+
 template <int BR> void State<BR>::printCurrentBoard() const {
   std::cout << board.sprint("  ");
 }
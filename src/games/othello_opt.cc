@@ -42,8 +42,7 @@ static typename Array::const_reference arrGet(const Array& arr,
 template <size_t SIZE>
 State<SIZE>::State(int seed)
     : core::State(seed)
-    , _hasher(hashBook) {
-  std::call_once(hashBookConfigured, [this]() { hashBook.setup(_rng); });
+    , _hasher(_Zobrist::book()) {
 }  // State<SIZE>::State
 
 template <size_t SIZE>
@@ -56,6 +55,7 @@ template <size_t SIZE>
 
   _featSize = {NUM_PIECE_TYPES, SIZE, SIZE};
   _features.resize(NUM_PIECE_TYPES * SIZE * SIZE, 0);
+  _binaryFeatures = true;
   fillFeatures();
   fillFullFeatures();
 
@@ -111,6 +111,18 @@ template <size_t SIZE>
   DoRandomAction();
 }
 
+template <size_t SIZE>
+/* virtual */ uint64_t State<SIZE>::computeHash() const {
+  uint64_t hash = 0;
+  for (size_t i = 0; i < SIZE * SIZE; ++i) {
+    hash ^= _Zobrist::key(_board[i] * SIZE * SIZE + i);
+  }
+  if (_status == GameStatus::player1Turn) {
+    hash ^= _Zobrist::key(HASHBOOK_SIZE - 1);
+  }
+  return hash;
+}  // State<SIZE>::computeHash
+
 template <size_t SIZE>
 /* virtual */ void State<SIZE>::printCurrentBoard() const {
   std::cout << boardToString() << std::endl;
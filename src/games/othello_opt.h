@@ -30,7 +30,7 @@ template <size_t SIZE> class State : public core::State {
   static constexpr size_t BLACK_INIT_OFFSET_1 =
       SIZE * (SIZE / 2 - 1) + SIZE / 2;
   static constexpr size_t BLACK_INIT_OFFSET_2 = SIZE * SIZE / 2 + SIZE / 2 - 1;
-  using _HashBook = HashBook<uint64_t, HASHBOOK_SIZE>;
+  using _Zobrist = Zobrist<HASHBOOK_SIZE>;
   using _Hasher = Hasher<uint64_t, HASHBOOK_SIZE>;
   using Cache = std::array<uint8_t, SIZE * SIZE>;
 
@@ -50,6 +50,7 @@ template <size_t SIZE> class State : public core::State {
   virtual std::unique_ptr<core::State> clone_() const override;
   virtual void ApplyAction(const ::_Action& action) override;
   virtual void DoGoodAction() override;
+  virtual uint64_t computeHash() const override;
   virtual void printCurrentBoard() const override;
 
   const Board& GetBoard() const {
@@ -72,16 +73,10 @@ template <size_t SIZE> class State : public core::State {
   void initializeCache();
   void setTerminalStatus();
 
-  static std::once_flag hashBookConfigured;
-  static _HashBook hashBook;
   _Hasher _hasher;
   Board _board;
   Cache _cache;
 
 };  // class State
 
-template <size_t SIZE> std::once_flag State<SIZE>::hashBookConfigured;
-
-template <size_t SIZE> typename State<SIZE>::_HashBook State<SIZE>::hashBook;
-
 }  // namespace Othello2
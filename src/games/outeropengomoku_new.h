@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "../core/state.h"
+#include "commons/hash.h"
 
 class StateForOOGomoku : public core::State {
  public:
@@ -22,7 +23,7 @@ class StateForOOGomoku : public core::State {
 
   virtual void Initialize() override {
     _moves.clear();
-    _hash = 2166136261u;
+    _hash = 0;
     _status = GameStatus::player0Turn;
     _featSize[0] = 3;
     _featSize[1] = boardHeight;
@@ -104,8 +105,7 @@ class StateForOOGomoku : public core::State {
     int player = 1 + getCurrentPlayer();
     size_t index = x + y * boardWidth;
     board.at(index) = player;
-    _hash ^= index;
-    _hash *= 16777619u;
+    _hash ^= _Zobrist::key((player - 1) * board.size() + index);
     auto count = [&](int dx, int dy) {
       int nx = x + dx;
       int ny = y + dy;
@@ -140,12 +140,24 @@ class StateForOOGomoku : public core::State {
     fillFullFeatures();
   }
 
+  virtual uint64_t computeHash() const override {
+    uint64_t hash = 0;
+    for (size_t i = 0; i != board.size(); ++i) {
+      if (board[i] != 0) {
+        hash ^= _Zobrist::key((board[i] - 1) * board.size() + i);
+      }
+    }
+    return hash;
+  }
+
   virtual void DoGoodAction() override {
     return DoRandomAction();
   }
 
   static const int boardWidth = 15;
   static const int boardHeight = 15;
+  // One key per (player, cell); the side to move follows from the stone count.
+  using _Zobrist = Zobrist<2 * boardWidth * boardHeight>;
   bool FirstMove;
   std::vector<char> board;
 };
@@ -13,6 +13,7 @@
 // - Email:  yumjelly@gmail.com
 
 #pragma once
+#include "commons/hash.h"
 #include <list>
 #include <math.h>
 #include <stdio.h>
@@ -35,24 +36,14 @@ const int SuraMaxPlayoutLength = 1000;
 
 class SKHash {
  public:
-  unsigned long long HashArray[2][SKDx][SKDy];
-  unsigned long long HashTurn;
+  using Keys = Zobrist<2 * SKDx * SKDy + 1>;
 
-  bool InitHashCalled = false;
+  static unsigned long long piece(int color, int x, int y) {
+    return Keys::key((color * SKDx + x) * SKDy + y);
+  }
 
-  void InitHash() {
-    for (int player = 0; player < 2; player++)
-      for (int i = 0; i < SKDx; i++)
-        for (int j = 0; j < SKDy; j++) {
-          HashArray[player][i][j] = 0;
-          for (int k = 0; k < 36; k++)
-            if ((rand() / (RAND_MAX + 1.0)) > 0.5)
-              HashArray[player][i][j] |= (1ULL << k);
-        }
-    HashTurn = 0;
-    for (int k = 0; k < 36; k++)
-      if ((rand() / (RAND_MAX + 1.0)) > 0.5)
-        HashTurn |= (1ULL << k);
+  static unsigned long long turn() {
+    return Keys::key(2 * SKDx * SKDy);
   }
 };
 
@@ -86,7 +77,6 @@ class SKBoard {
   int length, turn, nbPlay, repetition;
   bool isCapture, draw;
   vector<unsigned long long> history_move;
-  SKHash Sura;
 
   void init() {
     for (int i = 0; i < SKDx; i++)
@@ -98,19 +88,25 @@ class SKBoard {
     for (int i = SKDy - 2; i < SKDy; i++)
       for (int j = 0; j < SKDx; j++)
         board[j][i] = SuraBlack;
-    hash = 0;
     length = 0;
     turn = SuraWhite;
+    hash = fullHash();
     nbPlay = 0;
     repetition = 0;
     isCapture = false;
     draw = false;
     history_move.clear();
     history_move.push_back(hash);
-    if (Sura.InitHashCalled == false) {
-      Sura.InitHash();
-      Sura.InitHashCalled = true;
-    }
+  }
+
+  // Recomputes from scratch the value maintained incrementally by play().
+  unsigned long long fullHash() const {
+    unsigned long long h = turn == SuraBlack ? SKHash::turn() : 0;
+    for (int i = 0; i < SKDx; i++)
+      for (int j = 0; j < SKDy; j++)
+        if (board[i][j] != SuraEmpty)
+          h ^= SKHash::piece(board[i][j], i, j);
+    return h;
   }
 
   void print_board(FILE* fp) {
@@ -179,14 +175,14 @@ class SKBoard {
 
   void play(SKMove m) {
     board[m.x][m.y] = SuraEmpty;
-    hash ^= Sura.HashArray[m.color][m.x][m.y];
+    hash ^= SKHash::piece(m.color, m.x, m.y);
     if (board[m.x1][m.y1] != SuraEmpty) {
-      hash ^= Sura.HashArray[board[m.x1][m.y1]][m.x1][m.y1];
+      hash ^= SKHash::piece(board[m.x1][m.y1], m.x1, m.y1);
       isCapture = true;
     }
     board[m.x1][m.y1] = m.color;
-    hash ^= Sura.HashArray[m.color][m.x1][m.y1];
-    hash ^= Sura.HashTurn;
+    hash ^= SKHash::piece(m.color, m.x1, m.y1);
+    hash ^= SKHash::turn();
     if (length < SuraMaxPlayoutLength) {
       rollout[length] = m;
       length++;
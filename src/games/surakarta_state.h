@@ -56,6 +56,7 @@ class StateForSurakarta : public core::State, public SKBoard {
                      StateForSurakartaZ);
 
     init();
+    _hash = hash;
     findFeatures();
     findActions(SuraWhite);
     fillFullFeatures();
@@ -225,6 +226,10 @@ class StateForSurakarta : public core::State, public SKBoard {
     fillFullFeatures();
   }
 
+  uint64_t computeHash() const override {
+    return fullHash();
+  }
+
   // For this trivial example we just compare to random play
   virtual void DoGoodAction() override {
     DoRandomAction();
@@ -17,8 +17,6 @@
 
 using namespace std;
 
-unsigned long long HashArray[3000];
-
 bool useOrderMoves = true;
 
 bool MonteCarloMoveOrdering = true;
@@ -36,15 +34,6 @@ bool useNotLosing = false;
 
 bool useOrderPPAF = false;
 
-void initHash() {
-  for (int i = 0; i < 3000; i++) {
-    HashArray[i] = 0;
-    for (int k = 0; k < 64; k++)
-      if ((rand() / (RAND_MAX + 1.0)) > 0.5)
-        HashArray[i] |= (1ULL << k);
-  }
-}
-
 bool useCode = true;
 
 double history[MaxMoveNumber];
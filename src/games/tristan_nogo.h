@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include "commons/hash.h"
 #include <iostream>
 #include <list>
 #include <math.h>
@@ -28,8 +29,6 @@ const int MaxPlayoutLength = 1000;
 
 const int SizeTable = 1048575;  // une puissance de 2 moins 1
 
-extern unsigned long long HashArray[3000];
-
 extern bool useOrderMoves;
 
 extern bool MonteCarloMoveOrdering;
@@ -47,7 +46,6 @@ extern bool useNotLosing;
 
 class NogoBoard;
 
-extern void initHash();
 
 /*
 class Player {
@@ -85,6 +83,9 @@ extern double history[MaxMoveNumber];
 const int MaxSize = (Dx + 2) * (Dy + 2);
 const int MaxIntersections = Dx * Dy;
 
+// Zobrist keys for a black or a white stone on each intersection.
+using NogoZobrist = Zobrist<2 * MaxIntersections>;
+
 const int Exterieur = 3;
 
 const int Haut = 0;
@@ -442,13 +443,25 @@ class NogoBoard {
       fprintf(stderr, "Pb play,");
   }
 
+  // Recomputes from scratch the value maintained incrementally by joue().
+  unsigned long long fullHash() const {
+    unsigned long long h = 0;
+    for (int i = start; i < end; i++) {
+      if (board[i] == Black)
+        h ^= NogoZobrist::key(moveInter[i]);
+      else if (board[i] == White)
+        h ^= NogoZobrist::key(MaxIntersections + moveInter[i]);
+    }
+    return h;
+  }
+
   void joue(int inter, char color) {
     nbPlay++;
     board[inter] = color;
     if (color == Black)
-      hash ^= HashArray[moveInter[inter]];
+      hash ^= NogoZobrist::key(moveInter[inter]);
     else
-      hash ^= HashArray[MaxIntersections + moveInter[inter]];
+      hash ^= NogoZobrist::key(MaxIntersections + moveInter[inter]);
 
     nbVides--;
     indiceVide[vides[nbVides]] = indiceVide[inter];
@@ -65,6 +65,7 @@ class StateForTristannogo : public core::State, NogoBoard {
         }
     */
     init();
+    _hash = hash;
     findFeatures();
     findActions(White);
     fillFullFeatures();
@@ -154,6 +155,10 @@ class StateForTristannogo : public core::State, NogoBoard {
     fillFullFeatures();
   }
 
+  uint64_t computeHash() const override {
+    return fullHash();
+  }
+
   // For this trivial example we just compare to random play. Ok, this is not
   // really a good action.
   // By the way we need a good default DoGoodAction, e.g. one-ply at least.
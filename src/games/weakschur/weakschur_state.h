@@ -8,6 +8,7 @@
 #pragma once
 
 #include "../../core/state.h"
+#include "../commons/hash.h"
 #include "WeakSchur.hpp"
 // #include <boost/stacktrace.hpp> // TODO #ifdef
 #include <sstream>
@@ -18,11 +19,18 @@ template <int NBSUBSETS, int MAXNUMBER> class State : public core::State {
  private:
   WeakSchur _weakschur;
 
+  // Zobrist keys for each (subset, number) placement.
+  using _Zobrist = Zobrist<(NBSUBSETS + 1) * (MAXNUMBER + 1)>;
+  static uint64_t placementHash(int subset, int number) {
+    return _Zobrist::key(subset * (MAXNUMBER + 1) + number);
+  }
+
  public:
   State(int seed);
   bool isOnePlayerGame() const override;
   void Initialize() override;
   void ApplyAction(const _Action& action) override;
+  uint64_t computeHash() const override;
   void DoGoodAction() override;
   float getReward(int player) const override final {
     // if (player != 0)
@@ -59,6 +67,17 @@ bool weakschur::State<NBSUBSETS, MAXNUMBER>::isOnePlayerGame() const {
   return true;
 }
 
+template <int NBSUBSETS, int MAXNUMBER>
+uint64_t weakschur::State<NBSUBSETS, MAXNUMBER>::computeHash() const {
+  uint64_t hash = 0;
+  for (int number = 1; number <= MAXNUMBER; number++) {
+    int subset = _weakschur._subsetOfNumber.get(number);
+    if (subset != 0)
+      hash ^= placementHash(subset, number);
+  }
+  return hash;
+}
+
 template <int NBSUBSETS, int MAXNUMBER>
 void weakschur::State<NBSUBSETS, MAXNUMBER>::DoGoodAction() {
   DoRandomAction();
@@ -84,7 +103,7 @@ void weakschur::State<NBSUBSETS, MAXNUMBER>::Initialize() {
   _weakschur.reset();
 
   // state
-  _hash = 0;
+  _hash = computeHash();
   _status = GameStatus::player0Turn;
 
   // features
@@ -133,6 +152,7 @@ void weakschur::State<NBSUBSETS, MAXNUMBER>::ApplyAction(
   int subset = action.GetY();
   int number = action.GetZ();
   _weakschur.applyAction({subset, number});
+  _hash ^= placementHash(subset, number);
 
   // update status
   if (_weakschur.isTerminated()) {
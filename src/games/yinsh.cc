@@ -22,8 +22,6 @@
 // draw ka rule is different- no of rings pe aa jaati hai baat
 // namespace Yinsh{
 
-uint64_t StateForYinsh::hash_table[5][BOARD_X][BOARD_Y] = {0};
-std::once_flag StateForYinsh::table_flag = once_flag();
 
 string StateForYinsh::stateDescription(void) const {
   return "empty_state";
@@ -84,20 +82,35 @@ void StateForYinsh::set_vars() {
   // }
   // printf("leave:    set_vars\n");
 }
-void StateForYinsh::fill_hash_table() {
-  std::random_device rd;
-  std::default_random_engine generator(rd());
-  generator.seed(0);
-  std::uniform_int_distribution<long long unsigned> distribution(
-      0, 0xFFFFFFFFFFFFFFFF);
-
-  for (int i = 0; i < 5; i++) {
-    for (int j = 0; j < BOARD_X; j++) {
-      for (int k = 0; k < BOARD_Y; k++) {
-        hash_table[i][j][k] = (uint64_t)(distribution(generator));
-      }
+uint64_t StateForYinsh::pieceHash(int p, int x, int y) {
+  if (p == (int)(piece::empty))
+    return 0;
+  return _Zobrist::key(
+      ((p - (int)(piece::p0_marker)) * BOARD_X + x - 1) * BOARD_Y + y - 1);
+}
+uint64_t StateForYinsh::phaseHash() const {
+  uint64_t h = 0;
+  if (_status == GameStatus::player1Turn)
+    h ^= _Zobrist::key(hashPhaseOffset);
+  if (still_have_to_remove_ring)
+    h ^= _Zobrist::key(hashPhaseOffset + 1);
+  if (still_have_to_remove_marker)
+    h ^= _Zobrist::key(hashPhaseOffset + 2);
+  if (free_lunch)
+    h ^= _Zobrist::key(hashPhaseOffset + 3);
+  if (initial_fill < 10)
+    h ^= _Zobrist::key(hashPhaseOffset + 4);
+  return h;
+}
+uint64_t StateForYinsh::computeHash() const {
+  uint64_t h = phaseHash();
+  for (int i = 1; i <= BOARD_X; i++) {
+    for (int j = 1; j <= BOARD_Y; j++) {
+      if (board[i][j] != (int)(piece::invalid))
+        h ^= pieceHash(board[i][j], i, j);
     }
   }
+  return h;
 }
 void StateForYinsh::Initialize() {
   // printf("enter:    Initialize\n");
@@ -112,12 +125,10 @@ void StateForYinsh::Initialize() {
   _actionSize[1] = BOARD_X;
   _actionSize[2] = BOARD_Y;
 
-  _hash = 0ULL;  // DNU
   _status = GameStatus::player0Turn;
   _features.clear();
   _features.resize(_featSize[0] * _featSize[1] * _featSize[2]);
 
-  std::call_once(table_flag, fill_hash_table);
   // initGame();
   // hard code your init yahan
   // TODO
@@ -162,6 +173,7 @@ void StateForYinsh::Initialize() {
   still_have_to_remove_marker = false;
   free_lunch = false;
   // ended = false;
+  _hash = phaseHash();
 
   set_vars();
   findActions();
@@ -449,6 +461,7 @@ void StateForYinsh::ApplyAction(const _Action& action) {
 
   // fetch args
   // for every update manage hash
+  _hash ^= phaseHash();
   set_vars();
   // printCurrentBoard();
   // printf("following move was played by player %d\n", player);
@@ -485,12 +498,11 @@ void StateForYinsh::ApplyAction(const _Action& action) {
     // simply place the ring on the board
     //
     // cout<<"debug"<<endl;
-    _hash ^= hash_table[board[x][y] - 1][x - 1][y - 1];
+    _hash ^= pieceHash(board[x][y], x, y);
     board[x][y] = my_ring;
-    _hash ^= hash_table[board[x][y] - 1][x - 1][y - 1];
+    _hash ^= pieceHash(board[x][y], x, y);
 
     // assignment
-    // _hash ^= hash_table[][][];
     tuple<int, int> placed_ring(x, y);
     // if(player == 0) rings[0].push_back(placed_ring);
     // else rings[1].push_back(placed_ring);
@@ -518,9 +530,9 @@ void StateForYinsh::ApplyAction(const _Action& action) {
       cout << "trying to remove something which is not my ring" << endl;
       raise(SIGSEGV);
     }
-    _hash ^= hash_table[board[x][y] - 1][x - 1][y - 1];
+    _hash ^= pieceHash(board[x][y], x, y);
     board[x][y] = (int)(piece::empty);
-    _hash ^= hash_table[board[x][y] - 1][x - 1][y - 1];
+    _hash ^= pieceHash(board[x][y], x, y);
 
     // remove it from my vector_list too
     // cout<<"ring removed from "<<x<<" "<<y<<endl;
@@ -572,9 +584,9 @@ void StateForYinsh::ApplyAction(const _Action& action) {
       int x1, y1;
       x1 = start_x + i * dir_x;
       y1 = start_y + i * dir_y;
-      _hash ^= hash_table[board[x1][y1] - 1][x1 - 1][y1 - 1];
+      _hash ^= pieceHash(board[x1][y1], x1, y1);
       board[x1][y1] = (int)(piece::empty);
-      _hash ^= hash_table[board[x1][y1] - 1][x1 - 1][y1 - 1];
+      _hash ^= pieceHash(board[x1][y1], x1, y1);
     }
     places_filled -= 5;
 
@@ -592,6 +604,7 @@ void StateForYinsh::ApplyAction(const _Action& action) {
       // rings[1].clear();
       // raise(SIGSEGV);
       // PROB in this route
+      _hash ^= phaseHash();
       fillFullFeatures();
       // printf("leave:    ApplyAction\n");
       return;
@@ -631,9 +644,9 @@ void StateForYinsh::ApplyAction(const _Action& action) {
     // cout<<"ring pos, direction and jump were-";
     // printf("(%d ,%d), (%d, %d) and %d respectively\n",x,y, d_x, d_y, jump);
     if (board[x][y] == my_ring) {
-      _hash ^= hash_table[board[x][y] - 1][x - 1][y - 1];
+      _hash ^= pieceHash(board[x][y], x, y);
       board[x][y] = my_marker;
-      _hash ^= hash_table[board[x][y] - 1][x - 1][y - 1];
+      _hash ^= pieceHash(board[x][y], x, y);
     } else {
       cout << "trying to move non_ring " << x << " " << y << ", actually found "
            << board[x][y] << endl;
@@ -651,9 +664,9 @@ void StateForYinsh::ApplyAction(const _Action& action) {
 
         x1 = x + (i)*d_x;
         y1 = y + (i)*d_y;
-        _hash ^= hash_table[board[x1][y1] - 1][x1 - 1][y1 - 1];
+        _hash ^= pieceHash(board[x1][y1], x1, y1);
         board[x1][y1] = 6 - found;
-        _hash ^= hash_table[board[x1][y1] - 1][x1 - 1][y1 - 1];
+        _hash ^= pieceHash(board[x1][y1], x1, y1);
       } else {
         cout << "invalid move, dude" << endl;
       }
@@ -661,9 +674,9 @@ void StateForYinsh::ApplyAction(const _Action& action) {
 
     x1 = x + jump * d_x;
     y1 = y + jump * d_y;
-    _hash ^= hash_table[board[x1][y1] - 1][x1 - 1][y1 - 1];
+    _hash ^= pieceHash(board[x1][y1], x1, y1);
     board[x1][y1] = my_ring;
-    _hash ^= hash_table[board[x1][y1] - 1][x1 - 1][y1 - 1];
+    _hash ^= pieceHash(board[x1][y1], x1, y1);
     // update my_rings
     for (int i = 0; i < (int)rings[player].size(); i++) {
       int a, b;
@@ -695,6 +708,7 @@ void StateForYinsh::ApplyAction(const _Action& action) {
           // rings[1].clear();
           // break;
           // raise(SIGSEGV);
+          _hash ^= phaseHash();
           fillFullFeatures();
           // printf("leave:    ApplyAction\n");
           return;
@@ -745,6 +759,7 @@ void StateForYinsh::ApplyAction(const _Action& action) {
   // printCurrentBoard();
   // cout<<"debug3"<<endl;
 
+  _hash ^= phaseHash();
   set_vars();
   // cout<<"debug4"<<endl;
   // cout<<"after set vars"<<endl;
@@ -8,12 +8,12 @@
 #pragma once
 
 #include <iostream>
-#include <mutex>
 #include <random>
 #include <string>
 #include <vector>
 
 #include "../core/state.h"
+#include "commons/hash.h"
 // declare helper classes and functions
 #define NUM_ACTIONS 59
 // (6 directions * 9 max jump) + 1(initial placement) + 1(ring selection for
@@ -49,9 +49,7 @@ class StateForYinsh : public core::State {
   bool ended();
   string stateDescription(void) const override;    // DNU
   string actionsDescription(void) const override;  // DNU
-  static void fill_hash_table();
-  static uint64_t hash_table[5][BOARD_X][BOARD_Y];
-  static std::once_flag table_flag;
+  uint64_t computeHash() const override;
 
  private:
   void findActions(void);  // i have to maintain legal actions by myself
@@ -80,6 +78,13 @@ class StateForYinsh : public core::State {
   int player, my_ring, my_marker, opp_ring,
       opp_marker;  // set all these with set_vars()
   bool free_lunch;
+
+  // Zobrist keys for the 4 kinds of pieces on each cell, then for the side
+  // to move and the pending removal / placement phase flags.
+  static constexpr int hashPhaseOffset = 4 * BOARD_X * BOARD_Y;
+  using _Zobrist = Zobrist<hashPhaseOffset + 5>;
+  static uint64_t pieceHash(int p, int x, int y);
+  uint64_t phaseHash() const;
 };
 
 // }
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Times PUCT selection over the edges of one node, scalar against the
+// dispatched SIMD kernel, for the action counts of a few boards.
+
+#include "mcts/puct.h"
+#include "mcts/storage.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace mcts;
+
+namespace {
+
+template <typename F> double nsPerCall(F&& f, int iterations) {
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i != iterations; ++i) {
+    f();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - begin).count() /
+         iterations;
+}
+
+}  // namespace
+
+int main() {
+  struct Board {
+    const char* name;
+    size_t numActions;
+  };
+  const Board boards[] = {{"tictactoe", 9},   {"connectfour", 7},
+                          {"othello8", 64},   {"hex11", 121},
+                          {"gomoku15", 225},  {"hex19", 361},
+                          {"go19", 362},      {"amazons", 2000}};
+
+  std::minstd_rand rng(42);
+  Storage* storage = Storage::getStorage();
+
+  std::printf("%-12s %8s %14s %14s %8s %16s %16s\n", "board", "actions",
+              "puct scalar ns", "puct simd ns", "speedup", "forced scalar ns",
+              "forced simd ns");
+  for (const Board& board : boards) {
+    size_t n = board.numActions;
+    std::vector<float> policy(n);
+    float sum = 0.0f;
+    for (auto& v : policy) {
+      v = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+      sum += v;
+    }
+    for (auto& v : policy) {
+      v /= sum;
+    }
+    Node* node = storage->newNode();
+    node->init(nullptr);
+    node->setPolicy(storage, policy);
+    Edges edges = node->getEdges();
+    int totalVisits = 0;
+    for (size_t i = 0; i != n; ++i) {
+      int visits = std::uniform_int_distribution<int>(0, 3)(rng) == 0
+                       ? 0
+                       : std::uniform_int_distribution<int>(1, 200)(rng);
+      edges.numVisit[i] = visits;
+      edges.value[i] =
+          visits * std::uniform_real_distribution<float>(-1.0f, 1.0f)(rng);
+      edges.virtualLoss[i] = std::uniform_int_distribution<int>(0, 7)(rng) == 0;
+      totalVisits += visits;
+    }
+
+    PuctParams params;
+    params.puct = 1.1f;
+    params.sqrtParentNumVisit = std::sqrt((float)totalVisits);
+    params.flip = -1.0f;
+    params.unvisitedQ = 0.1f;
+
+    std::vector<float> scalarScores(n);
+    std::vector<float> simdScores(n);
+    size_t scalarBest =
+        puctScoresScalar(edges, n, params, scalarScores.data());
+    size_t simdBest = puctScores(edges, n, params, simdScores.data());
+    // Contraction into fused multiply-adds may change the last bit.
+    for (size_t i = 0; i != n; ++i) {
+      if (std::abs(scalarScores[i] - simdScores[i]) >
+          1e-5f * std::max(1.0f, std::abs(scalarScores[i]))) {
+        std::printf("%s: SIMD score %zu is %g instead of %g\n", board.name, i,
+                    simdScores[i], scalarScores[i]);
+        return 1;
+      }
+    }
+    if (simdBest >= n ||
+        scalarScores[simdBest] < scalarScores[scalarBest] - 1e-5f) {
+      std::printf("%s: SIMD picked edge %zu instead of %zu\n", board.name,
+                  simdBest, scalarBest);
+      return 1;
+    }
+
+    int iterations = (int)(20000000 / n) + 1;
+    volatile size_t sink = 0;
+    double scalarNs = nsPerCall(
+        [&]() {
+          sink = puctScoresScalar(edges, n, params, scalarScores.data());
+        },
+        iterations);
+    double simdNs = nsPerCall(
+        [&]() { sink = puctScores(edges, n, params, simdScores.data()); },
+        iterations);
+    // No edge has a child, so these scan them all.
+    double forcedScalarNs = nsPerCall(
+        [&]() { sink = findForcedEdgeScalar(edges, n, 2.0f, 1600, 1000); },
+        iterations);
+    double forcedSimdNs = nsPerCall(
+        [&]() { sink = findForcedEdge(edges, n, 2.0f, 1600, 1000); },
+        iterations);
+    (void)sink;
+
+    std::printf("%-12s %8zu %14.1f %14.1f %7.2fx %16.1f %16.1f\n", board.name,
+                n, scalarNs, simdNs, scalarNs / simdNs, forcedScalarNs,
+                forcedSimdNs);
+    node->freeTree();
+  }
+  return 0;
+}
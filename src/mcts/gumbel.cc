@@ -0,0 +1,205 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "mcts/gumbel.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace mcts {
+
+namespace {
+
+// sigma(q) = (cVisit + max visits) * cScale * q, with q rescaled to [0, 1]
+// over the root's edges. These are the defaults of the reference code.
+constexpr float cVisit = 50.0f;
+constexpr float cScale = 0.1f;
+
+}  // namespace
+
+void GumbelRoot::reset(unsigned int seed,
+                       int budget,
+                       int numSampled,
+                       float virtualLoss) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  rng_.seed(seed);
+  initialized_ = false;
+  budget_ = budget;
+  numSampled_ = std::max(numSampled, 1);
+  virtualLoss_ = virtualLoss;
+}
+
+void GumbelRoot::init(const Node* root) {
+  size_t n = root->getNumChildSlots();
+  Edges edges = root->getEdges();
+  logits_.resize(n);
+  gumbel_.resize(n);
+  remaining_.resize(n);
+  baseVisits_.resize(n);
+  baseValue_.resize(n);
+  std::extreme_value_distribution<float> gumbel;
+  for (size_t a = 0; a != n; ++a) {
+    logits_[a] = std::log(std::max(edges.prior[a], 1e-12f));
+    gumbel_[a] = gumbel(rng_);
+    remaining_[a] = a;
+    baseVisits_[a] = edges.numVisit[a].load(std::memory_order_relaxed);
+    baseValue_[a] = edges.value[a].load(std::memory_order_relaxed);
+  }
+  // The top numSampled of noise + logit are a sample without replacement
+  // from the policy.
+  std::stable_sort(
+      remaining_.begin(), remaining_.end(), [&](size_t a, size_t b) {
+        return gumbel_[a] + logits_[a] > gumbel_[b] + logits_[b];
+      });
+  remaining_.resize(std::min(n, (size_t)numSampled_));
+  numPhases_ = remaining_.size() > 1
+                   ? (int)std::ceil(std::log2((float)remaining_.size()))
+                   : 1;
+  target_ = phaseVisits();
+  initialized_ = true;
+}
+
+int GumbelRoot::phaseVisits() const {
+  return std::max(1, budget_ / (numPhases_ * (int)remaining_.size()));
+}
+
+int GumbelRoot::visits(const Edges& edges, size_t a) const {
+  return edges.numVisit[a].load(std::memory_order_relaxed) - baseVisits_[a];
+}
+
+float GumbelRoot::value(const Edges& edges, size_t a) const {
+  return edges.value[a].load(std::memory_order_relaxed) - baseValue_[a];
+}
+
+Action GumbelRoot::select(const Node* root) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!initialized_) {
+    init(root);
+  }
+  if (remaining_.empty()) {
+    return InvalidAction;
+  }
+  Edges edges = root->getEdges();
+  while (true) {
+    // Visit the remaining actions evenly, counting those in flight; ties go
+    // to the best ranked.
+    size_t best = remaining_[0];
+    int bestCount = INT_MAX;
+    for (size_t a : remaining_) {
+      int count = visits(edges, a);
+      if (virtualLoss_ > 0) {
+        count += (int)std::lround(
+            edges.virtualLoss[a].load(std::memory_order_relaxed) /
+            virtualLoss_);
+      }
+      if (count < bestCount) {
+        bestCount = count;
+        best = a;
+      }
+    }
+    if (bestCount < target_ || remaining_.size() == 1) {
+      return best;
+    }
+    // The phase is complete; keep the better half.
+    completedQ(root);
+    std::stable_sort(
+        remaining_.begin(), remaining_.end(), [&](size_t a, size_t b) {
+          return gumbel_[a] + logits_[a] + sigma(a) >
+                 gumbel_[b] + logits_[b] + sigma(b);
+        });
+    remaining_.resize((remaining_.size() + 1) / 2);
+    target_ += phaseVisits();
+  }
+}
+
+Action GumbelRoot::bestAction(const Node* root, bool sample) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!initialized_) {
+    init(root);
+  }
+  completedQ(root);
+  Action best = InvalidAction;
+  float bestScore = 0.0f;
+  for (size_t a : remaining_) {
+    float score = (sample ? gumbel_[a] : 0.0f) + logits_[a] + sigma(a);
+    if (best == InvalidAction || score > bestScore) {
+      best = a;
+      bestScore = score;
+    }
+  }
+  return best;
+}
+
+std::vector<float> GumbelRoot::improvedPolicy(const Node* root) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!initialized_) {
+    init(root);
+  }
+  completedQ(root);
+  size_t n = logits_.size();
+  std::vector<float> policy(n);
+  float max = -INFINITY;
+  for (size_t a = 0; a != n; ++a) {
+    policy[a] = logits_[a] + sigma(a);
+    max = std::max(max, policy[a]);
+  }
+  float sum = 0.0f;
+  for (auto& v : policy) {
+    v = std::exp(v - max);
+    sum += v;
+  }
+  for (auto& v : policy) {
+    v /= sum;
+  }
+  return policy;
+}
+
+void GumbelRoot::completedQ(const Node* root) {
+  size_t n = logits_.size();
+  Edges edges = root->getEdges();
+  q_.resize(n);
+  int sumVisits = 0;
+  float sumPrior = 0.0f;
+  float sumPriorQ = 0.0f;
+  maxVisits_ = 0;
+  for (size_t a = 0; a != n; ++a) {
+    int numVisits = visits(edges, a);
+    if (numVisits > 0) {
+      float q = value(edges, a) / numVisits;
+      q_[a] = q;
+      sumVisits += numVisits;
+      sumPrior += edges.prior[a];
+      sumPriorQ += edges.prior[a] * q;
+      maxVisits_ = std::max(maxVisits_, numVisits);
+    } else {
+      q_[a] = NAN;
+    }
+  }
+  // Unvisited edges get the network value of the root mixed with the
+  // prior-weighted q of the visited ones.
+  float mixed = root->getPiVal().value;
+  if (sumPrior > 0.0f) {
+    mixed = (mixed + sumVisits * sumPriorQ / sumPrior) / (1 + sumVisits);
+  }
+  minQ_ = INFINITY;
+  maxQ_ = -INFINITY;
+  for (size_t a = 0; a != n; ++a) {
+    if (std::isnan(q_[a])) {
+      q_[a] = mixed;
+    }
+    minQ_ = std::min(minQ_, q_[a]);
+    maxQ_ = std::max(maxQ_, q_[a]);
+  }
+}
+
+float GumbelRoot::sigma(size_t a) const {
+  float q = (q_[a] - minQ_) / std::max(maxQ_ - minQ_, 1e-8f);
+  return (cVisit + maxVisits_) * cScale * q;
+}
+
+}  // namespace mcts
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "mcts/node.h"
+
+namespace mcts {
+
+// Root action selection by Gumbel-top-k sampling and sequential halving
+// (Danihelka et al., "Policy improvement by planning with Gumbel", 2022).
+//
+// The root samples numSampled actions without replacement by adding Gumbel
+// noise to the policy logits, then splits the simulation budget into phases.
+// Each phase visits the remaining actions evenly and keeps the better half by
+// noise + logit + sigma(q). Below the root the search is unchanged.
+class GumbelRoot {
+ public:
+  // Starts a new search of budget simulations. Rollouts in flight are
+  // recognized by their virtual loss. Visits the root already has, from a
+  // reused tree or from pondering, are left out of the search: the phases
+  // and the completed q only count those made since.
+  void reset(unsigned int seed, int budget, int numSampled, float virtualLoss);
+
+  // Returns the root action for the next simulation. Safe to call from
+  // several rollouts at once; the root must be expanded.
+  Action select(const Node* root);
+
+  // The remaining action with the highest noise + logit + sigma(q), or
+  // logit + sigma(q) without sample.
+  Action bestAction(const Node* root, bool sample);
+
+  // softmax(logit + sigma(completed q)) over the legal actions, the policy
+  // training target.
+  std::vector<float> improvedPolicy(const Node* root);
+
+ private:
+  void init(const Node* root);
+  int phaseVisits() const;
+  // Visits and total value of edge a since init.
+  int visits(const Edges& edges, size_t a) const;
+  float value(const Edges& edges, size_t a) const;
+  // q of each edge from the root player's view, with the value mixed from
+  // the network and the visited edges for those that have no visits.
+  void completedQ(const Node* root);
+  // sigma(q) of edge a, after completedQ.
+  float sigma(size_t a) const;
+
+  std::mutex mutex_;
+  std::minstd_rand rng_;
+  bool initialized_ = false;
+  int budget_ = 0;
+  int numSampled_ = 0;
+  float virtualLoss_ = 0.0f;
+  int numPhases_ = 0;
+  // Visits each remaining edge should have by the end of the phase.
+  int target_ = 0;
+  std::vector<float> logits_;
+  std::vector<float> gumbel_;
+  std::vector<size_t> remaining_;
+  // Visits and total value of each edge at init.
+  std::vector<int> baseVisits_;
+  std::vector<float> baseValue_;
+  std::vector<float> q_;
+  float minQ_ = 0.0f;
+  float maxQ_ = 0.0f;
+  int maxVisits_ = 0;
+};
+
+}  // namespace mcts
@@ -6,12 +6,14 @@
  */
 
 #include "mcts/mcts.h"
+#include "mcts/puct.h"
 #include "common/async.h"
 #include "common/thread_id.h"
 #include "common/threads.h"
 #include "core/state.h"
 
 #include <chrono>
+#include <deque>
 
 namespace mcts {
 
@@ -24,16 +26,15 @@ float puctValue(int rootPlayerId,
                 float puct,
                 const Node* node,
                 mcts::Action action) {
-  const auto& pi = node->legalPolicy_;
-  const Node* child = node->getChild(action);
-  auto childNumVisit = child->getMctsStats().getNumVisit();
-  float piValue = pi[action];
+  Edges edges = node->getEdges();
+  int childNumVisit = edges.numVisit[action].load(std::memory_order_relaxed);
+  float piValue = edges.prior[action];
   auto parentNumVisit = node->getMctsStats().getNumVisit();
   float priorScore =
       (float)piValue / (1 + childNumVisit) * (float)std::sqrt(parentNumVisit);
   int flip = (node->getPiVal().playerId == rootPlayerId) ? 1 : -1;
-  float value = child->getMctsStats().getValue();
-  float vloss = child->getMctsStats().getVirtualLoss();
+  float value = edges.value[action].load(std::memory_order_relaxed);
+  float vloss = edges.virtualLoss[action].load(std::memory_order_relaxed);
   float q = (value * flip - vloss) / (childNumVisit + vloss);
   float score = priorScore * puct + q;
   return score;
@@ -45,90 +46,54 @@ Action pickBestAction(int rootPlayerId,
                       const MctsOption& option,
                       std::minstd_rand& rng,
                       int maxNumRollouts) {
-  const auto& pi = node->legalPolicy_;
-  if (pi.empty()) {
+  const size_t numEdges = node->getNumChildSlots();
+  if (numEdges == 0) {
     return InvalidAction;
   }
+  const Edges edges = node->getEdges();
 
-  float puct = option.puct;
-  bool useValuePrior = option.useValuePrior;
   // We need to flip here because at opponent's step, we need to find
   // opponent's best action which minimizes our value.  Careful not to
   // flip the exploration term.
   int flip = (node->getPiVal().playerId == rootPlayerId) ? 1 : -1;
-  float priorValue = node->getMctsStats().getAvgChildV() * flip;
-
-  auto getScore = [&](Action actionIndex, const Node* child) {
-    float q = 0;
-    int childNumVisit = 0;
-    float vloss = 0;
-    float value = 0;
-
-    float piValue = pi[actionIndex];
-    auto parentNumVisit = node->getMctsStats().getNumVisit();
-
-    if (child) {
-      const MctsStats& mctsStats = child->getMctsStats();
-      childNumVisit += mctsStats.getNumVisit();
-      vloss += mctsStats.getVirtualLoss();
-      value += mctsStats.getValue();
-    }
-    if (childNumVisit != 0) {
-      q = (value * flip - vloss) / (childNumVisit + vloss);
-    } else {
-      // When there are no child nodes under this action, replace the q value
-      // with prior.
-      // This prior is estimated from the values of other explored child.
-      // q = 0 if this is the first child to be explroed. In this case, all q =
-      // 0 and we start with the child with highest policy probability.
-      if (useValuePrior) {
-        q = priorValue;
-      }
-    }
 
-    float priorScore =
-        (float)piValue / (1 + childNumVisit) * (float)std::sqrt(parentNumVisit);
-    return priorScore * puct + q;
-  };
+  PuctParams params;
+  params.puct = option.puct;
+  params.sqrtParentNumVisit =
+      (float)std::sqrt(node->getMctsStats().getNumVisit());
+  params.flip = flip;
+  // Virtual loss from rollouts still in flight through a child counts as
+  // that many lost visits, so concurrent rollouts pick other paths.
+  // When there are no child nodes under an action, replace the q value
+  // with prior.
+  // This prior is estimated from the values of other explored child.
+  // q = 0 if this is the first child to be explroed. In this case, all q =
+  // 0 and we start with the child with highest policy probability.
+  if (option.useValuePrior) {
+    params.unvisitedQ = node->getMctsStats().getAvgChildV() * flip;
+  }
 
   if (option.forcedRolloutsMultiplier && !node->getParent()) {
     // Forced rollouts; this only happens at the root node
     int maxForcedRollouts = forcedRollouts(1.0f, maxNumRollouts, option);
-    for (auto& v : node->getChildren()) {
-      Action actionIndex = v.first;
-      const Node* child = v.second;
-      int childNumVisit = child->getMctsStats().getNumVisit();
-      if (childNumVisit < maxForcedRollouts &&
-          childNumVisit <
-              forcedRollouts(pi[actionIndex], maxNumRollouts, option)) {
-        return actionIndex;
-      }
+    size_t forced =
+        findForcedEdge(edges, numEdges, option.forcedRolloutsMultiplier,
+                       maxNumRollouts, maxForcedRollouts);
+    if (forced != numEdges) {
+      return forced;
     }
   }
 
+  thread_local std::vector<float> scores;
+  scores.resize(numEdges);
+  size_t best = puctScores(edges, numEdges, params, scores.data());
+
   if (sample) {
-    return sampleDiscreteProbability(pi.size(),
-                                     [&](size_t index) {
-                                       float score = getScore(
-                                           index, node->getChild(index));
-                                       return std::exp(score * 4);
-                                     },
-                                     rng);
+    return sampleDiscreteProbability(
+        numEdges, [&](size_t index) { return std::exp(scores[index] * 4); },
+        rng);
   } else {
-    float bestScore = -std::numeric_limits<float>::infinity();
-    Action bestAction = InvalidAction;
-
-    for (mcts::Action actionIndex = 0; actionIndex != (mcts::Action)pi.size();
-         ++actionIndex) {
-      const Node* child = node->getChild(actionIndex);
-
-      float score = getScore(actionIndex, child);
-      if (score > bestScore) {
-        bestScore = score;
-        bestAction = actionIndex;
-      }
-    }
-    return bestAction;
+    return best != numEdges ? (Action)best : InvalidAction;
   }
 }
 
@@ -147,7 +112,10 @@ int computeRolloutsImpl(const std::vector<Node*>& rootNode,
                         core::Actor& actor,
                         const MctsOption& option,
                         double max_time,
-                        std::minstd_rand& rng) {
+                        std::minstd_rand& rng,
+                        TranspositionTable* tt,
+                        std::vector<GumbelRoot>* gumbel,
+                        const std::atomic_bool* stop) {
 
   double elapsedTime = 0;
   auto begin = std::chrono::steady_clock::now();
@@ -162,56 +130,87 @@ int computeRolloutsImpl(const std::vector<Node*>& rootNode,
 
     Node* forcedParent = nullptr;
     Action forcedAction = InvalidAction;
-  };
+    std::unique_ptr<core::State> forcedState;
 
-  std::vector<RolloutState> states(rootNode.size());
-
-  async::Task task(threads::threads);
+    // A node allocated for an expansion lost to another thread.
+    Node* spare = nullptr;
+  };
 
-  size_t stride =
-      (states.size() + threads::threads.size() - 1) / threads::threads.size();
+  // Each root gets numParallel consecutive rollout states sharing its tree.
+  size_t numParallel = std::max(option.numParallelRollouts, 1);
+  std::vector<RolloutState> states(rootNode.size() * numParallel);
+
+  // The rollout states are split into contiguous cohorts, each with its own
+  // batch range and task. While the network evaluates one cohort, the
+  // threads back up and descend the others, so neither sits idle.
+  struct Cohort {
+    size_t begin = 0;
+    size_t end = 0;
+    size_t stride = 0;
+    int numStep = 0;
+    bool keepGoing = false;
+    bool done = false;
+  };
+  size_t numCohorts =
+      std::min((size_t)std::max(option.numPipelineCohorts, 1), states.size());
+  std::vector<Cohort> cohorts(numCohorts);
+  std::deque<async::Task> tasks;
 
+  // The cohort and first rollout state of each thread's share of the work.
+  std::vector<std::pair<size_t, size_t>> chunks;
   std::vector<async::Thread*> reservedThreads(states.size());
-  for (size_t i = 0; i < states.size(); i += stride) {
-    reservedThreads[i] = &threads::threads.getThread();
+  for (size_t c = 0; c != numCohorts; ++c) {
+    Cohort& cohort = cohorts[c];
+    cohort.begin = states.size() * c / numCohorts;
+    cohort.end = states.size() * (c + 1) / numCohorts;
+    cohort.stride = (cohort.end - cohort.begin + threads::threads.size() - 1) /
+                    threads::threads.size();
+    for (size_t i = cohort.begin; i < cohort.end; i += cohort.stride) {
+      chunks.emplace_back(c, i);
+      reservedThreads[i] = &threads::threads.getThread();
+    }
+    tasks.emplace_back(threads::threads);
   }
 
-  int numRollout = 0;
   std::vector<async::Handle> functionHandles(states.size());
 
   int rollouts = option.totalTime ? 0 : option.numRolloutPerThread;
 
-  bool keepGoing = false;
-
-  for (size_t i = 0; i < states.size(); i += stride) {
+  // Transposition table hits are backed up without waiting for the network,
+  // so a rollout can complete several simulations per batch.
+  bool useTT = tt && rnnState.empty();
+  uint64_t ttVersion = useTT ? actor.modelVersion() : 0;
+  const int maxTTHitsPerStep = 8;
+  // A rollout that runs into a node being expanded by another one starts
+  // over, and sits out the batch after too many attempts.
+  const int maxCollisionsPerStep = 4;
+  // Simulations started, whether they wait for the network or not.
+  std::atomic_int simulations{0};
+
+  for (const auto& chunk : chunks) {
+    size_t c = chunk.first;
+    size_t i = chunk.second;
+    const Cohort& cohort = cohorts[c];
     rng.discard(1);
-    size_t n = std::min(states.size() - i, stride);
+    size_t n = std::min(cohort.end - i, cohort.stride);
 
-    auto f = [&, ii = i, n, rng]() mutable {
+    auto f = [&, ii = i, n, c, rng]() mutable {
       size_t i = ii;
 
       for (size_t s = 0; s != n; ++s, ++i) {
 
         auto& st = states[i];
-        Node* root = rootNode[i];
+        size_t rootIndex = i / numParallel;
+        Node* root = rootNode[rootIndex];
         st.root = root;
 
         if (!st.storage) {
           st.storage = Storage::getStorage();
         }
         Storage* storage = st.storage;
+        thread_local std::vector<float> legalPolicy;
 
-        if (numRollout != 0) {
-          Node* node = st.node;
-          if (!st.terminated) {
-            auto& state = *st.state;
-            actor.batchResult(i, state, node->piVal_);
-            core::getLegalPi(
-                state, node->piVal_.logitPolicy, node->legalPolicy_);
-            core::softmax_(node->legalPolicy_);
-            node->piVal_.logitPolicy.reset();
-          }
-
+        auto backup = [&](Node* node) {
           node->settle(st.root->getPiVal().playerId);
 
           float value = node->getPiVal().value;
@@ -222,179 +221,279 @@ int computeRolloutsImpl(const std::vector<Node*>& rootNode,
           // We need to flip here because at opponent's node, we have opponent's
           // value. We need to sum up our value.
           while (node != nullptr) {
-            MctsStats& mctsStats = node->getMctsStats();
-            mctsStats.atomicUpdate(value, 0.0f);
+            node->atomicUpdate(value, option.virtualLoss);
             node = node->getParent();
           }
-        }
+        };
 
-        if (!keepGoing) {
-          continue;
-        }
+        if (st.node) {
+          Node* node = st.node;
+          st.node = nullptr;
+          if (!st.terminated) {
+            auto& state = *st.state;
+            // The legal logits go straight from the batch into the edges.
+            size_t numLegal = state.GetLegalActions().size();
+            float* prior = node->allocEdges(storage, numLegal);
+            actor.batchResult(i, state, node->piVal_, prior);
+            core::softmax_(prior, prior + numLegal);
+            if (useTT && TranspositionTable::supports(state)) {
+              tt->insert(state, ttVersion, node->piVal_, prior);
+            }
+          }
 
-        Node* node = root;
-        std::unique_ptr<core::State> localState = std::move(st.state);
-        const core::State* src =
-            st.forcedParent ? &*st.forcedParent->localState() : rootState[i];
-        if (!src) {
-          throw std::runtime_error("src state is null");
-        }
-        if (!localState) {
-          localState = src->clone();
-        } else {
-          localState->copy(*src);
+          backup(node);
         }
 
-        const torch::Tensor* rsp = nullptr;
-        if (!rnnState.empty()) {
-          rsp = &rnnState[i];
+        if (!cohorts[c].keepGoing) {
+          if (st.spare) {
+            st.spare->storage_->freeNode(st.spare);
+            st.spare = nullptr;
+          }
+          continue;
         }
 
-        // 1. Selection
+        auto newNode = [&]() {
+          Node* r = st.spare ? st.spare : storage->newNode();
+          st.spare = nullptr;
+          return r;
+        };
 
-        thread_local std::vector<Action> queuedActions;
-        queuedActions.clear();
+        for (int ttHits = 0, collisions = 0;;) {
 
-        const core::State* checkpointState = nullptr;
+          Node* node = root;
+          std::unique_ptr<core::State> localState = std::move(st.state);
+          const core::State* src = rootState[rootIndex];
+          if (st.forcedParent) {
+            src = st.forcedParent->hasState() ? &st.forcedParent->getState()
+                                              : &*st.forcedState;
+          }
+          if (!src) {
+            throw std::runtime_error("src state is null");
+          }
+          if (!localState) {
+            localState = src->clone();
+          } else {
+            localState->copy(*src);
+          }
 
-        auto flushActions = [&]() {
-          if (checkpointState) {
-            localState->copy(*checkpointState);
+          const torch::Tensor* rsp = nullptr;
+          if (!rnnState.empty()) {
+            rsp = &rnnState[rootIndex];
           }
-          if (!queuedActions.empty()) {
-            for (Action a : queuedActions) {
-              localState->forward(a);
+
+          // 1. Selection
+
+          thread_local std::vector<Action> queuedActions;
+          queuedActions.clear();
+
+          const core::State* checkpointState = nullptr;
+
+          auto flushActions = [&]() {
+            if (checkpointState) {
+              localState->copy(*checkpointState);
             }
-            queuedActions.clear();
-          }
-        };
+            if (!queuedActions.empty()) {
+              for (Action a : queuedActions) {
+                localState->forward(a);
+              }
+              queuedActions.clear();
+            }
+          };
+
+          Node* parent = nullptr;
+          Action action = InvalidAction;
 
-        Node* parent = nullptr;
-        Action action = InvalidAction;
+          bool save = false;
+          bool collided = false;
 
-        bool save = false;
+          if (st.forcedParent) {
+            parent = st.forcedParent;
+            action = st.forcedAction;
+            st.forcedParent = nullptr;
 
-        if (st.forcedParent) {
-          parent = st.forcedParent;
-          action = st.forcedAction;
-          st.forcedParent = nullptr;
+            Node* childNode = newNode();
+            node = parent->newChild(childNode, action);
+            if (node != childNode) {
+              st.spare = childNode;
+              collided = true;
+            }
 
-          node = parent->newChild(storage->newNode(), action);
+            auto& state = *localState;
 
-          auto& state = *localState;
+            if ((size_t)action >= state.GetLegalActions().size()) {
+              throw std::runtime_error("forced rollout bad action :((");
+            }
 
-          if ((size_t)action >= state.GetLegalActions().size()) {
-            throw std::runtime_error("forced rollout bad action :((");
-          }
+          } else if (!node->isVisited() && i % numParallel != 0) {
+            // Only the first rollout of each root expands it.
+            collided = true;
+          } else if (node->isVisited()) {
+            while (true) {
+              rsp = &node->piVal_.rnnState;
+
+              Action bestAction =
+                  gumbel && node == root
+                      ? (*gumbel)[rootIndex].select(root)
+                      : (option.samplingMcts ? pickBestAction<true>
+                                             : pickBestAction<false>)(
+                            root->getPiVal().playerId, node, option, rng,
+                            rollouts);
+              // this is a terminal state that has been visited
+              if (bestAction == InvalidAction) {
+                flushActions();
+                break;
+              }
+
+              Node* childNode = node->getChild(bestAction);
+              if (childNode) {
+                if (!childNode->isVisited()) {
+                  // Still waiting for its evaluation in another rollout.
+                  collided = true;
+                  break;
+                }
+                node = childNode;
+                if (node->hasState()) {
+                  checkpointState = &node->getState();
+                  queuedActions.clear();
+                } else {
+                  queuedActions.push_back(bestAction);
+                }
+                continue;
+              }
+              save = queuedActions.size() >= (size_t)option.storeStateInterval;
 
-        } else if (node->isVisited()) {
-          while (true) {
-            rsp = &node->piVal_.rnnState;
-
-            Action bestAction =
-                (option.samplingMcts
-                     ? pickBestAction<true>
-                     : pickBestAction<false>)(root->getPiVal().playerId, node,
-                                              option, rng, rollouts);
-            // this is a terminal state that has been visited
-            if (bestAction == InvalidAction) {
+              Node* newChildNode = newNode();
+              childNode = node->newChild(newChildNode, bestAction);
+              if (childNode != newChildNode) {
+                st.spare = newChildNode;
+                collided = true;
+                break;
+              }
               flushActions();
+
+              action = bestAction;
+              parent = node;
+              node = childNode;
               break;
             }
 
-            Node* childNode = node->getChild(bestAction);
-            if (childNode) {
-              node = childNode;
-              if (node->hasState()) {
-                checkpointState = &node->getState();
-                queuedActions.clear();
-              } else {
-                queuedActions.push_back(bestAction);
+            auto& state = *localState;
+
+            if (!collided && node->isVisited() && !state.terminated()) {
+              if (state.GetLegalActions().empty()) {
+                throw std::runtime_error(
+                    "MCTS error - no legal actions in unterminated game state");
               }
-              continue;
+              throw std::runtime_error(
+                  "MCTS error - rollout ended on unvisited "
+                  "node with unterminated game state");
             }
-            save = queuedActions.size() >= (size_t)option.storeStateInterval;
-            flushActions();
-
-            childNode = node->newChild(storage->newNode(), bestAction);
+          }
 
-            action = bestAction;
-            parent = node;
-            node = childNode;
+          if (collided) {
+            st.state = std::move(localState);
+            if (root->isVisited() && ++collisions < maxCollisionsPerStep) {
+              continue;
+            }
             break;
           }
 
-          auto& state = *localState;
-
-          if (node->isVisited() && !state.terminated()) {
-            if (state.GetLegalActions().empty()) {
-              throw std::runtime_error(
-                  "MCTS error - no legal actions in unterminated game state");
+          // Every node on the path counts the rollout as a loss until it is
+          // backed up.
+          if (option.virtualLoss) {
+            for (Node* n = node; n; n = n->getParent()) {
+              n->addVirtualLoss(option.virtualLoss);
             }
-            throw std::runtime_error("MCTS error - rollout ended on unvisited "
-                                     "node with unterminated game state");
           }
-        }
-
-        auto& state = *localState;
+          ++simulations;
 
-        auto saveState = [&](Node* saveNode) {
-          if (saveNode->localState() &&
-              saveNode->localState()->typeId() == state.typeId()) {
-            core::State* dst = &*saveNode->localState();
-            dst->copy(state);
-            saveNode->setState(dst);
-          } else {
-            saveNode->localState() = localState->clone();
-            saveNode->setState(&*saveNode->localState());
-          }
-        };
+          auto& state = *localState;
 
-        if (parent) {
-          // Force visits to any children that share this policy output
-          // location.
-          const _Action& a = state.GetLegalActions().at(action);
-          for (auto& x : state.GetLegalActions()) {
-            if (x.GetIndex() != action && x.GetX() == a.GetX() &&
-                x.GetY() == a.GetY() && x.GetZ() == a.GetZ()) {
-              if (!parent->getChild(x.GetIndex())) {
-                st.forcedParent = parent;
-                st.forcedAction = x.GetIndex();
-
-                if (!parent->hasState()) {
-                  saveState(parent);
+          auto saveState = [&](Node* saveNode) {
+            if (saveNode->localState() &&
+                saveNode->localState()->typeId() == state.typeId()) {
+              core::State* dst = &*saveNode->localState();
+              dst->copy(state);
+              saveNode->setState(dst);
+            } else {
+              saveNode->localState() = localState->clone();
+              saveNode->setState(&*saveNode->localState());
+            }
+          };
+
+          if (parent) {
+            // Force visits to any children that share this policy output
+            // location.
+            const _Action& a = state.GetLegalActions().at(action);
+            for (auto& x : state.GetLegalActions()) {
+              if (x.GetIndex() != action && x.GetX() == a.GetX() &&
+                  x.GetY() == a.GetY() && x.GetZ() == a.GetZ()) {
+                if (!parent->getChild(x.GetIndex())) {
+                  st.forcedParent = parent;
+                  st.forcedAction = x.GetIndex();
+
+                  // The parent is shared with other rollouts, so its state
+                  // is kept here rather than stored in it.
+                  if (!parent->hasState()) {
+                    if (st.forcedState &&
+                        st.forcedState->typeId() == state.typeId()) {
+                      st.forcedState->copy(state);
+                    } else {
+                      st.forcedState = state.clone();
+                    }
+                  }
+                  break;
                 }
-                break;
               }
             }
-          }
 
-          localState->forward(action);
+            localState->forward(action);
 
-          if (save) {
-            saveState(node);
+            if (save) {
+              saveState(node);
+            }
           }
-        }
 
-        // 2. Expansion
+          // 2. Expansion
 
-        if (state.terminated()) {
-          PiVal& piVal = node->piVal_;
-          piVal.value = state.getReward(state.getCurrentPlayer()) * 2.0f;
-          piVal.playerId = state.getCurrentPlayer();
+          if (state.terminated()) {
+            // A terminal node reached again already holds its value.
+            if (!node->isVisited()) {
+              node->stateHash_ = state.getHash();
+              PiVal& piVal = node->piVal_;
+              piVal.value = state.getReward(state.getCurrentPlayer()) * 2.0f;
+              piVal.playerId = state.getCurrentPlayer();
+            }
 
-          st.terminated = true;
-        } else {
-          st.terminated = false;
-        }
+            st.terminated = true;
+          } else {
+            st.terminated = false;
+            node->stateHash_ = state.getHash();
+
+            if (useTT && !node->isVisited() && ttHits < maxTTHitsPerStep &&
+                TranspositionTable::supports(state) &&
+                tt->lookup(state, ttVersion, node->piVal_, legalPolicy)) {
+              node->setPolicy(storage, legalPolicy);
+              backup(node);
+              ++ttHits;
+              st.state = std::move(localState);
+              continue;
+            }
+          }
 
-        st.node = node;
-        st.state = std::move(localState);
-        actor.batchPrepare(i, state, rsp ? *rsp : torch::Tensor());
+          st.node = node;
+          st.state = std::move(localState);
+          // Terminal nodes already hold their value, and slots left
+          // unprepared, like those of collided rollouts, are not evaluated.
+          if (!st.terminated) {
+            actor.batchPrepare(i, state, rsp ? *rsp : torch::Tensor());
+          }
+          break;
+        }
       }
     };
 
-    functionHandles[i] = task.getHandle(*reservedThreads[i], std::move(f));
+    functionHandles[i] = tasks[c].getHandle(*reservedThreads[i], std::move(f));
     functionHandles[i].setPriority(common::getThreadId());
   }
 
@@ -411,58 +510,84 @@ int computeRolloutsImpl(const std::vector<Node*>& rootNode,
     } while (rollouts < 1 || rollouts > max);
   }
 
-  while (true) {
-    keepGoing = (option.totalTime ? elapsedTime < max_time
-                                  : numRollout < option.numRolloutPerThread) ||
-                numRollout < 2;
-
-    for (size_t i = 0; i < states.size(); i += stride) {
-      task.enqueue(functionHandles[i]);
+  int prevSimulations = 0;
+
+  auto startCohort = [&](size_t c) {
+    Cohort& cohort = cohorts[c];
+    // Simulations count towards the budget, averaged over all roots; this
+    // includes those completed from the transposition table.
+    int progress = simulations / (int)rootNode.size();
+    cohort.keepGoing =
+        !(stop && *stop) &&
+        ((option.totalTime ? elapsedTime < max_time
+                           : progress < option.numRolloutPerThread) ||
+         cohort.numStep < 2);
+    for (size_t i = cohort.begin; i < cohort.end; i += cohort.stride) {
+      tasks[c].enqueue(functionHandles[i]);
     }
+  };
+
+  for (size_t c = 0; c != numCohorts; ++c) {
+    startCohort(c);
+  }
 
-    task.wait();
-    if (!keepGoing) {
-      break;
+  for (size_t c = 0, numDone = 0; numDone != numCohorts;
+       c = (c + 1) % numCohorts) {
+    Cohort& cohort = cohorts[c];
+    if (cohort.done) {
+      continue;
     }
-    actor.batchEvaluate(states.size());
+    tasks[c].wait();
+    if (!cohort.keepGoing) {
+      cohort.done = true;
+      ++numDone;
+      continue;
+    }
+    actor.batchEvaluate(cohort.begin, cohort.end - cohort.begin);
 
-    rolloutCount += states.size();
+    int currentSimulations = simulations;
+    rolloutCount += currentSimulations - prevSimulations;
+    prevSimulations = currentSimulations;
 
-    ++numRollout;
+    ++cohort.numStep;
     auto end = std::chrono::steady_clock::now();
     elapsedTime =
         std::chrono::duration_cast<
             std::chrono::duration<double, std::ratio<1, 1>>>(end - begin)
             .count();
+    startCohort(c);
   }
 
-  for (const Node* root : rootNode) {
-    mcts::Action bestAction = -1;
-    int best = 0;
-    for (auto& v : root->getChildren()) {
-      const Node* child = v.second;
-      if (child->getMctsStats().getNumVisit() > best) {
-        best = child->getMctsStats().getNumVisit();
-        bestAction = v.first;
-      }
-    }
-    if (bestAction != -1) {
-      float bestPuct =
-          puctValue(root->getPiVal().playerId, option.puct, root, bestAction);
-      for (auto& v : root->getChildren()) {
-        if (v.first == bestAction) {
-          continue;
+  // Sequential halving already spends the visits where it means to.
+  if (!gumbel) {
+    for (const Node* root : rootNode) {
+      Edges edges = root->getEdges();
+      mcts::Action bestAction = -1;
+      int best = 0;
+      for (size_t a = 0; a != root->getNumChildSlots(); ++a) {
+        int visits = edges.numVisit[a].load(std::memory_order_relaxed);
+        if (visits > best) {
+          best = visits;
+          bestAction = a;
         }
-        Node* child = v.second;
-        int forced =
-            forcedRollouts(root->legalPolicy_[v.first], rollouts, option);
-        for (; forced && child->getMctsStats().getNumVisit(); --forced) {
-          child->getMctsStats().subtractVisit();
-          float pv =
-              puctValue(root->getPiVal().playerId, option.puct, root, v.first);
-          if (pv > bestPuct) {
-            child->getMctsStats().addVisit();
-            break;
+      }
+      if (bestAction != -1) {
+        float bestPuct =
+            puctValue(root->getPiVal().playerId, option.puct, root, bestAction);
+        for (size_t a = 0; a != root->getNumChildSlots(); ++a) {
+          if ((Action)a == bestAction) {
+            continue;
+          }
+          std::atomic_int& visits = edges.numVisit[a];
+          int forced = forcedRollouts(edges.prior[a], rollouts, option);
+          for (; forced && visits.load(std::memory_order_relaxed); --forced) {
+            visits.fetch_sub(1, std::memory_order_relaxed);
+            float pv =
+                puctValue(root->getPiVal().playerId, option.puct, root, a);
+            if (pv > bestPuct) {
+              visits.fetch_add(1, std::memory_order_relaxed);
+              break;
+            }
           }
         }
       }
@@ -478,35 +603,49 @@ int computeRollouts(const std::vector<Node*>& rootNode,
                     core::Actor& actor,
                     const MctsOption& option,
                     double max_time,
-                    std::minstd_rand& rng) {
+                    std::minstd_rand& rng,
+                    TranspositionTable* tt,
+                    std::vector<GumbelRoot>* gumbel,
+                    const std::atomic_bool* stop) {
 
-  return computeRolloutsImpl(
-      rootNode, rootState, rnnState, actor, option, max_time, rng);
+  return computeRolloutsImpl(rootNode, rootState, rnnState, actor, option,
+                             max_time, rng, tt, gumbel, stop);
 }
 
 std::vector<MctsResult> MctsPlayer::actMcts(
     const std::vector<const core::State*>& states,
     const std::vector<torch::Tensor>& rnnState) {
+  stopPondering();
+
   std::vector<MctsResult> result(states.size(), &rng_);
 
   auto begin = std::chrono::steady_clock::now();
-  uint64_t beginRolloutCount = rolloutCount;
 
   if (!started) {
     started = true;
     starttime = begin;
   }
 
+  // Tree reuse is not supported with rnn states, since the rnn state passed
+  // in for the new root need not match the one stored in the kept subtree.
+  bool reuseTree = (option_.reuseTree || option_.ponder) && rnnState.empty();
+
   std::vector<Node*> roots;
-  Storage* storage = Storage::getStorage();
+  Storage* storage = nullptr;
   for (auto* state : states) {
-    Node* rootNode = storage->newNode();
-    rootNode->init(nullptr);
-    roots.push_back(rootNode);
-
     if (state->terminated()) {
       throw std::runtime_error("Attempt to run MCTS from terminated state");
     }
+
+    Node* rootNode = reuseTree ? takeTree(*state) : nullptr;
+    if (!rootNode) {
+      if (!storage) {
+        storage = Storage::getStorage();
+      }
+      rootNode = storage->newNode();
+      rootNode->init(nullptr);
+    }
+    roots.push_back(rootNode);
   }
 
   double thisMoveTime = remaining_time * option_.timeRatio;
@@ -514,8 +653,34 @@ std::vector<MctsResult> MctsPlayer::actMcts(
     std::cerr << "Remaining time:" << remaining_time << std::endl;
     std::cerr << "This move time:" << thisMoveTime << std::endl;
   }
-  int rollouts = computeRollouts(
-      roots, states, rnnState, *actor_, option_, thisMoveTime, rng_);
+  if (option_.transpositionTableSize > 0) {
+    if (!tt_ || tt_->size() != (size_t)option_.transpositionTableSize) {
+      tt_ = std::make_unique<TranspositionTable>(
+          option_.transpositionTableSize);
+    }
+  } else {
+    tt_.reset();
+  }
+
+  int beginNumVisit = 0;
+  for (const Node* root : roots) {
+    beginNumVisit += root->getMctsStats().getNumVisit();
+  }
+
+  // Sequential halving splits a known budget, so it does not apply to a
+  // search bounded by time.
+  std::vector<GumbelRoot> gumbel;
+  if (option_.useGumbel && !option_.totalTime) {
+    gumbel = std::vector<GumbelRoot>(states.size());
+    for (auto& g : gumbel) {
+      g.reset(rng_(), option_.numRolloutPerThread, option_.gumbelNumSampled,
+              option_.virtualLoss);
+    }
+  }
+
+  int rollouts =
+      computeRollouts(roots, states, rnnState, *actor_, option_, thisMoveTime,
+                      rng_, tt_.get(), gumbel.empty() ? nullptr : &gumbel);
   if (option_.totalTime) {
     auto end = std::chrono::steady_clock::now();
     remaining_time -=
@@ -525,7 +690,7 @@ std::vector<MctsResult> MctsPlayer::actMcts(
   }
   for (size_t i = 0; i != states.size(); ++i) {
     Node* rootNode = roots[i];
-    assert(rootNode->getMctsStats().getVirtualLoss() == 0);
+    assert(rootNode->getMctsStats().getNumVirtualLoss() == 0);
     if (option_.totalTime > 0) {
       std::cerr << "Value : " << rootNode->getMctsStats().getValue()
                 << " total rollouts : "
@@ -537,16 +702,24 @@ std::vector<MctsResult> MctsPlayer::actMcts(
     }
     result[i].rollouts = rollouts;
     result[i].rootValue = rootNode->getMctsStats().getAvgValue();
-    for (auto& v : rootNode->getChildren()) {
-      int visits = v.second->getMctsStats().getNumVisit();
+    if (!gumbel.empty()) {
+      result[i].setMctsPolicy(gumbel[i].improvedPolicy(rootNode));
+      result[i].bestAction = gumbel[i].bestAction(
+          rootNode, states[i]->getStepIdx() < option_.sampleBeforeStepIdx);
+      continue;
+    }
+    Edges edges = rootNode->getEdges();
+    for (size_t a = 0; a != rootNode->getNumChildSlots(); ++a) {
+      int visits = edges.numVisit[a].load(std::memory_order_relaxed);
       if (visits > 1) {
-        result[i].add(v.first, visits);
+        result[i].add(a, visits);
       }
     }
     if (result[i].bestAction == InvalidAction) {
-      for (auto& v : rootNode->getChildren()) {
-        int visits = v.second->getMctsStats().getNumVisit();
-        result[i].add(v.first, visits);
+      for (size_t a = 0; a != rootNode->getNumChildSlots(); ++a) {
+        if (rootNode->getChild(a)) {
+          result[i].add(a, edges.numVisit[a].load(std::memory_order_relaxed));
+        }
       }
     }
     result[i].normalize();
@@ -558,30 +731,40 @@ std::vector<MctsResult> MctsPlayer::actMcts(
           "MCTS could not find any valid actions at state " +
           states[i]->history());
     }
-    if (states[i]->getStepIdx() < option_.sampleBeforeStepIdx) {
+    // Gumbel search samples its move itself.
+    if (gumbel.empty() &&
+        states[i]->getStepIdx() < option_.sampleBeforeStepIdx) {
       // std::cout << "sample:" << std::endl;
       result[i].sample();
     }
   }
 
+  // Simulations backed up into these trees, per second of this move.
+  int numVisit = -beginNumVisit;
+  for (const Node* root : roots) {
+    numVisit += root->getMctsStats().getNumVisit();
+  }
+  rolloutsPerSecond_ =
+      numVisit / std::chrono::duration_cast<
+                     std::chrono::duration<double, std::ratio<1, 1>>>(
+                     std::chrono::steady_clock::now() - begin)
+                     .count();
+
   for (size_t i = 0; i != states.size(); ++i) {
     auto* n = roots[i]->getChild(result[i].bestAction);
     if (n && n->getPiVal().rnnState.defined()) {
       result[i].rnnState = n->getPiVal().rnnState;
     }
-    roots[i]->freeTree();
+    if (reuseTree) {
+      keepTree(states[i], states[i]->getMoves(), roots[i]);
+    } else {
+      roots[i]->freeTree();
+    }
   }
 
   bool verbose = false;
 
   if (verbose) {
-    uint64_t n = rolloutCount - beginRolloutCount;
-    double s = std::chrono::duration_cast<
-                   std::chrono::duration<double, std::ratio<1, 1>>>(
-                   std::chrono::steady_clock::now() - begin)
-                   .count();
-    rolloutsPerSecond_ = n / s;
-
     printf("rollouts per second: %g\n", rolloutsPerSecond_);
 
     double sx = std::chrono::duration_cast<
@@ -594,4 +777,101 @@ std::vector<MctsResult> MctsPlayer::actMcts(
   return result;
 }
 
+Node* MctsPlayer::takeTree(const core::State& state) {
+  KeptTree tree;
+  {
+    std::lock_guard l(treesMutex_);
+    auto i = trees_.find(&state);
+    if (i == trees_.end()) {
+      return nullptr;
+    }
+    tree = std::move(i->second);
+    trees_.erase(i);
+  }
+  // The kept tree is only valid if the current state was reached from its
+  // root by deterministic moves.
+  const auto& moves = state.getMoves();
+  if (state.isStochastic() || state.stochasticReset() ||
+      moves.size() < tree.moves.size() ||
+      !std::equal(tree.moves.begin(), tree.moves.end(), moves.begin())) {
+    tree.root->freeTree();
+    return nullptr;
+  }
+  Node* root = tree.root;
+  for (size_t i = tree.moves.size(); root && i != moves.size(); ++i) {
+    root = root->detachChild(moves[i]);
+  }
+  if (root && !root->isVisited()) {
+    root->freeTree();
+    return nullptr;
+  }
+  // Storages are bump allocated and only recycled once all their nodes are
+  // freed, so a subtree kept in place would hold on to every storage of the
+  // earlier searches that it has a node in. It is compacted into a fresh
+  // one instead, which bounds what a game retains to one tree.
+  if (root) {
+    Node* copy = root->copyTree(Storage::getStorage(), nullptr);
+    root->freeTree();
+    root = copy;
+  }
+  return root;
+}
+
+void MctsPlayer::keepTree(const core::State* key,
+                          const std::vector<Action>& moves,
+                          Node* root) {
+  std::lock_guard l(treesMutex_);
+  auto& tree = trees_[key];
+  if (tree.root) {
+    tree.root->freeTree();
+  }
+  tree.root = root;
+  tree.moves = moves;
+}
+
+void MctsPlayer::ponder(const core::State& state) {
+  stopPondering();
+  if (!rnnStateSize().empty() || state.terminated() || state.isStochastic()) {
+    return;
+  }
+  Node* root = takeTree(state);
+  if (!root) {
+    root = Storage::getStorage()->newNode();
+    root->init(nullptr);
+  }
+  ponderStop_ = false;
+  // The search runs on a copy, since the caller may change state (undoing
+  // moves, say) before stopping it; such a tree is dropped by takeTree.
+  ponderThread_ = std::thread(
+      [this, key = &state, clone = state.clone(), root]() {
+        computeRollouts({root}, {clone.get()}, {}, *actor_, option_,
+                        remaining_time, rng_, tt_.get(), nullptr, &ponderStop_);
+        keepTree(key, clone->getMoves(), root);
+      });
+}
+
+void MctsPlayer::stopPondering() {
+  if (ponderThread_.joinable()) {
+    ponderStop_ = true;
+    ponderThread_.join();
+  }
+}
+
+void MctsPlayer::freeTree(const core::State* state) {
+  std::lock_guard l(treesMutex_);
+  auto i = trees_.find(state);
+  if (i != trees_.end()) {
+    i->second.root->freeTree();
+    trees_.erase(i);
+  }
+}
+
+void MctsPlayer::freeTrees() {
+  std::lock_guard l(treesMutex_);
+  for (auto& v : trees_) {
+    v.second.root->freeTree();
+  }
+  trees_.clear();
+}
+
 }  // namespace mcts
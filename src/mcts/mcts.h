@@ -14,24 +14,31 @@
 #include <future>
 #include <iostream>
 #include <random>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "core/actor.h"
 #include "core/actor_player.h"
 #include "core/state.h"
+#include "mcts/gumbel.h"
 #include "mcts/node.h"
 #include "mcts/storage.h"
+#include "mcts/transposition_table.h"
 #include "mcts/utils.h"
 
 namespace mcts {
 
 int computeRollouts(const std::vector<Node*>& rootNode,
                     const std::vector<const core::State*>& rootState,
-                    const std::vector<std::vector<float>>& rnnState,
+                    const std::vector<torch::Tensor>& rnnState,
                     core::Actor& actor,
                     const MctsOption& option,
                     double thisMoveTime,
-                    std::minstd_rand& rng);
+                    std::minstd_rand& rng,
+                    TranspositionTable* tt = nullptr,
+                    std::vector<GumbelRoot>* gumbel = nullptr,
+                    const std::atomic_bool* stop = nullptr);
 
 class MctsPlayer : public core::ActorPlayer {
  public:
@@ -52,6 +59,12 @@ class MctsPlayer : public core::ActorPlayer {
     return actMcts({&state}, {rnnState}).at(0);
   }
 
+  // Searches state, with the opponent to move, on a background thread until
+  // stopPondering. The tree is then kept for the next actMcts on state, which
+  // must not be destroyed meanwhile.
+  void ponder(const core::State& state);
+  void stopPondering();
+
   double rolloutsPerSecond() {
     return rolloutsPerSecond_;
   }
@@ -65,13 +78,54 @@ class MctsPlayer : public core::ActorPlayer {
   }
 
   virtual void reset() override {
+    stopPondering();
     remaining_time = option_.totalTime;
+    freeTrees();
+    if (tt_) {
+      tt_->clear();
+    }
+  }
+
+  virtual void result(const core::State* state, float reward) override {
+    stopPondering();
+    ActorPlayer::result(state, reward);
+    freeTree(state);
+  }
+
+  virtual void forget(const core::State* state) override {
+    stopPondering();
+    ActorPlayer::forget(state);
+    freeTree(state);
+  }
+
+  ~MctsPlayer() {
+    stopPondering();
+    freeTrees();
   }
 
  private:
+  // A search tree kept between moves when option_.reuseTree is set, along
+  // with the moves leading to its root.
+  struct KeptTree {
+    Node* root = nullptr;
+    std::vector<Action> moves;
+  };
+
+  Node* takeTree(const core::State& state);
+  void keepTree(const core::State* key,
+                const std::vector<Action>& moves,
+                Node* root);
+  void freeTree(const core::State* state);
+  void freeTrees();
+
   MctsOption option_;
   double remaining_time;
   std::minstd_rand rng_;
+  std::mutex treesMutex_;
+  std::unordered_map<const core::State*, KeptTree> trees_;
+  std::unique_ptr<TranspositionTable> tt_;
+  std::thread ponderThread_;
+  std::atomic_bool ponderStop_{false};
   // Storage storage_;
   double rolloutsPerSecond_ = 0.0;
 };
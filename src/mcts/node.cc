@@ -16,50 +16,118 @@ void Node::init(Node* parent) {
 
   parent_ = nullptr;
   state_ = nullptr;
-  children_.clear();
+  stateHash_ = 0;
+  action_ = InvalidAction;
+  edges_ = nullptr;
+  numChildSlots_ = 0;
   visited_ = false;
 
   mctsStats_.reset();
   piVal_.reset();
-  legalPolicy_.clear();
 
   parent_ = parent;
 }
 
-void Node::acquire() {
-  //  mSelf_.lock();
-  //  holderThreadId_ = std::this_thread::get_id();
-}
-
-void Node::release() {
-  //  assert(holderThreadId_ == std::this_thread::get_id());
-  //  mSelf_.unlock();
-}
-
 Node* Node::newChild(Node* child, Action action) {
   child->init(this);
-  auto i = std::lower_bound(children_.begin(), children_.end(), action,
-                            [](auto& a, Action b) { return a.first < b; });
-  children_.insert(i, std::make_pair(action, child));
-  return child;
+  child->action_ = action;
+  Node* expected = nullptr;
+  if (getEdges().child[action].compare_exchange_strong(
+          expected, child, std::memory_order_acq_rel)) {
+    return child;
+  }
+  return expected;
 }
 
-namespace {
-const std::vector<Node*> emptyList;
+float* Node::allocEdges(Storage* storage, size_t n) {
+  if (n == 0) {
+    return nullptr;
+  }
+  edges_ = storage->newEdges(24 * n + sizeof(Storage*));
+  numChildSlots_ = n;
+  Edges edges = getEdges();
+  for (size_t i = 0; i != n; ++i) {
+    new (&edges.numVisit[i]) std::atomic_int(0);
+    new (&edges.value[i]) std::atomic<float>(0.0f);
+    new (&edges.virtualLoss[i]) std::atomic<float>(0.0f);
+    new (&edges.child[i]) std::atomic<Node*>(nullptr);
+  }
+  *(Storage**)(edges_ + 24 * n) = storage;
+  return (float*)edges.prior;
 }
 
-Node* Node::getChild(Action action) const {
-  auto i = std::lower_bound(children_.begin(), children_.end(), action,
-                            [](auto& a, Action b) { return a.first < b; });
-  return i == children_.end() || i->first != action ? nullptr : i->second;
+void Node::freeEdges() {
+  if (edges_) {
+    (*(Storage**)(edges_ + 24 * numChildSlots_))->freeEdges(edges_);
+    edges_ = nullptr;
+  }
+  numChildSlots_ = 0;
 }
 
 void Node::freeTree() {
   piVal_.rnnState.reset();
-  for (auto& v : children_) {
-    v.second->freeTree();
+  for (size_t i = 0; i != numChildSlots_; ++i) {
+    if (Node* child = getChild(i)) {
+      child->freeTree();
+    }
+  }
+  freeEdges();
+  storage_->freeNode(this);
+}
+
+Node* Node::detachChild(Action action) {
+  Node* child = nullptr;
+  for (size_t i = 0; i != numChildSlots_; ++i) {
+    if (Node* c = getChild(i)) {
+      if ((Action)i == action) {
+        child = c;
+      } else {
+        c->freeTree();
+      }
+    }
   }
+  freeEdges();
+  piVal_.rnnState.reset();
   storage_->freeNode(this);
+  if (child) {
+    child->parent_ = nullptr;
+  }
+  return child;
+}
+
+Node* Node::copyTree(Storage* storage, Node* parent) const {
+  Node* copy = storage->newNode();
+  copy->init(parent);
+  copy->action_ = action_;
+  copy->stateHash_ = stateHash_;
+  copy->mctsStats_.copyFrom(mctsStats_);
+  copy->piVal_ = piVal_;
+  // A node reused from a storage may keep a state it no longer points to.
+  if (state_ && state_ == localState_.get()) {
+    copy->localState_ = localState_->clone();
+    copy->state_ = copy->localState_.get();
+  }
+  if (numChildSlots_) {
+    Edges src = getEdges();
+    float* prior = copy->allocEdges(storage, numChildSlots_);
+    std::copy(src.prior, src.prior + numChildSlots_, prior);
+    Edges dst = copy->getEdges();
+    for (size_t i = 0; i != numChildSlots_; ++i) {
+      dst.numVisit[i].store(src.numVisit[i].load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+      dst.value[i].store(src.value[i].load(std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+      dst.virtualLoss[i].store(
+          src.virtualLoss[i].load(std::memory_order_relaxed),
+          std::memory_order_relaxed);
+      if (Node* child = getChild(i)) {
+        dst.child[i].store(
+            child->copyTree(storage, copy), std::memory_order_relaxed);
+      }
+    }
+  }
+  copy->visited_.store(isVisited(), std::memory_order_release);
+  return copy;
 }
 
 void Node::printTree(int level, int maxLevel, int action) const {
@@ -72,9 +140,11 @@ void Node::printTree(int level, int maxLevel, int action) const {
   std::cout << action << " " << mctsStats_.getValue() << "/"
             << mctsStats_.getNumVisit();
   std::cout << "(" << mctsStats_.getValue() / mctsStats_.getNumVisit() << ")";
-  std::cout << ", vloss:" << mctsStats_.getVirtualLoss() << std::endl;
-  for (auto& v : getChildren()) {
-    v.second->printTree(level + 1, maxLevel, v.first);
+  std::cout << ", vloss:" << mctsStats_.getNumVirtualLoss() << std::endl;
+  for (size_t i = 0; i != numChildSlots_; ++i) {
+    if (const Node* child = getChild(i)) {
+      child->printTree(level + 1, maxLevel, i);
+    }
   }
 }
 
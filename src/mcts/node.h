@@ -7,8 +7,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <mutex>
-#include <thread>
 #include <vector>
 
 #include "core/state.h"
@@ -18,6 +20,18 @@
 namespace mcts {
 
 class Storage;
+class Node;
+
+// The edges from a node to its children, one per legal action. They are
+// parallel arrays in a single block allocated from a Storage, so that
+// selection scans them linearly rather than visiting every child node.
+struct Edges {
+  const float* prior;
+  std::atomic_int* numVisit;
+  std::atomic<float>* value;
+  std::atomic<float>* virtualLoss;
+  std::atomic<Node*>* child;
+};
 
 class Node {
  public:
@@ -36,14 +50,38 @@ class Node {
 
   void init(Node* parent);
 
-  void acquire();
+  // Inserts childNode under action unless another thread got there first.
+  // Returns the child now in place, which is not childNode if it lost the
+  // race; childNode is then left untouched for the caller to reuse.
+  Node* newChild(Node* childNode, Action action);
+
+  Node* getChild(Action action) const {
+    return (size_t)action < numChildSlots_
+               ? getEdges().child[action].load(std::memory_order_acquire)
+               : nullptr;
+  }
 
-  void release();
+  // Number of edges, one per legal action (0 until visited).
+  size_t getNumChildSlots() const {
+    return numChildSlots_;
+  }
 
-  // caller is responsible for holding locks in case of multi-threading
-  Node* newChild(Node* childNode, Action action);
+  Edges getEdges() const {
+    size_t n = numChildSlots_;
+    return {(const float*)edges_, (std::atomic_int*)(edges_ + 4 * n),
+            (std::atomic<float>*)(edges_ + 8 * n),
+            (std::atomic<float>*)(edges_ + 12 * n),
+            (std::atomic<Node*>*)(edges_ + 16 * n)};
+  }
+
+  // Allocates n edges from storage and returns their priors for the caller
+  // to fill in. Called by the rollout that expanded this node, before settle.
+  float* allocEdges(Storage* storage, size_t n);
 
-  Node* getChild(Action action) const;
+  void setPolicy(Storage* storage, const std::vector<float>& legalPolicy) {
+    std::copy(legalPolicy.begin(), legalPolicy.end(),
+              allocEdges(storage, legalPolicy.size()));
+  }
 
   MctsStats& getMctsStats() {
     return mctsStats_;
@@ -73,10 +111,6 @@ class Node {
     return id_;
   }
 
-  const auto& getChildren() const {
-    return children_;
-  }
-
   Node* getParent() const {
     return parent_;
   }
@@ -85,22 +119,52 @@ class Node {
     return piVal_;
   }
 
+  // Called by the rollout that expanded this node, or that reached it again
+  // as a terminal node. The first call publishes piVal_ and the edges to the
+  // other threads through visited_.
   void settle(int rootPlayerId) {
-    // Only called when the node is locked.
     if (parent_ != nullptr) {
       auto& stats = parent_->getMctsStats();
       float upValue =
           rootPlayerId == piVal_.playerId ? piVal_.value : -piVal_.value;
       stats.atomicUpdateChildV(upValue);
     }
-    visited_ = true;
+    if (!isVisited()) {
+      visited_.store(true, std::memory_order_release);
+    }
+  }
+
+  // Backs up a rollout through this node and its edge from the parent.
+  void atomicUpdate(float value, float virtualLoss) {
+    mctsStats_.atomicUpdate(value, virtualLoss);
+    if (parent_ != nullptr) {
+      Edges edges = parent_->getEdges();
+      edges.numVisit[action_].fetch_add(1, std::memory_order_relaxed);
+      atomicAdd(edges.value[action_], value);
+      atomicAdd(edges.virtualLoss[action_], -virtualLoss);
+    }
+  }
+
+  void addVirtualLoss(float virtualLoss) {
+    mctsStats_.addVirtualLoss();
+    if (parent_ != nullptr) {
+      atomicAdd(parent_->getEdges().virtualLoss[action_], virtualLoss);
+    }
   }
 
   // free the entire tree rooted at this node
   void freeTree();
 
-  bool isVisited() {
-    return visited_;
+  // free this node and every subtree except the one under action, which is
+  // detached and returned as a new root (nullptr if it was never expanded)
+  Node* detachChild(Action action);
+
+  // Copies the tree rooted at this node, nodes and edges, into storage as a
+  // child of parent. No search may be running on the tree.
+  Node* copyTree(Storage* storage, Node* parent) const;
+
+  bool isVisited() const {
+    return visited_.load(std::memory_order_acquire);
   }
 
   uint64_t getStateHash() {
@@ -109,6 +173,8 @@ class Node {
 
   void printTree(int level, int maxLevel, int action) const;
 
+  void freeEdges();
+
   // private:
 
   // std::pair<Node*, Node*> link;
@@ -117,23 +183,21 @@ class Node {
   Storage* storage_;
   NodeId id_;
 
-  // sync tools
-  // std::mutex mSelf_;
-  // std::thread::id holderThreadId_;
-
   // actual attributes
   Node* parent_;
   std::unique_ptr<core::State> localState_;
   core::State* state_;
   uint64_t stateHash_;
-  // std::unordered_map<Action, std::vector<Node*>> children_;
-  std::vector<std::pair<Action, Node*>> children_;
+  // action leading here from parent_
+  Action action_;
+  // see getEdges; the Storage they came from is stored after the arrays
+  char* edges_;
+  size_t numChildSlots_;
   // int depth_;
-  bool visited_;
+  std::atomic_bool visited_;
 
   MctsStats mctsStats_;
   PiVal piVal_;
-  std::vector<float> legalPolicy_;
 };
 
 }  // namespace mcts
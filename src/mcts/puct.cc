@@ -0,0 +1,345 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "mcts/puct.h"
+
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MCTS_PUCT_X86
+#include <immintrin.h>
+#endif
+
+namespace mcts {
+
+namespace {
+
+// The SIMD code reads the atomic arrays as plain ints and floats. The loads
+// are relaxed either way: concurrent updates may or may not be seen.
+static_assert(sizeof(std::atomic_int) == sizeof(int));
+static_assert(sizeof(std::atomic<float>) == sizeof(float));
+
+inline float edgeScore(const Edges& edges, size_t i, const PuctParams& p) {
+  int numVisit = edges.numVisit[i].load(std::memory_order_relaxed);
+  float vloss = edges.virtualLoss[i].load(std::memory_order_relaxed);
+  float value = edges.value[i].load(std::memory_order_relaxed);
+  float q = p.unvisitedQ;
+  if (numVisit != 0 || vloss != 0) {
+    q = (value * p.flip - vloss) / (numVisit + vloss);
+  }
+  float priorScore =
+      edges.prior[i] / (1 + numVisit + vloss) * p.sqrtParentNumVisit;
+  return priorScore * p.puct + q;
+}
+
+// Scores edges [begin, n) and continues the argmax from best.
+size_t scalarScores(const Edges& edges,
+                    size_t begin,
+                    size_t n,
+                    const PuctParams& p,
+                    float* scores,
+                    size_t best,
+                    float bestScore) {
+  for (size_t i = begin; i != n; ++i) {
+    float score = edgeScore(edges, i, p);
+    scores[i] = score;
+    if (score > bestScore) {
+      bestScore = score;
+      best = i;
+    }
+  }
+  return best;
+}
+
+bool isForced(const Edges& edges,
+              size_t i,
+              float multiplier,
+              int numRollouts,
+              int maxForced) {
+  int numVisit = edges.numVisit[i].load(std::memory_order_relaxed);
+  return numVisit < maxForced &&
+         numVisit <
+             (int)std::sqrt(multiplier * edges.prior[i] * numRollouts) &&
+         edges.child[i].load(std::memory_order_relaxed) != nullptr;
+}
+
+#ifdef MCTS_PUCT_X86
+
+// Picks the first highest of the per-lane maxima.
+template <size_t lanes>
+size_t reduceLanes(const float* laneBest, const int* laneIndex, size_t n) {
+  size_t best = n;
+  float bestScore = -std::numeric_limits<float>::infinity();
+  for (size_t l = 0; l != lanes; ++l) {
+    if (laneIndex[l] < 0) {
+      continue;
+    }
+    if (laneBest[l] > bestScore ||
+        (laneBest[l] == bestScore && (size_t)laneIndex[l] < best)) {
+      bestScore = laneBest[l];
+      best = laneIndex[l];
+    }
+  }
+  return best;
+}
+
+// The kernels score the last, partial vector with masked loads rather than
+// with scalar code: the compiler may fuse the scalar multiply-adds, and the
+// tail would then round differently from the edges before it.
+
+__attribute__((target("avx2"))) inline __m256 scoresAvx2(__m256i numVisitI,
+                                                         __m256 vloss,
+                                                         __m256 value,
+                                                         __m256 prior,
+                                                         const PuctParams& p) {
+  const __m256 zero = _mm256_setzero_ps();
+  __m256 numVisit = _mm256_cvtepi32_ps(numVisitI);
+  __m256 visited = _mm256_or_ps(_mm256_cmp_ps(numVisit, zero, _CMP_NEQ_UQ),
+                                _mm256_cmp_ps(vloss, zero, _CMP_NEQ_UQ));
+  __m256 q = _mm256_div_ps(
+      _mm256_sub_ps(_mm256_mul_ps(value, _mm256_set1_ps(p.flip)), vloss),
+      _mm256_add_ps(numVisit, vloss));
+  q = _mm256_blendv_ps(_mm256_set1_ps(p.unvisitedQ), q, visited);
+  __m256 denom = _mm256_add_ps(
+      _mm256_cvtepi32_ps(_mm256_add_epi32(numVisitI, _mm256_set1_epi32(1))),
+      vloss);
+  __m256 priorScore = _mm256_mul_ps(
+      _mm256_div_ps(prior, denom), _mm256_set1_ps(p.sqrtParentNumVisit));
+  return _mm256_add_ps(_mm256_mul_ps(priorScore, _mm256_set1_ps(p.puct)), q);
+}
+
+__attribute__((target("avx2"))) size_t puctScoresAvx2(const Edges& edges,
+                                                      size_t n,
+                                                      const PuctParams& p,
+                                                      float* scores) {
+  const __m256i step = _mm256_set1_epi32(8);
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256 best = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+  __m256i bestIndex = _mm256_set1_epi32(-1);
+  __m256i index = lane;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 score = scoresAvx2(
+        _mm256_loadu_si256((const __m256i*)(edges.numVisit + i)),
+        _mm256_loadu_ps((const float*)(edges.virtualLoss + i)),
+        _mm256_loadu_ps((const float*)(edges.value + i)),
+        _mm256_loadu_ps(edges.prior + i), p);
+    _mm256_storeu_ps(scores + i, score);
+
+    __m256 better = _mm256_cmp_ps(score, best, _CMP_GT_OQ);
+    best = _mm256_blendv_ps(best, score, better);
+    bestIndex = _mm256_castps_si256(_mm256_blendv_ps(
+        _mm256_castsi256_ps(bestIndex), _mm256_castsi256_ps(index), better));
+    index = _mm256_add_epi32(index, step);
+  }
+  if (i != n) {
+    __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - i), lane);
+    __m256 score = scoresAvx2(
+        _mm256_maskload_epi32((const int*)(edges.numVisit + i), valid),
+        _mm256_maskload_ps((const float*)(edges.virtualLoss + i), valid),
+        _mm256_maskload_ps((const float*)(edges.value + i), valid),
+        _mm256_maskload_ps(edges.prior + i, valid), p);
+    _mm256_maskstore_ps(scores + i, valid, score);
+
+    __m256 better = _mm256_and_ps(_mm256_cmp_ps(score, best, _CMP_GT_OQ),
+                                  _mm256_castsi256_ps(valid));
+    best = _mm256_blendv_ps(best, score, better);
+    bestIndex = _mm256_castps_si256(_mm256_blendv_ps(
+        _mm256_castsi256_ps(bestIndex), _mm256_castsi256_ps(index), better));
+  }
+  alignas(32) float laneBest[8];
+  alignas(32) int laneIndex[8];
+  _mm256_store_ps(laneBest, best);
+  _mm256_store_si256((__m256i*)laneIndex, bestIndex);
+  return reduceLanes<8>(laneBest, laneIndex, n);
+}
+
+__attribute__((target("avx512f"))) inline __m512 scoresAvx512(
+    __m512i numVisitI,
+    __m512 vloss,
+    __m512 value,
+    __m512 prior,
+    const PuctParams& p) {
+  const __m512 zero = _mm512_setzero_ps();
+  __m512 numVisit = _mm512_cvtepi32_ps(numVisitI);
+  __mmask16 visited = _mm512_cmp_ps_mask(numVisit, zero, _CMP_NEQ_UQ) |
+                      _mm512_cmp_ps_mask(vloss, zero, _CMP_NEQ_UQ);
+  __m512 q = _mm512_div_ps(
+      _mm512_sub_ps(_mm512_mul_ps(value, _mm512_set1_ps(p.flip)), vloss),
+      _mm512_add_ps(numVisit, vloss));
+  q = _mm512_mask_blend_ps(visited, _mm512_set1_ps(p.unvisitedQ), q);
+  __m512 denom = _mm512_add_ps(
+      _mm512_cvtepi32_ps(_mm512_add_epi32(numVisitI, _mm512_set1_epi32(1))),
+      vloss);
+  __m512 priorScore = _mm512_mul_ps(
+      _mm512_div_ps(prior, denom), _mm512_set1_ps(p.sqrtParentNumVisit));
+  return _mm512_add_ps(_mm512_mul_ps(priorScore, _mm512_set1_ps(p.puct)), q);
+}
+
+__attribute__((target("avx512f"))) size_t puctScoresAvx512(
+    const Edges& edges, size_t n, const PuctParams& p, float* scores) {
+  const __m512i step = _mm512_set1_epi32(16);
+  __m512 best = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+  __m512i bestIndex = _mm512_set1_epi32(-1);
+  __m512i index = _mm512_setr_epi32(
+      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512 score = scoresAvx512(_mm512_loadu_si512(edges.numVisit + i),
+                                _mm512_loadu_ps(edges.virtualLoss + i),
+                                _mm512_loadu_ps(edges.value + i),
+                                _mm512_loadu_ps(edges.prior + i), p);
+    _mm512_storeu_ps(scores + i, score);
+
+    __mmask16 better = _mm512_cmp_ps_mask(score, best, _CMP_GT_OQ);
+    best = _mm512_mask_blend_ps(better, best, score);
+    bestIndex = _mm512_mask_blend_epi32(better, bestIndex, index);
+    index = _mm512_add_epi32(index, step);
+  }
+  if (i != n) {
+    __mmask16 valid = (1u << (n - i)) - 1;
+    __m512 score =
+        scoresAvx512(_mm512_maskz_loadu_epi32(valid, edges.numVisit + i),
+                     _mm512_maskz_loadu_ps(valid, edges.virtualLoss + i),
+                     _mm512_maskz_loadu_ps(valid, edges.value + i),
+                     _mm512_maskz_loadu_ps(valid, edges.prior + i), p);
+    _mm512_mask_storeu_ps(scores + i, valid, score);
+
+    __mmask16 better = _mm512_mask_cmp_ps_mask(valid, score, best, _CMP_GT_OQ);
+    best = _mm512_mask_blend_ps(better, best, score);
+    bestIndex = _mm512_mask_blend_epi32(better, bestIndex, index);
+  }
+  alignas(64) float laneBest[16];
+  alignas(64) int laneIndex[16];
+  _mm512_store_ps(laneBest, best);
+  _mm512_store_si512(laneIndex, bestIndex);
+  return reduceLanes<16>(laneBest, laneIndex, n);
+}
+
+__attribute__((target("avx2"))) size_t findForcedEdgeAvx2(const Edges& edges,
+                                                          size_t n,
+                                                          float multiplier,
+                                                          int numRollouts,
+                                                          int maxForced) {
+  const __m256 mult = _mm256_set1_ps(multiplier);
+  const __m256 rollouts = _mm256_set1_ps((float)numRollouts);
+  const __m256i maxForcedV = _mm256_set1_epi32(maxForced);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i numVisit =
+        _mm256_loadu_si256((const __m256i*)(edges.numVisit + i));
+    __m256 prior = _mm256_loadu_ps(edges.prior + i);
+    __m256i limit = _mm256_cvttps_epi32(
+        _mm256_sqrt_ps(_mm256_mul_ps(_mm256_mul_ps(mult, prior), rollouts)));
+    __m256i below = _mm256_and_si256(_mm256_cmpgt_epi32(limit, numVisit),
+                                     _mm256_cmpgt_epi32(maxForcedV, numVisit));
+    unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(below));
+    for (; mask; mask &= mask - 1) {
+      size_t e = i + __builtin_ctz(mask);
+      if (edges.child[e].load(std::memory_order_relaxed) != nullptr) {
+        return e;
+      }
+    }
+  }
+  for (; i != n; ++i) {
+    if (isForced(edges, i, multiplier, numRollouts, maxForced)) {
+      return i;
+    }
+  }
+  return n;
+}
+
+#endif
+
+using FindForcedEdgeFn = size_t (*)(const Edges&, size_t, float, int, int);
+
+PuctScoresFn selectPuctScores() {
+#ifdef MCTS_PUCT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return puctScoresAvx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return puctScoresAvx2;
+  }
+#endif
+  return puctScoresScalar;
+}
+
+FindForcedEdgeFn selectFindForcedEdge() {
+#ifdef MCTS_PUCT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return findForcedEdgeAvx2;
+  }
+#endif
+  return findForcedEdgeScalar;
+}
+
+}  // namespace
+
+size_t puctScoresScalar(const Edges& edges,
+                        size_t n,
+                        const PuctParams& params,
+                        float* scores) {
+  return scalarScores(edges, 0, n, params, scores, n,
+                      -std::numeric_limits<float>::infinity());
+}
+
+size_t puctScores(const Edges& edges,
+                  size_t n,
+                  const PuctParams& params,
+                  float* scores) {
+  static const PuctScoresFn impl = selectPuctScores();
+  // Too few edges to fill the vectors.
+  if (n < 16) {
+    return puctScoresScalar(edges, n, params, scores);
+  }
+  return impl(edges, n, params, scores);
+}
+
+std::vector<PuctScoresFn> puctScoresKernels() {
+  std::vector<PuctScoresFn> r = {puctScoresScalar};
+#ifdef MCTS_PUCT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    r.push_back(puctScoresAvx2);
+  }
+  if (__builtin_cpu_supports("avx512f")) {
+    r.push_back(puctScoresAvx512);
+  }
+#endif
+  return r;
+}
+
+size_t findForcedEdgeScalar(const Edges& edges,
+                            size_t n,
+                            float multiplier,
+                            int numRollouts,
+                            int maxForced) {
+  for (size_t i = 0; i != n; ++i) {
+    if (isForced(edges, i, multiplier, numRollouts, maxForced)) {
+      return i;
+    }
+  }
+  return n;
+}
+
+size_t findForcedEdge(const Edges& edges,
+                      size_t n,
+                      float multiplier,
+                      int numRollouts,
+                      int maxForced) {
+  static const FindForcedEdgeFn impl = selectFindForcedEdge();
+  if (n < 16) {
+    return findForcedEdgeScalar(edges, n, multiplier, numRollouts, maxForced);
+  }
+  return impl(edges, n, multiplier, numRollouts, maxForced);
+}
+
+}  // namespace mcts
@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "mcts/node.h"
+
+#include <vector>
+
+namespace mcts {
+
+struct PuctParams {
+  float puct = 0.0f;
+  float sqrtParentNumVisit = 0.0f;
+  // 1 if the node's player is the root player, -1 otherwise
+  float flip = 1.0f;
+  // q of an edge with neither visits nor virtual loss
+  float unvisitedQ = 0.0f;
+};
+
+// Writes the PUCT score of each of the n edges to scores and returns the
+// index of the first highest one (n if there is none). This uses AVX-512 or
+// AVX2 when the CPU supports them; they follow the scalar code operation for
+// operation, up to the rounding of fused multiply-adds.
+size_t puctScores(const Edges& edges,
+                  size_t n,
+                  const PuctParams& params,
+                  float* scores);
+
+size_t puctScoresScalar(const Edges& edges,
+                        size_t n,
+                        const PuctParams& params,
+                        float* scores);
+
+using PuctScoresFn = size_t (*)(const Edges&,
+                                size_t,
+                                const PuctParams&,
+                                float*);
+
+// The kernels puctScores may use on this CPU, scalar first; for tests.
+std::vector<PuctScoresFn> puctScoresKernels();
+
+// Returns the first edge with a child whose visit count is below both
+// maxForced and sqrt(multiplier * prior * numRollouts), or n if there is none.
+size_t findForcedEdge(const Edges& edges,
+                      size_t n,
+                      float multiplier,
+                      int numRollouts,
+                      int maxForced);
+
+size_t findForcedEdgeScalar(const Edges& edges,
+                            size_t n,
+                            float multiplier,
+                            int numRollouts,
+                            int maxForced);
+
+}  // namespace mcts
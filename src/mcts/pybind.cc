@@ -34,5 +34,15 @@ PYBIND11_MODULE(mcts, m) {
       .def_readwrite("randomized_rollouts", &MctsOption::randomizedRollouts)
       .def_readwrite("sampling_mcts", &MctsOption::samplingMcts)
       .def_readwrite(
-          "forced_rollouts_multiplier", &MctsOption::forcedRolloutsMultiplier);
+          "forced_rollouts_multiplier", &MctsOption::forcedRolloutsMultiplier)
+      .def_readwrite("reuse_tree", &MctsOption::reuseTree)
+      .def_readwrite(
+          "transposition_table_size", &MctsOption::transpositionTableSize)
+      .def_readwrite(
+          "num_parallel_rollouts", &MctsOption::numParallelRollouts)
+      .def_readwrite(
+          "num_pipeline_cohorts", &MctsOption::numPipelineCohorts)
+      .def_readwrite("use_gumbel", &MctsOption::useGumbel)
+      .def_readwrite("gumbel_num_sampled", &MctsOption::gumbelNumSampled)
+      .def_readwrite("ponder", &MctsOption::ponder);
 }
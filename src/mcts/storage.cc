@@ -1,6 +1,8 @@
 
 #include "storage.h"
 
+#include <algorithm>
+
 namespace mcts {
 
 std::mutex freeStoragesMutex;
@@ -26,10 +28,37 @@ Node* Storage::newNode() {
 }
 
 void Storage::freeNode(Node* node) {
+  release();
+}
+
+char* Storage::newEdges(size_t bytes) {
+  bytes = (bytes + 63) & ~(size_t)63;
+  while (edgeChunkIndex < edgeChunks.size() &&
+         edgeOffset + bytes > edgeChunks[edgeChunkIndex].second) {
+    ++edgeChunkIndex;
+    edgeOffset = 0;
+  }
+  if (edgeChunkIndex == edgeChunks.size()) {
+    size_t size = std::max(bytes, edgeChunkSize);
+    edgeChunks.emplace_back((char*)std::aligned_alloc(64, size), size);
+  }
+  char* r = edgeChunks[edgeChunkIndex].first + edgeOffset;
+  edgeOffset += bytes;
+  ++allocated;
+  return r;
+}
+
+void Storage::freeEdges(char* edges) {
+  release();
+}
+
+void Storage::release() {
   --allocated;
   if (allocated == 0) {
     chunkIndex = 0;
     subIndex = 0;
+    edgeChunkIndex = 0;
+    edgeOffset = 0;
     std::lock_guard l(freeStoragesMutex);
     freeStorages.push_back(this);
   }
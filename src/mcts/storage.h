@@ -21,6 +21,14 @@ class Storage {
   size_t allocated = 0;
   const size_t chunkSize = 16;
 
+  // Arenas for the child edges of nodes, bump allocated like the nodes.
+  std::vector<std::pair<char*, size_t>> edgeChunks;
+  size_t edgeChunkIndex = 0;
+  size_t edgeOffset = 0;
+  const size_t edgeChunkSize = 1 << 16;
+
+  void release();
+
  public:
   Storage() = default;
   Storage(const Storage&) = delete;
@@ -28,6 +36,10 @@ class Storage {
 
   Node* newNode();
   void freeNode(Node* node);
+  // Returns a 64-byte aligned block of at least the given size, which counts
+  // as an allocation until passed to freeEdges.
+  char* newEdges(size_t bytes);
+  void freeEdges(char* edges);
   static Storage* getStorage();
 };
 
@@ -0,0 +1,41 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "mcts/transposition_table.h"
+
+namespace mcts {
+
+bool TranspositionTable::lookup(const core::State& state,
+                                uint64_t version,
+                                PiVal& piVal,
+                                std::vector<float>& legalPolicy) {
+  return cache_.lookup(state.getHash(), version, [&](const Eval& e) {
+    // Guard against hash collisions as far as cheaply possible.
+    if (e.playerId != state.getCurrentPlayer() ||
+        e.legalPolicy.size() != state.GetLegalActions().size()) {
+      return false;
+    }
+    piVal.playerId = e.playerId;
+    piVal.value = e.value;
+    legalPolicy = e.legalPolicy;
+    return true;
+  });
+}
+
+void TranspositionTable::insert(const core::State& state,
+                                uint64_t version,
+                                const PiVal& piVal,
+                                const float* legalPolicy) {
+  cache_.insert(state.getHash(), version, [&](Eval& e) {
+    e.playerId = piVal.playerId;
+    e.value = piVal.value;
+    e.legalPolicy.assign(
+        legalPolicy, legalPolicy + state.GetLegalActions().size());
+  });
+}
+
+}  // namespace mcts
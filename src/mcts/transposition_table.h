@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "core/sharded_cache.h"
+#include "core/state.h"
+#include "mcts/utils.h"
+
+#include <vector>
+
+namespace mcts {
+
+// Bounded cache of network evaluations keyed by State::getHash(), shared by
+// all nodes that reach the same position through different move orders.
+// Entries are tagged with the model version they were evaluated with (see
+// core::Actor::modelVersion) and go stale when the model is updated, as the
+// table lives across games.
+class TranspositionTable {
+ public:
+  TranspositionTable(size_t size)
+      : cache_(size) {
+  }
+
+  // Only deterministic games that maintain a hash can use the table, and
+  // only with features that the hash determines.
+  static bool supports(const core::State& state) {
+    return state.hasHash() && !state.isStochastic() &&
+           state.hasPositionalFeatures();
+  }
+
+  // On a hit for the current model version, fills in piVal (without
+  // logits) and legalPolicy and returns true.
+  bool lookup(const core::State& state,
+              uint64_t version,
+              PiVal& piVal,
+              std::vector<float>& legalPolicy);
+
+  // legalPolicy holds one prior per legal action of state. version is that
+  // of the model at the start of the search, so that an evaluation racing
+  // with a model update is never stored as current.
+  void insert(const core::State& state,
+              uint64_t version,
+              const PiVal& piVal,
+              const float* legalPolicy);
+
+  void clear() {
+    cache_.clear();
+  }
+
+  size_t size() const {
+    return cache_.size();
+  }
+
+ private:
+  struct Eval {
+    int playerId = 0;
+    float value = 0.0f;
+    std::vector<float> legalPolicy;
+  };
+
+  core::ShardedCache<Eval> cache_;
+};
+
+}  // namespace mcts
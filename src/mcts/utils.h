@@ -13,7 +13,6 @@
 #include <atomic>
 #include <cassert>
 #include <iostream>
-#include <mutex>
 #include <random>
 #include <sstream>
 #include <unordered_map>
@@ -54,8 +53,49 @@ class MctsOption {
   bool samplingMcts = false;
 
   float forcedRolloutsMultiplier = 2.0f;
+
+  // If true, keep the search tree between moves of the same game and continue
+  // from the subtree reached by the moves actually played.
+  bool reuseTree = false;
+
+  // Number of entries in the transposition table sharing network evaluations
+  // between nodes with the same state hash; 0 disables it. The table is kept
+  // between moves and cleared on reset.
+  int transpositionTableSize = 0;
+
+  // Number of simulations descending each root concurrently in a batch step.
+  // They share the tree, each on its own thread and batch slot, and are
+  // spread over different paths by virtualLoss. Above 1 this lets a single
+  // game use several cores and fill a larger inference batch.
+  int numParallelRollouts = 1;
+
+  // Number of cohorts the batch is split into. The network evaluates one
+  // cohort while the threads advance the others, overlapping inference with
+  // tree work; 1 runs the whole batch in lockstep.
+  int numPipelineCohorts = 1;
+
+  // If true, the root samples gumbelNumSampled actions by Gumbel-top-k and
+  // narrows them down by sequential halving over the rollout budget, and the
+  // policy target is the improved policy of the completed q values rather
+  // than the visit counts. Needs numRolloutPerThread; totalTime keeps PUCT.
+  bool useGumbel = false;
+  int gumbelNumSampled = 16;
+
+  // If true, the game keeps searching the current position in the background
+  // while a human or text protocol opponent thinks, and the tree is kept for
+  // the next move as with reuseTree. The extra search is bounded by
+  // numRolloutPerThread, or by the remaining time with totalTime.
+  bool ponder = false;
 };
 
+inline void atomicAdd(std::atomic<float>& x, float v) {
+  float cur = x.load(std::memory_order_relaxed);
+  while (!x.compare_exchange_weak(cur, cur + v, std::memory_order_relaxed)) {
+  }
+}
+
+// All the statistics are atomics, so that several threads can select and back
+// up through the same node without locking.
 class MctsStats {
  public:
   MctsStats() {
@@ -65,19 +105,17 @@ class MctsStats {
   void reset() {
     value_ = 0.0;
     numVisit_ = 0;
-    virtualLoss_ = 0.0;
+    numVirtualLoss_ = 0;
     sumChildV_ = 0.0;
     numChild_ = 0;
   }
 
   float getValue() const {
-    // std::lock_guard<std::mutex> lock(mSelf_);
-    return value_;
+    return value_.load(std::memory_order_relaxed);
   }
 
   int getNumVisit() const {
-    // std::lock_guard<std::mutex> lock(mSelf_);
-    return numVisit_;
+    return numVisit_.load(std::memory_order_relaxed);
   }
 
   // Get prior child value (from the perspective of the current node).
@@ -88,67 +126,83 @@ class MctsStats {
   // optimistic and explore all actions once and waste a lot of rollouts (which
   // is bad for cases with high-branching factor).
   float getAvgChildV() const {
-    if (numChild_ == 0) {
+    int numChild = numChild_.load(std::memory_order_relaxed);
+    if (numChild == 0) {
       return 0.0;
     } else {
-      return sumChildV_ / numChild_;
+      return sumChildV_.load(std::memory_order_relaxed) / numChild;
     }
   }
 
   float getAvgValue() const {
-    assert(numVisit_ > 0);
-    return value_ / numVisit_;
+    assert(getNumVisit() > 0);
+    return getValue() / getNumVisit();
   }
 
-  float getVirtualLoss() const {
-    return virtualLoss_;
+  // Rollouts in flight through this node that count as losses. Kept as a
+  // count rather than a sum of floats, so that it is back to exactly 0 once
+  // every rollout is backed up.
+  int getNumVirtualLoss() const {
+    return numVirtualLoss_.load(std::memory_order_relaxed);
   }
 
-  void addVirtualLoss(float virtualLoss) {
-    // std::lock_guard<std::mutex> lock(mSelf_);
-    virtualLoss_ += virtualLoss;
+  void addVirtualLoss() {
+    numVirtualLoss_.fetch_add(1, std::memory_order_relaxed);
   }
 
+  // virtualLoss is that of the rollout, 0 if it did not add any.
   void atomicUpdate(float value, float virtualLoss) {
-    // std::lock_guard<std::mutex> lock(mSelf_);
-    value_ += value;
-    numVisit_++;
-    virtualLoss_ -= virtualLoss;
+    atomicAdd(value_, value);
+    numVisit_.fetch_add(1, std::memory_order_relaxed);
+    if (virtualLoss != 0) {
+      numVirtualLoss_.fetch_sub(1, std::memory_order_relaxed);
+    }
   }
 
   // Update child value estimate with a new obtained child value
   // (from the perspective of the root node
   void atomicUpdateChildV(float childV) {
-    // std::lock_guard<std::mutex> lock(mSelf_);
-    sumChildV_ += childV;
-    numChild_++;
+    atomicAdd(sumChildV_, childV);
+    numChild_.fetch_add(1, std::memory_order_relaxed);
   }
 
   std::string summary() const {
     std::stringstream ss;
-    ss << value_ << "/" << numVisit_ << " (" << value_ / numVisit_
-       << "), vloss: " << virtualLoss_;
+    ss << getValue() << "/" << getNumVisit() << " ("
+       << getValue() / getNumVisit() << "), vloss: " << getNumVirtualLoss();
     return ss.str();
   }
 
   void subtractVisit() {
-    --numVisit_;
+    numVisit_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  // Not atomic as a whole: other must not be updated meanwhile.
+  void copyFrom(const MctsStats& other) {
+    value_.store(other.value_.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+    numVisit_.store(other.numVisit_.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+    numVirtualLoss_.store(
+        other.numVirtualLoss_.load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+    sumChildV_.store(other.sumChildV_.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+    numChild_.store(other.numChild_.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
   }
   void addVisit() {
-    ++numVisit_;
+    numVisit_.fetch_add(1, std::memory_order_relaxed);
   }
 
  private:
-  float value_;
-  int numVisit_;
-  float virtualLoss_;
+  std::atomic<float> value_;
+  std::atomic_int numVisit_;
+  std::atomic_int numVirtualLoss_;
 
   // Summation of the value prediction from a child
-  float sumChildV_;
+  std::atomic<float> sumChildV_;
   // # child that has been explored.
-  int numChild_;
-
-  // std::mutex mSelf_;
+  std::atomic_int numChild_;
 };
 
 template <typename F, typename Rng>
@@ -195,6 +195,55 @@ void DataChannel::markSlotFilledAutoRelease(int slot) {
   }
 }
 
+int64_t DataChannel::sendBlockNoReply(
+    const std::unordered_map<std::string, torch::Tensor>& block) {
+  assert(!block.empty());
+  const int64_t rows = block.begin()->second.size(0);
+  std::vector<int64_t> slots;
+  int64_t sent = 0;
+  while (sent < rows) {
+    slots.clear();
+    {
+      std::unique_lock<std::mutex> lk(mAvailSlots_);
+      cvAvailSlots_.wait(
+          lk, [this] { return availSlots_.size() > 0 || terminated_; });
+      if (terminated_) {
+        return sent;
+      }
+      while (!availSlots_.empty() && sent + (int64_t)slots.size() < rows) {
+        int slot = availSlots_.back();
+        availSlots_.pop_back();
+        assert(slotStatus_[slot] == SlotStatus::avail);
+        slots.push_back(slot);
+      }
+    }
+
+    const int64_t n = slots.size();
+    torch::Tensor indices = torch::from_blob(slots.data(), {n}, torch::kInt64);
+    for (auto& name2tensor : sendName2Buffer_) {
+      auto it = block.find(name2tensor.first);
+      if (it == block.end() || it->second.size(0) != rows) {
+        throw std::runtime_error("sendBlockNoReply: bad block for key " +
+                                 name2tensor.first);
+      }
+      name2tensor.second.index_copy_(0, indices, it->second.narrow(0, sent, n));
+    }
+
+    std::unique_lock<std::mutex> lk(mFilled_);
+    for (int64_t slot : slots) {
+      slotStatus_[slot] = SlotStatus::filledAutoRelease;
+    }
+    numFilledSlot_ += n;
+    assert(numFilledSlot_ <= batchsize);
+    if (numFilledSlot_ == batchsize) {
+      lk.unlock();
+      cvFilled_.notify_all();  // there should be only one waiting
+    }
+    sent += n;
+  }
+  return sent;
+}
+
 std::unordered_map<std::string, torch::Tensor> DataChannel::getReply(int slot) {
   std::unique_lock<std::mutex> lk(mReplied_);
   cvReplied_.wait(lk, [this, slot] {
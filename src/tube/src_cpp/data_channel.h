@@ -54,6 +54,13 @@ class DataChannel {
   void markSlotFilled(int slot);
   void markSlotFilledAutoRelease(int slot);
 
+  // Sends each row of block, whose tensors share their first dimension, as
+  // one slot and without waiting for a reply, filling as many slots as are
+  // available at once. Returns the number of rows sent, which is short only
+  // if the channel is terminated.
+  int64_t sendBlockNoReply(
+      const std::unordered_map<std::string, torch::Tensor>& block);
+
   std::unordered_map<std::string, torch::Tensor> getReply(int slot);
 
   void releaseSlot(int slot);
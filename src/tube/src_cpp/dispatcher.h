@@ -86,6 +86,19 @@ class Dispatcher {
     return DISPATCH_NOERR;
   }
 
+  // send the rows of block, each as if by dispatchNoReply, but copied and
+  // marked filled in bulk; see DataChannel::sendBlockNoReply
+  int dispatchBlockNoReply(
+      const std::unordered_map<std::string, torch::Tensor>& block) {
+    if (dc_->terminated()) {
+      return DISPATCH_ERR_DC_TERM;
+    }
+    if (dc_->sendBlockNoReply(block) != block.begin()->second.size(0)) {
+      return DISPATCH_ERR_DC_TERM;
+    }
+    return DISPATCH_NOERR;
+  }
+
   void terminate() {
     if (dc_) {
       dc_->terminate();
@@ -42,6 +42,15 @@ class EpisodicTrajectory {
     return true;
   }
 
+  // Removes the whole trajectory, oldest first, as one tensor with a leading
+  // dimension of len(), which must not be 0.
+  torch::Tensor takeAll() {
+    assert(!trajectory_.empty());
+    torch::Tensor t = torch::stack(trajectory_);
+    trajectory_.clear();
+    return t;
+  }
+
   int len() {
     return (int)trajectory_.size();
   }
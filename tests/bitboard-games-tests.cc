@@ -0,0 +1,260 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Checks the bitboard implementations of Connect Four, Breakthrough and the
+// mnk-games move by move against plain per-cell implementations of their
+// rules, over random games: legal actions, status, features and hash.
+
+#include <random>
+#include <set>
+#include <tuple>
+
+#include <breakthrough_state.h>
+#include <connectfour.h>
+#include <gtest/gtest.h>
+#include <mnkgame.h>
+
+using Move = std::tuple<int, int, int>;
+
+// Game outcome of the references: -1 while the game goes on, the index of
+// the winner, or 2 for a tie.
+static int StatusOf(const core::State& state) {
+ if (!state.terminated())
+  return -1;
+ float reward = state.getReward(0);
+ return reward > 0 ? 0 : reward < 0 ? 1 : 2;
+}
+
+static std::set<Move> LegalMoves(const core::State& state) {
+ std::set<Move> moves;
+ for (auto& action : state.GetLegalActions())
+  moves.emplace(action.GetX(), action.GetY(), action.GetZ());
+ return moves;
+}
+
+// Plays random games with both the state and the reference, comparing them
+// after every move.
+template <typename State, typename Reference>
+static void CheckGames(int numGames) {
+ std::mt19937 rng(0);
+ for (int game = 0; game < numGames; ++game) {
+  State state(game);
+  state.Initialize();
+  Reference ref;
+  while (true) {
+   ASSERT_EQ(ref.status, StatusOf(state));
+   ASSERT_EQ(state.computeHash(), state.getHash());
+   if (ref.status >= 0)
+    break;
+   ASSERT_EQ(ref.legalMoves(), LegalMoves(state));
+   ASSERT_EQ(ref.features(), state.GetFeatures());
+   auto& actions = state.GetLegalActions();
+   auto& action = actions[rng() % actions.size()];
+   ref.play(action.GetX(), action.GetY(), action.GetZ());
+   state.forward(action.GetIndex());
+  }
+ }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Connect Four
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct ConnectFourReference {
+ int cells[7][6] = {};  // 0 for empty, else 1 + player
+ int player = 0;
+ int featuresPlayer = 0;
+ int status = -1;
+
+ std::set<Move> legalMoves() const {
+  std::set<Move> moves;
+  for (int x = 0; x < 7; ++x)
+   if (cells[x][5] == 0)
+    moves.emplace(x, 0, 0);
+  return moves;
+ }
+
+ // The stones of the player who moved last, then the other's, then ones.
+ std::vector<float> features() const {
+  std::vector<float> f(3 * 42, 1.f);
+  for (int y = 0; y < 6; ++y)
+   for (int x = 0; x < 7; ++x) {
+    f[y * 7 + x] = cells[x][y] == 1 + featuresPlayer;
+    f[42 + y * 7 + x] = cells[x][y] == 2 - featuresPlayer;
+   }
+  return f;
+ }
+
+ int count(int x, int y, int dx, int dy) const {
+  int n = 0;
+  for (x += dx, y += dy; x >= 0 && x < 7 && y >= 0 && y < 6 &&
+                         cells[x][y] == 1 + player;
+       x += dx, y += dy)
+   ++n;
+  return n;
+ }
+
+ void play(int x, int, int) {
+  int y = 0;
+  while (cells[x][y] != 0)
+   ++y;
+  cells[x][y] = 1 + player;
+  for (auto [dx, dy] : {std::pair(1, 0), {0, 1}, {1, 1}, {1, -1}})
+   if (1 + count(x, y, dx, dy) + count(x, y, -dx, -dy) >= 4)
+    status = player;
+  if (status < 0) {
+   featuresPlayer = player;
+   if (legalMoves().empty())
+    status = 2;
+  }
+  player = 1 - player;
+ }
+};
+
+}  // namespace
+
+TEST(BitboardGamesGroup, connectfour) {
+ CheckGames<StateForConnectFour, ConnectFourReference>(300);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Breakthrough
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+template <bool fixedPolicy> struct BreakthroughReference {
+ int cells[8][8];  // [x][y]
+ int player = White;
+ int status = -1;
+
+ BreakthroughReference() {
+  for (int x = 0; x < 8; ++x)
+   for (int y = 0; y < 8; ++y)
+    cells[x][y] = y < 2 ? Black : y >= 6 ? White : Empty;
+ }
+
+ // Actions (dir, x, y) move the piece at (x, y) to column x - 1, x or x + 1
+ // of the next row; only diagonal moves capture.
+ std::set<Move> movesOf(int color) const {
+  std::set<Move> moves;
+  int dy = color == White ? -1 : 1;
+  for (int x = 0; x < 8; ++x)
+   for (int y = 0; y < 8; ++y) {
+    if (cells[x][y] != color || y + dy < 0 || y + dy >= 8)
+     continue;
+    for (int dir = 0; dir < 3; ++dir) {
+     int x1 = x + dir - 1;
+     if (x1 < 0 || x1 >= 8)
+      continue;
+     int target = cells[x1][y + dy];
+     if (dir == 1 ? target == Empty : target != color)
+      moves.emplace(dir, x, y);
+    }
+   }
+  return moves;
+ }
+
+ std::set<Move> legalMoves() const {
+  return movesOf(player);
+ }
+
+ std::vector<float> features() const {
+  std::vector<float> f(2 * 64);
+  for (int i = 0; i < 64; ++i) {
+   int value = fixedPolicy ? cells[i / 8][i % 8] : cells[i % 8][i / 8];
+   f[i] = value == Black;
+   f[64 + i] = value == White;
+  }
+  return f;
+ }
+
+ void play(int dir, int x, int y) {
+  int y1 = y + (player == White ? -1 : 1);
+  cells[x][y] = Empty;
+  cells[x + dir - 1][y1] = player;
+  if (y1 == 0 || y1 == 7 || movesOf(1 - player).empty())
+   status = player;
+  player = 1 - player;
+ }
+};
+
+}  // namespace
+
+TEST(BitboardGamesGroup, breakthrough) {
+ CheckGames<StateForBreakthrough<true>, BreakthroughReference<true>>(300);
+}
+
+TEST(BitboardGamesGroup, breakthrough_transposed) {
+ CheckGames<StateForBreakthrough<false>, BreakthroughReference<false>>(300);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mnk-games
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+template <int M, int N, int K> struct MNKReference {
+ int cells[M][N] = {};  // 0 for empty, else 1 + player
+ int player = 0;
+ int status = -1;
+
+ std::set<Move> legalMoves() const {
+  std::set<Move> moves;
+  for (int x = 0; x < M; ++x)
+   for (int y = 0; y < N; ++y)
+    if (cells[x][y] == 0)
+     moves.emplace(0, x, y);
+  return moves;
+ }
+
+ // One plane per player, with square x + M * y.
+ std::vector<float> features() const {
+  std::vector<float> f(2 * M * N);
+  for (int x = 0; x < M; ++x)
+   for (int y = 0; y < N; ++y)
+    if (cells[x][y] != 0)
+     f[(cells[x][y] - 1) * M * N + M * y + x] = 1;
+  return f;
+ }
+
+ int count(int x, int y, int dx, int dy) const {
+  int n = 0;
+  for (x += dx, y += dy; x >= 0 && x < M && y >= 0 && y < N &&
+                         cells[x][y] == 1 + player;
+       x += dx, y += dy)
+   ++n;
+  return n;
+ }
+
+ void play(int, int x, int y) {
+  cells[x][y] = 1 + player;
+  for (auto [dx, dy] : {std::pair(1, 0), {0, 1}, {1, 1}, {1, -1}})
+   if (1 + count(x, y, dx, dy) + count(x, y, -dx, -dy) >= K)
+    status = player;
+  if (status < 0 && legalMoves().empty())
+   status = 2;
+  player = 1 - player;
+ }
+};
+
+}  // namespace
+
+TEST(BitboardGamesGroup, tictactoe) {
+ CheckGames<MNKGame::State<3, 3, 3>, MNKReference<3, 3, 3>>(300);
+}
+
+TEST(BitboardGamesGroup, mnk_rectangular) {
+ CheckGames<MNKGame::State<7, 5, 4>, MNKReference<7, 5, 4>>(300);
+}
+
+TEST(BitboardGamesGroup, gomoku) {
+ CheckGames<MNKGame::State<15, 15, 5>, MNKReference<15, 15, 5>>(100);
+}
@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Unit tests for the chess game: perft counts of the move generator on the
+// usual test positions, and a few games through chess::State.
+
+#include <chess.h>
+#include <gtest/gtest.h>
+#include "utils.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////
+
+static void CheckPerft(const std::string& fen,
+                       const std::vector<uint64_t>& expected) {
+ chess::ChessBoard board;
+ board.setFen(fen);
+ board.findMoves();
+ for (size_t depth = 1; depth <= expected.size(); ++depth)
+  ASSERT_EQ(expected[depth - 1], board.perft(depth))
+      << fen << " depth " << depth;
+}
+
+static void Play(chess::State& state, const std::vector<std::string>& moves) {
+ for (const std::string& move : moves) {
+  ASSERT_FALSE(state.terminated());
+  bool found = false;
+  for (auto& action : state.GetLegalActions()) {
+   if (state.actionDescription(action) == move) {
+    state.forward(action.GetIndex());
+    found = true;
+    break;
+   }
+  }
+  ASSERT_TRUE(found) << move;
+ }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// perft
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(ChessGroup, perft_initial) {
+ CheckPerft("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            {20, 400, 8902, 197281, 4865609});
+}
+
+TEST(ChessGroup, perft_kiwipete) {
+ CheckPerft("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+            {48, 2039, 97862, 4085603});
+}
+
+TEST(ChessGroup, perft_position3) {
+ CheckPerft("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+            {14, 191, 2812, 43238, 674624});
+}
+
+TEST(ChessGroup, perft_position4) {
+ CheckPerft("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+            {6, 264, 9467, 422333});
+}
+
+TEST(ChessGroup, perft_position5) {
+ CheckPerft("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+            {44, 1486, 62379, 2103487});
+}
+
+TEST(ChessGroup, perft_position6) {
+ CheckPerft("r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+            {46, 2079, 89890, 3894594});
+}
+
+TEST(ChessGroup, fen_invalid) {
+ chess::ChessBoard board;
+ ASSERT_THROW(board.setFen(""), std::runtime_error);
+ ASSERT_THROW(board.setFen("8/8/8/8/8/8/8/8 w - - 0 1"), std::runtime_error);
+ ASSERT_THROW(board.setFen("rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"),
+              std::runtime_error);
+ ASSERT_THROW(board.setFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1"),
+              std::runtime_error);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// State
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(ChessGroup, state_init) {
+ chess::State state(0);
+ state.Initialize();
+
+ ASSERT_EQ((std::vector<int64_t>{12, 8, 8}), state.GetFeatureSize());
+ ASSERT_EQ((std::vector<int64_t>{6, 8, 8}), state.GetActionSize());
+ ASSERT_EQ(20u, state.GetLegalActions().size());
+ ASSERT_EQ(state.computeHash(), state.getHash());
+
+ // white pawns, then the black king
+ const auto& features = state.GetFeatures();
+ for (int i = 0; i < 64; ++i)
+  ASSERT_EQ(i >= 8 && i < 16 ? 1.f : 0.f, features[i]);
+ for (int i = 0; i < 64; ++i)
+  ASSERT_EQ(i == 60 ? 1.f : 0.f, features[11 * 64 + i]);
+}
+
+TEST(ChessGroup, state_mate) {
+ chess::State state(0);
+ state.Initialize();
+ Play(state, {"f3", "e5", "g4", "Qh4"});
+ ASSERT_TRUE(state.terminated());
+ ASSERT_EQ(-1, state.getReward(0));
+}
+
+TEST(ChessGroup, state_repetition) {
+ chess::State state(0);
+ state.Initialize();
+ // The position after Nf3 occurs for the third time.
+ Play(state, {"Nf3", "Nf6", "Ng1", "Ng8", "Nf3", "Nf6", "Ng1", "Ng8"});
+ ASSERT_FALSE(state.terminated());
+ Play(state, {"Nf3"});
+ ASSERT_TRUE(state.terminated());
+ ASSERT_EQ(0, state.getReward(0));
+}
+
+TEST(ChessGroup, state_features) {
+ // The features updated move by move match those of the final position.
+ chess::State state(0);
+ state.Initialize();
+ Play(state, {"e4", "d5", "exd5", "c5", "dxc6", "Nf6", "cxb7", "e5", "bxa8=N",
+              "Bc5", "Nf3", "O-O", "Bc4", "Qe7", "O-O"});
+ std::vector<float> features = state.GetFeatures();
+ state.featurize();
+ ASSERT_EQ(state.GetFeatures(), features);
+ ASSERT_EQ(state.computeHash(), state.getHash());
+}
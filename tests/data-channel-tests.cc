@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Unit tests for sending whole blocks of rows through a DataChannel, as games
+// send their trajectories to the train channel.
+
+#include <data_channel.h>
+#include <gtest/gtest.h>
+
+#include <thread>
+
+///////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////
+
+using TensorMap = std::unordered_map<std::string, torch::Tensor>;
+
+// A channel for rows of a float "s" and an int "pi_index", as in the
+// training data.
+static std::shared_ptr<tube::DataChannel> NewChannel(int batchsize,
+                                                     int timeoutMs) {
+ auto dc = std::make_shared<tube::DataChannel>("train", batchsize, timeoutMs);
+ dc->createOrCheckBuffers(
+     {std::make_shared<tube::DataBlock>(
+          "s", std::vector<int64_t>{3}, torch::kFloat32),
+      std::make_shared<tube::DataBlock>(
+          "pi_index", std::vector<int64_t>{2}, torch::kInt32)},
+     {});
+ return dc;
+}
+
+// Rows begin to end, each starting with its number.
+static TensorMap Block(int64_t begin, int64_t end) {
+ torch::Tensor id = torch::arange(begin, end, torch::kFloat32).unsqueeze(1);
+ return {{"s", torch::cat({id, id * 0.5f, -id}, 1)},
+         {"pi_index", torch::cat({id, id + 1000}, 1).to(torch::kInt32)}};
+}
+
+// Takes batches from dc as the trainer does until it has n rows, and returns
+// them ordered by their number.
+static TensorMap Receive(tube::DataChannel& dc, int64_t n) {
+ std::vector<torch::Tensor> s;
+ std::vector<torch::Tensor> piIndex;
+ int64_t received = 0;
+ while (received < n) {
+  TensorMap input = dc.getInput();
+  // A full batch is the channel buffer itself, reused once replied to.
+  s.push_back(input.at("s").clone());
+  piIndex.push_back(input.at("pi_index").clone());
+  received += s.back().size(0);
+  dc.setReply({});
+ }
+ torch::Tensor allS = torch::cat(s);
+ torch::Tensor order = allS.select(1, 0).argsort();
+ return {{"s", allS.index_select(0, order)},
+         {"pi_index", torch::cat(piIndex).index_select(0, order)}};
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tests
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(DataChannelGroup, send_block_round_trip) {
+ auto dc = NewChannel(4, 10);
+ TensorMap received;
+ std::thread consumer([&] { received = Receive(*dc, 13); });
+ // More rows than slots, then a block that reuses the released slots, which
+ // neither fills a batch.
+ ASSERT_EQ(dc->sendBlockNoReply(Block(0, 10)), 10);
+ ASSERT_EQ(dc->sendBlockNoReply(Block(10, 13)), 3);
+ consumer.join();
+ TensorMap expected = Block(0, 13);
+ ASSERT_TRUE(received.at("s").equal(expected.at("s")));
+ ASSERT_TRUE(received.at("pi_index").equal(expected.at("pi_index")));
+}
+
+TEST(DataChannelGroup, send_block_terminated) {
+ auto dc = NewChannel(2, -1);
+ int64_t sent = -1;
+ std::thread sender([&] { sent = dc->sendBlockNoReply(Block(0, 5)); });
+ // The first batch is filled, but never replied to.
+ TensorMap input = dc->getInput();
+ TensorMap expected = Block(0, 2);
+ torch::Tensor order = input.at("s").select(1, 0).argsort();
+ EXPECT_TRUE(input.at("s").index_select(0, order).equal(expected.at("s")));
+ dc->terminate();
+ sender.join();
+ ASSERT_EQ(sent, 2);
+}
+
+TEST(DataChannelGroup, send_block_missing_key) {
+ auto dc = NewChannel(4, 10);
+ TensorMap block = Block(0, 3);
+ block.erase("pi_index");
+ ASSERT_THROW(dc->sendBlockNoReply(block), std::runtime_error);
+}
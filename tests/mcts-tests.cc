@@ -0,0 +1,270 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Unit tests for the tree search, on Connect Four with a deterministic
+// evaluation in place of random rollouts. A single rollout state searches
+// the same way every time, so trees searched through MctsPlayer can be
+// compared with trees searched by hand.
+
+#include <common/threads.h>
+#include <connectfour.h>
+#include <gtest/gtest.h>
+#include <mcts/mcts.h>
+
+#include <chrono>
+#include <thread>
+
+///////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////
+
+// Evaluates positions by their hash, and counts the evaluations.
+class TestConnectFour : public StateForConnectFour {
+ public:
+ TestConnectFour()
+     : StateForConnectFour(0) {
+  initializeAs<TestConnectFour>();
+  Initialize();
+ }
+
+ std::unique_ptr<core::State> clone_() const override {
+  return std::make_unique<TestConnectFour>(*this);
+ }
+
+ float getRandomRolloutReward(int player) const override {
+  ++numEvaluations;
+  uint64_t h = getHash() * 0x9e3779b97f4a7c15;
+  float value = (h >> 40) % 2001 / 1000.0f - 1.0f;
+  return player == getCurrentPlayer() ? value : -value;
+ }
+
+ static std::atomic_int numEvaluations;
+};
+
+std::atomic_int TestConnectFour::numEvaluations{0};
+
+// An actor without a model, as for pure MCTS players.
+static std::shared_ptr<core::Actor> MakeActor(const core::State& state) {
+ threads::init(4);
+ return std::make_shared<core::Actor>(nullptr, state.GetFeatureSize(),
+                                      state.GetActionSize(),
+                                      std::vector<int64_t>{}, 0, false,
+                                      false, false, nullptr);
+}
+
+static mcts::MctsOption Options(int numRollouts) {
+ mcts::MctsOption option;
+ option.puct = 1.1f;
+ option.numRolloutPerThread = numRollouts;
+ option.virtualLoss = 1.0f;
+ // Keeps the visit counts as searched.
+ option.forcedRolloutsMultiplier = 0.0f;
+ return option;
+}
+
+static mcts::Node* NewRoot() {
+ mcts::Node* root = mcts::Storage::getStorage()->newNode();
+ root->init(nullptr);
+ return root;
+}
+
+static void Search(mcts::Node* root,
+                   const core::State& state,
+                   core::Actor& actor,
+                   const mcts::MctsOption& option,
+                   mcts::TranspositionTable* tt = nullptr,
+                   std::vector<mcts::GumbelRoot>* gumbel = nullptr) {
+ std::minstd_rand rng(option.seed);
+ mcts::computeRollouts(
+     {root}, {&state}, {}, actor, option, 0.0, rng, tt, gumbel);
+}
+
+static std::vector<int> Visits(const mcts::Node* root) {
+ std::vector<int> r;
+ mcts::Edges edges = root->getEdges();
+ for (size_t a = 0; a != root->getNumChildSlots(); ++a) {
+  r.push_back(edges.numVisit[a].load());
+ }
+ return r;
+}
+
+// The policy MctsPlayer::actMcts returns for a root searched by PUCT.
+static std::vector<float> Policy(const mcts::Node* root) {
+ std::minstd_rand rng;
+ mcts::MctsResult result(&rng);
+ std::vector<int> visits = Visits(root);
+ for (size_t a = 0; a != visits.size(); ++a) {
+  if (visits[a] > 1) {
+   result.add(a, visits[a]);
+  }
+ }
+ result.normalize();
+ return result.mctsPolicy;
+}
+
+static mcts::Action MostVisited(const mcts::Node* node) {
+ std::vector<int> visits = Visits(node);
+ return std::max_element(visits.begin(), visits.end()) - visits.begin();
+}
+
+// Checks that no virtual loss is left in the tree, and that the visits of
+// each edge are those of its child.
+static void CheckBackedUp(const mcts::Node* node) {
+ ASSERT_EQ(node->getMctsStats().getNumVirtualLoss(), 0);
+ mcts::Edges edges = node->getEdges();
+ for (size_t a = 0; a != node->getNumChildSlots(); ++a) {
+  ASSERT_EQ(edges.virtualLoss[a].load(), 0.0f);
+  if (const mcts::Node* child = node->getChild(a)) {
+   ASSERT_EQ(child->getMctsStats().getNumVisit(), edges.numVisit[a].load());
+   CheckBackedUp(child);
+  }
+ }
+}
+
+// Waits for the background search of a player to make n evaluations.
+static void WaitForEvaluations(int n) {
+ auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+ while (TestConnectFour::numEvaluations < n) {
+  ASSERT_LT(std::chrono::steady_clock::now(), deadline);
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+ }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tests
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(MctsGroup, reused_tree_matches_kept_subtree) {
+ TestConnectFour state;
+ auto actor = MakeActor(state);
+ mcts::MctsOption option = Options(200);
+ option.reuseTree = true;
+ mcts::MctsPlayer player(option);
+ player.setActor(actor);
+
+ mcts::Node* root = NewRoot();
+ Search(root, state, *actor, option);
+ mcts::MctsResult result = player.actMcts(state);
+ ASSERT_EQ(result.mctsPolicy, Policy(root));
+
+ // Both moves are in the searched tree, so the player goes on from the
+ // subtree they lead to.
+ mcts::Action move = result.bestAction;
+ mcts::Action reply = MostVisited(root->getChild(move));
+ state.forward(move);
+ state.forward(reply);
+ root = root->detachChild(move)->detachChild(reply);
+ ASSERT_NE(root, nullptr);
+ ASSERT_GT(root->getMctsStats().getNumVisit(), 1);
+ Search(root, state, *actor, option);
+ result = player.actMcts(state);
+ ASSERT_EQ(result.mctsPolicy, Policy(root));
+ ASSERT_EQ(result.rootValue, root->getMctsStats().getAvgValue());
+ root->freeTree();
+}
+
+TEST(MctsGroup, transposition_table_hits) {
+ TestConnectFour state;
+ auto actor = MakeActor(state);
+ mcts::MctsOption option = Options(400);
+ auto numEvaluations = [&](mcts::TranspositionTable* tt) {
+  int begin = TestConnectFour::numEvaluations;
+  mcts::Node* root = NewRoot();
+  Search(root, state, *actor, option, tt);
+  root->freeTree();
+  return TestConnectFour::numEvaluations - begin;
+ };
+ int plain = numEvaluations(nullptr);
+ mcts::TranspositionTable tt(1 << 16);
+ // Positions reached by several move orders are evaluated once.
+ int first = numEvaluations(&tt);
+ ASSERT_LT(first, plain);
+ // A new search takes the evaluations of the first one from the table, but
+ // for the simulation that ends each batch.
+ int second = numEvaluations(&tt);
+ ASSERT_LT(second, first / 4);
+}
+
+TEST(MctsGroup, parallel_search_backs_up_virtual_loss) {
+ TestConnectFour state;
+ auto actor = MakeActor(state);
+ mcts::MctsOption option = Options(2000);
+ option.numParallelRollouts = 8;
+ mcts::Node* root = NewRoot();
+ Search(root, state, *actor, option);
+ ASSERT_GE(root->getMctsStats().getNumVisit(), 2000);
+ CheckBackedUp(root);
+ root->freeTree();
+}
+
+TEST(MctsGroup, gumbel_phase_counts) {
+ TestConnectFour state;
+ auto actor = MakeActor(state);
+ mcts::MctsOption option = Options(64);
+ option.useGumbel = true;
+ std::vector<mcts::GumbelRoot> gumbel(1);
+ mcts::Node* root = NewRoot();
+ // 4 of the 7 actions are sampled, then halved once: 2 phases of 32
+ // simulations, the first of which expands the root.
+ gumbel[0].reset(1, 64, 4, option.virtualLoss);
+ Search(root, state, *actor, option, nullptr, &gumbel);
+ std::vector<int> visits = Visits(root);
+ std::sort(visits.begin(), visits.end());
+ ASSERT_EQ(visits, (std::vector<int>{0, 0, 0, 8, 8, 23, 24}));
+
+ // Searching the root again only counts the new visits.
+ std::vector<int> before = Visits(root);
+ gumbel[0].reset(2, 64, 4, option.virtualLoss);
+ Search(root, state, *actor, option, nullptr, &gumbel);
+ visits = Visits(root);
+ for (size_t a = 0; a != visits.size(); ++a) {
+  visits[a] -= before[a];
+ }
+ std::sort(visits.begin(), visits.end());
+ ASSERT_EQ(visits, (std::vector<int>{0, 0, 0, 8, 8, 24, 24}));
+ root->freeTree();
+}
+
+TEST(MctsGroup, ponder_stop_resume) {
+ TestConnectFour state;
+ auto actor = MakeActor(state);
+ mcts::MctsOption option = Options(100);
+ option.ponder = true;
+
+ // Three searches of the same tree, as made by two rounds of pondering and
+ // the move that follows.
+ mcts::Node* root = NewRoot();
+ std::vector<int> numEvaluations;
+ for (int i = 0; i != 3; ++i) {
+  int begin = TestConnectFour::numEvaluations;
+  Search(root, state, *actor, option);
+  numEvaluations.push_back(TestConnectFour::numEvaluations - begin);
+ }
+
+ mcts::MctsPlayer player(option);
+ player.setActor(actor);
+ for (int i = 0; i != 2; ++i) {
+  // Each round goes on from the tree of the previous one.
+  int target = TestConnectFour::numEvaluations + numEvaluations[i];
+  player.ponder(state);
+  WaitForEvaluations(target);
+  player.stopPondering();
+ }
+ mcts::MctsResult result = player.actMcts(state);
+ ASSERT_EQ(result.mctsPolicy, Policy(root));
+ root->freeTree();
+
+ // Stopping interrupts a search of any length, and the move after it still
+ // searches its own budget.
+ player.option().numRolloutPerThread = 1 << 30;
+ player.ponder(state);
+ std::this_thread::sleep_for(std::chrono::milliseconds(20));
+ player.stopPondering();
+ player.option().numRolloutPerThread = 100;
+ result = player.actMcts(state);
+ ASSERT_LT((size_t)result.bestAction, state.GetLegalActions().size());
+}
@@ -0,0 +1,182 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Unit tests for the PUCT kernels: each SIMD kernel the CPU supports must
+// pick the same edge as the scalar code, for any number of edges, whether or
+// not it fills the vectors, and must break ties by the lowest index.
+
+#include <gtest/gtest.h>
+#include <mcts/puct.h>
+
+#include <cmath>
+#include <memory>
+#include <random>
+
+///////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////
+
+// The edge arrays of a node with n children.
+class TestEdges {
+ public:
+ TestEdges(size_t n)
+     : prior(n, 0.0f)
+     , numVisit(new std::atomic_int[n])
+     , value(new std::atomic<float>[n])
+     , virtualLoss(new std::atomic<float>[n])
+     , child(new std::atomic<mcts::Node*>[n]) {
+  for (size_t i = 0; i != n; ++i) {
+   set(i, 0.0f, 0, 0.0f, 0.0f);
+   child[i] = nullptr;
+  }
+ }
+
+ void set(size_t i, float p, int visits, float v, float vloss) {
+  prior[i] = p;
+  numVisit[i] = visits;
+  value[i] = v;
+  virtualLoss[i] = vloss;
+ }
+
+ mcts::Edges edges() const {
+  return {prior.data(), numVisit.get(), value.get(), virtualLoss.get(),
+          child.get()};
+ }
+
+ std::vector<float> prior;
+ std::unique_ptr<std::atomic_int[]> numVisit;
+ std::unique_ptr<std::atomic<float>[]> value;
+ std::unique_ptr<std::atomic<float>[]> virtualLoss;
+ std::unique_ptr<std::atomic<mcts::Node*>[]> child;
+};
+
+// Edge counts below, at and past the vector widths, with padded tails.
+static const size_t edgeCounts[] = {
+    1, 7, 8, 9, 15, 16, 17, 23, 31, 32, 37, 64, 71, 121, 362};
+
+// Random statistics like those of a node during search: a quarter of the
+// edges unvisited, some with virtual loss only.
+static TestEdges RandomEdges(size_t n, std::minstd_rand& rng) {
+ TestEdges t(n);
+ for (size_t i = 0; i != n; ++i) {
+  int visits = std::uniform_int_distribution<int>(0, 3)(rng) == 0
+                   ? 0
+                   : std::uniform_int_distribution<int>(1, 200)(rng);
+  float value =
+      visits * std::uniform_real_distribution<float>(-1.0f, 1.0f)(rng);
+  float vloss = std::uniform_int_distribution<int>(0, 7)(rng) == 0;
+  t.set(i, std::uniform_real_distribution<float>(0.0f, 1.0f)(rng), visits,
+        value, vloss);
+ }
+ return t;
+}
+
+static mcts::PuctParams Params() {
+ mcts::PuctParams params;
+ params.puct = 1.1f;
+ params.sqrtParentNumVisit = 60.0f;
+ params.flip = -1.0f;
+ params.unvisitedQ = -0.2f;
+ return params;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tests
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(PuctGroup, kernels_match_scalar) {
+ std::minstd_rand rng(42);
+ mcts::PuctParams params = Params();
+ auto kernels = mcts::puctScoresKernels();
+ for (size_t n : edgeCounts) {
+  for (int trial = 0; trial != 100; ++trial) {
+   TestEdges t = RandomEdges(n, rng);
+   std::vector<float> expected(n);
+   size_t best = mcts::puctScoresScalar(t.edges(), n, params, expected.data());
+   ASSERT_LT(best, n);
+   // The kernels may round differently in the last bits, so the argmax is
+   // only compared when no other score is that close.
+   float tolerance = 1e-5f * (1.0f + std::abs(expected[best]));
+   bool unique = true;
+   for (size_t i = 0; i != n; ++i) {
+    unique = unique && (i == best || expected[i] < expected[best] - tolerance);
+   }
+   for (auto kernel : kernels) {
+    std::vector<float> scores(n);
+    size_t r = kernel(t.edges(), n, params, scores.data());
+    ASSERT_LT(r, n);
+    for (size_t i = 0; i != n; ++i) {
+     ASSERT_NEAR(
+         scores[i], expected[i], 1e-5f * (1.0f + std::abs(expected[i])));
+    }
+    if (unique) {
+     ASSERT_EQ(r, best);
+    } else {
+     ASSERT_GE(expected[r], expected[best] - tolerance);
+    }
+   }
+   std::vector<float> scores(n);
+   size_t r = mcts::puctScores(t.edges(), n, params, scores.data());
+   ASSERT_TRUE(!unique || r == best);
+  }
+ }
+}
+
+TEST(PuctGroup, kernels_break_ties_by_lowest_index) {
+ mcts::PuctParams params = Params();
+ auto kernels = mcts::puctScoresKernels();
+ // The best edges in the same lane, in different lanes with the lower index
+ // in the higher lane, in the vectors and in the tail, and both in the tail.
+ const std::pair<size_t, size_t> ties[] = {
+     {1, 17}, {3, 10}, {7, 8}, {15, 16}, {14, 30}, {5, 35}, {20, 36},
+     {33, 36}, {0, 70}};
+ for (size_t n : {37, 71}) {
+  for (auto [j, k] : ties) {
+   if (k >= n) {
+    continue;
+   }
+   TestEdges t(n);
+   for (size_t i = 0; i != n; ++i) {
+    t.set(i, 0.1f, 10, 2.0f, 0.0f);
+   }
+   t.set(j, 0.5f, 3, -1.0f, 1.0f);
+   t.set(k, 0.5f, 3, -1.0f, 1.0f);
+   for (auto kernel : kernels) {
+    std::vector<float> scores(n);
+    ASSERT_EQ(kernel(t.edges(), n, params, scores.data()), j);
+    ASSERT_EQ(scores[j], scores[k]);
+   }
+  }
+  // All edges alike.
+  TestEdges t(n);
+  for (size_t i = 0; i != n; ++i) {
+   t.set(i, 0.2f, 0, 0.0f, 0.0f);
+  }
+  for (auto kernel : kernels) {
+   std::vector<float> scores(n);
+   ASSERT_EQ(kernel(t.edges(), n, params, scores.data()), 0);
+  }
+ }
+}
+
+TEST(PuctGroup, forced_edge_matches_scalar) {
+ std::minstd_rand rng(7);
+ mcts::Node node;
+ for (size_t n : edgeCounts) {
+  for (int trial = 0; trial != 100; ++trial) {
+   TestEdges t = RandomEdges(n, rng);
+   for (size_t i = 0; i != n; ++i) {
+    t.numVisit[i] = std::uniform_int_distribution<int>(0, 40)(rng);
+    if (std::uniform_int_distribution<int>(0, 1)(rng)) {
+     t.child[i] = &node;
+    }
+   }
+   size_t expected = mcts::findForcedEdgeScalar(t.edges(), n, 2.0f, 400, 20);
+   ASSERT_EQ(mcts::findForcedEdge(t.edges(), n, 2.0f, 400, 20), expected);
+  }
+ }
+}
@@ -0,0 +1,372 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Unit tests for the replay buffer: batches taken from its pool must not be
+// refilled while they are still held, an attached buffer must restore the
+// samples of its last checkpoint, each sampling mode must draw samples with
+// its own distribution, and samples compressed with trained dictionaries
+// must come back exactly.
+
+#include <core/replay_buffer.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <unistd.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////
+
+// Adds the samples begin to end - 1, each holding its own number.
+static void Fill(core::ReplayBuffer& buffer, int begin = 0, int end = 100) {
+ std::unordered_map<std::string, torch::Tensor> input;
+ input["s"] = torch::arange(begin, end, torch::kFloat32).view({end - begin, 1});
+ buffer.add(input);
+}
+
+// The numbers of n samples drawn in one batch, in order.
+static std::vector<int> SampleIds(core::ReplayBuffer& buffer, int n) {
+ auto batch = buffer.sample(n);
+ torch::Tensor s = batch.at("s").view({n});
+ std::vector<int> r;
+ for (int i = 0; i != n; ++i) {
+  r.push_back((int)s[i].item<float>());
+ }
+ return r;
+}
+
+// Uniform sampling draws each sample once before drawing any again, so a
+// batch of size() samples holds all of them.
+static std::vector<int> AllIds(core::ReplayBuffer& buffer) {
+ std::vector<int> r = SampleIds(buffer, buffer.size());
+ std::sort(r.begin(), r.end());
+ return r;
+}
+
+static std::vector<int> Range(int begin, int end) {
+ std::vector<int> r;
+ for (int i = begin; i != end; ++i) {
+  r.push_back(i);
+ }
+ return r;
+}
+
+// How many times each sample is drawn in numBatches batches of n.
+static std::map<int, int> CountIds(core::ReplayBuffer& buffer,
+                                   int numBatches,
+                                   int n) {
+ std::map<int, int> r;
+ for (int i = 0; i != numBatches; ++i) {
+  for (int id : SampleIds(buffer, n)) {
+   ++r[id];
+  }
+ }
+ return r;
+}
+
+static core::ReplayBuffer::SamplingOptions Prioritized() {
+ core::ReplayBuffer::SamplingOptions options;
+ options.mode = "prioritized";
+ options.priorityAlpha = 1.0f;
+ options.priorityBeta = 1.0f;
+ return options;
+}
+
+// Rows of 256 floats: the row number, then a pattern that a dictionary
+// trained on some rows compresses well.
+static torch::Tensor DictionaryRows(int n) {
+ torch::Tensor r = torch::empty({n, 256}, torch::kFloat32);
+ float* data = r.data_ptr<float>();
+ for (int i = 0; i != n; ++i) {
+  data[i * 256] = i;
+  for (int j = 1; j != 256; ++j) {
+   data[i * 256 + j] = (j * 7 + i % 3) % 32;
+  }
+ }
+ return r;
+}
+
+// Draws all the samples of a buffer filled with DictionaryRows(n), and
+// checks that each comes back once and unchanged.
+static void CheckDictionaryRows(core::ReplayBuffer& buffer, int n) {
+ ASSERT_EQ(buffer.size(), n);
+ torch::Tensor expected = DictionaryRows(n);
+ torch::Tensor s = buffer.sample(n).at("s");
+ std::vector<int> ids;
+ for (int k = 0; k != n; ++k) {
+  int id = (int)s[k][0].item<float>();
+  ASSERT_TRUE(torch::equal(s[k], expected[id]));
+  ids.push_back(id);
+ }
+ std::sort(ids.begin(), ids.end());
+ ASSERT_EQ(ids, Range(0, n));
+}
+
+static std::string MakeTempDir() {
+ char path[] = "/tmp/replay-buffer-tests-XXXXXX";
+ if (!mkdtemp(path)) {
+  throw std::runtime_error("mkdtemp failed");
+ }
+ return path;
+}
+
+// Cuts the last byte off the record of the newest sample of the checkpoint
+// in directory. The checkpoint is a header of 3 words followed by an index
+// of {seq, segment, offset, size} words per slot.
+static void TruncateNewestRecord(const std::string& directory, int capacity) {
+ std::vector<uint64_t> data(3 + 4 * capacity);
+ std::ifstream f(directory + "/checkpoint", std::ios::binary);
+ ASSERT_TRUE(f.read((char*)data.data(), data.size() * sizeof(uint64_t)));
+ const uint64_t* newest = nullptr;
+ for (int i = 0; i != capacity; ++i) {
+  const uint64_t* entry = &data[3 + 4 * i];
+  if (!newest || entry[0] > newest[0]) {
+   newest = entry;
+  }
+ }
+ ASSERT_NE(newest[0], 0u);
+ std::string path = directory + "/segment-" + std::to_string(newest[1]);
+ ASSERT_EQ(truncate(path.c_str(), newest[2] + newest[3] - 1), 0);
+}
+
+// Holds two batches across further calls to sample(), and checks that
+// neither is handed out again nor overwritten.
+static void CheckHeldBatches(core::ReplayBuffer& buffer) {
+ auto a = buffer.sample(8);
+ auto b = buffer.sample(8);
+ ASSERT_NE(a.at("s").data_ptr(), b.at("s").data_ptr());
+ torch::Tensor aCopy = a.at("s").clone();
+ // A view alone also keeps its batch.
+ torch::Tensor bView = b.at("s").view({8});
+ torch::Tensor bCopy = bView.clone();
+ b.clear();
+ for (int i = 0; i != 20; ++i) {
+  auto c = buffer.sample(8);
+  ASSERT_NE(a.at("s").data_ptr(), c.at("s").data_ptr());
+  ASSERT_NE(bView.data_ptr(), c.at("s").data_ptr());
+ }
+ ASSERT_TRUE(torch::equal(aCopy, a.at("s")));
+ ASSERT_TRUE(torch::equal(bCopy, bView));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tests
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(ReplayBufferGroup, held_batches_no_prefetch) {
+ core::ReplayBuffer buffer(100, 1);
+ buffer.setPrefetch(0, 1, false);
+ Fill(buffer);
+ CheckHeldBatches(buffer);
+}
+
+TEST(ReplayBufferGroup, held_batches_prefetch) {
+ core::ReplayBuffer buffer(100, 1);
+ buffer.setPrefetch(2, 2, false);
+ Fill(buffer);
+ CheckHeldBatches(buffer);
+}
+
+TEST(ReplayBufferGroup, released_batch_reused) {
+ core::ReplayBuffer buffer(100, 1);
+ buffer.setPrefetch(0, 1, false);
+ Fill(buffer);
+ void* data = buffer.sample(8).at("s").data_ptr();
+ ASSERT_EQ(data, buffer.sample(8).at("s").data_ptr());
+}
+
+TEST(ReplayBufferGroup, checkpoint_restore) {
+ std::string dir = MakeTempDir();
+ {
+  core::ReplayBuffer buffer(10, 1);
+  buffer.setPrefetch(0, 1, false);
+  buffer.attach(dir);
+  Fill(buffer, 0, 8);
+  buffer.checkpoint();
+  // Added after the checkpoint, so lost.
+  Fill(buffer, 8, 10);
+ }
+ {
+  core::ReplayBuffer buffer(10, 1);
+  buffer.setPrefetch(0, 1, false);
+  buffer.attach(dir);
+  ASSERT_EQ(buffer.size(), 8);
+  ASSERT_EQ(buffer.numAdd(), 8);
+  ASSERT_EQ(AllIds(buffer), Range(0, 8));
+  // Restored buffers keep adding to new segments.
+  Fill(buffer, 8, 10);
+  buffer.checkpoint();
+ }
+ {
+  core::ReplayBuffer buffer(10, 1);
+  buffer.setPrefetch(0, 1, false);
+  buffer.attach(dir);
+  ASSERT_EQ(buffer.size(), 10);
+  ASSERT_EQ(AllIds(buffer), Range(0, 10));
+ }
+ std::filesystem::remove_all(dir);
+}
+
+TEST(ReplayBufferGroup, restore_truncated_record) {
+ std::string dir = MakeTempDir();
+ {
+  core::ReplayBuffer buffer(10, 1);
+  buffer.setPrefetch(0, 1, false);
+  buffer.attach(dir);
+  Fill(buffer, 0, 6);
+  buffer.checkpoint();
+ }
+ TruncateNewestRecord(dir, 10);
+ {
+  core::ReplayBuffer buffer(10, 1);
+  buffer.setPrefetch(0, 1, false);
+  buffer.attach(dir);
+  ASSERT_EQ(buffer.size(), 5);
+  ASSERT_EQ(AllIds(buffer), Range(0, 5));
+  // The damaged record is dropped for good.
+  Fill(buffer, 5, 7);
+  buffer.checkpoint();
+ }
+ {
+  core::ReplayBuffer buffer(10, 1);
+  buffer.setPrefetch(0, 1, false);
+  buffer.attach(dir);
+  ASSERT_EQ(AllIds(buffer), Range(0, 7));
+ }
+ std::filesystem::remove_all(dir);
+}
+
+TEST(ReplayBufferGroup, prioritized_sampling) {
+ core::ReplayBuffer buffer(4, 1);
+ buffer.setPrefetch(0, 1, false);
+ buffer.setSampling(Prioritized());
+ Fill(buffer, 0, 4);
+ // Priorities 1, 1, 1 and 5: each batch of 8 draws one from each eighth of
+ // the priority mass, so sample 3 takes 5 of them.
+ buffer.updatePriorities(torch::tensor({3}), torch::tensor({5.0f}));
+ int numDrawn3 = 0;
+ for (int i = 0; i != 100; ++i) {
+  auto batch = buffer.sample(8);
+  torch::Tensor s = batch.at("s").view({8});
+  torch::Tensor index = batch.at("replay_index");
+  torch::Tensor weight = batch.at("replay_weight");
+  ASSERT_EQ(index.scalar_type(), torch::kInt64);
+  for (int k = 0; k != 8; ++k) {
+   int id = (int)s[k].item<float>();
+   ASSERT_EQ(index[k].item<int64_t>(), id);
+   // Weights (size * P)^-1 are 2 and 0.4, over their maximum.
+   ASSERT_NEAR(weight[k].item<float>(), id == 3 ? 0.2f : 1.0f, 1e-4f);
+   numDrawn3 += id == 3;
+  }
+ }
+ ASSERT_NEAR(numDrawn3 / 800.0, 5.0 / 8, 0.01);
+}
+
+TEST(ReplayBufferGroup, priorities_skip_overwritten) {
+ core::ReplayBuffer buffer(4, 1);
+ buffer.setPrefetch(0, 1, false);
+ buffer.setSampling(Prioritized());
+ Fill(buffer, 0, 4);
+ // Samples 0 and 1 are overwritten by 4 and 5 before their priorities come
+ // back; the priority of 0 must not go to 4.
+ Fill(buffer, 4, 6);
+ buffer.updatePriorities(torch::tensor({0, 3}), torch::tensor({100.0f, 3.0f}));
+ auto counts = CountIds(buffer, 100, 6);
+ ASSERT_EQ(counts.count(0), 0u);
+ ASSERT_EQ(counts.count(1), 0u);
+ // Priorities 1, 1, 1 and 3.
+ ASSERT_NEAR(counts[4] / 600.0, 1.0 / 6, 0.01);
+ ASSERT_NEAR(counts[5] / 600.0, 1.0 / 6, 0.01);
+ ASSERT_NEAR(counts[2] / 600.0, 1.0 / 6, 0.01);
+ ASSERT_NEAR(counts[3] / 600.0, 1.0 / 2, 0.01);
+}
+
+TEST(ReplayBufferGroup, recent_sampling) {
+ core::ReplayBuffer buffer(100, 1);
+ buffer.setPrefetch(0, 1, false);
+ core::ReplayBuffer::SamplingOptions options;
+ options.mode = "recent";
+ options.recencyWindow = 10;
+ buffer.setSampling(options);
+ // Past capacity, so that the window wraps around the slots.
+ Fill(buffer, 0, 150);
+ auto counts = CountIds(buffer, 200, 10);
+ ASSERT_EQ(counts.size(), 10u);
+ for (auto [id, n] : counts) {
+  ASSERT_GE(id, 140);
+  ASSERT_LT(id, 150);
+  // 200 expected, with a standard deviation of about 13.
+  ASSERT_NEAR(n, 200, 60);
+ }
+}
+
+TEST(ReplayBufferGroup, phase_sampling) {
+ core::ReplayBuffer buffer(40, 1);
+ buffer.setPrefetch(0, 1, false);
+ core::ReplayBuffer::SamplingOptions options;
+ options.mode = "phase";
+ options.numPhases = 2;
+ options.phaseSteps = 10;
+ buffer.setSampling(options);
+ auto add = [&](int begin, int end, auto step) {
+  std::unordered_map<std::string, torch::Tensor> input;
+  input["s"] =
+      torch::arange(begin, end, torch::kFloat32).view({end - begin, 1});
+  input["step"] = torch::empty({end - begin, 1}, torch::kFloat32);
+  for (int i = begin; i != end; ++i) {
+   input["step"][i - begin][0] = step(i);
+  }
+  buffer.add(input);
+ };
+ // 30 samples in the first phase and 10 in the last, open-ended one.
+ add(0, 30, [](int i) { return i % 10; });
+ add(30, 40, [](int i) { return i; });
+ for (int i = 0; i != 100; ++i) {
+  std::vector<int> ids = SampleIds(buffer, 10);
+  auto isLast = [](int id) { return id >= 30; };
+  ASSERT_EQ(std::count_if(ids.begin(), ids.end(), isLast), 5);
+ }
+ // Overwriting every slot with first phase samples empties the last phase.
+ add(40, 80, [](int) { return 0; });
+ auto counts = CountIds(buffer, 100, 10);
+ ASSERT_EQ(counts.size(), 40u);
+ ASSERT_GE(counts.begin()->first, 40);
+}
+
+TEST(ReplayBufferGroup, dictionary_round_trip) {
+ std::string dir = MakeTempDir();
+ {
+  core::ReplayBuffer buffer(200, 1);
+  buffer.setPrefetch(0, 1, false);
+  buffer.setDictionaries(100, 4096);
+  buffer.attach(dir);
+  // The first 100 samples are compressed before the dictionary is trained
+  // on them, the next 100 with it.
+  std::unordered_map<std::string, torch::Tensor> input;
+  input["s"] = DictionaryRows(200);
+  buffer.add(input);
+  ASSERT_GT(buffer.compressionRatio(), 1.0);
+  // The dictionary of the only key was trained and saved.
+  uint64_t dictionarySize = 0;
+  std::ifstream f(dir + "/dictionaries", std::ios::binary);
+  ASSERT_TRUE(f.read((char*)&dictionarySize, sizeof(dictionarySize)));
+  ASSERT_GT(dictionarySize, 0u);
+  CheckDictionaryRows(buffer, 200);
+  buffer.checkpoint();
+ }
+ {
+  // Frames of both kinds are read back with the saved dictionary.
+  core::ReplayBuffer buffer(200, 1);
+  buffer.setPrefetch(0, 1, false);
+  buffer.attach(dir);
+  CheckDictionaryRows(buffer, 200);
+ }
+ std::filesystem::remove_all(dir);
+}
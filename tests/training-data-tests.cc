@@ -0,0 +1,161 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Unit tests for the compact forms of the training data: each must give back
+// exactly the dense tensors it replaces once unpacked as the trainer does.
+
+#include <connectfour.h>
+#include <core/utils.h>
+#include <gtest/gtest.h>
+#include <hex_state.h>
+
+#include <random>
+
+///////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////
+
+// Unpacks bits as utils.unpack_bits does: bit j of byte i is element 8i + j.
+static std::vector<float> UnpackBits(const torch::Tensor& bits, int64_t size) {
+ EXPECT_EQ(bits.numel(), (size + 7) / 8);
+ const uint8_t* data = bits.data_ptr<uint8_t>();
+ std::vector<float> r(size);
+ for (int64_t i = 0; i != size; ++i) {
+  r[i] = (data[i / 8] >> (i % 8)) & 1;
+ }
+ return r;
+}
+
+static std::vector<float> Flat(const torch::Tensor& t) {
+ torch::Tensor c = t.contiguous();
+ const float* data = c.data_ptr<float>();
+ return std::vector<float>(data, data + c.numel());
+}
+
+// A policy over the legal actions, with about a third of them at zero.
+static std::vector<float> RandomPolicy(const core::State& state,
+                                       std::minstd_rand& rng) {
+ std::vector<float> pi(state.GetLegalActions().size());
+ float sum = 0.0f;
+ for (auto& v : pi) {
+  if (std::uniform_int_distribution<int>(0, 2)(rng)) {
+   v = std::uniform_real_distribution<float>(0.01f, 1.0f)(rng);
+   sum += v;
+  }
+ }
+ if (sum == 0.0f) {
+  pi[0] = sum = 1.0f;
+ }
+ for (auto& v : pi) {
+  v /= sum;
+ }
+ return pi;
+}
+
+// Packs the policy of the position with room for capacity actions, and
+// checks it against the dense tensors of getPolicyInTensor after densifying
+// it as utils.densify_policy does.
+static void CheckSparsePolicy(const core::State& state,
+                              const std::vector<float>& pi,
+                              int64_t capacity) {
+ auto [dense, mask] = getPolicyInTensor(state, pi);
+ auto [index, value, maskBits] =
+     getSparsePolicyInTensor(state, pi, capacity);
+ ASSERT_EQ(index.numel(), capacity);
+ ASSERT_EQ(value.numel(), capacity);
+ const int32_t* indexData = index.data_ptr<int32_t>();
+ const float* valueData = value.data_ptr<float>();
+ std::vector<float> expected = Flat(dense);
+ std::vector<float> pis(expected.size(), 0.0f);
+ for (int64_t i = 0; i != capacity; ++i) {
+  if (indexData[i] < 0) {
+   ASSERT_EQ(valueData[i], 0.0f);
+   continue;
+  }
+  ASSERT_LT(indexData[i], (int64_t)pis.size());
+  pis[indexData[i]] += valueData[i];
+ }
+ ASSERT_EQ(UnpackBits(maskBits, expected.size()), Flat(mask));
+
+ int numNonZero = std::count_if(
+     expected.begin(), expected.end(), [](float v) { return v != 0.0f; });
+ if (numNonZero <= capacity) {
+  ASSERT_EQ(pis, expected);
+  return;
+ }
+ // Only the most probable actions are kept, with the same total.
+ std::vector<float> sorted = expected;
+ std::sort(sorted.begin(), sorted.end(), std::greater<>());
+ float threshold = sorted[capacity - 1];
+ float total = 0.0f;
+ float kept = 0.0f;
+ float scale = 0.0f;
+ for (size_t i = 0; i != expected.size(); ++i) {
+  total += expected[i];
+  kept += pis[i];
+  if (pis[i] != 0.0f) {
+   ASSERT_GE(expected[i], threshold);
+   if (scale == 0.0f) {
+    scale = pis[i] / expected[i];
+   }
+   ASSERT_NEAR(pis[i], expected[i] * scale, 1e-6f);
+  }
+ }
+ ASSERT_EQ(std::count_if(pis.begin(), pis.end(),
+                         [](float v) { return v != 0.0f; }),
+           capacity);
+ ASSERT_NEAR(kept, total, 1e-5f);
+}
+
+// Plays random moves from the initial position of state, and calls
+// check(state, rng) on each position.
+template <typename Check>
+static void ForEachPosition(core::State& state, int seed, Check&& check) {
+ std::minstd_rand rng(seed);
+ while (!state.terminated()) {
+  check(state, rng);
+  int n = state.GetLegalActions().size();
+  state.forward(std::uniform_int_distribution<int>(0, n - 1)(rng));
+ }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tests
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(TrainingDataGroup, sparse_policy_round_trip) {
+ // 7 and 49 actions, so that the mask ends with a partial byte.
+ StateForConnectFour connectFour(0);
+ connectFour.Initialize();
+ Hex::State<7, true> hex(0);
+ hex.Initialize();
+ for (core::State* state : {(core::State*)&connectFour, (core::State*)&hex}) {
+  ForEachPosition(*state, 1, [](core::State& s, std::minstd_rand& rng) {
+   std::vector<float> pi = RandomPolicy(s, rng);
+   CheckSparsePolicy(s, pi, pi.size());
+   CheckSparsePolicy(s, pi, pi.size() + 5);
+   CheckSparsePolicy(s, pi, 3);
+  });
+ }
+}
+
+TEST(TrainingDataGroup, packed_features_round_trip) {
+ // 126 and 98 features, so that the bits end with a partial byte.
+ StateForConnectFour connectFour(0);
+ connectFour.Initialize();
+ Hex::State<7, true> hex(0);
+ hex.Initialize();
+ for (core::State* state : {(core::State*)&connectFour, (core::State*)&hex}) {
+  ASSERT_TRUE(state->hasBinaryFeatures());
+  ForEachPosition(*state, 2, [](core::State& s, std::minstd_rand&) {
+   torch::Tensor bits = getPackedFeatureInTensor(s);
+   ASSERT_EQ(bits.numel(), getPackedFeatureBytes(s));
+   ASSERT_EQ(UnpackBits(bits, s.GetFeatureLength()),
+             Flat(getFeatureInTensor(s)));
+  });
+ }
+}